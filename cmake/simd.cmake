@@ -34,6 +34,33 @@ if (CMAKE_COMPILER_IS_GNUCC OR CMAKE_COMPILER_IS_CLANG )
     CC_HAS_AVX_INTRINSICS)
 endif()
 
+#
+# Check compiler for per-function SSE 4.2 and PCLMUL support, used
+# by the 3-way interleaved CRC32 implementation. The CPU support
+# is checked at runtime, so no global compiler flags are needed.
+#
+if ((CMAKE_SYSTEM_PROCESSOR MATCHES "x86_64") AND
+    (CMAKE_COMPILER_IS_GNUCC OR CMAKE_COMPILER_IS_CLANG))
+    set(CMAKE_REQUIRED_FLAGS "")
+    check_c_source_compiles("
+    #include <nmmintrin.h>
+    #include <wmmintrin.h>
+
+    __attribute__((target(\"sse4.2,pclmul\")))
+    static unsigned long long f(unsigned long long a, unsigned long long b)
+    {
+    __m128i x = _mm_clmulepi64_si128(_mm_cvtsi64_si128(a),
+                                     _mm_cvtsi64_si128(b), 0);
+    return _mm_crc32_u64(0, _mm_cvtsi128_si64(x));
+    }
+
+    int main()
+    {
+    return (int) f(1, 2);
+    }"
+    HAVE_CRC32C_PCLMUL)
+endif()
+
 if ((CMAKE_SYSTEM_PROCESSOR MATCHES "x86_64") AND CC_HAS_SSE2_INTRINSICS)
     # any amd64 supports sse2 instructions
     set(ENABLE_SSE2_DEFAULT ON)
@@ -1015,6 +1015,9 @@ key_def_change_require_index_rebuid(struct key_def *old_key_def,
 		    || old_key_def->opts.distance != new_key_def->opts.distance)
 			return true;
 	}
+	if (old_key_def->type == HASH &&
+	    old_key_def->opts.swiss != new_key_def->opts.swiss)
+		return true;
 	return false;
 }
 
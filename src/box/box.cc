@@ -37,6 +37,7 @@
 #include "recovery.h"
 #include "wal.h"
 #include "relay.h"
+#include "gc.h"
 #include "applier.h"
 #include <rmean.h>
 #include "main.h"
@@ -118,6 +119,19 @@ box_check_slab_alloc_minimal(ssize_t slab_alloc_minimal)
 		  "specified value is out of bounds");
 }
 
+static void
+box_check_slab_alloc_huge_page_size(int64_t huge_page_size)
+{
+	if (huge_page_size == 0)
+		return;
+	if (huge_page_size < 2 * 1024 * 1024 ||
+	    huge_page_size > 1024 * 1024 * 1024 ||
+	    (huge_page_size & (huge_page_size - 1)) != 0) {
+		tnt_raise(ClientError, ER_CFG, "slab_alloc_huge_page_size",
+			  "must be 0 or a power of two from 2MB to 1GB");
+	}
+}
+
 static void
 process_rw(struct request *request, struct space *space, struct tuple **result)
 {
@@ -245,7 +259,9 @@ wal_stream_create(struct wal_stream *ctx, size_t rows_per_wal)
 static void
 apply_initial_join_row(struct xstream *stream, struct xrow_header *row)
 {
-	if (row->type != IPROTO_INSERT) {
+	/* An incremental snapshot has REPLACE and DELETE rows. */
+	if (row->type != IPROTO_INSERT && row->type != IPROTO_REPLACE &&
+	    row->type != IPROTO_DELETE) {
 		tnt_raise(ClientError, ER_UNKNOWN_REQUEST_TYPE,
 				(uint32_t) row->type);
 	}
@@ -343,6 +359,41 @@ box_check_rows_per_wal(int64_t rows_per_wal)
 	return rows_per_wal;
 }
 
+static int64_t
+box_check_wal_async_max_lag(int64_t max_lag)
+{
+	if (max_lag < 0) {
+		tnt_raise(ClientError, ER_CFG, "wal_async_max_lag",
+			  "the value must not be negative");
+	}
+	return max_lag;
+}
+
+static uint32_t
+box_check_snap_threads(int snap_threads)
+{
+	static_assert(MEMTX_SNAP_THREADS_MAX == 64,
+		      "update the error message below");
+	if (snap_threads < 1 || snap_threads > MEMTX_SNAP_THREADS_MAX) {
+		tnt_raise(ClientError, ER_CFG, "snap_threads",
+			  "the value must be between 1 and 64");
+	}
+	return snap_threads;
+}
+
+static uint32_t
+box_check_snap_delta_count(int snap_delta_count)
+{
+	static_assert(MEMTX_SNAP_DELTA_COUNT_MAX == 100,
+		      "update the error message below");
+	if (snap_delta_count < 0 ||
+	    snap_delta_count > MEMTX_SNAP_DELTA_COUNT_MAX) {
+		tnt_raise(ClientError, ER_CFG, "snap_delta_count",
+			  "the value must be between 0 and 100");
+	}
+	return snap_delta_count;
+}
+
 void
 box_check_config()
 {
@@ -352,7 +403,12 @@ box_check_config()
 	box_check_readahead(cfg_geti("readahead"));
 	box_check_rows_per_wal(cfg_geti64("rows_per_wal"));
 	box_check_wal_mode(cfg_gets("wal_mode"));
+	box_check_wal_async_max_lag(cfg_geti64("wal_async_max_lag"));
+	box_check_snap_threads(cfg_geti("snap_threads"));
+	box_check_snap_delta_count(cfg_geti("snap_delta_count"));
 	box_check_slab_alloc_minimal(cfg_geti64("slab_alloc_minimal"));
+	box_check_slab_alloc_huge_page_size(
+		cfg_geti64("slab_alloc_huge_page_size"));
 }
 
 /*
@@ -463,12 +519,45 @@ box_set_snap_io_rate_limit(void)
 		memtx->setSnapIoRateLimit(cfg_getd("snap_io_rate_limit"));
 }
 
+void
+box_set_snap_threads(void)
+{
+	MemtxEngine *memtx = (MemtxEngine *) engine_find("memtx");
+	if (memtx)
+		memtx->setSnapThreads(
+			box_check_snap_threads(cfg_geti("snap_threads")));
+}
+
+void
+box_set_snap_delta_count(void)
+{
+	MemtxEngine *memtx = (MemtxEngine *) engine_find("memtx");
+	if (memtx)
+		memtx->setSnapDeltaCount(box_check_snap_delta_count(
+			cfg_geti("snap_delta_count")));
+}
+
+void
+box_set_snap_sections(void)
+{
+	MemtxEngine *memtx = (MemtxEngine *) engine_find("memtx");
+	if (memtx)
+		memtx->setSnapSections(cfg_geti("snap_sections"));
+}
+
 void
 box_set_too_long_threshold(void)
 {
 	too_long_threshold = cfg_getd("too_long_threshold");
 }
 
+void
+box_set_wal_async_max_lag(void)
+{
+	wal_async_max_lag =
+		box_check_wal_async_max_lag(cfg_geti64("wal_async_max_lag"));
+}
+
 void
 box_set_readahead(void)
 {
@@ -628,6 +717,48 @@ box_select(struct port *port, uint32_t space_id, uint32_t index_id,
 	}
 }
 
+int
+box_get_many(struct port *port, uint32_t space_id, uint32_t index_id,
+	     const char *keys, const char *keys_end)
+{
+	mp_tuple_assert(keys, keys_end);
+	rmean_collect(rmean_box, IPROTO_SELECT, 1);
+
+	try {
+		struct space *space = space_cache_find(space_id);
+		access_check_space(space, PRIV_R);
+		Index *index = index_find_unique(space, index_id);
+		uint32_t key_count = mp_decode_array(&keys);
+		const char **key_parts = (const char **)
+			region_alloc_xc(&fiber()->gc,
+					sizeof(*key_parts) * key_count);
+		struct tuple **result = (struct tuple **)
+			region_alloc_xc(&fiber()->gc,
+					sizeof(*result) * key_count);
+		for (uint32_t i = 0; i < key_count; i++) {
+			uint32_t part_count = 1;
+			if (mp_typeof(*keys) == MP_ARRAY)
+				part_count = mp_decode_array(&keys);
+			if (primary_key_validate(index->key_def, keys,
+						 part_count) != 0)
+				diag_raise();
+			key_parts[i] = keys;
+			for (uint32_t part = 0; part < part_count; part++)
+				mp_next(&keys);
+		}
+		struct txn *txn = txn_begin_ro_stmt(space);
+		index->findByKeys(key_parts, key_count, result);
+		for (uint32_t i = 0; i < key_count; i++)
+			port_add_tuple(port, result[i]);
+		txn_commit_ro_stmt(txn);
+		return 0;
+	} catch (Exception *e) {
+		txn_rollback_stmt();
+		/* will be hanled by box.error() in Lua */
+		return -1;
+	}
+}
+
 int
 box_insert(uint32_t space_id, const char *tuple, const char *tuple_end,
 	   box_tuple_t **result)
@@ -1026,7 +1157,8 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 	 * => JOIN { SERVER_UUID: replica_uuid }
 	 * <= OK { VCLOCK: start_vclock }
 	 *    Replica has enough permissions and master is ready for JOIN.
-	 *     - start_vclock - vclock of the latest master's checkpoint.
+	 *     - start_vclock - vclock of the read view of master's data
+	 *       sent at the initial stage.
 	 *
 	 * <= INSERT
 	 *    ...
@@ -1083,9 +1215,25 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 			  "wal_mode = 'none'");
 	}
 
-	/* Remember start vclock. */
+	/*
+	 * Freeze a read view of the data and remember its
+	 * vclock: all changes visible in the read view are
+	 * written to WAL before WAL reports the vclock, and
+	 * the replica needs only the WAL written after it.
+	 */
+	engine_begin_join();
+	auto join_guard = make_scoped_guard([]{ engine_end_join(); });
 	struct vclock start_vclock;
-	recovery_last_checkpoint(&start_vclock);
+	wal_checkpoint(wal, &start_vclock, false);
+	/*
+	 * The read view doesn't block checkpoints: keep the WAL
+	 * written after it until the final stage is sent.
+	 */
+	struct gc_consumer *gc = gc_consumer_register("join",
+					vclock_sum(&start_vclock));
+	if (gc == NULL)
+		diag_raise();
+	auto gc_guard = make_scoped_guard([=]{ gc_consumer_unregister(gc); });
 
 	/* Respond to JOIN request with start_vclock. */
 	struct xrow_header row;
@@ -1098,6 +1246,8 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 	 */
 	relay_initial_join(io->fd, header->sync);
 	say_info("initial data sent.");
+	join_guard.is_active = false;
+	engine_end_join();
 
 	/**
 	 * Call the server-side hook which stores the replica uuid
@@ -1246,6 +1396,7 @@ box_free(void)
 		port_free();
 #endif
 		engine_shutdown();
+		gc_free();
 	}
 }
 
@@ -1262,6 +1413,9 @@ engine_init()
 					     cfg_geti("panic_on_snap_error"),
 					     cfg_geti("panic_on_wal_error"));
 	engine_register(memtx);
+	box_set_snap_threads();
+	box_set_snap_delta_count();
+	box_set_snap_sections();
 
 	SysviewEngine *sysview = new SysviewEngine();
 	engine_register(sysview);
@@ -1387,12 +1541,14 @@ box_init(void)
 	tuple_init(cfg_getd("slab_alloc_arena"),
 		   cfg_geti("slab_alloc_minimal"),
 		   cfg_geti("slab_alloc_maximal"),
-		   cfg_getd("slab_alloc_factor"));
+		   cfg_getd("slab_alloc_factor"),
+		   cfg_geti64("slab_alloc_huge_page_size"));
 
 	rmean_box = rmean_new(iproto_type_strs, IPROTO_TYPE_STAT_MAX);
 	rmean_error = rmean_new(rmean_error_strings, RMEAN_ERROR_LAST);
 
 	engine_init();
+	gc_init(cfg_gets("snap_dir"), cfg_gets("wal_dir"));
 
 	schema_init();
 	user_cache_init();
@@ -1530,6 +1686,11 @@ box_snapshot()
 		return -1;
 	}
 	box_snapshot_is_in_progress = true;
+	/*
+	 * Rows of the asynchronous writes failed so far are
+	 * committed in memory and will make it to the snapshot.
+	 */
+	int64_t async_errors = wal_async_errors(wal);
 	/* create snapshot file */
 	latch_lock(&schema_lock);
 	if ((rc = engine_begin_checkpoint()))
@@ -1542,6 +1703,10 @@ box_snapshot()
 		wal_checkpoint(wal, &vclock, true);
 	}
 	rc = engine_commit_checkpoint(&vclock);
+	if (rc == 0) {
+		wal_async_checkpoint_errors(wal, async_errors);
+		gc_run();
+	}
 end:
 	if (rc)
 		engine_abort_checkpoint();
@@ -112,7 +112,11 @@ void box_set_replication_source(void);
 void box_set_log_level(void);
 void box_set_io_collect_interval(void);
 void box_set_snap_io_rate_limit(void);
+void box_set_snap_threads(void);
+void box_set_snap_delta_count(void);
+void box_set_snap_sections(void);
 void box_set_too_long_threshold(void);
+void box_set_wal_async_max_lag(void);
 void box_set_readahead(void);
 void box_set_panic_on_wal_error(void);
 
@@ -132,6 +136,17 @@ box_select(struct port *port, uint32_t space_id, uint32_t index_id,
 	   int iterator, uint32_t offset, uint32_t limit,
 	   const char *key, const char *key_end);
 
+/**
+ * Look up a batch of keys in a unique index. @a keys is a
+ * MsgPack array of keys, each either an array of parts or a
+ * single scalar part. A tuple or a hole (NULL) is added to the
+ * port for each key, in the order of keys.
+ * Private, used by FFI and by iproto GET_MANY.
+ */
+API_EXPORT int
+box_get_many(struct port *port, uint32_t space_id, uint32_t index_id,
+	     const char *keys, const char *keys_end);
+
 /** \cond public */
 
 /*
@@ -129,12 +129,22 @@ Engine::abortCheckpoint()
 {
 }
 
+void
+Engine::beginJoin()
+{
+}
+
 void
 Engine::join(struct xstream *stream)
 {
 	(void) stream;
 }
 
+void
+Engine::endJoin()
+{
+}
+
 void
 Engine::keydefCheck(struct space *space, struct key_def *key_def)
 {
@@ -338,6 +348,15 @@ engine_abort_checkpoint()
 		engine->abortCheckpoint();
 }
 
+void
+engine_begin_join()
+{
+	Engine *engine;
+	engine_foreach(engine) {
+		engine->beginJoin();
+	}
+}
+
 void
 engine_join(struct xstream *stream)
 {
@@ -346,3 +365,12 @@ engine_join(struct xstream *stream)
 		engine->join(stream);
 	}
 }
+
+void
+engine_end_join()
+{
+	Engine *engine;
+	engine_foreach(engine) {
+		engine->endJoin();
+	}
+}
@@ -86,7 +86,14 @@ public:
 				       struct space *new_space,
 				       Index *new_index);
 
+	/**
+	 * Freeze a read view of the data to be sent by join().
+	 * Called before the vclock of the initial join is taken.
+	 */
+	virtual void beginJoin();
 	virtual void join(struct xstream *);
+	/** Release the read view made by beginJoin(). */
+	virtual void endJoin();
 	/**
 	 * Begin a new single or multi-statement transaction.
 	 * Called on first statement in a transaction, not when
@@ -289,6 +296,12 @@ engine_commit_checkpoint(struct vclock *vclock);
 void
 engine_abort_checkpoint();
 
+/**
+ * Make engines freeze the data to be sent by engine_join().
+ */
+void
+engine_begin_join();
+
 /**
  * Feed snapshot data as join events to the replicas.
  * (called on the master).
@@ -296,4 +309,10 @@ engine_abort_checkpoint();
 void
 engine_join(struct xstream *stream);
 
+/**
+ * Release the data frozen by engine_begin_join().
+ */
+void
+engine_end_join();
+
 #endif /* TARANTOOL_BOX_ENGINE_H_INCLUDED */
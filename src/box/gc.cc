@@ -0,0 +1,431 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "gc.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pmatomic.h>
+
+#include "trivia/util.h"
+#include "say.h"
+#include "diag.h"
+#include "fiber.h"
+#include "ipc.h"
+#include "coeio_file.h"
+#include "vclock.h"
+#include "cluster.h"
+#include "error.h"
+
+const char *gc_reason_strs[] = {
+	"none",
+	"checkpoint",
+	"base",
+	"recovery",
+	"consumer",
+	"disabled",
+};
+
+static struct gc_state {
+	/** Snapshot directory, scanned on each collection. */
+	struct xdir snap_dir;
+	/** Write ahead log directory. */
+	struct xdir wal_dir;
+	/** The number of snapshots to keep, 0 - keep all files. */
+	int checkpoint_count;
+	/** List of all registered consumers. */
+	struct rlist consumers;
+	/** Background fiber removing files. */
+	struct fiber *fiber;
+	/** Signalled by gc_run(). */
+	struct ipc_cond cond;
+	/** Set if a collection was requested. */
+	bool is_pending;
+} gc;
+
+static int
+gc_fiber_f(va_list ap);
+
+void
+gc_init(const char *snap_dir, const char *wal_dir)
+{
+	xdir_create(&gc.snap_dir, snap_dir, SNAP, &SERVER_UUID);
+	xdir_create(&gc.wal_dir, wal_dir, XLOG, &SERVER_UUID);
+	/*
+	 * Never guess: if any file can't be read, it's better
+	 * to skip a collection than to remove a wrong file.
+	 */
+	gc.snap_dir.panic_if_error = true;
+	gc.wal_dir.panic_if_error = true;
+	gc.checkpoint_count = 0;
+	rlist_create(&gc.consumers);
+	ipc_cond_create(&gc.cond);
+	gc.is_pending = false;
+	gc.fiber = fiber_new("gc", gc_fiber_f);
+	if (gc.fiber == NULL)
+		panic("failed to start the garbage collector fiber");
+	fiber_start(gc.fiber);
+}
+
+void
+gc_free(void)
+{
+	/* The fiber is not running any more on shutdown. */
+	struct gc_consumer *consumer, *tmp;
+	rlist_foreach_entry_safe(consumer, &gc.consumers, in_consumers, tmp)
+		free(consumer);
+	ipc_cond_destroy(&gc.cond);
+	xdir_destroy(&gc.snap_dir);
+	xdir_destroy(&gc.wal_dir);
+}
+
+void
+gc_set_checkpoint_count(int count)
+{
+	assert(count >= 0);
+	gc.checkpoint_count = count;
+}
+
+int
+gc_checkpoint_count(void)
+{
+	return gc.checkpoint_count;
+}
+
+void
+gc_run(void)
+{
+	if (gc.checkpoint_count == 0)
+		return;
+	gc.is_pending = true;
+	ipc_cond_signal(&gc.cond);
+}
+
+/* {{{ Consumers */
+
+struct gc_consumer *
+gc_consumer_register(const char *name, int64_t signature)
+{
+	struct gc_consumer *consumer =
+		(struct gc_consumer *) malloc(sizeof(*consumer));
+	if (consumer == NULL) {
+		diag_set(OutOfMemory, sizeof(*consumer), "malloc",
+			 "struct gc_consumer");
+		return NULL;
+	}
+	snprintf(consumer->name, sizeof(consumer->name), "%s", name);
+	consumer->signature = signature;
+	rlist_add_tail_entry(&gc.consumers, consumer, in_consumers);
+	return consumer;
+}
+
+void
+gc_consumer_unregister(struct gc_consumer *consumer)
+{
+	rlist_del_entry(consumer, in_consumers);
+	free(consumer);
+	/* The files pinned by the consumer may be removed now. */
+	gc_run();
+}
+
+void
+gc_consumer_advance(struct gc_consumer *consumer, int64_t signature)
+{
+	pm_atomic_store_explicit(&consumer->signature, signature,
+				 pm_memory_order_relaxed);
+}
+
+int64_t
+gc_consumer_signature(struct gc_consumer *consumer)
+{
+	return pm_atomic_load_explicit(&consumer->signature,
+				       pm_memory_order_relaxed);
+}
+
+struct gc_consumer *
+gc_consumer_first(void)
+{
+	if (rlist_empty(&gc.consumers))
+		return NULL;
+	return rlist_first_entry(&gc.consumers, struct gc_consumer,
+				 in_consumers);
+}
+
+struct gc_consumer *
+gc_consumer_next(struct gc_consumer *consumer)
+{
+	if (rlist_next(&consumer->in_consumers) == &gc.consumers)
+		return NULL;
+	return rlist_next_entry(consumer, in_consumers);
+}
+
+/* }}} */
+
+/* {{{ Plan */
+
+static uint32_t
+gc_count_files(struct xdir *dir)
+{
+	uint32_t count = 0;
+	for (struct vclock *vclock = vclockset_first(&dir->index);
+	     vclock != NULL; vclock = vclockset_next(&dir->index, vclock))
+		count++;
+	return count;
+}
+
+static struct gc_file *
+gc_find_file(struct gc_file *files, uint32_t n_files, int64_t signature)
+{
+	uint32_t begin = 0, end = n_files;
+	while (begin < end) {
+		uint32_t mid = begin + (end - begin) / 2;
+		if (files[mid].signature < signature)
+			begin = mid + 1;
+		else
+			end = mid;
+	}
+	if (begin < n_files && files[begin].signature == signature)
+		return &files[begin];
+	return NULL;
+}
+
+/**
+ * Decide which snapshots to keep: the last checkpoint_count
+ * ones and all snapshots incremental ones among them are
+ * based on. Iterate newest first, so that a base is always
+ * marked before it is visited.
+ */
+static int
+gc_plan_snapshots(struct gc_file *snaps, uint32_t n_snaps)
+{
+	uint32_t n_checkpoints = 0;
+	for (uint32_t i = n_snaps; i-- > 0; ) {
+		struct gc_file *file = &snaps[i];
+		if (gc.checkpoint_count == 0 ||
+		    n_checkpoints < (uint32_t) gc.checkpoint_count) {
+			file->reason = GC_REASON_CHECKPOINT;
+			n_checkpoints++;
+		}
+		/* Read the header for the number of parts and the base. */
+		struct xlog_cursor cursor;
+		if (xdir_open_cursor(&gc.snap_dir, file->signature,
+				     &cursor) != 0)
+			return -1;
+		file->parts = cursor.meta.parts;
+		bool is_incremental = cursor.meta.is_incremental;
+		int64_t base = cursor.meta.base;
+		xlog_cursor_close(&cursor, false);
+
+		if (file->reason == GC_REASON_NONE || !is_incremental)
+			continue;
+		struct gc_file *base_file = gc_find_file(snaps, i, base);
+		if (base_file == NULL) {
+			say_warn("base snapshot %lld of %s is missing",
+				 (long long) base, gc_file_path(file, 0));
+			continue;
+		}
+		if (base_file->reason == GC_REASON_NONE)
+			base_file->reason = GC_REASON_BASE;
+	}
+	return 0;
+}
+
+/**
+ * Decide which xlogs to keep. An xlog is named after the
+ * signature of its first row minus one, so an xlog is only
+ * needed by someone who needs rows older than the signature
+ * of the next xlog. The last xlog is always kept.
+ */
+static void
+gc_plan_xlogs(struct gc_file *xlogs, uint32_t n_xlogs,
+	      int64_t checkpoint_signature)
+{
+	struct gc_consumer *oldest = NULL;
+	int64_t consumer_signature = INT64_MAX;
+	struct gc_consumer *consumer;
+	rlist_foreach_entry(consumer, &gc.consumers, in_consumers) {
+		int64_t signature = gc_consumer_signature(consumer);
+		if (signature < consumer_signature) {
+			consumer_signature = signature;
+			oldest = consumer;
+		}
+	}
+	for (uint32_t i = 0; i < n_xlogs; i++) {
+		struct gc_file *file = &xlogs[i];
+		int64_t next = i + 1 < n_xlogs ?
+			       xlogs[i + 1].signature : INT64_MAX;
+		if (next > checkpoint_signature) {
+			file->reason = GC_REASON_RECOVERY;
+		} else if (next > consumer_signature) {
+			file->reason = GC_REASON_CONSUMER;
+			file->consumer = oldest;
+		}
+	}
+}
+
+int
+gc_plan_create(struct gc_plan *plan)
+{
+	memset(plan, 0, sizeof(*plan));
+	if (xdir_scan(&gc.snap_dir) != 0 || xdir_scan(&gc.wal_dir) != 0)
+		return -1;
+	uint32_t n_snaps = gc_count_files(&gc.snap_dir);
+	uint32_t n_xlogs = gc_count_files(&gc.wal_dir);
+	size_t size = sizeof(*plan->files) * (n_snaps + n_xlogs);
+	plan->files = (struct gc_file *) calloc(1, MAX(size, 1));
+	if (plan->files == NULL) {
+		diag_set(OutOfMemory, size, "calloc", "gc plan");
+		return -1;
+	}
+	plan->n_files = n_snaps + n_xlogs;
+
+	struct gc_file *snaps = plan->files;
+	struct gc_file *xlogs = plan->files + n_snaps;
+	struct gc_file *file = plan->files;
+	struct vclock *vclock;
+	for (vclock = vclockset_first(&gc.snap_dir.index); vclock != NULL;
+	     vclock = vclockset_next(&gc.snap_dir.index, vclock)) {
+		file->type = SNAP;
+		file->signature = vclock_sum(vclock);
+		file++;
+	}
+	for (vclock = vclockset_first(&gc.wal_dir.index); vclock != NULL;
+	     vclock = vclockset_next(&gc.wal_dir.index, vclock)) {
+		file->type = XLOG;
+		file->signature = vclock_sum(vclock);
+		file++;
+	}
+
+	if (gc_plan_snapshots(snaps, n_snaps) != 0) {
+		gc_plan_destroy(plan);
+		return -1;
+	}
+	/* Xlogs are needed to recover from the oldest kept snapshot. */
+	int64_t checkpoint_signature = -1;
+	for (uint32_t i = 0; i < n_snaps; i++) {
+		if (snaps[i].reason != GC_REASON_NONE) {
+			checkpoint_signature = snaps[i].signature;
+			break;
+		}
+	}
+	if (checkpoint_signature < 0) {
+		/* Nothing to recover from, keep all xlogs. */
+		checkpoint_signature = INT64_MAX;
+	}
+	gc_plan_xlogs(xlogs, n_xlogs, checkpoint_signature);
+
+	if (gc.checkpoint_count == 0) {
+		for (uint32_t i = 0; i < plan->n_files; i++) {
+			if (plan->files[i].reason == GC_REASON_NONE)
+				plan->files[i].reason = GC_REASON_DISABLED;
+		}
+	}
+	return 0;
+}
+
+void
+gc_plan_destroy(struct gc_plan *plan)
+{
+	free(plan->files);
+	plan->files = NULL;
+	plan->n_files = 0;
+}
+
+const char *
+gc_file_path(const struct gc_file *file, uint32_t part)
+{
+	struct xdir *dir = file->type == SNAP ? &gc.snap_dir : &gc.wal_dir;
+	if (part == 0)
+		return xdir_format_filename(dir, file->signature, NONE);
+	return xdir_format_part_filename(dir, file->signature, part, NONE);
+}
+
+/* }}} */
+
+/* {{{ Collection */
+
+static void
+gc_unlink(const struct gc_file *file, uint32_t part)
+{
+	/*
+	 * The name buffer is static and may be reused while
+	 * we wait for the coeio thread, copy it.
+	 */
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s", gc_file_path(file, part));
+	say_info("removing %s", path);
+	if (coeio_unlink(path) != 0 && errno != ENOENT)
+		say_syserror("error while removing %s", path);
+}
+
+static void
+gc_collect(void)
+{
+	struct gc_plan plan;
+	if (gc_plan_create(&plan) != 0) {
+		diag_log();
+		say_error("garbage collection failed");
+		return;
+	}
+	/*
+	 * Snapshots go first, so that a crash in the middle
+	 * never leaves a snapshot without the xlogs it needs.
+	 * The main file of a snapshot is removed before the
+	 * parts, otherwise a crash could leave a snapshot which
+	 * can't be read.
+	 */
+	for (uint32_t i = 0; i < plan.n_files; i++) {
+		struct gc_file *file = &plan.files[i];
+		if (file->reason != GC_REASON_NONE)
+			continue;
+		gc_unlink(file, 0);
+		for (uint32_t part = 1; part < file->parts; part++)
+			gc_unlink(file, part);
+	}
+	gc_plan_destroy(&plan);
+}
+
+static int
+gc_fiber_f(va_list ap)
+{
+	(void) ap;
+	while (true) {
+		while (!gc.is_pending)
+			ipc_cond_wait(&gc.cond);
+		gc.is_pending = false;
+		gc_collect();
+	}
+	return 0;
+}
+
+/* }}} */
@@ -0,0 +1,184 @@
+#ifndef TARANTOOL_BOX_GC_H_INCLUDED
+#define TARANTOOL_BOX_GC_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "small/rlist.h"
+#include "xlog.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * Garbage collector of snapshots and write ahead logs.
+ *
+ * The collector keeps the last checkpoint_count snapshots,
+ * the snapshots incremental ones among them are based on,
+ * and all xlogs needed to recover from the oldest of them.
+ * Besides, it keeps xlogs which haven't been read yet by a
+ * consumer - a relay feeding a replica. Everything else is
+ * removed by a background fiber after each checkpoint.
+ */
+
+enum { GC_NAME_MAX = 64 };
+
+/** A reader of xlogs, which pins the files it hasn't read. */
+struct gc_consumer {
+	/** Link in the list of all consumers. */
+	struct rlist in_consumers;
+	/** Human-readable name, shown in box.info.gc(). */
+	char name[GC_NAME_MAX];
+	/**
+	 * Signature of the last row read by the consumer.
+	 * Updated from the relay thread, so must be accessed
+	 * with pm_atomic_*().
+	 */
+	int64_t signature;
+};
+
+/** Why a file is kept by the garbage collector. */
+enum gc_reason {
+	/** The file is not needed and will be removed. */
+	GC_REASON_NONE,
+	/** One of the last checkpoint_count snapshots. */
+	GC_REASON_CHECKPOINT,
+	/** A kept incremental snapshot is based on it. */
+	GC_REASON_BASE,
+	/** Needed to recover from the oldest kept snapshot. */
+	GC_REASON_RECOVERY,
+	/** Has rows not read by a consumer yet. */
+	GC_REASON_CONSUMER,
+	/** Garbage collection is disabled. */
+	GC_REASON_DISABLED,
+	gc_reason_MAX
+};
+
+extern const char *gc_reason_strs[];
+
+/** A snapshot or an xlog, as seen by the garbage collector. */
+struct gc_file {
+	enum xdir_type type;
+	int64_t signature;
+	/** The number of parts of a snapshot, 0 for xlogs. */
+	uint32_t parts;
+	enum gc_reason reason;
+	/** For GC_REASON_CONSUMER, the oldest consumer. */
+	struct gc_consumer *consumer;
+};
+
+/** Snapshots and xlogs, oldest first, with their fate. */
+struct gc_plan {
+	struct gc_file *files;
+	uint32_t n_files;
+};
+
+/**
+ * Initialize the garbage collector for the given
+ * directories. Collection is disabled until
+ * gc_set_checkpoint_count() is called.
+ */
+void
+gc_init(const char *snap_dir, const char *wal_dir);
+
+/** Stop the background fiber and free the consumers. */
+void
+gc_free(void);
+
+/**
+ * Set the number of snapshots to keep, 0 disables
+ * garbage collection.
+ */
+void
+gc_set_checkpoint_count(int count);
+
+int
+gc_checkpoint_count(void);
+
+/**
+ * Wake up the background fiber to remove the files
+ * which aren't needed any more.
+ */
+void
+gc_run(void);
+
+/**
+ * Register a consumer which has read all rows up to
+ * @a signature.
+ *
+ * @retval NULL out of memory, diag is set
+ */
+struct gc_consumer *
+gc_consumer_register(const char *name, int64_t signature);
+
+/** Unregister a consumer, releasing the files it pinned. */
+void
+gc_consumer_unregister(struct gc_consumer *consumer);
+
+/**
+ * Advance a consumer. Can be called from any thread, the
+ * files are released on the next collection.
+ */
+void
+gc_consumer_advance(struct gc_consumer *consumer, int64_t signature);
+
+int64_t
+gc_consumer_signature(struct gc_consumer *consumer);
+
+struct gc_consumer *
+gc_consumer_first(void);
+
+struct gc_consumer *
+gc_consumer_next(struct gc_consumer *consumer);
+
+/**
+ * Scan the directories and decide which files to keep.
+ *
+ * @retval -1 failed to scan a directory or read a file
+ *            header, diag is set
+ */
+int
+gc_plan_create(struct gc_plan *plan);
+
+void
+gc_plan_destroy(struct gc_plan *plan);
+
+/** Return the path of a file of a plan, part 0 for xlogs. */
+const char *
+gc_file_path(const struct gc_file *file, uint32_t part);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_BOX_GC_H_INCLUDED */
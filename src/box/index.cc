@@ -78,11 +78,12 @@ key_validate(struct key_def *key_def, enum iterator_type type, const char *key,
 	if (part_count == 0) {
 		/*
 		 * Zero key parts are allowed:
-		 * - for TREE index, all iterator types,
+		 * - for TREE and ART indexes, all iterator types,
 		 * - ITER_ALL iterator type, all index types
 		 * - ITER_GT iterator in HASH index (legacy)
 		 */
-		if (key_def->type == TREE || type == ITER_ALL ||
+		if (key_def->type == TREE || key_def->type == ART ||
+		    type == ITER_ALL ||
 		    (key_def->type == HASH && type == ITER_GT))
 			return 0;
 		/* Fall through. */
@@ -132,8 +133,9 @@ key_validate(struct key_def *key_def, enum iterator_type type, const char *key,
 			return -1;
 		}
 
-		/* Partial keys are allowed only for TREE index type. */
-		if (key_def->type != TREE && part_count < key_def->part_count) {
+		/* Partial keys are allowed only for ordered indexes. */
+		if (key_def->type != TREE && key_def->type != ART &&
+		    part_count < key_def->part_count) {
 			diag_set(ClientError, ER_EXACT_MATCH,
 				 key_def->part_count, part_count);
 			return -1;
@@ -175,7 +177,7 @@ box_tuple_extract_key(const box_tuple_t *tuple, uint32_t space_id,
 /* {{{ Index -- base class for all indexes. ********************/
 
 Index::Index(struct key_def *key_def_arg)
-	:key_def(NULL), sc_version(::sc_version)
+	:key_def(NULL), sc_version(::sc_version), refs(1)
 {
 	key_def = key_def_dup(key_def_arg);
 	if (key_def == NULL)
@@ -233,6 +235,14 @@ Index::findByKey(const char *key, uint32_t part_count) const
 	return NULL;
 }
 
+void
+Index::findByKeys(const char **keys, uint32_t key_count,
+		  struct tuple **result) const
+{
+	for (uint32_t i = 0; i < key_count; i++)
+		result[i] = findByKey(keys[i], key_def->part_count);
+}
+
 struct tuple *
 Index::findByTuple(struct tuple *tuple) const
 {
@@ -386,7 +396,8 @@ box_index_min(uint32_t space_id, uint32_t index_id, const char *key,
 	try {
 		struct space *space;
 		Index *index = check_index(space_id, index_id, &space);
-		if (index->key_def->type != TREE) {
+		if (index->key_def->type != TREE &&
+		    index->key_def->type != ART) {
 			/* Show nice error messages in Lua */
 			tnt_raise(UnsupportedIndexFeature, index, "min()");
 		}
@@ -415,7 +426,8 @@ box_index_max(uint32_t space_id, uint32_t index_id, const char *key,
 	try {
 		struct space *space;
 		Index *index = check_index(space_id, index_id, &space);
-		if (index->key_def->type != TREE) {
+		if (index->key_def->type != TREE &&
+		    index->key_def->type != ART) {
 			/* Show nice error messages in Lua */
 			tnt_raise(UnsupportedIndexFeature, index, "max()");
 		}
@@ -314,6 +314,11 @@ public:
 	struct key_def *key_def;
 	/* Schema version on index construction moment */
 	uint32_t sc_version;
+	/**
+	 * The space holds one reference, read views which
+	 * outlive the space hold the others, see index_ref().
+	 */
+	uint32_t refs;
 
 protected:
 	/**
@@ -336,6 +341,15 @@ public:
 	virtual size_t count(enum iterator_type type, const char *key,
 			     uint32_t part_count) const;
 	virtual struct tuple *findByKey(const char *key, uint32_t part_count) const;
+	/**
+	 * Look up a batch of full keys of a unique index.
+	 * @a keys are pointers to the first part of each key,
+	 * result[i] is set to the tuple matching keys[i] or NULL.
+	 * The default implementation calls findByKey() for each
+	 * key, memtx indexes overlap the cache misses of lookups.
+	 */
+	virtual void findByKeys(const char **keys, uint32_t key_count,
+				struct tuple **result) const;
 	virtual struct tuple *findByTuple(struct tuple *tuple) const;
 	virtual struct tuple *replace(struct tuple *old_tuple,
 				      struct tuple *new_tuple,
@@ -432,6 +446,25 @@ index_is_primary(const Index *index)
 	return index_id(index) == 0;
 }
 
+/**
+ * Pin an index, so that it is not deleted with its space,
+ * e.g. while a read view of the index is in use.
+ */
+static inline void
+index_ref(Index *index)
+{
+	index->refs++;
+}
+
+/** Unpin an index, delete it if it isn't used any more. */
+static inline void
+index_unref(Index *index)
+{
+	assert(index->refs > 0);
+	if (--index->refs == 0)
+		delete index;
+}
+
 #endif /* defined(__plusplus) */
 
 #endif /* TARANTOOL_BOX_INDEX_H_INCLUDED */
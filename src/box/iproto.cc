@@ -302,6 +302,8 @@ tx_process1(struct cmsg *msg);
 static void
 tx_process_select(struct cmsg *msg);
 static void
+tx_process_get_many(struct cmsg *msg);
+static void
 net_send_msg(struct cmsg *msg);
 
 static void
@@ -361,6 +363,11 @@ static const struct cmsg_hop select_route[] = {
 	{ net_send_msg, NULL },
 };
 
+static const struct cmsg_hop get_many_route[] = {
+	{ tx_process_get_many, &net_pipe },
+	{ net_send_msg, NULL },
+};
+
 static const struct cmsg_hop process1_route[] = {
 	{ tx_process1, &net_pipe },
 	{ net_send_msg, NULL },
@@ -582,6 +589,16 @@ iproto_decode_msg(struct iproto_msg *msg, const char **pos, const char *reqend,
 		assert(msg->header.type < sizeof(dml_route)/sizeof(*dml_route));
 		cmsg_init(msg, dml_route[msg->header.type]);
 		break;
+	case IPROTO_GET_MANY:
+		if (msg->header.bodycnt == 0) {
+			tnt_raise(ClientError, ER_INVALID_MSGPACK,
+				  "missing request body");
+		}
+		request_decode_xc(&msg->request,
+				 (const char *) msg->header.body[0].iov_base,
+				 msg->header.body[0].iov_len);
+		cmsg_init(msg, get_many_route);
+		break;
 	case IPROTO_PING:
 		cmsg_init(msg, misc_route);
 		break;
@@ -909,6 +926,38 @@ error:
 	msg->write_end = obuf_create_svp(out);
 }
 
+static void
+tx_process_get_many(struct cmsg *m)
+{
+	struct iproto_msg *msg = (struct iproto_msg *) m;
+	struct obuf *out = &msg->iobuf->out;
+	struct obuf_svp svp;
+	struct port port;
+	int rc;
+	struct request *req = &msg->request;
+
+	tx_fiber_init(msg->connection->session, msg->header.sync);
+
+	if (tx_check_schema(msg->header.schema_id))
+		goto error;
+
+	port_create(&port);
+	rc = box_get_many((struct port *) &port, req->space_id, req->index_id,
+			  req->key, req->key_end);
+	if (rc < 0 || iproto_prepare_select(out, &svp) != 0) {
+		port_destroy(&port);
+		goto error;
+	}
+	port_dump(&port, out);
+	iproto_reply_select(out, &svp, msg->header.sync, port.size);
+	msg->write_end = obuf_create_svp(out);
+	return;
+error:
+	iproto_reply_error(out, diag_last_error(&fiber()->diag),
+			   msg->header.sync);
+	msg->write_end = obuf_create_svp(out);
+}
+
 static void
 tx_process_misc(struct cmsg *m)
 {
@@ -105,7 +105,7 @@ const char *iproto_type_strs[] =
 };
 
 #define bit(c) (1ULL<<IPROTO_##c)
-const uint64_t iproto_body_key_map[IPROTO_CALL + 1] = {
+const uint64_t iproto_body_key_map[IPROTO_GET_MANY + 1] = {
 	0,                                                     /* unused */
 	bit(SPACE_ID) | bit(LIMIT) | bit(KEY),                 /* SELECT */
 	bit(SPACE_ID) | bit(TUPLE),                            /* INSERT */
@@ -117,6 +117,7 @@ const uint64_t iproto_body_key_map[IPROTO_CALL + 1] = {
 	bit(EXPR)     | bit(TUPLE),                            /* EVAL */
 	bit(SPACE_ID) | bit(OPS) | bit(TUPLE),                 /* UPSERT */
 	bit(FUNCTION_NAME) | bit(TUPLE),                       /* CALL */
+	bit(SPACE_ID) | bit(KEY),                              /* GET_MANY */
 };
 #undef bit
 
@@ -162,5 +163,13 @@ const char *iproto_key_strs[IPROTO_KEY_MAX] = {
 	"vector clock",     /* 0x26 */
 	"expression",       /* 0x27 */
 	"operations",       /* 0x28 */
+	"",                 /* 0x29 */
+	"",                 /* 0x2a */
+	"",                 /* 0x2b */
+	"",                 /* 0x2c */
+	"",                 /* 0x2d */
+	"",                 /* 0x2e */
+	"",                 /* 0x2f */
+	"data",             /* 0x30 */
 };
 
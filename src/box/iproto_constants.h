@@ -132,11 +132,22 @@ enum iproto_type {
 	IPROTO_UPSERT = 9,
 	IPROTO_CALL = 10,
 	IPROTO_TYPE_STAT_MAX = IPROTO_CALL + 1,
+	/**
+	 * Look up a batch of keys (IPROTO_KEY is an array of
+	 * keys) in a unique index, see box_get_many(). Counted
+	 * as SELECT in statistics.
+	 */
+	IPROTO_GET_MANY = 11,
 	/* admin command codes */
 	IPROTO_PING = 64,
 	IPROTO_JOIN = 65,
 	IPROTO_SUBSCRIBE = 66,
 	IPROTO_TYPE_ADMIN_MAX = IPROTO_SUBSCRIBE + 1,
+	/* snapshot row types, never sent over the network */
+	/** A block of tuples of one space. */
+	IPROTO_SNAP_BLOCK = 80,
+	/** Offsets of the space sections in a snapshot file. */
+	IPROTO_SNAP_INDEX = 81,
 	/* command failed = (IPROTO_TYPE_ERROR | ER_XXX from errcode.h) */
 	IPROTO_TYPE_ERROR = 1 << 15
 };
@@ -163,7 +174,8 @@ iproto_type_name(uint32_t type)
 static inline bool
 iproto_type_is_select(uint32_t type)
 {
-	return type <= IPROTO_SELECT || type == IPROTO_CALL || type == IPROTO_EVAL;
+	return type <= IPROTO_SELECT || type == IPROTO_CALL ||
+		type == IPROTO_EVAL || type == IPROTO_GET_MANY;
 }
 
 /** A common request with a mandatory and simple body (key, tuple, ops)  */
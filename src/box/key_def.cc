@@ -82,7 +82,7 @@ const char *mp_type_strs[] = {
 	/* .MP_EXT    = */ "extension",
 };
 
-const char *index_type_strs[] = { "HASH", "TREE", "BITSET", "RTREE" };
+const char *index_type_strs[] = { "HASH", "TREE", "BITSET", "RTREE", "ART" };
 
 const char *rtree_index_distance_type_strs[] = { "EUCLID", "MANHATTAN" };
 
@@ -106,6 +106,7 @@ const struct key_opts key_opts_default = {
 	/* .dimension           = */ 2,
 	/* .distancebuf         = */ { '\0' },
 	/* .distance            = */ RTREE_INDEX_DISTANCE_TYPE_EUCLID,
+	/* .swiss               = */ false,
 	/* .path                = */ { 0 },
 	/* .range_size          = */ 0,
 	/* .page_size           = */ 0,
@@ -117,6 +118,7 @@ const struct opt_def key_opts_reg[] = {
 	OPT_DEF("unique", MP_BOOL, struct key_opts, is_unique),
 	OPT_DEF("dimension", MP_UINT, struct key_opts, dimension),
 	OPT_DEF("distance", MP_STR, struct key_opts, distancebuf),
+	OPT_DEF("swiss", MP_BOOL, struct key_opts, swiss),
 	OPT_DEF("path", MP_STR, struct key_opts, path),
 	OPT_DEF("range_size", MP_UINT, struct key_opts, range_size),
 	OPT_DEF("page_size", MP_UINT, struct key_opts, page_size),
@@ -454,10 +456,12 @@ key_validate_parts(struct key_def *key_def, const char *key,
 
 const struct space_opts space_opts_default = {
 	/* .temporary = */ false,
+	/* .async = */ false,
 };
 
 const struct opt_def space_opts_reg[] = {
 	OPT_DEF("temporary", MP_BOOL, struct space_opts, temporary),
+	OPT_DEF("async", MP_BOOL, struct space_opts, async),
 	{ NULL, MP_NIL, 0, 0 }
 };
 
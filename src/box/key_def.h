@@ -128,6 +128,7 @@ enum index_type {
 	TREE,     /* TREE Index */
 	BITSET,   /* BITSET Index */
 	RTREE,    /* R-Tree Index */
+	ART,      /* Adaptive Radix Tree Index */
 	index_type_MAX,
 };
 
@@ -174,6 +175,10 @@ struct key_opts {
 	 */
 	char distancebuf[16];
 	enum rtree_index_distance_type distance;
+	/**
+	 * Use a swiss table for a memtx HASH index.
+	 */
+	bool swiss;
 	/**
 	 * Vinyl index options.
 	 */
@@ -203,6 +208,8 @@ key_opts_cmp(const struct key_opts *o1, const struct key_opts *o2)
 		return o1->dimension < o2->dimension ? -1 : 1;
 	if (o1->distance != o2->distance)
 		return o1->distance < o2->distance ? -1 : 1;
+	if (o1->swiss != o2->swiss)
+		return o1->swiss < o2->swiss ? -1 : 1;
 	return 0;
 }
 
@@ -325,6 +332,13 @@ struct space_opts {
 	 * - changes are not part of a snapshot
 	 */
 	bool temporary;
+	/**
+	 * Transactions changing only asynchronous spaces
+	 * are acknowledged as soon as they are queued to
+	 * the WAL thread, without waiting for the write
+	 * to complete. See wal_async_max_lag.
+	 */
+	bool async;
 };
 
 extern const struct space_opts space_opts_default;
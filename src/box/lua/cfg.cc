@@ -37,6 +37,7 @@
 #include "lua/utils.h"
 
 #include "box/box.h"
+#include "box/gc.h"
 
 extern "C" {
 	#include <lua.h>
@@ -130,6 +131,17 @@ lbox_cfg_set_too_long_threshold(struct lua_State *L)
 	return 0;
 }
 
+static int
+lbox_cfg_set_wal_async_max_lag(struct lua_State *L)
+{
+	try {
+		box_set_wal_async_max_lag();
+	} catch (Exception *) {
+		lbox_error(L);
+	}
+	return 0;
+}
+
 static int
 lbox_cfg_set_snap_io_rate_limit(struct lua_State *L)
 {
@@ -141,6 +153,39 @@ lbox_cfg_set_snap_io_rate_limit(struct lua_State *L)
 	return 0;
 }
 
+static int
+lbox_cfg_set_snap_threads(struct lua_State *L)
+{
+	try {
+		box_set_snap_threads();
+	} catch (Exception *) {
+		lbox_error(L);
+	}
+	return 0;
+}
+
+static int
+lbox_cfg_set_snap_delta_count(struct lua_State *L)
+{
+	try {
+		box_set_snap_delta_count();
+	} catch (Exception *) {
+		lbox_error(L);
+	}
+	return 0;
+}
+
+static int
+lbox_cfg_set_snap_sections(struct lua_State *L)
+{
+	try {
+		box_set_snap_sections();
+	} catch (Exception *) {
+		lbox_error(L);
+	}
+	return 0;
+}
+
 static int
 lbox_cfg_set_read_only(struct lua_State *L)
 {
@@ -152,6 +197,20 @@ lbox_cfg_set_read_only(struct lua_State *L)
 	return 0;
 }
 
+/**
+ * Called by the snapshot daemon: the number of snapshots
+ * to keep, 0 if old files must not be removed.
+ */
+static int
+lbox_cfg_set_checkpoint_count(struct lua_State *L)
+{
+	int count = luaL_checkinteger(L, 1);
+	if (count < 0)
+		return luaL_error(L, "checkpoint count must be >= 0");
+	gc_set_checkpoint_count(count);
+	return 0;
+}
+
 void
 box_lua_cfg_init(struct lua_State *L)
 {
@@ -164,8 +223,13 @@ box_lua_cfg_init(struct lua_State *L)
 		{"cfg_set_readahead", lbox_cfg_set_readahead},
 		{"cfg_set_io_collect_interval", lbox_cfg_set_io_collect_interval},
 		{"cfg_set_too_long_threshold", lbox_cfg_set_too_long_threshold},
+		{"cfg_set_wal_async_max_lag", lbox_cfg_set_wal_async_max_lag},
 		{"cfg_set_snap_io_rate_limit", lbox_cfg_set_snap_io_rate_limit},
+		{"cfg_set_snap_threads", lbox_cfg_set_snap_threads},
+		{"cfg_set_snap_delta_count", lbox_cfg_set_snap_delta_count},
+		{"cfg_set_snap_sections", lbox_cfg_set_snap_sections},
 		{"cfg_set_read_only", lbox_cfg_set_read_only},
+		{"cfg_set_checkpoint_count", lbox_cfg_set_checkpoint_count},
 		{NULL, NULL}
 	};
 
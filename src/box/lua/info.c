@@ -44,6 +44,7 @@
 #include "box/recovery.h"
 #include "box/wal.h"
 #include "box/cluster.h"
+#include "box/gc.h"
 #include "main.h"
 #include "box/box.h"
 #include "lua/utils.h"
@@ -269,6 +270,75 @@ lbox_info_vinyl(struct lua_State *L)
 	return 1;
 }
 
+static int
+lbox_info_gc_call(struct lua_State *L)
+{
+	struct gc_plan plan;
+	if (gc_plan_create(&plan) != 0)
+		return lbox_error(L);
+
+	lua_newtable(L);
+
+	lua_pushstring(L, "checkpoint_count");
+	lua_pushinteger(L, gc_checkpoint_count());
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "consumers");
+	lua_newtable(L);
+	int count = 0;
+	for (struct gc_consumer *consumer = gc_consumer_first();
+	     consumer != NULL; consumer = gc_consumer_next(consumer)) {
+		lua_createtable(L, 0, 2);
+		lua_pushstring(L, "name");
+		lua_pushstring(L, consumer->name);
+		lua_settable(L, -3);
+		lua_pushstring(L, "signature");
+		luaL_pushint64(L, gc_consumer_signature(consumer));
+		lua_settable(L, -3);
+		lua_rawseti(L, -2, ++count);
+	}
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "files");
+	lua_newtable(L);
+	for (uint32_t i = 0; i < plan.n_files; i++) {
+		struct gc_file *file = &plan.files[i];
+		lua_createtable(L, 0, 3);
+		lua_pushstring(L, "path");
+		lua_pushstring(L, gc_file_path(file, 0));
+		lua_settable(L, -3);
+		lua_pushstring(L, "reason");
+		lua_pushstring(L, gc_reason_strs[file->reason]);
+		lua_settable(L, -3);
+		if (file->consumer != NULL) {
+			lua_pushstring(L, "consumer");
+			lua_pushstring(L, file->consumer->name);
+			lua_settable(L, -3);
+		}
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_settable(L, -3);
+
+	gc_plan_destroy(&plan);
+	return 1;
+}
+
+static int
+lbox_info_gc(struct lua_State *L)
+{
+	lua_newtable(L);
+
+	lua_newtable(L); /* metatable */
+
+	lua_pushstring(L, "__call");
+	lua_pushcfunction(L, lbox_info_gc_call);
+	lua_settable(L, -3);
+
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
 static const struct luaL_reg
 lbox_info_dynamic_meta [] =
 {
@@ -280,6 +350,7 @@ lbox_info_dynamic_meta [] =
 	{"pid", lbox_info_pid},
 	{"cluster", lbox_info_cluster},
 	{"vinyl", lbox_info_vinyl},
+	{"gc", lbox_info_gc},
 	{NULL, NULL}
 };
 
@@ -20,6 +20,7 @@ local default_cfg = {
     slab_alloc_minimal  = 16,
     slab_alloc_maximal  = 1024 * 1024,
     slab_alloc_factor   = 1.1,
+    slab_alloc_huge_page_size = 0, -- 0 = regular pages
     work_dir            = nil,
     snap_dir            = ".",
     wal_dir             = ".",
@@ -31,10 +32,14 @@ local default_cfg = {
     io_collect_interval = nil,
     readahead           = 16320,
     snap_io_rate_limit  = nil, -- no limit
+    snap_threads        = 1,
+    snap_delta_count    = 0,
+    snap_sections       = false,
     too_long_threshold  = 0.5,
     wal_mode            = "write",
     rows_per_wal        = 500000,
     wal_dir_rescan_delay= 2,
+    wal_async_max_lag   = 16 * 1024 * 1024,
     panic_on_snap_error = true,
     panic_on_wal_error  = true,
     replication_source  = nil,
@@ -71,6 +76,7 @@ local template_cfg = {
     slab_alloc_minimal  = 'number',
     slab_alloc_maximal  = 'number',
     slab_alloc_factor   = 'number',
+    slab_alloc_huge_page_size = 'number',
     work_dir            = 'string',
     snap_dir            = 'string',
     wal_dir             = 'string',
@@ -82,10 +88,14 @@ local template_cfg = {
     io_collect_interval = 'number',
     readahead           = 'number',
     snap_io_rate_limit  = 'number',
+    snap_threads        = 'number',
+    snap_delta_count    = 'number',
+    snap_sections       = 'boolean',
     too_long_threshold  = 'number',
     wal_mode            = 'string',
     rows_per_wal        = 'number',
     wal_dir_rescan_delay= 'number',
+    wal_async_max_lag   = 'number',
     panic_on_snap_error = 'boolean',
     panic_on_wal_error  = 'boolean',
     replication_source  = 'string, number, table',
@@ -121,6 +131,10 @@ local dynamic_cfg = {
     readahead               = private.cfg_set_readahead,
     too_long_threshold      = private.cfg_set_too_long_threshold,
     snap_io_rate_limit      = private.cfg_set_snap_io_rate_limit,
+    snap_threads            = private.cfg_set_snap_threads,
+    snap_delta_count        = private.cfg_set_snap_delta_count,
+    snap_sections           = private.cfg_set_snap_sections,
+    wal_async_max_lag       = private.cfg_set_wal_async_max_lag,
     panic_on_wal_error      = function() end,
     read_only               = private.cfg_set_read_only,
     -- snapshot_daemon
@@ -57,7 +57,7 @@ lbox_encode_tuple_on_gc(lua_State *L, int idx, size_t *p_len)
 
 /* }}} */
 
-/** {{{ Lua/C implementation of index:select(): used only by Vinyl **/
+/** {{{ Lua/C implementation of select() and get_many(): used only by Vinyl **/
 
 static inline void
 lbox_port_to_table(lua_State *L, struct port *port)
@@ -65,8 +65,11 @@ lbox_port_to_table(lua_State *L, struct port *port)
 	lua_createtable(L, port->size, 0);
 	struct port_entry *entry = port->first;
 	for (size_t i = 0 ; i < port->size; i++) {
-		lbox_pushtuple(L, entry->tuple);
-		lua_rawseti(L, -2, i + 1);
+		/* Keys without a match in get_many() are left as holes */
+		if (entry->tuple != NULL) {
+			lbox_pushtuple(L, entry->tuple);
+			lua_rawseti(L, -2, i + 1);
+		}
 		entry = entry->next;
 	}
 }
@@ -111,6 +114,30 @@ lbox_select(lua_State *L)
 	return 1; /* lua table with tuples */
 }
 
+static int
+lbox_get_many(lua_State *L)
+{
+	if (lua_gettop(L) != 3 || !lua_isnumber(L, 1) || !lua_isnumber(L, 2))
+		return luaL_error(L, "Usage index:get_many(keys)");
+
+	uint32_t space_id = lua_tointeger(L, 1);
+	uint32_t index_id = lua_tointeger(L, 2);
+	size_t keys_len;
+	const char *keys = lbox_encode_tuple_on_gc(L, 3, &keys_len);
+
+	struct port port;
+	port_create(&port);
+	if (box_get_many((struct port *) &port, space_id, index_id,
+			 keys, keys + keys_len) != 0) {
+		port_destroy(&port);
+		return lbox_error(L);
+	}
+	/* See the comment in lbox_select() */
+	lbox_port_to_table(L, &port);
+	port_destroy(&port);
+	return 1; /* lua table with tuples */
+}
+
 /* }}} */
 
 void
@@ -118,6 +145,7 @@ box_lua_misc_init(struct lua_State *L)
 {
 	static const struct luaL_reg boxlib_internal[] = {
 		{"select", lbox_select},
+		{"get_many", lbox_get_many},
 		{NULL, NULL}
 	};
 
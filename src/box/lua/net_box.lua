@@ -53,6 +53,7 @@ local method_codec           = {
     insert  = internal.encode_insert,
     replace = internal.encode_replace,
     delete  = internal.encode_delete,
+    get_many = internal.encode_get_many,
     update  = internal.encode_update,
     upsert  = internal.encode_upsert,
     select  = function(buf, id, schema_id, spaceno, indexno, key, opts)
@@ -659,7 +660,8 @@ function remote_methods:_request(method, ...)
             if postproc and rawget(box, 'tuple') then
                 local tnew = box.tuple.new
                 for i, v in pairs(res) do
-                    res[i] = tnew(v)
+                    -- get_many replies nil for keys without a match
+                    res[i] = v ~= nil and tnew(v) or nil
                 end
             end
             return res
@@ -878,6 +880,11 @@ space_metatable = function(remote)
         if res[1] ~= nil then return res[1] end
     end
 
+    function methods:get_many(keys)
+        space_check(self, 'get_many')
+        return remote:_request('get_many', self.id, 0, keys)
+    end
+
     return { __index = methods, __metatable = false }
 end
 
@@ -904,6 +911,11 @@ index_metatable = function(remote)
         if res[1] ~= nil then return res[1] end
     end
 
+    function methods:get_many(keys)
+        index_check(self, 'get_many')
+        return remote:_request('get_many', self.space.id, self.id, keys)
+    end
+
     function methods:min(key)
         index_check(self, 'min')
         local res = remote:_request('select', self.space.id, self.id, key,
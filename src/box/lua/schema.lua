@@ -80,6 +80,9 @@ ffi.cdef[[
     box_select(struct port *port, uint32_t space_id, uint32_t index_id,
                int iterator, uint32_t offset, uint32_t limit,
                const char *key, const char *key_end);
+    int
+    box_get_many(struct port *port, uint32_t space_id, uint32_t index_id,
+                 const char *keys, const char *keys_end);
     void password_prepare(const char *password, int len,
                           char *out, int out_len);
 ]]
@@ -240,11 +243,13 @@ box.schema.space.create = function(name, options)
         user = 'string, number',
         format = 'table',
         temporary = 'boolean',
+        async = 'boolean',
     }
     local options_defaults = {
         engine = 'memtx',
         field_count = 0,
         temporary = false,
+        async = false,
     }
     check_param_table(options, options_template)
     options = update_param_table(options, options_defaults)
@@ -281,6 +286,7 @@ box.schema.space.create = function(name, options)
     -- filter out global parameters from the options array
     local space_options = setmetatable({
         temporary = options.temporary and true or nil,
+        async = options.async and true or nil,
     }, { __serialize = 'map' })
     _space:insert{id, uid, name, options.engine, options.field_count,
         space_options, format}
@@ -383,6 +389,7 @@ box.schema.index.create = function(space_id, name, options)
         if_not_exists = 'boolean',
         dimension = 'number',
         distance = 'string',
+        swiss = 'boolean',
         path = 'string',
         page_size = 'number',
         range_size = 'number',
@@ -451,6 +458,7 @@ box.schema.index.create = function(space_id, name, options)
             dimension = options.dimension,
             unique = options.unique,
             distance = options.distance,
+            swiss = options.swiss,
             path = options.path,
             page_size = options.page_size,
             range_size = options.range_size,
@@ -514,6 +522,7 @@ box.schema.index.alter = function(space_id, index_id, options)
         unique = 'boolean',
         dimension = 'number',
         distance = 'string',
+        swiss = 'boolean',
     }
     check_param_table(options, options_template)
 
@@ -583,6 +592,9 @@ box.schema.index.alter = function(space_id, index_id, options)
     if options.distance ~= nil then
         key_opts.distance = options.distance
     end
+    if options.swiss ~= nil then
+        key_opts.swiss = options.swiss
+    end
     if options.parts ~= nil then
         check_index_parts(options.parts)
         options.parts = update_index_parts(options.parts)
@@ -833,6 +845,32 @@ function box.schema.space.bless(space)
         return internal.get(index.space_id, index.id, key)
     end
 
+    -- Each key is a table of parts or a single part. Returns
+    -- a table with the tuple for keys[i] or nil at i.
+    index_mt.get_many_ffi = function(index, keys)
+        local keys, keys_end = tuple_encode(keys)
+        builtin.port_create(port)
+        if builtin.box_get_many(port, index.space_id, index.id,
+                                keys, keys_end) ~= 0 then
+            builtin.port_destroy(port);
+            return box.error()
+        end
+
+        local ret = {}
+        local entry = port.first
+        for i=1,tonumber(port.size),1 do
+            if entry.tuple ~= nil then
+                ret[i] = tuple_bless(entry.tuple)
+            end
+            entry = entry.next
+        end
+        builtin.port_destroy(port);
+        return ret
+    end
+    index_mt.get_many_luac = function(index, keys)
+        return internal.get_many(index.space_id, index.id, keify(keys))
+    end
+
     local function check_select_opts(opts, key_is_nil)
         local offset = 0
         local limit = 4294967295
@@ -906,7 +944,8 @@ function box.schema.space.bless(space)
 
     -- true if reading operations may yield
     local read_yields = space.engine == 'vinyl'
-    local read_ops = {'select', 'get', 'min', 'max', 'count', 'random', 'pairs'}
+    local read_ops = {'select', 'get', 'get_many', 'min', 'max', 'count',
+                      'random', 'pairs'}
     for _, op in ipairs(read_ops) do
         if read_yields then
             -- use Lua/C implmenetation
@@ -938,6 +977,10 @@ function box.schema.space.bless(space)
         check_index(space, 0)
         return space.index[0]:get(key)
     end
+    space_mt.get_many = function(space, keys)
+        check_index(space, 0)
+        return space.index[0]:get_many(keys)
+    end
     space_mt.select = function(space, key, opts)
         check_index(space, 0)
         return space.index[0]:select(key, opts)
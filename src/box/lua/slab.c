@@ -43,6 +43,7 @@
 #include "memory.h"
 
 extern struct small_alloc memtx_alloc;
+extern size_t memtx_delayed_free_size;
 extern struct mempool memtx_index_extent_pool;
 
 static int
@@ -215,6 +216,14 @@ lbox_slab_info(struct lua_State *L)
 	lua_pushstring(L, ratio_buf);
 	lua_settable(L, -3);
 
+	/*
+	 * Memory freed during a snapshot, which can't be reused
+	 * until the snapshot is written.
+	 */
+	lua_pushstring(L, "delayed_free_size");
+	luaL_pushuint64(L, memtx_delayed_free_size);
+	lua_settable(L, -3);
+
 	return 1;
 }
 
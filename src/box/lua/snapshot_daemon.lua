@@ -86,68 +86,9 @@ local function process(self)
         return
     end
 
-    if not make_snapshot(snaps[#snaps]) then
-        return
-    end
-
-    -- cleanup code
-    if daemon.snapshot_count == nil then
-        return
-    end
-
-    if not (self.snapshot_count > 0) then
-        return
-    end
-
-
-    -- reload snap list after snapshot
-    snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap'))
-    local xlogs = fio.glob(fio.pathjoin(box.cfg.wal_dir, '*.xlog'))
-    if xlogs == nil then
-        log.error("can't read wal_dir %s: %s", box.cfg.wal_dir,
-                  errno.strerror())
-        return
-    end
-
-    while #snaps > self.snapshot_count do
-        local rm = snaps[1]
-        table.remove(snaps, 1)
-
-        log.info("removing old snapshot %s", rm)
-        if not fio.unlink(rm) then
-            log.error("error while removing %s: %s",
-                      rm, errno.strerror())
-            return
-        end
-    end
-
-
-    local snapno = fio.basename(snaps[1], '.snap')
-
-    while #xlogs > 0 do
-        if #xlogs < 2 then
-            break
-        end
-
-        if fio.basename(xlogs[1], '.xlog') > snapno then
-            break
-        end
-
-        if fio.basename(xlogs[2], '.xlog') > snapno then
-            break
-        end
-
-
-        local rm = xlogs[1]
-        table.remove(xlogs, 1)
-        log.info("removing old xlog %s", rm)
-
-        if not fio.unlink(rm) then
-            log.error("error while removing %s: %s",
-                      rm, errno.strerror())
-            return
-        end
-    end
+    -- old snapshots and xlogs are removed by the garbage
+    -- collector after each snapshot, see reload()
+    make_snapshot(snaps[#snaps])
 end
 
 local function daemon_fiber(self)
@@ -186,6 +127,12 @@ local function daemon_fiber(self)
 end
 
 local function reload(self)
+    -- keep all files unless the daemon is running
+    local count = 0
+    if self.snapshot_period > 0 and self.snapshot_count > 0 then
+        count = self.snapshot_count
+    end
+    box.internal.cfg_set_checkpoint_count(count)
     if self.snapshot_period > 0 then
         if self.control == nil then
             -- Start daemon
@@ -165,9 +165,14 @@ lbox_fillspace(struct lua_State *L, struct space *space, int i)
 		lua_pushnumber(L, key_def->iid);
 		lua_newtable(L);		/* space.index[k] */
 
-		if (key_def->type == HASH || key_def->type == TREE) {
+		if (key_def->type == HASH || key_def->type == TREE ||
+		    key_def->type == ART) {
 			lua_pushboolean(L, key_def->opts.is_unique);
 			lua_setfield(L, -2, "unique");
+			if (key_def->opts.swiss) {
+				lua_pushboolean(L, true);
+				lua_setfield(L, -2, "swiss");
+			}
 		} else if (key_def->type == RTREE) {
 			lua_pushnumber(L, key_def->opts.dimension);
 			lua_setfield(L, -2, "dimension");
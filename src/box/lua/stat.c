@@ -39,6 +39,7 @@
 #include <lualib.h>
 
 #include "lua/utils.h"
+#include "box/wal.h"
 
 extern struct rmean *rmean_box;
 extern struct rmean *rmean_error;
@@ -144,6 +145,24 @@ lbox_stat_wal_call(struct lua_State *L)
 	lua_newtable(L);
 	if (rmean_tx_wal_bus)
 		rmean_foreach(rmean_tx_wal_bus, set_stat_item, L);
+
+	struct wal_async_stat stat;
+	wal_async_stat(wal, &stat);
+	lua_pushstring(L, "async_pending");
+	luaL_pushint64(L, stat.pending);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "unflushed_bytes");
+	luaL_pushint64(L, stat.unflushed_bytes);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "lag");
+	lua_pushnumber(L, stat.lag);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "async_errors");
+	luaL_pushint64(L, stat.errors);
+	lua_settable(L, -3);
 	return 1;
 }
 
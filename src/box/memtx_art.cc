@@ -0,0 +1,492 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "memtx_art.h"
+
+#include "tuple.h"
+#include "space.h"
+#include "schema.h" /* space_cache_find() */
+#include "memtx_engine.h"
+#include "fiber.h"
+
+/* {{{ Keys *******************************************************/
+
+/** Make room for @a size more bytes in a key. */
+static int
+memtx_art_key_reserve(struct memtx_art_key *key, uint32_t size)
+{
+	if (key->size + size <= key->capacity)
+		return 0;
+	uint32_t capacity = MAX(key->capacity * 2, key->size + size);
+	capacity = MAX(capacity, 64);
+	unsigned char *data = (unsigned char *) realloc(key->data, capacity);
+	if (data == NULL) {
+		diag_set(OutOfMemory, capacity, "realloc", "ART key");
+		return -1;
+	}
+	key->data = data;
+	key->capacity = capacity;
+	return 0;
+}
+
+/** Append 8 bytes big-endian, the room must be reserved. */
+static inline void
+memtx_art_key_append_u64(struct memtx_art_key *key, uint64_t val)
+{
+	unsigned char *p = key->data + key->size;
+	for (int shift = 56; shift >= 0; shift -= 8)
+		*p++ = (unsigned char) (val >> shift);
+	key->size += sizeof(val);
+}
+
+/** Append a field, @sa struct memtx_art_key. */
+static int
+memtx_art_key_append_field(struct memtx_art_key *key, const char *field,
+			   enum field_type type)
+{
+	switch (type) {
+	case FIELD_TYPE_UNSIGNED:
+		if (memtx_art_key_reserve(key, sizeof(uint64_t)) != 0)
+			return -1;
+		memtx_art_key_append_u64(key, mp_decode_uint(&field));
+		return 0;
+	case FIELD_TYPE_INTEGER: {
+		if (memtx_art_key_reserve(key, 1 + sizeof(uint64_t)) != 0)
+			return -1;
+		uint64_t val;
+		bool is_negative = false;
+		if (mp_typeof(*field) == MP_UINT) {
+			val = mp_decode_uint(&field);
+		} else {
+			int64_t ival = mp_decode_int(&field);
+			is_negative = ival < 0;
+			val = (uint64_t) ival;
+		}
+		key->data[key->size++] = is_negative ? 0 : 1;
+		memtx_art_key_append_u64(key, val);
+		return 0;
+	}
+	case FIELD_TYPE_STRING: {
+		uint32_t len;
+		const unsigned char *str =
+			(const unsigned char *) mp_decode_str(&field, &len);
+		/* Every byte may be escaped, plus the terminator. */
+		if (memtx_art_key_reserve(key, 2 * len + 2) != 0)
+			return -1;
+		unsigned char *p = key->data + key->size;
+		for (uint32_t i = 0; i < len; i++) {
+			*p++ = str[i];
+			if (str[i] == 0)
+				*p++ = 0xff;
+		}
+		*p++ = 0;
+		*p++ = 0;
+		key->size = p - key->data;
+		return 0;
+	}
+	default:
+		unreachable();
+		return 0;
+	}
+}
+
+/** Encode the key of a tuple. */
+static int
+memtx_art_key_from_tuple(struct memtx_art_key *key,
+			 const struct tuple *tuple, struct key_def *key_def)
+{
+	key->size = 0;
+	for (uint32_t i = 0; i < key_def->part_count; i++) {
+		const struct key_part *part = &key_def->parts[i];
+		const char *field = tuple_field(tuple, part->fieldno);
+		if (memtx_art_key_append_field(key, field, part->type) != 0)
+			return -1;
+	}
+	if (!key_def->opts.is_unique) {
+		if (memtx_art_key_reserve(key, sizeof(uint64_t)) != 0)
+			return -1;
+		memtx_art_key_append_u64(key, (uintptr_t) tuple);
+	}
+	return 0;
+}
+
+/** Encode a search key of @a part_count first parts. */
+static int
+memtx_art_key_from_key(struct memtx_art_key *key, const char *parts,
+		       uint32_t part_count, struct key_def *key_def)
+{
+	key->size = 0;
+	for (uint32_t i = 0; i < part_count; i++) {
+		if (memtx_art_key_append_field(key, parts,
+					       key_def->parts[i].type) != 0)
+			return -1;
+		mp_next(&parts);
+	}
+	return 0;
+}
+
+static void
+memtx_art_key_destroy(struct memtx_art_key *key)
+{
+	free(key->data);
+	key->data = NULL;
+	key->size = key->capacity = 0;
+}
+
+/** Key loader of the tree, @sa art_load_key_t. */
+static const unsigned char *
+memtx_art_load_key(void *value, uint32_t *len, void *arg)
+{
+	MemtxArt *index = (MemtxArt *) arg;
+	if (memtx_art_key_from_tuple(&index->load_buf, (struct tuple *) value,
+				     index->key_def) != 0)
+		return NULL;
+	*len = index->load_buf.size;
+	return index->load_buf.data;
+}
+
+/* }}} */
+
+/* {{{ MemtxArt Iterators *****************************************/
+
+/**
+ * The tree iterator is invalidated by any change of the tree,
+ * so the index iterator remembers the key of the last tuple
+ * returned and positions itself again after it when it sees
+ * that the tree has changed. An iterator with a read view
+ * iterates the view and never needs that.
+ */
+struct art_index_iterator {
+	struct iterator base;
+	struct art *tree;
+	struct key_def *key_def;
+	struct art_iterator tree_iterator;
+	enum iterator_type type;
+	/** Search key, EQ and REQ stop at a key not starting with it. */
+	struct memtx_art_key key;
+	/** Key of the last tuple returned. */
+	struct memtx_art_key last;
+	/** Set once a tuple has been returned. */
+	bool has_last;
+	/** art.mod_count the tree iterator is positioned at. */
+	uint64_t mod_count;
+	/** Read view, set by createReadViewForIterator(). */
+	struct art_view view;
+	bool is_frozen;
+};
+
+static void
+art_index_iterator_free(struct iterator *iterator);
+
+static inline struct art_index_iterator *
+art_index_iterator(struct iterator *it)
+{
+	assert(it->free == art_index_iterator_free);
+	return (struct art_index_iterator *) it;
+}
+
+static void
+art_index_iterator_free(struct iterator *iterator)
+{
+	struct art_index_iterator *it = art_index_iterator(iterator);
+	assert(!it->is_frozen);
+	art_iterator_destroy(&it->tree_iterator);
+	memtx_art_key_destroy(&it->key);
+	memtx_art_key_destroy(&it->last);
+	free(it);
+}
+
+static struct tuple *
+art_index_iterator_dummie(struct iterator *iterator)
+{
+	(void)iterator;
+	return 0;
+}
+
+/**
+ * Position the tree iterator at the first tuple following the
+ * last one returned, or the search key at the start.
+ */
+static void
+art_index_iterator_position(struct art_index_iterator *it)
+{
+	const struct memtx_art_key *bound = &it->key;
+	bool is_inclusive = it->type != ITER_GT && it->type != ITER_LT;
+	if (it->has_last) {
+		bound = &it->last;
+		is_inclusive = false;
+	}
+	struct art_iterator *tree_it = &it->tree_iterator;
+	int rc;
+	if (!iterator_type_is_reverse(it->type)) {
+		rc = is_inclusive ?
+		     art_iterator_lower_bound(it->tree, tree_it,
+					      bound->data, bound->size) :
+		     art_iterator_upper_bound(it->tree, tree_it,
+					      bound->data, bound->size);
+	} else {
+		/* Step back from the first key after the bound. */
+		rc = is_inclusive ?
+		     art_iterator_upper_bound(it->tree, tree_it,
+					      bound->data, bound->size) :
+		     art_iterator_lower_bound(it->tree, tree_it,
+					      bound->data, bound->size);
+		if (rc == 0 && art_iterator_get(tree_it) != NULL)
+			rc = art_iterator_prev(tree_it);
+		else if (rc == 0)
+			rc = art_iterator_last(tree_it, it->tree->root);
+	}
+	if (rc != 0) {
+		tnt_raise(OutOfMemory, sizeof(struct art_iterator_frame),
+			  "MemtxArt", "iterator");
+	}
+	it->mod_count = it->tree->mod_count;
+}
+
+static struct tuple *
+art_index_iterator_next(struct iterator *iterator)
+{
+	struct art_index_iterator *it = art_index_iterator(iterator);
+	if (!it->is_frozen && it->mod_count != it->tree->mod_count)
+		art_index_iterator_position(it);
+	struct art_iterator *tree_it = &it->tree_iterator;
+	struct tuple *tuple = (struct tuple *) art_iterator_get(tree_it);
+	if (tuple == NULL)
+		return NULL;
+	bool check_equality = it->type == ITER_EQ || it->type == ITER_REQ;
+	if (!it->is_frozen || check_equality) {
+		if (memtx_art_key_from_tuple(&it->last, tuple,
+					     it->key_def) != 0)
+			diag_raise();
+		it->has_last = true;
+	}
+	if (check_equality &&
+	    (it->last.size < it->key.size ||
+	     memcmp(it->last.data, it->key.data, it->key.size) != 0)) {
+		iterator->next = art_index_iterator_dummie;
+		return NULL;
+	}
+	int rc = iterator_type_is_reverse(it->type) ?
+		 art_iterator_prev(tree_it) : art_iterator_next(tree_it);
+	if (rc != 0) {
+		tnt_raise(OutOfMemory, sizeof(struct art_iterator_frame),
+			  "MemtxArt", "iterator");
+	}
+	return tuple;
+}
+
+/* }}} */
+
+/* {{{ MemtxArt ***************************************************/
+
+MemtxArt::MemtxArt(struct key_def *key_def_arg)
+	: MemtxIndex(key_def_arg)
+{
+	memset(&load_buf, 0, sizeof(load_buf));
+	memset(&key_buf, 0, sizeof(key_buf));
+	memtx_index_arena_init();
+	art_create(&tree, memtx_art_load_key, this, MEMTX_EXTENT_SIZE,
+		   memtx_index_extent_alloc, memtx_index_extent_free, NULL);
+}
+
+MemtxArt::~MemtxArt()
+{
+	art_destroy(&tree);
+	memtx_art_key_destroy(&load_buf);
+	memtx_art_key_destroy(&key_buf);
+}
+
+size_t
+MemtxArt::size() const
+{
+	return art_size(&tree);
+}
+
+size_t
+MemtxArt::bsize() const
+{
+	return art_mem_used(&tree);
+}
+
+struct tuple *
+MemtxArt::random(uint32_t rnd) const
+{
+	return (struct tuple *) art_random(&tree, rnd);
+}
+
+struct tuple *
+MemtxArt::findByKey(const char *key, uint32_t part_count) const
+{
+	assert(key_def->opts.is_unique && part_count == key_def->part_count);
+
+	if (memtx_art_key_from_key(&key_buf, key, part_count, key_def) != 0)
+		diag_raise();
+	return (struct tuple *) art_find((struct art *) &tree, key_buf.data,
+					 key_buf.size);
+}
+
+struct tuple *
+MemtxArt::replace(struct tuple *old_tuple, struct tuple *new_tuple,
+		  enum dup_replace_mode mode)
+{
+	uint32_t errcode;
+
+	if (new_tuple) {
+		if (memtx_art_key_from_tuple(&key_buf, new_tuple, key_def) != 0)
+			diag_raise();
+		void *dup_tuple = NULL;
+
+		/* Try to optimistically replace the new_tuple. */
+		if (art_insert(&tree, key_buf.data, key_buf.size, new_tuple,
+			       &dup_tuple) != 0) {
+			tnt_raise(OutOfMemory, MEMTX_EXTENT_SIZE,
+				  "MemtxArt", "replace");
+		}
+
+		errcode = replace_check_dup(old_tuple,
+					    (struct tuple *) dup_tuple, mode);
+
+		if (errcode) {
+			/*
+			 * The insertion has just made the nodes on
+			 * the path private and big enough, so the
+			 * rollback doesn't allocate.
+			 */
+			void *unused;
+			if (dup_tuple)
+				art_insert(&tree, key_buf.data, key_buf.size,
+					   dup_tuple, &unused);
+			else
+				art_delete(&tree, key_buf.data, key_buf.size,
+					   &unused);
+			struct space *sp = space_cache_find(key_def->space_id);
+			tnt_raise(ClientError, errcode, index_name(this),
+				  space_name(sp));
+		}
+		if (dup_tuple)
+			return (struct tuple *) dup_tuple;
+	}
+	if (old_tuple) {
+		if (memtx_art_key_from_tuple(&key_buf, old_tuple, key_def) != 0)
+			diag_raise();
+		void *deleted;
+		if (art_delete(&tree, key_buf.data, key_buf.size,
+			       &deleted) != 0) {
+			tnt_raise(OutOfMemory, MEMTX_EXTENT_SIZE,
+				  "MemtxArt", "replace");
+		}
+	}
+	return old_tuple;
+}
+
+struct iterator *
+MemtxArt::allocIterator() const
+{
+	struct art_index_iterator *it = (struct art_index_iterator *)
+			calloc(1, sizeof(*it));
+	if (it == NULL) {
+		tnt_raise(OutOfMemory, sizeof(struct art_index_iterator),
+			  "MemtxArt", "iterator");
+	}
+
+	it->key_def = key_def;
+	it->tree = (struct art *) &tree;
+	it->base.free = art_index_iterator_free;
+	art_iterator_create(&it->tree_iterator);
+	return (struct iterator *) it;
+}
+
+void
+MemtxArt::initIterator(struct iterator *iterator, enum iterator_type type,
+		       const char *key, uint32_t part_count) const
+{
+	assert(part_count == 0 || key != NULL);
+	struct art_index_iterator *it = art_index_iterator(iterator);
+
+	if (part_count == 0) {
+		/*
+		 * If no key is specified, downgrade equality
+		 * iterators to a full range.
+		 */
+		if (type < 0 || type > ITER_GT) {
+			return Index::initIterator(iterator, type, key,
+						   part_count);
+		}
+		type = iterator_type_is_reverse(type) ? ITER_LE : ITER_GE;
+	}
+	switch (type) {
+	case ITER_EQ:
+	case ITER_REQ:
+	case ITER_ALL:
+	case ITER_GE:
+	case ITER_GT:
+	case ITER_LE:
+	case ITER_LT:
+		break;
+	default:
+		return Index::initIterator(iterator, type, key, part_count);
+	}
+	if (memtx_art_key_from_key(&it->key, key, part_count, key_def) != 0)
+		diag_raise();
+	it->type = type;
+	it->has_last = false;
+	it->base.next = art_index_iterator_next;
+	art_index_iterator_position(it);
+}
+
+/**
+ * Create a read view for iterator so further index modifications
+ * will not affect the iterator iteration.
+ */
+void
+MemtxArt::createReadViewForIterator(struct iterator *iterator)
+{
+	struct art_index_iterator *it = art_index_iterator(iterator);
+	assert(!it->is_frozen);
+	if (it->mod_count != tree.mod_count)
+		art_index_iterator_position(it);
+	art_view_create(&tree, &it->view);
+	it->is_frozen = true;
+}
+
+/**
+ * Destroy a read view of an iterator. Must be called for iterators,
+ * for which createReadViewForIterator was called.
+ */
+void
+MemtxArt::destroyReadViewForIterator(struct iterator *iterator)
+{
+	struct art_index_iterator *it = art_index_iterator(iterator);
+	assert(it->is_frozen);
+	art_view_destroy(&tree, &it->view);
+	it->is_frozen = false;
+}
+
+/* }}} */
@@ -0,0 +1,97 @@
+#ifndef TARANTOOL_BOX_MEMTX_ART_H_INCLUDED
+#define TARANTOOL_BOX_MEMTX_ART_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "memtx_index.h"
+
+#include <salad/art.h>
+
+/**
+ * A growing buffer for an encoded key of an ART index.
+ *
+ * The tree is keyed on a binary encoding of the key parts,
+ * which compares with memcmp() in the order of the parts:
+ *  - UNSIGNED is 8 bytes big-endian;
+ *  - INTEGER is a sign byte, 0 for negative values and 1 for
+ *    the others, and 8 bytes big-endian;
+ *  - STRING is the bytes with 0 escaped as 0 0xff and
+ *    terminated with 0 0.
+ * Every part is prefix-free, so a key of a few first parts
+ * is a prefix of the keys of all tuples it matches. A tuple
+ * of a non-unique index also gets the tuple address appended,
+ * which makes all keys distinct.
+ */
+struct memtx_art_key {
+	unsigned char *data;
+	uint32_t size;
+	uint32_t capacity;
+};
+
+class MemtxArt: public MemtxIndex {
+public:
+	MemtxArt(struct key_def *key_def);
+	virtual ~MemtxArt() override;
+
+	virtual size_t size() const override;
+	virtual struct tuple *random(uint32_t rnd) const override;
+	virtual struct tuple *findByKey(const char *key,
+					uint32_t part_count) const override;
+	virtual struct tuple *replace(struct tuple *old_tuple,
+				      struct tuple *new_tuple,
+				      enum dup_replace_mode mode) override;
+
+	virtual size_t bsize() const override;
+	virtual struct iterator *allocIterator() const override;
+	virtual void initIterator(struct iterator *iterator,
+				  enum iterator_type type,
+				  const char *key,
+				  uint32_t part_count) const override;
+
+	/**
+	 * Create a read view for iterator so further index modifications
+	 * will not affect the iterator iteration.
+	 */
+	virtual void createReadViewForIterator(struct iterator *iterator) override;
+	/**
+	 * Destroy a read view of an iterator. Must be called for iterators,
+	 * for which createReadViewForIterator was called.
+	 */
+	virtual void destroyReadViewForIterator(struct iterator *iterator) override;
+
+// protected:
+	struct art tree;
+	/** Key of a tuple loaded by the tree, @sa art_load_key_t. */
+	struct memtx_art_key load_buf;
+	/** Key of the tuple or the search key being looked up. */
+	mutable struct memtx_art_key key_buf;
+};
+
+#endif /* TARANTOOL_BOX_MEMTX_ART_H_INCLUDED */
@@ -295,7 +295,10 @@ MemtxBitset::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 			ret = old_tuple;
 
 			assert(old_tuple != new_tuple);
-			bitset_index_remove_value(&m_index, value);
+			if (bitset_index_remove_value(&m_index, value) != 0) {
+				tnt_raise(OutOfMemory, 0,
+					  "MemtxBitset", "remove");
+			}
 #ifndef OLD_GOOD_BITSET
 			unregisterTuple(old_tuple);
 #endif /* #ifndef OLD_GOOD_BITSET */
@@ -40,9 +40,14 @@
 #include "iproto_constants.h"
 #include "xrow.h"
 #include "xstream.h"
+#include "xlog_reader.h"
 #include "bootstrap.h"
 #include "cluster.h"
 #include "schema.h"
+#include "clock.h"
+#include "ipc.h"
+#include <pmatomic.h>
+#include <small/ibuf.h>
 
 /** For all memory used by all indexes.
  * If you decide to use memtx_index_arena or
@@ -169,53 +174,305 @@ static void
 memtx_end_build_primary_key(struct space *space, void *param)
 {
 	struct MemtxSpace *handler = (struct MemtxSpace *) space->handler;
-	if (handler->engine != param || space_index(space, 0) == NULL ||
-	    handler->replace == memtx_replace_all_keys)
+	if (handler->engine != param)
+		return;
+	memtx_space_end_build(space);
+}
+
+void
+memtx_space_end_build(struct space *space)
+{
+	struct MemtxSpace *handler = (struct MemtxSpace *) space->handler;
+	/*
+	 * Skip spaces with enabled keys, and spaces which have
+	 * been switched already by an incremental snapshot.
+	 */
+	if (handler->replace != memtx_replace_build_next)
 		return;
 
 	((MemtxIndex *) space->index[0])->endBuild();
 	handler->replace = memtx_replace_primary_key;
 }
 
-/**
+/* {{{ Building secondary keys */
+
+/*
  * Secondary indexes are built in bulk after all data is
- * recovered. This function enables secondary keys on a space.
+ * recovered. Most of the time goes to sorting the tuples of
+ * tree indexes, which needs no index memory and so can be
+ * done in other threads. Spaces are built one by one, so
+ * that only one space's build arrays exist at a time: the
+ * tuples of every secondary key of the space are collected
+ * in tx, the trees are split into chunks, which are sorted
+ * and then merged by a pool of threads, and finally the
+ * indexes are built from the sorted arrays in tx.
  * Data dictionary spaces are an exception, they are fully
  * built right from the start.
  */
-void
-memtx_build_secondary_keys(struct space *space, void *param)
+
+enum {
+	/** Trees are sorted in chunks of this many tuples. */
+	MEMTX_BUILD_CHUNK_SIZE = 256 * 1024,
+	/** Max number of threads sorting trees. */
+	MEMTX_BUILD_THREADS_MAX = 32,
+};
+
+/** A secondary key being built. */
+struct memtx_build_index {
+	struct space *space;
+	MemtxIndex *index;
+	uint32_t n_tuples;
+	/** Total time spent building the index, in seconds. */
+	double build_time;
+	/** Link in memtx_build::indexes. */
+	struct stailq_entry in_build;
+};
+
+/** Sort a chunk of a tree, or merge the sorted chunks. */
+struct memtx_build_task {
+	struct memtx_build_index *build_index;
+	bool is_merge;
+	/** The chunk to sort. */
+	size_t begin;
+	size_t end;
+	/** Time spent on the task, in seconds. */
+	double time;
+};
+
+struct memtx_build {
+	MemtxEngine *engine;
+	/** Secondary keys of the space being built. */
+	struct stailq indexes;
+	/** Total number of chunks of the space trees. */
+	uint32_t n_chunks;
+	/** Number of trees to sort. */
+	uint32_t n_trees;
+	/** Tasks of the current stage. */
+	struct memtx_build_task *tasks;
+	uint32_t n_tasks;
+	/** The next task to take, shared by all threads. */
+	uint32_t next_task;
+};
+
+static bool
+memtx_build_needs_secondary_keys(struct space *space, MemtxEngine *engine)
 {
 	struct MemtxSpace *handler = (struct MemtxSpace *) space->handler;
-	if (handler->engine != param || space_index(space, 0) == NULL ||
-	    handler->replace == memtx_replace_all_keys)
-		return;
+	return handler->engine == engine && space_index(space, 0) != NULL &&
+	       handler->replace != memtx_replace_all_keys;
+}
+
+/** Collect the tuples of all secondary keys of a space (tx). */
+static void
+memtx_build_fill_space(struct memtx_build *build, struct space *space)
+{
+	MemtxIndex *pk = (MemtxIndex *) space->index[0];
+	uint32_t n_tuples = pk->size();
+	if (space->index_id_max > 0 && n_tuples > 0) {
+		say_info("Building secondary indexes in space '%s'...",
+			 space_name(space));
+	}
+	for (uint32_t j = 1; j < space->index_count; j++) {
+		struct memtx_build_index *build_index =
+			region_alloc_object_xc(&fiber()->gc,
+					       struct memtx_build_index);
+		build_index->space = space;
+		build_index->index = (MemtxIndex *) space->index[j];
+		build_index->n_tuples = n_tuples;
+		double start = clock_monotonic();
+		index_build_fill(build_index->index, pk);
+		build_index->build_time = clock_monotonic() - start;
+		stailq_add_tail_entry(&build->indexes, build_index, in_build);
+		if (build_index->index->key_def->type == TREE &&
+		    n_tuples > 0) {
+			build->n_chunks += (n_tuples + MEMTX_BUILD_CHUNK_SIZE
+					    - 1) / MEMTX_BUILD_CHUNK_SIZE;
+			build->n_trees++;
+		}
+	}
+}
 
-	if (space->index_id_max > 0) {
-		MemtxIndex *pk = (MemtxIndex *) space->index[0];
-		uint32_t n_tuples = pk->size();
+static void
+memtx_build_run_tasks(struct memtx_build *build)
+{
+	while (true) {
+		uint32_t i = pm_atomic_fetch_add_explicit(&build->next_task,
+					1, pm_memory_order_relaxed);
+		if (i >= build->n_tasks)
+			break;
+		struct memtx_build_task *task = &build->tasks[i];
+		MemtxTree *tree = (MemtxTree *) task->build_index->index;
+		double start = clock_monotonic();
+		if (task->is_merge)
+			tree->mergeBuildRanges(MEMTX_BUILD_CHUNK_SIZE);
+		else
+			tree->sortBuildRange(task->begin, task->end);
+		task->time = clock_monotonic() - start;
+	}
+}
+
+static int
+memtx_build_f(va_list ap)
+{
+	struct memtx_build *build = va_arg(ap, struct memtx_build *);
+	memtx_build_run_tasks(build);
+	return 0;
+}
+
+static int
+memtx_build_start_thread(struct cord *cord, const char *name,
+			 struct memtx_build *build)
+{
+	ERROR_INJECT(ERRINJ_MEMTX_BUILD_THREAD, {
+		diag_set(ClientError, ER_INJECTION,
+			 "ERRINJ_MEMTX_BUILD_THREAD");
+		return -1;
+	});
+	return cord_costart(cord, name, memtx_build_f, build);
+}
+
+/**
+ * Run tasks in a pool of threads and wait for them to
+ * complete. If no thread can be started, the tasks are run
+ * in tx.
+ */
+static void
+memtx_build_run(struct memtx_build *build, struct memtx_build_task *tasks,
+		uint32_t n_tasks)
+{
+	build->tasks = tasks;
+	build->n_tasks = n_tasks;
+	build->next_task = 0;
+
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t n_threads = MIN(n_tasks, (uint32_t) MAX(n_cpus, 1L));
+	n_threads = MIN(n_threads, (uint32_t) MEMTX_BUILD_THREADS_MAX);
+	/* A single task is not worth a thread. */
+	struct cord *cords = NULL;
+	if (n_threads > 1)
+		cords = (struct cord *) malloc(n_threads * sizeof(*cords));
+	uint32_t n_started = 0;
+	for (; cords != NULL && n_started < n_threads; n_started++) {
+		char name[FIBER_NAME_MAX];
+		snprintf(name, sizeof(name), "build.%u", n_started);
+		if (memtx_build_start_thread(&cords[n_started], name,
+					     build) != 0) {
+			error_log(diag_last_error(diag_get()));
+			break;
+		}
+	}
+	if (n_started == 0)
+		memtx_build_run_tasks(build);
+	for (uint32_t i = 0; i < n_started; i++) {
+		if (cord_cojoin(&cords[i]) != 0)
+			error_log(diag_last_error(diag_get()));
+	}
+	free(cords);
+	for (uint32_t i = 0; i < n_tasks; i++)
+		tasks[i].build_index->build_time += tasks[i].time;
+}
 
-		if (n_tuples > 0) {
-			say_info("Building secondary indexes in space '%s'...",
-				 space_name(space));
+/** Sort all trees: chunks first, then merge the chunks. */
+static void
+memtx_build_sort(struct memtx_build *build)
+{
+	uint32_t n_tasks = build->n_chunks + build->n_trees;
+	if (n_tasks == 0)
+		return;
+	struct memtx_build_task *tasks = (struct memtx_build_task *)
+		calloc(n_tasks, sizeof(*tasks));
+	if (tasks == NULL) {
+		tnt_raise(OutOfMemory, n_tasks * sizeof(*tasks),
+			  "calloc", "struct memtx_build_task");
+	}
+	auto guard = make_scoped_guard([=]{ free(tasks); });
+
+	struct memtx_build_task *sort = tasks;
+	struct memtx_build_task *merge = tasks + build->n_chunks;
+	struct memtx_build_index *build_index;
+	stailq_foreach_entry(build_index, &build->indexes, in_build) {
+		if (build_index->index->key_def->type != TREE ||
+		    build_index->n_tuples == 0)
+			continue;
+		size_t n_tuples = build_index->n_tuples;
+		for (size_t begin = 0; begin < n_tuples;
+		     begin += MEMTX_BUILD_CHUNK_SIZE) {
+			sort->build_index = build_index;
+			sort->begin = begin;
+			sort->end = MIN(begin + MEMTX_BUILD_CHUNK_SIZE,
+					n_tuples);
+			sort++;
 		}
+		merge->build_index = build_index;
+		merge->is_merge = true;
+		merge++;
+	}
+	assert(sort == tasks + build->n_chunks);
+	assert(merge == tasks + n_tasks);
+
+	memtx_build_run(build, tasks, build->n_chunks);
+	memtx_build_run(build, tasks + build->n_chunks, build->n_trees);
+}
 
-		for (uint32_t j = 1; j < space->index_count; j++)
-			index_build((MemtxIndex *) space->index[j], pk);
+/** Build and enable the secondary keys of a space. */
+static void
+memtx_build_space(struct space *space, void *param)
+{
+	MemtxEngine *engine = (MemtxEngine *) param;
+	if (!memtx_build_needs_secondary_keys(space, engine))
+		return;
 
-		if (n_tuples > 0) {
-			say_info("Space '%s': done", space_name(space));
+	struct memtx_build build;
+	memset(&build, 0, sizeof(build));
+	build.engine = engine;
+	stailq_create(&build.indexes);
+	memtx_build_fill_space(&build, space);
+
+	memtx_build_sort(&build);
+
+	struct memtx_build_index *build_index;
+	stailq_foreach_entry(build_index, &build.indexes, in_build) {
+		double start = clock_monotonic();
+		build_index->index->endBuild();
+		build_index->build_time += clock_monotonic() - start;
+		if (build_index->n_tuples > 0) {
+			say_info("Space '%s': index '%s' built in %.3f sec",
+				 space_name(build_index->space),
+				 index_name(build_index->index),
+				 build_index->build_time);
 		}
 	}
+	struct MemtxSpace *handler = (struct MemtxSpace *) space->handler;
 	handler->replace = memtx_replace_all_keys;
 }
 
+/**
+ * Build secondary keys of all spaces and enable them.
+ */
+static void
+memtx_build_secondary_keys(MemtxEngine *engine)
+{
+	space_foreach(memtx_build_space, engine);
+}
+
+/* }}} */
+
 MemtxEngine::MemtxEngine(const char *snap_dirname, bool panic_on_snap_error,
 			 bool panic_on_wal_error)
 	:Engine("memtx"),
 	m_checkpoint(0),
+	m_join(NULL),
 	m_state(MEMTX_INITIALIZED),
 	m_snap_io_rate_limit(UINT64_MAX),
+	m_snap_threads(1),
+	m_snap_delta_count(0),
+	m_snap_sections(false),
+	m_delta_is_tracking(false),
+	m_delta_keys_size(0),
+	m_delta_base_version(0),
+	m_delta_sc_version(0),
+	m_delta_chain(0),
+	m_is_throttling(false),
 	m_panic_on_wal_error(panic_on_wal_error)
 {
 	flags = ENGINE_CAN_BE_TEMPORARY;
@@ -249,6 +506,69 @@ MemtxEngine::lastCheckpoint(struct vclock *vclock)
 	return vclock->signature;
 }
 
+/**
+ * Stop the reader of a snapshot part and raise its error,
+ * if any.
+ */
+static void
+memtx_snapshot_reader_finish(struct xlog_reader *reader)
+{
+	xlog_reader_stop(reader);
+	if (!diag_is_empty(&reader->diag)) {
+		diag_move(&reader->diag, diag_get());
+		diag_raise();
+	}
+	/**
+	 * We should never try to read snapshots with no EOF
+	 * marker - such snapshots are very likely corrupted and
+	 * should not be trusted.
+	 */
+	if (!reader->eof_read)
+		panic("snapshot `%s' has no EOF marker", reader->name);
+	say_info("done `%s'", reader->name);
+}
+
+/**
+ * Find the chain of snapshots needed to recover from the
+ * snapshot with the given signature: the last full snapshot
+ * followed by the incremental snapshots on top of it.
+ * @return the number of snapshots in the chain
+ */
+static uint32_t
+memtx_snapshot_chain(struct xdir *dir, int64_t signature, int64_t *chain)
+{
+	uint32_t n_chain = 0;
+	while (true) {
+		if (n_chain > MEMTX_SNAP_DELTA_COUNT_MAX) {
+			tnt_raise(XlogError, "%s: too many incremental "
+				  "snapshots", xdir_format_filename(dir,
+						signature, NONE));
+		}
+		chain[n_chain++] = signature;
+		const char *filename = xdir_format_filename(dir, signature,
+							    NONE);
+		struct xlog_cursor cursor;
+		xlog_cursor_open_mmap_xc(&cursor, filename);
+		bool is_incremental = cursor.meta.is_incremental;
+		int64_t base = cursor.meta.base;
+		xlog_cursor_close(&cursor, false);
+		if (!is_incremental)
+			break;
+		if (base >= signature) {
+			tnt_raise(XlogError, "%s: invalid base snapshot",
+				  filename);
+		}
+		signature = base;
+	}
+	/* Oldest first. */
+	for (uint32_t i = 0; i < n_chain / 2; i++) {
+		int64_t tmp = chain[i];
+		chain[i] = chain[n_chain - 1 - i];
+		chain[n_chain - 1 - i] = tmp;
+	}
+	return n_chain;
+}
+
 void
 MemtxEngine::recoverSnapshot()
 {
@@ -261,48 +581,157 @@ MemtxEngine::recoverSnapshot()
 	int64_t signature = m_last_checkpoint.signature;
 	const char *filename = xdir_format_filename(&m_snap_dir, signature,
 						    NONE);
+	/*
+	 * Only read the header here: it has the server UUID,
+	 * used to check the rest of the files.
+	 */
+	struct xlog_cursor cursor;
+	xlog_cursor_open_mmap_xc(&cursor, filename);
+	SERVER_UUID = cursor.meta.server_uuid;
+	xlog_cursor_close(&cursor, false);
+
+	int64_t chain[MEMTX_SNAP_DELTA_COUNT_MAX + 1];
+	uint32_t n_chain = memtx_snapshot_chain(&m_snap_dir, signature, chain);
+	for (uint32_t i = 0; i < n_chain; i++)
+		recoverSnapshotFile(chain[i]);
 
+	/*
+	 * Tuples recovered from now on are not in the snapshot:
+	 * start a new generation, and let the next snapshot be
+	 * incremental on top of this one.
+	 */
+	snapshot_version++;
+	m_delta_base_version = snapshot_version;
+	m_delta_sc_version = sc_version;
+	m_delta_chain = n_chain - 1;
+	m_delta_is_tracking = m_snap_delta_count > 0;
+}
+
+void
+MemtxEngine::recoverSnapshotFile(int64_t signature)
+{
+	const char *filename = xdir_format_filename(&m_snap_dir, signature,
+						    NONE);
 	say_info("recovering from `%s'", filename);
+	/* Read the number of parts from the header. */
 	struct xlog_cursor cursor;
-	xlog_cursor_open_xc(&cursor, filename);
-	SERVER_UUID = cursor.meta.server_uuid;
-	auto reader_guard = make_scoped_guard([&]{
-		xlog_cursor_close(&cursor, false);
+	xlog_cursor_open_mmap_xc(&cursor, filename);
+	uint32_t n_parts = MAX(cursor.meta.parts, 1U);
+	xlog_cursor_close(&cursor, false);
+	if (n_parts > MEMTX_SNAP_THREADS_MAX) {
+		tnt_raise(XlogError, "%s: invalid number of parts",
+			  filename);
+	}
+
+	/*
+	 * All parts are read and decoded by separate threads,
+	 * while tx only applies the rows: tuples and indexes
+	 * can only be allocated in tx.
+	 */
+	struct xlog_reader *readers = (struct xlog_reader *)
+		malloc(n_parts * sizeof(*readers));
+	if (readers == NULL) {
+		tnt_raise(OutOfMemory, n_parts * sizeof(*readers),
+			  "malloc", "struct xlog_reader");
+	}
+	struct xlog_reader *active[MEMTX_SNAP_THREADS_MAX];
+	uint32_t n_active = 0;
+	struct ipc_cond tx_cond;
+	ipc_cond_create(&tx_cond);
+	auto guard = make_scoped_guard([&]{
+		for (uint32_t i = 0; i < n_active; i++) {
+			xlog_reader_stop(active[i]);
+			diag_destroy(&active[i]->diag);
+		}
+		free(readers);
+		ipc_cond_destroy(&tx_cond);
 	});
+	for (uint32_t part = 0; part < n_parts; part++) {
+		char name[FIBER_NAME_MAX];
+		if (n_parts == 1)
+			snprintf(name, sizeof(name), "recovery");
+		else
+			snprintf(name, sizeof(name), "recovery.%u", part);
+		xlog_reader_start(&readers[part], name, &m_snap_dir,
+				  signature, part, &tx_cond);
+		active[n_active++] = &readers[part];
+	}
 
-	struct xrow_header row;
+	/*
+	 * Part 0 contains all system spaces, so it must be
+	 * recovered first. Other parts are read ahead meanwhile.
+	 */
 	uint64_t row_count = 0;
-	while (xlog_cursor_next_xc(&cursor, &row,
-				   m_snap_dir.panic_if_error) == 0) {
+	struct xlog_reader_batch *batch;
+	while ((batch = xlog_reader_next(&readers[0])) != NULL)
+		recoverSnapshotBatch(batch, &row_count);
+	active[0] = active[--n_active];
+	memtx_snapshot_reader_finish(&readers[0]);
+
+	/*
+	 * The rest of the parts contain disjoint sets of user
+	 * spaces, so their rows can be applied in any order.
+	 * Apply batches as soon as they arrive, to keep all
+	 * readers busy.
+	 */
+	while (n_active > 0) {
+		bool progress = false;
+		for (uint32_t i = 0; i < n_active; ) {
+			struct xlog_reader *reader = active[i];
+			batch = xlog_reader_first(reader);
+			if (batch != NULL) {
+				recoverSnapshotBatch(batch, &row_count);
+				progress = true;
+				i++;
+			} else if (reader->is_done) {
+				active[i] = active[--n_active];
+				memtx_snapshot_reader_finish(reader);
+				progress = true;
+			} else {
+				i++;
+			}
+		}
+		if (!progress)
+			ipc_cond_wait(&tx_cond);
+	}
+}
+
+void
+MemtxEngine::recoverSnapshotBatch(struct xlog_reader_batch *batch,
+				  uint64_t *row_count)
+{
+	for (int i = 0; i < batch->n_rows; i++) {
+		struct xrow_header *row = &batch->rows[i];
+		/* The section index is only used by tools. */
+		if (row->type == IPROTO_SNAP_INDEX)
+			continue;
 		try {
-			recoverSnapshotRow(&row);
+			if (row->type == IPROTO_SNAP_BLOCK) {
+				recoverSnapshotBlock(row, row_count);
+				continue;
+			}
+			recoverSnapshotRow(row);
 		} catch (ClientError *e) {
 			if (m_snap_dir.panic_if_error)
 				throw;
 			say_error("can't apply row: ");
 			e->log();
 		}
-		++row_count;
-		if (row_count % 100000 == 0)
+		++*row_count;
+		if (*row_count % 100000 == 0)
 			say_info("%.1fM rows processed",
-				 row_count / 1000000.);
+				 *row_count / 1000000.);
 	}
-
-	/**
-	 * We should never try to read snapshots with no EOF
-	 * marker - such snapshots are very likely corrupted and
-	 * should not be trusted.
-	 */
-	if (!cursor.eof_read)
-		panic("snapshot `%s' has no EOF marker", filename);
-
+	xlog_reader_release(batch->reader, batch);
 }
 
 void
 MemtxEngine::recoverSnapshotRow(struct xrow_header *row)
 {
 	assert(row->bodycnt == 1); /* always 1 for read */
-	if (row->type != IPROTO_INSERT) {
+	/* Incremental snapshots also have REPLACE and DELETE rows. */
+	if (row->type != IPROTO_INSERT && row->type != IPROTO_REPLACE &&
+	    row->type != IPROTO_DELETE) {
 		tnt_raise(ClientError, ER_UNKNOWN_REQUEST_TYPE,
 			  (uint32_t) row->type);
 	}
@@ -323,6 +752,79 @@ MemtxEngine::recoverSnapshotRow(struct xrow_header *row)
 
 }
 
+void
+MemtxEngine::recoverSnapshotBlock(struct xrow_header *row,
+				  uint64_t *row_count)
+{
+	assert(row->bodycnt == 1); /* always 1 for read */
+	const char *data = (const char *) row->body[0].iov_base;
+	const char *end = data + row->body[0].iov_len;
+	const char *tmp = data;
+	if (mp_check(&tmp, end) != 0 || tmp != end ||
+	    mp_typeof(*data) != MP_MAP)
+		tnt_raise(ClientError, ER_INVALID_MSGPACK, "snapshot block");
+
+	uint32_t space_id = UINT32_MAX;
+	uint32_t type = IPROTO_INSERT;
+	const char *tuples = NULL;
+	uint32_t size = mp_decode_map(&data);
+	for (uint32_t i = 0; i < size; i++) {
+		if (mp_typeof(*data) != MP_UINT) {
+			mp_next(&data);
+			mp_next(&data);
+			continue;
+		}
+		uint64_t key = mp_decode_uint(&data);
+		if (key == IPROTO_SPACE_ID && mp_typeof(*data) == MP_UINT) {
+			space_id = mp_decode_uint(&data);
+		} else if (key == IPROTO_REQUEST_TYPE &&
+			   mp_typeof(*data) == MP_UINT) {
+			type = mp_decode_uint(&data);
+		} else if (key == IPROTO_DATA &&
+			   mp_typeof(*data) == MP_ARRAY) {
+			tuples = data;
+			mp_next(&data);
+		} else {
+			mp_next(&data);
+		}
+	}
+	if (space_id == UINT32_MAX || tuples == NULL ||
+	    (type != IPROTO_INSERT && type != IPROTO_REPLACE))
+		tnt_raise(ClientError, ER_INVALID_MSGPACK, "snapshot block");
+
+	struct space *space = space_cache_find(space_id);
+	/* memtx snapshot must contain only memtx spaces */
+	if (space->handler->engine != this)
+		tnt_raise(ClientError, ER_CROSS_ENGINE_TRANSACTION);
+
+	/* Each tuple is applied as a row of its own type. */
+	struct xrow_header header = *row;
+	header.type = type;
+	uint32_t n_tuples = mp_decode_array(&tuples);
+	for (uint32_t i = 0; i < n_tuples; i++) {
+		struct request request;
+		request_create(&request, type);
+		request.header = &header;
+		request.space_id = space_id;
+		request.tuple = tuples;
+		mp_next(&tuples);
+		request.tuple_end = tuples;
+		try {
+			space->handler->applySnapshotRow(space, &request);
+		} catch (ClientError *e) {
+			if (m_snap_dir.panic_if_error)
+				throw;
+			say_error("can't apply row: ");
+			e->log();
+		}
+		fiber_gc();
+		++*row_count;
+		if (*row_count % 100000 == 0)
+			say_info("%.1fM rows processed",
+				 *row_count / 1000000.);
+	}
+}
+
 /** Called at start to tell memtx to recover to a given LSN. */
 void
 MemtxEngine::beginInitialRecovery(struct vclock *vclock)
@@ -368,7 +870,7 @@ MemtxEngine::beginFinalRecovery()
 		 * unique keys.
 		 */
 		m_state = MEMTX_OK;
-		space_foreach(memtx_build_secondary_keys, this);
+		memtx_build_secondary_keys(this);
 	}
 }
 
@@ -384,7 +886,7 @@ MemtxEngine::endRecovery()
 	if (m_state != MEMTX_OK) {
 		assert(m_state == MEMTX_FINAL_RECOVERY);
 		m_state = MEMTX_OK;
-		space_foreach(memtx_build_secondary_keys, this);
+		memtx_build_secondary_keys(this);
 	}
 }
 
@@ -438,6 +940,302 @@ MemtxEngine::initSystemSpace(struct space *space)
 	memtx_add_primary_key(space, MEMTX_OK);
 }
 
+/** The number of tuples an online index build puts at a time. */
+enum { MEMTX_ONLINE_BUILD_BATCH = 1000 };
+
+/**
+ * An online build of a secondary index. The build puts tuples
+ * into the new index in primary key order and yields after
+ * every batch, so the old space may change meanwhile. The
+ * changes of the tuples the build has already passed are put
+ * into the new index by an on_replace trigger, the rest are
+ * seen by the build itself: the new index always reflects the
+ * primary key up to the cursor.
+ */
+struct memtx_online_build {
+	/**
+	 * The index being built, NULL if the build has failed
+	 * or the alter is over.
+	 */
+	Index *index;
+	/** Primary key of the old space, orders the build. */
+	Index *pk;
+	/** Format of the new space, to check tuples against. */
+	struct tuple_format *format;
+	/**
+	 * The last tuple put into the index by the build,
+	 * referenced. NULL if there is none yet.
+	 */
+	struct tuple *cursor;
+	/** Set when the whole primary key has been passed. */
+	bool is_done;
+	/**
+	 * The number of transactions which have changed the old
+	 * space and are not committed or rolled back yet.
+	 */
+	int n_pending;
+	/**
+	 * Set when the alter transaction has ended. The state is
+	 * freed as soon as it is set and n_pending drops to 0.
+	 */
+	bool is_detached;
+	/** Trigger on replace in the old space. */
+	struct trigger on_replace;
+	/** Triggers on commit and rollback of the alter. */
+	struct trigger on_alter_commit;
+	struct trigger on_alter_rollback;
+};
+
+/**
+ * Return true if the build has passed the tuple, i.e. its
+ * changes must be put into the new index by the trigger.
+ */
+static inline bool
+memtx_online_build_has_passed(struct memtx_online_build *build,
+			      struct tuple *tuple)
+{
+	return build->is_done ||
+	       (build->cursor != NULL &&
+		tuple_compare(tuple, build->cursor,
+			      build->pk->key_def) <= 0);
+}
+
+/**
+ * A trigger invoked when a transaction which has changed the
+ * old space ends. The last one frees the state if the alter
+ * has ended before it.
+ */
+static void
+memtx_online_build_on_commit(struct trigger *trigger, void * /* event */)
+{
+	struct memtx_online_build *build =
+		(struct memtx_online_build *) trigger->data;
+	assert(build->n_pending > 0);
+	if (--build->n_pending == 0 && build->is_detached)
+		free(build);
+}
+
+/**
+ * Remove the changes of a rolled back transaction from the new
+ * index. Only the tuples the build has passed are there, the
+ * build will see the rest as they are after the rollback.
+ */
+static void
+memtx_online_build_on_rollback(struct trigger *trigger, void *event)
+{
+	struct txn *txn = (struct txn *) event;
+	struct memtx_online_build *build =
+		(struct memtx_online_build *) trigger->data;
+	if (build->index == NULL) {
+		/* The index is dropped or owned by the new space. */
+		memtx_online_build_on_commit(trigger, event);
+		return;
+	}
+	uint32_t space_id = build->index->key_def->space_id;
+	/* Undo the statements in reverse order. */
+	stailq_reverse(&txn->stmts);
+	struct txn_stmt *stmt;
+	stailq_foreach_entry(stmt, &txn->stmts, next) {
+		if (stmt->space->def.id != space_id)
+			continue;
+		struct tuple *tuple = stmt->new_tuple != NULL ?
+				      stmt->new_tuple : stmt->old_tuple;
+		if (tuple == NULL || !memtx_online_build_has_passed(build, tuple))
+			continue;
+		build->index->replace(stmt->new_tuple, stmt->old_tuple,
+				      DUP_INSERT);
+	}
+	stailq_reverse(&txn->stmts);
+	memtx_online_build_on_commit(trigger, event);
+}
+
+/** Return true if the build is tracking the transaction. */
+static bool
+memtx_online_build_is_tracked(struct memtx_online_build *build,
+			      struct txn *txn)
+{
+	if (!txn->has_triggers)
+		return false;
+	struct trigger *trigger;
+	rlist_foreach_entry(trigger, &txn->on_rollback, link) {
+		if (trigger->run == memtx_online_build_on_rollback &&
+		    trigger->data == build)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * A trigger invoked on replace in the old space while the new
+ * index is being built.
+ */
+static void
+memtx_online_build_on_replace(struct trigger *trigger, void *event)
+{
+	struct txn *txn = (struct txn *) event;
+	struct txn_stmt *stmt = txn_current_stmt(txn);
+	struct memtx_online_build *build =
+		(struct memtx_online_build *) trigger->data;
+	/*
+	 * Track every transaction changing the space, even if
+	 * the build hasn't reached its tuples yet: it may pass
+	 * them before the transaction is rolled back. Allocate
+	 * the triggers first, since it may fail, and install
+	 * them only if the statement succeeds.
+	 */
+	struct trigger *on_commit = NULL, *on_rollback = NULL;
+	if (!memtx_online_build_is_tracked(build, txn)) {
+		on_commit = region_calloc_object_xc(&fiber()->gc,
+						    struct trigger);
+		on_rollback = region_calloc_object_xc(&fiber()->gc,
+						      struct trigger);
+		trigger_create(on_commit, memtx_online_build_on_commit,
+			       build, NULL);
+		trigger_create(on_rollback, memtx_online_build_on_rollback,
+			       build, NULL);
+	}
+	struct tuple *tuple = stmt->new_tuple != NULL ?
+			      stmt->new_tuple : stmt->old_tuple;
+	/* Otherwise the build will put the tuple itself. */
+	if (memtx_online_build_has_passed(build, tuple)) {
+		if (stmt->new_tuple != NULL &&
+		    tuple_validate(build->format, stmt->new_tuple))
+			diag_raise();
+		build->index->replace(stmt->old_tuple, stmt->new_tuple,
+				      DUP_INSERT);
+	}
+	if (on_rollback != NULL) {
+		txn_on_commit(txn, on_commit);
+		txn_on_rollback(txn, on_rollback);
+		build->n_pending++;
+	}
+}
+
+/**
+ * A trigger invoked when the alter transaction ends. The
+ * transactions tracked by the build are older than the alter,
+ * yet a WAL error may roll them back after it, when the new
+ * index is gone: detach the state from the index and leave it
+ * to the last of them to free.
+ */
+static void
+memtx_online_build_detach(struct trigger *trigger, void * /* event */)
+{
+	struct memtx_online_build *build =
+		(struct memtx_online_build *) trigger->data;
+	build->index = NULL;
+	build->is_detached = true;
+	if (build->n_pending == 0)
+		free(build);
+}
+
+/** Put the next batch of tuples into the new index. */
+static bool
+memtx_online_build_next(struct memtx_online_build *build,
+			struct iterator *it)
+{
+	for (int i = 0; i < MEMTX_ONLINE_BUILD_BATCH; i++) {
+		struct tuple *tuple = it->next(it);
+		if (tuple == NULL)
+			return false;
+		if (tuple_validate(build->format, tuple))
+			diag_raise();
+		struct tuple *old_tuple =
+			build->index->replace(NULL, tuple, DUP_INSERT);
+		assert(old_tuple == NULL); /* Guaranteed by DUP_INSERT. */
+		(void) old_tuple;
+		tuple_ref(tuple);
+		if (build->cursor != NULL)
+			tuple_unref(build->cursor);
+		build->cursor = tuple;
+	}
+	return true;
+}
+
+/**
+ * Build the new index without blocking the old space: put
+ * tuples into the index in batches, yield between them and
+ * continue from the cursor, since the primary key may change
+ * meanwhile.
+ */
+static void
+memtx_online_build(struct space *old_space, struct space *new_space,
+		   Index *new_index)
+{
+	struct txn *txn = in_txn();
+	assert(txn != NULL);
+	Index *pk = index_find(old_space, 0);
+	/*
+	 * Transactions changing the space during the build may
+	 * end after the alter, so the state outlives both the
+	 * build and the alter transaction.
+	 */
+	struct memtx_online_build *build = (struct memtx_online_build *)
+		calloc(1, sizeof(*build));
+	if (build == NULL) {
+		tnt_raise(OutOfMemory, sizeof(*build), "calloc",
+			  "struct memtx_online_build");
+	}
+	build->index = new_index;
+	build->pk = pk;
+	build->format = new_space->format;
+	build->cursor = NULL;
+	build->is_done = false;
+	build->n_pending = 0;
+	build->is_detached = false;
+	trigger_create(&build->on_replace, memtx_online_build_on_replace,
+		       build, NULL);
+	trigger_create(&build->on_alter_commit, memtx_online_build_detach,
+		       build, NULL);
+	trigger_create(&build->on_alter_rollback, memtx_online_build_detach,
+		       build, NULL);
+	txn_on_commit(txn, &build->on_alter_commit);
+	txn_on_rollback(txn, &build->on_alter_rollback);
+	/*
+	 * Run after the other triggers, which may still fail
+	 * the statement.
+	 */
+	rlist_add_tail_entry(&old_space->on_replace, &build->on_replace,
+			     link);
+
+	bool is_ok = true;
+	try {
+		struct iterator *it = build->pk->allocIterator();
+		IteratorGuard guard(it);
+		build->pk->initIterator(it, ITER_ALL, NULL, 0);
+		while (memtx_online_build_next(build, it)) {
+			fiber_reschedule();
+			fiber_testcancel();
+			uint32_t key_size;
+			const char *key = tuple_extract_key(build->cursor,
+							    build->pk->key_def,
+							    &key_size);
+			if (key == NULL)
+				diag_raise();
+			build->pk->initIterator(it, ITER_GT, key,
+						build->pk->key_def->part_count);
+		}
+	} catch (Exception *) {
+		is_ok = false;
+	}
+	/*
+	 * The alter installs its own trigger on success, no
+	 * yields until then.
+	 */
+	build->is_done = true;
+	trigger_clear(&build->on_replace);
+	if (build->cursor != NULL)
+		tuple_unref(build->cursor);
+	if (is_ok)
+		return;
+	/*
+	 * The index is dropped with the rolled back alter, the
+	 * state is freed by the alter triggers.
+	 */
+	build->index = NULL;
+	diag_raise();
+}
+
 void
 MemtxEngine::buildSecondaryKey(struct space *old_space,
 			       struct space *new_space, Index *new_index)
@@ -454,8 +1252,20 @@ MemtxEngine::buildSecondaryKey(struct space *old_space,
 			return;
 	}
 	Index *pk = index_find(old_space, 0);
-
-	/* Now deal with any kind of add index during normal operation. */
+	/*
+	 * After recovery a secondary key is built online. That
+	 * needs a primary key ordered by key to continue from
+	 * the cursor after a yield, a TREE or an ART; an RTREE
+	 * is bulk loaded at once, see below.
+	 */
+	if (new_key_def->iid != 0 && m_state == MEMTX_OK &&
+	    (pk->key_def->type == TREE || pk->key_def->type == ART) &&
+	    new_key_def->type != RTREE) {
+		memtx_online_build(old_space, new_space, new_index);
+		return;
+	}
+
+	/* Now deal with any kind of add index during normal operation. */
 	struct iterator *it = pk->allocIterator();
 	IteratorGuard guard(it);
 	pk->initIterator(it, ITER_ALL, NULL, 0);
@@ -466,7 +1276,16 @@ MemtxEngine::buildSecondaryKey(struct space *old_space,
 	 * new index' constraints. If any tuple can not be
 	 * added to the index (insufficient number of fields,
 	 * etc., the build is aborted.
+	 *
+	 * RTREE keys can't be duplicate, so an RTREE index is
+	 * filled with checked tuples and bulk loaded at the end.
 	 */
+	MemtxIndex *build_index = NULL;
+	if (new_key_def->type == RTREE) {
+		build_index = (MemtxIndex *) new_index;
+		build_index->beginBuild();
+		build_index->reserve(pk->size());
+	}
 	/* Build the new index. */
 	struct tuple *tuple;
 	struct tuple_format *format = new_space->format;
@@ -477,6 +1296,10 @@ MemtxEngine::buildSecondaryKey(struct space *old_space,
 		 */
 		if (tuple_validate(format, tuple))
 			diag_raise();
+		if (build_index != NULL) {
+			build_index->buildNext(tuple);
+			continue;
+		}
 		/*
 		 * @todo: better message if there is a duplicate.
 		 */
@@ -485,11 +1308,19 @@ MemtxEngine::buildSecondaryKey(struct space *old_space,
 		assert(old_tuple == NULL); /* Guaranteed by DUP_INSERT. */
 		(void) old_tuple;
 	}
+	if (build_index != NULL)
+		build_index->endBuild();
 }
 
 void
 MemtxEngine::keydefCheck(struct space *space, struct key_def *key_def)
 {
+	if (key_def->opts.swiss && key_def->type != HASH) {
+		tnt_raise(ClientError, ER_MODIFY_INDEX,
+			  key_def->name,
+			  space_name(space),
+			  "swiss option is only supported by HASH index");
+	}
 	switch (key_def->type) {
 	case HASH:
 		if (! key_def->opts.is_unique) {
@@ -502,6 +1333,22 @@ MemtxEngine::keydefCheck(struct space *space, struct key_def *key_def)
 	case TREE:
 		/* TREE index has no limitations. */
 		break;
+	case ART:
+		/* Only types with an order-preserving encoding. */
+		for (uint32_t i = 0; i < key_def->part_count; i++) {
+			enum field_type type = key_def->parts[i].type;
+			if (type != FIELD_TYPE_UNSIGNED &&
+			    type != FIELD_TYPE_INTEGER &&
+			    type != FIELD_TYPE_STRING) {
+				tnt_raise(ClientError, ER_MODIFY_INDEX,
+					  key_def->name,
+					  space_name(space),
+					  "ART index field type must be "
+					  "UNSIGNED, INTEGER or STRING");
+			}
+		}
+		/* no further checks of parts needed */
+		return;
 	case RTREE:
 		if (key_def->part_count != 1) {
 			tnt_raise(ClientError, ER_MODIFY_INDEX,
@@ -629,6 +1476,51 @@ MemtxEngine::rollbackStatement(struct txn *, struct txn_stmt *stmt)
 	stmt->new_tuple = NULL;
 }
 
+/** How long a throttled writer sleeps at a time. */
+static const double MEMTX_THROTTLE_DELAY = 0.01; /* seconds */
+/** Max delay of one throttled statement. */
+static const double MEMTX_THROTTLE_TIMEOUT = 1; /* seconds */
+
+/**
+ * Return true if the memory quota is about to run out while a
+ * part of it is held by the tuples freed during a snapshot.
+ */
+static inline bool
+memtx_is_short_of_memory()
+{
+	if (!memtx_alloc.is_delayed_free_mode || memtx_delayed_free_size == 0)
+		return false;
+	size_t total = quota_total(&memtx_quota);
+	size_t used = quota_used(&memtx_quota);
+	return total - MIN(used, total) < total / MEMTX_THROTTLE_QUOTA_FRACTION;
+}
+
+void
+MemtxEngine::beginStatement(struct txn *txn)
+{
+	/*
+	 * Memory freed during a checkpoint can't be reused
+	 * until the snapshot is written. If it is about to run
+	 * out, slow down writers to let the snapshot finish,
+	 * rather than fail them with ER_MEMORY_ISSUE.
+	 * Only an autocommit statement may yield here.
+	 */
+	if (m_checkpoint == NULL || m_state != MEMTX_OK ||
+	    !txn->is_autocommit || txn->in_sub_stmt > 1 ||
+	    !memtx_is_short_of_memory())
+		return;
+	if (!m_is_throttling) {
+		say_warn("memory is short, throttling writers until "
+			 "the snapshot is written: %zu bytes held by "
+			 "the snapshot", memtx_delayed_free_size);
+		m_is_throttling = true;
+	}
+	ev_tstamp deadline = ev_now(loop()) + MEMTX_THROTTLE_TIMEOUT;
+	do {
+		fiber_sleep(MEMTX_THROTTLE_DELAY);
+	} while (memtx_is_short_of_memory() && ev_now(loop()) < deadline);
+}
+
 void
 MemtxEngine::rollback(struct txn *txn)
 {
@@ -639,14 +1531,115 @@ MemtxEngine::rollback(struct txn *txn)
 		rollbackStatement(txn, stmt);
 }
 
+/* {{{ Incremental snapshots */
+
+enum {
+	/**
+	 * If the keys of deleted tuples take more memory than
+	 * this, give up and make the next snapshot full.
+	 */
+	MEMTX_DELTA_KEYS_SIZE_MAX = 256 * 1024 * 1024,
+};
+
+size_t
+memtx_deleted_keys_free(struct stailq *keys)
+{
+	size_t size = 0;
+	struct memtx_deleted_key *key, *tmp;
+	stailq_foreach_entry_safe(key, tmp, keys, link) {
+		size += sizeof(*key) + key->size;
+		free(key);
+	}
+	stailq_create(keys);
+	return size;
+}
+
+void
+MemtxEngine::dropDeletedKeys(struct stailq *keys)
+{
+	size_t size = memtx_deleted_keys_free(keys);
+	m_delta_keys_size -= MIN(size, m_delta_keys_size);
+}
+
+static void
+memtx_drop_deleted_keys(struct space *space, void *param)
+{
+	(void) param;
+	if (!space_is_memtx(space))
+		return;
+	MemtxSpace *handler = (MemtxSpace *) space->handler;
+	memtx_deleted_keys_free(&handler->deleted_keys);
+}
+
+void
+MemtxEngine::stopDeltaTracking()
+{
+	space_foreach(memtx_drop_deleted_keys, NULL);
+	m_delta_keys_size = 0;
+	m_delta_is_tracking = false;
+}
+
+void
+MemtxEngine::setSnapDeltaCount(uint32_t snap_delta_count)
+{
+	/*
+	 * If incremental snapshots are turned on, deletes are
+	 * tracked starting from the next checkpoint: the first
+	 * snapshot is full.
+	 */
+	if (snap_delta_count == 0)
+		stopDeltaTracking();
+	m_snap_delta_count = snap_delta_count;
+}
+
+void
+MemtxEngine::trackDelete(struct space *space, struct tuple *tuple)
+{
+	if (space_is_temporary(space))
+		return;
+	Index *pk = space_index(space, 0);
+	assert(pk != NULL);
+	uint32_t size;
+	const char *data = tuple_extract_key(tuple, pk->key_def, &size);
+	struct memtx_deleted_key *key = NULL;
+	size_t new_size = m_delta_keys_size + sizeof(*key) + size;
+	ERROR_INJECT(ERRINJ_SNAP_DELTA_KEYS,
+		     new_size = MEMTX_DELTA_KEYS_SIZE_MAX + 1);
+	if (data != NULL && new_size <= MEMTX_DELTA_KEYS_SIZE_MAX)
+		key = (struct memtx_deleted_key *) malloc(sizeof(*key) + size);
+	if (key == NULL) {
+		say_warn("too many deleted tuples, "
+			 "the next snapshot will be full");
+		stopDeltaTracking();
+		return;
+	}
+	key->size = size;
+	memcpy(key->data, data, size);
+	MemtxSpace *handler = (MemtxSpace *) space->handler;
+	stailq_add_tail_entry(&handler->deleted_keys, key, link);
+	m_delta_keys_size = new_size;
+}
+
+/* }}} */
+
 void
 MemtxEngine::commit(struct txn *txn, int64_t signature)
 {
 	(void) signature;
 	struct txn_stmt *stmt;
 	stailq_foreach_entry(stmt, &txn->stmts, next) {
-		if (stmt->old_tuple)
-			tuple_unref(stmt->old_tuple);
+		if (stmt->old_tuple == NULL)
+			continue;
+		/*
+		 * A deleted tuple which is in the last snapshot
+		 * must be deleted by the next incremental one.
+		 * A replaced tuple is overwritten by its new
+		 * version anyway.
+		 */
+		if (stmt->new_tuple == NULL && m_delta_is_tracking &&
+		    stmt->old_tuple->version < snapshot_version)
+			trackDelete(stmt->space, stmt->old_tuple);
+		tuple_unref(stmt->old_tuple);
 	}
 }
 
@@ -681,16 +1674,89 @@ MemtxEngine::bootstrap()
 	}
 }
 
+/**
+ * Pacing of snapshot writes by snap_io_rate_limit: a token
+ * bucket, filled at the current rate, which is lowered if the
+ * disk doesn't keep up with the writes, so that a snapshot
+ * doesn't stall WAL writes sharing the disk.
+ */
+struct checkpoint_throttle {
+	/** snap_io_rate_limit of the thread, bytes per second. */
+	double limit;
+	/** The current rate, <= limit. */
+	double rate;
+	/** Bytes which can be written without a delay. */
+	double tokens;
+	/** The time the bucket was last filled. */
+	double last;
+};
+
+enum {
+	/**
+	 * A write which takes longer than this is a sign that
+	 * the disk can't keep up: with write behind, see
+	 * xlog_tx_write(), a write waits only for the data
+	 * written a sync interval ago.
+	 */
+	CHECKPOINT_WRITE_LATENCY_MAX_MS = 20,
+	/** Don't lower the rate below 1/N of the limit. */
+	CHECKPOINT_RATE_MIN_FRACTION = 16,
+	/** Increase the rate by 1/N of the limit at a time. */
+	CHECKPOINT_RATE_STEP_FRACTION = 16,
+	/** Allow bursts of 1/N of a second worth of writes. */
+	CHECKPOINT_BURST_FRACTION = 10,
+};
+
 static void
-checkpoint_write_row(struct xlog *l, struct xrow_header *row,
-		     uint64_t snap_io_rate_limit)
+checkpoint_throttle_create(struct checkpoint_throttle *throttle,
+			   uint64_t snap_io_rate_limit)
 {
-	static uint64_t bytes;
-	ev_tstamp elapsed;
-	static ev_tstamp last = 0;
-	ev_loop *loop = loop();
+	throttle->limit = snap_io_rate_limit == UINT64_MAX ?
+			  0 : snap_io_rate_limit;
+	throttle->rate = throttle->limit;
+	throttle->tokens = 0;
+	throttle->last = throttle->limit != 0 ? clock_monotonic() : 0;
+}
 
-	row->tm = last;
+/**
+ * Account @a written bytes, which took @a write_time seconds,
+ * and sleep if the rate is exceeded.
+ */
+static void
+checkpoint_throttle_write(struct checkpoint_throttle *throttle,
+			  size_t written, double write_time)
+{
+	if (throttle->limit == 0)
+		return;
+	/* Additive increase, multiplicative decrease. */
+	if (write_time * 1000 > CHECKPOINT_WRITE_LATENCY_MAX_MS) {
+		throttle->rate = MAX(throttle->rate / 2, throttle->limit /
+				     CHECKPOINT_RATE_MIN_FRACTION);
+	} else {
+		throttle->rate = MIN(throttle->rate + throttle->limit /
+				     CHECKPOINT_RATE_STEP_FRACTION,
+				     throttle->limit);
+	}
+	double now = clock_monotonic();
+	throttle->tokens = MIN(throttle->tokens +
+			       (now - throttle->last) * throttle->rate,
+			       throttle->rate / CHECKPOINT_BURST_FRACTION);
+	throttle->tokens -= written;
+	throttle->last = now;
+	if (throttle->tokens < 0) {
+		/* Sleep until the bucket is refilled. */
+		usleep(-throttle->tokens / throttle->rate * 1000000);
+		now = clock_monotonic();
+		throttle->tokens += (now - throttle->last) * throttle->rate;
+		throttle->last = now;
+	}
+}
+
+static void
+checkpoint_write_row(struct xlog *l, struct xrow_header *row,
+		     struct checkpoint_throttle *throttle)
+{
+	row->tm = ev_now(loop());
 	row->server_id = 0;
 	/**
 	 * Rows in snapshot are numbered from 1 to %rows.
@@ -702,121 +1768,277 @@ checkpoint_write_row(struct xlog *l, struct xrow_header *row,
 	row->lsn = ++l->rows;
 	row->sync = 0; /* don't write sync to wal */
 
+	/*
+	 * Rows are accumulated in the xlog buffer and written
+	 * in large chunks, so only the writes which reach the
+	 * disk are timed and paced.
+	 */
+	double start = throttle->limit != 0 ? clock_monotonic() : 0;
 	ssize_t written = xlog_write_row(l, row);
 	fiber_gc();
 	if (written < 0) {
 		tnt_raise(SystemError, "Can't write snapshot row");
 	}
-	bytes += written;
 
 	if (l->rows % 100000 == 0)
 		say_crit("%.1fM rows written", l->rows / 1000000.);
 
-
-	if (snap_io_rate_limit != UINT64_MAX) {
-		if (last == 0) {
-			/*
-			 * Remember the time of first
-			 * write to disk.
-			 */
-			ev_now_update(loop);
-			last = ev_now(loop);
-		}
-		/**
-		 * If io rate limit is set, flush the
-		 * filesystem cache, otherwise the limit is
-		 * not really enforced.
-		 */
-		if (bytes > snap_io_rate_limit)
-			fdatasync(l->fd);
-	}
-	while (bytes > snap_io_rate_limit) {
-		ev_now_update(loop);
-		/*
-		 * How much time have passed since
-		 * last write?
-		 */
-		elapsed = ev_now(loop) - last;
-		/*
-		 * If last write was in less than
-		 * a second, sleep until the
-		 * second is reached.
-		 */
-		if (elapsed < 1)
-			usleep(((1 - elapsed) * 1000000));
-
-		ev_now_update(loop);
-		last = ev_now(loop);
-		bytes -= snap_io_rate_limit;
+	if (written > 0) {
+		checkpoint_throttle_write(throttle, written,
+					  clock_monotonic() - start);
 	}
 }
 
+/**
+ * Write a row with a body of two keys: IPROTO_SPACE_ID and
+ * @a key, which value is @a data.
+ */
 static void
-checkpoint_write_tuple(struct xlog *l, uint32_t n, struct tuple *tuple,
-		       uint64_t snap_io_rate_limit)
+checkpoint_write_data(struct xlog *l, uint16_t type, uint32_t n, uint8_t key,
+		      const char *data, uint32_t size,
+		      struct checkpoint_throttle *throttle)
 {
 	struct request_replace_body body;
 	body.m_body = 0x82; /* map of two elements. */
 	body.k_space_id = IPROTO_SPACE_ID;
 	body.m_space_id = 0xce; /* uint32 */
 	body.v_space_id = mp_bswap_u32(n);
-	body.k_tuple = IPROTO_TUPLE;
+	body.k_tuple = key;
 
 	struct xrow_header row;
 	memset(&row, 0, sizeof(struct xrow_header));
-	row.type = IPROTO_INSERT;
+	row.type = type;
 
 	row.bodycnt = 2;
 	row.body[0].iov_base = &body;
 	row.body[0].iov_len = sizeof(body);
+	row.body[1].iov_base = (char *) data;
+	row.body[1].iov_len = size;
+	checkpoint_write_row(l, &row, throttle);
+}
+
+/**
+ * Write a tuple: as INSERT to a full snapshot, as REPLACE to
+ * an incremental one.
+ */
+static void
+checkpoint_write_tuple(struct xlog *l, uint16_t type, uint32_t n,
+		       struct tuple *tuple,
+		       struct checkpoint_throttle *throttle)
+{
 	uint32_t bsize;
-	row.body[1].iov_base = (char *) tuple_data_range(tuple, &bsize);
-	row.body[1].iov_len = bsize;
-	checkpoint_write_row(l, &row, snap_io_rate_limit);
+	const char *data = tuple_data_range(tuple, &bsize);
+	checkpoint_write_data(l, type, n, IPROTO_TUPLE, data, bsize, throttle);
+}
+
+/**
+ * Tuples of a space accumulated for an IPROTO_SNAP_BLOCK row.
+ */
+struct checkpoint_block {
+	/** Encoded tuples, one after another. */
+	struct ibuf data;
+	/** The number of tuples in @a data. */
+	uint32_t n_tuples;
+};
+
+/**
+ * Write the accumulated tuples of space @a n as one row:
+ * {IPROTO_SPACE_ID: n, IPROTO_REQUEST_TYPE: type,
+ *  IPROTO_DATA: [tuple, tuple, ...]}
+ */
+static void
+checkpoint_write_block(struct xlog *l, uint16_t type, uint32_t n,
+		       struct checkpoint_block *block,
+		       struct checkpoint_throttle *throttle)
+{
+	if (block->n_tuples == 0)
+		return;
+	char head[32];
+	char *pos = mp_encode_map(head, 3);
+	pos = mp_encode_uint(pos, IPROTO_SPACE_ID);
+	pos = mp_encode_uint(pos, n);
+	pos = mp_encode_uint(pos, IPROTO_REQUEST_TYPE);
+	pos = mp_encode_uint(pos, type);
+	pos = mp_encode_uint(pos, IPROTO_DATA);
+	pos = mp_encode_array(pos, block->n_tuples);
+	assert(pos <= head + sizeof(head));
+
+	struct xrow_header row;
+	memset(&row, 0, sizeof(struct xrow_header));
+	row.type = IPROTO_SNAP_BLOCK;
+
+	row.bodycnt = 2;
+	row.body[0].iov_base = head;
+	row.body[0].iov_len = pos - head;
+	row.body[1].iov_base = block->data.rpos;
+	row.body[1].iov_len = ibuf_used(&block->data);
+	checkpoint_write_row(l, &row, throttle);
+	ibuf_reset(&block->data);
+	block->n_tuples = 0;
+}
+
+/**
+ * Add a tuple to the block of space @a n, write the block
+ * out if it is full.
+ */
+static void
+checkpoint_add_tuple(struct xlog *l, uint16_t type, uint32_t n,
+		     struct checkpoint_block *block, struct tuple *tuple,
+		     struct checkpoint_throttle *throttle)
+{
+	uint32_t bsize;
+	const char *data = tuple_data_range(tuple, &bsize);
+	if (ibuf_used(&block->data) + bsize > MEMTX_SNAP_BLOCK_SIZE)
+		checkpoint_write_block(l, type, n, block, throttle);
+	void *ptr = ibuf_alloc(&block->data, bsize);
+	if (ptr == NULL)
+		tnt_raise(OutOfMemory, bsize, "ibuf", "snapshot block");
+	memcpy(ptr, data, bsize);
+	block->n_tuples++;
 }
 
 struct checkpoint_entry {
 	struct space *space;
 	struct iterator *iterator;
+	/** The number of tuples in the space, for balancing. */
+	uint64_t n_tuples;
+	/** The snapshot part the space is written to. */
+	uint32_t part;
+	/**
+	 * File offset of the section of the space, if tuples
+	 * are written in blocks, see IPROTO_SNAP_INDEX.
+	 */
+	off_t offset;
+	/** The number of tuples written to the section. */
+	uint64_t n_written;
+	/**
+	 * Keys of the tuples deleted since the previous
+	 * snapshot, written if the snapshot is incremental.
+	 * A list of struct memtx_deleted_key.
+	 */
+	struct stailq deleted_keys;
 	struct rlist link;
 };
 
+/**
+ * A part of a snapshot, written to a separate file by a
+ * separate thread, see xlog_meta::parts.
+ */
+struct checkpoint_part {
+	struct checkpoint *ckpt;
+	/** Part number, 0 for the main snapshot file. */
+	uint32_t id;
+	/** Spaces to write to this part. */
+	struct rlist entries;
+	/** The total number of tuples to write. */
+	uint64_t n_tuples;
+	struct cord cord;
+};
+
 struct checkpoint {
 	/**
 	 * List of MemTX spaces to snapshot, with consistent
-	 * read view iterators.
+	 * read view iterators. Moved to parts before the
+	 * snapshot threads are started.
 	 */
 	struct rlist entries;
 	uint64_t snap_io_rate_limit;
-	struct cord cord;
+	struct checkpoint_part *parts;
+	uint32_t n_parts;
+	/** The number of started snapshot threads. */
+	uint32_t n_started;
 	bool waiting_for_snap_thread;
 	/** The vclock of the snapshot file. */
 	struct vclock vclock;
+	/**
+	 * Set if only the changes since the previous snapshot
+	 * are written, see xlog_meta::base.
+	 */
+	bool is_incremental;
+	/** The signature of the previous snapshot. */
+	int64_t base;
+	/**
+	 * Tuples with a version less than this are in the
+	 * previous snapshot and are not written if the snapshot
+	 * is incremental.
+	 */
+	uint32_t base_version;
+	/** snapshot_version of this checkpoint. */
+	uint32_t version;
+	/** Set while the tuple read view is open. */
+	bool has_read_view;
+	/** Schema version at the start of this checkpoint. */
+	uint32_t sc_version;
+	/**
+	 * Set if tuples are written in blocks, one section
+	 * per space, see IPROTO_SNAP_BLOCK.
+	 */
+	bool use_sections;
 	struct xdir dir;
 };
 
 static void
 checkpoint_init(struct checkpoint *ckpt, const char *snap_dirname,
-		uint64_t snap_io_rate_limit)
+		uint64_t snap_io_rate_limit, uint32_t n_parts)
 {
 	ckpt->entries = RLIST_HEAD_INITIALIZER(ckpt->entries);
 	ckpt->waiting_for_snap_thread = false;
+	ckpt->is_incremental = false;
+	ckpt->base = 0;
+	ckpt->base_version = 0;
+	ckpt->version = 0;
+	ckpt->has_read_view = false;
+	ckpt->sc_version = 0;
+	ckpt->use_sections = false;
 	xdir_create(&ckpt->dir, snap_dirname, SNAP, &SERVER_UUID);
+	/* The limit is shared by all snapshot threads. */
+	if (snap_io_rate_limit != UINT64_MAX)
+		snap_io_rate_limit /= n_parts;
 	ckpt->snap_io_rate_limit = snap_io_rate_limit;
+	ckpt->parts = (struct checkpoint_part *)
+		region_alloc_xc(&fiber()->gc, sizeof(*ckpt->parts) * n_parts);
+	ckpt->n_parts = n_parts;
+	ckpt->n_started = 0;
+	for (uint32_t i = 0; i < n_parts; i++) {
+		struct checkpoint_part *part = &ckpt->parts[i];
+		part->ckpt = ckpt;
+		part->id = i;
+		rlist_create(&part->entries);
+		part->n_tuples = 0;
+	}
 	/* May be used in abortCheckpoint() */
 	vclock_create(&ckpt->vclock);
 }
 
+/** Let the tuples freed since the checkpoint start be reused. */
 static void
-checkpoint_destroy(struct checkpoint *ckpt)
+checkpoint_end_read_view(struct checkpoint *ckpt)
+{
+	if (!ckpt->has_read_view)
+		return;
+	tuple_end_snapshot();
+	ckpt->has_read_view = false;
+}
+
+static void
+checkpoint_destroy_entries(struct rlist *entries)
 {
 	struct checkpoint_entry *entry;
-	rlist_foreach_entry(entry, &ckpt->entries, link) {
+	rlist_foreach_entry(entry, entries, link) {
 		Index *pk = space_index(entry->space, 0);
 		pk->destroyReadViewForIterator(entry->iterator);
 		entry->iterator->free(entry->iterator);
+		memtx_deleted_keys_free(&entry->deleted_keys);
 	}
-	ckpt->entries = RLIST_HEAD_INITIALIZER(ckpt->entries);
+	rlist_create(entries);
+}
+
+static void
+checkpoint_destroy(struct checkpoint *ckpt)
+{
+	checkpoint_destroy_entries(&ckpt->entries);
+	for (uint32_t i = 0; i < ckpt->n_parts; i++)
+		checkpoint_destroy_entries(&ckpt->parts[i].entries);
 	xdir_destroy(&ckpt->dir);
 }
 
@@ -838,37 +2060,216 @@ checkpoint_add_space(struct space *sp, void *data)
 
 	entry->space = sp;
 	entry->iterator = pk->allocIterator();
+	entry->n_tuples = pk->size();
+	entry->part = 0;
+	entry->offset = 0;
+	entry->n_written = 0;
+	stailq_create(&entry->deleted_keys);
 
 	pk->initIterator(entry->iterator, ITER_ALL, NULL, 0);
 	pk->createReadViewForIterator(entry->iterator);
 };
 
+static int
+checkpoint_entry_cmp(const void *a, const void *b)
+{
+	uint64_t n_a = (*(struct checkpoint_entry **) a)->n_tuples;
+	uint64_t n_b = (*(struct checkpoint_entry **) b)->n_tuples;
+	return n_a < n_b ? 1 : n_a > n_b ? -1 : 0;
+}
+
+/**
+ * Distribute spaces among snapshot parts. System spaces go
+ * to part 0, which is recovered first, so that the schema
+ * is in place before any user data is loaded. User spaces
+ * are assigned, the largest first, to the least loaded part.
+ * Within a part, spaces keep the space_foreach() order.
+ */
+static void
+checkpoint_distribute(struct checkpoint *ckpt)
+{
+	struct checkpoint_entry *entry, *tmp;
+	uint32_t n_entries = 0;
+	rlist_foreach_entry(entry, &ckpt->entries, link)
+		n_entries++;
+	struct checkpoint_entry **sorted = (struct checkpoint_entry **)
+		region_alloc_xc(&fiber()->gc, sizeof(*sorted) * n_entries);
+	uint32_t n_sorted = 0;
+	rlist_foreach_entry(entry, &ckpt->entries, link) {
+		if (space_is_system(entry->space))
+			ckpt->parts[0].n_tuples += entry->n_tuples;
+		else
+			sorted[n_sorted++] = entry;
+	}
+	qsort(sorted, n_sorted, sizeof(*sorted), checkpoint_entry_cmp);
+	for (uint32_t i = 0; i < n_sorted; i++) {
+		struct checkpoint_part *min = &ckpt->parts[0];
+		for (uint32_t j = 1; j < ckpt->n_parts; j++) {
+			if (ckpt->parts[j].n_tuples < min->n_tuples)
+				min = &ckpt->parts[j];
+		}
+		sorted[i]->part = min->id;
+		min->n_tuples += sorted[i]->n_tuples;
+	}
+	rlist_foreach_entry_safe(entry, &ckpt->entries, link, tmp) {
+		rlist_move_tail_entry(&ckpt->parts[entry->part].entries,
+				      entry, link);
+	}
+}
+
+/**
+ * Write the offsets of the sections of all spaces of a
+ * snapshot part as the last row of the file:
+ * {IPROTO_DATA: {space_id: [offset, tuple count], ...}}
+ * It lets tools find the data of a space without reading
+ * the whole file. Recovery skips it.
+ */
+static void
+checkpoint_write_index(struct xlog *l, struct rlist *entries,
+		       struct checkpoint_throttle *throttle)
+{
+	uint32_t n_entries = 0;
+	struct checkpoint_entry *entry;
+	rlist_foreach_entry(entry, entries, link)
+		n_entries++;
+
+	size_t size = mp_sizeof_map(1) + mp_sizeof_uint(IPROTO_DATA) +
+		      mp_sizeof_map(n_entries);
+	rlist_foreach_entry(entry, entries, link) {
+		size += mp_sizeof_uint(space_id(entry->space)) +
+			mp_sizeof_array(2) + mp_sizeof_uint(entry->offset) +
+			mp_sizeof_uint(entry->n_written);
+	}
+	char *data = (char *) region_alloc_xc(&fiber()->gc, size);
+	char *pos = mp_encode_map(data, 1);
+	pos = mp_encode_uint(pos, IPROTO_DATA);
+	pos = mp_encode_map(pos, n_entries);
+	rlist_foreach_entry(entry, entries, link) {
+		pos = mp_encode_uint(pos, space_id(entry->space));
+		pos = mp_encode_array(pos, 2);
+		pos = mp_encode_uint(pos, entry->offset);
+		pos = mp_encode_uint(pos, entry->n_written);
+	}
+	assert(pos == data + size);
+
+	struct xrow_header row;
+	memset(&row, 0, sizeof(struct xrow_header));
+	row.type = IPROTO_SNAP_INDEX;
+	row.bodycnt = 1;
+	row.body[0].iov_base = data;
+	row.body[0].iov_len = size;
+	checkpoint_write_row(l, &row, throttle);
+}
+
 int
 checkpoint_f(va_list ap)
 {
-	struct checkpoint *ckpt = va_arg(ap, struct checkpoint *);
+	struct checkpoint_part *part = va_arg(ap, struct checkpoint_part *);
+	struct checkpoint *ckpt = part->ckpt;
+
+	struct xlog_meta meta;
+	memset(&meta, 0, sizeof(meta));
+	snprintf(meta.filetype, sizeof(meta.filetype), "%s",
+		 ckpt->dir.filetype);
+	meta.server_uuid = *ckpt->dir.server_uuid;
+	vclock_copy(&meta.vclock, &ckpt->vclock);
+	/*
+	 * The main file tells how many parts are there and
+	 * which snapshot this one is based on.
+	 */
+	if (part->id == 0) {
+		meta.parts = ckpt->n_parts;
+		meta.is_incremental = ckpt->is_incremental;
+		meta.base = ckpt->base;
+	}
 
+	int64_t signature = vclock_sum(&ckpt->vclock);
+	const char *filename = part->id == 0 ?
+		xdir_format_filename(&ckpt->dir, signature, NONE) :
+		xdir_format_part_filename(&ckpt->dir, signature, part->id,
+					  NONE);
 	struct xlog snap;
-	if (xdir_create_xlog(&ckpt->dir, &snap, &ckpt->vclock) != 0)
+	if (xlog_create(&snap, filename, &meta) != 0)
 		tnt_raise(SystemError, "Can't create xlog");
+	snap.sync_interval = ckpt->dir.sync_interval;
 
 	auto guard = make_scoped_guard([&]{ xlog_close(&snap, false); });
 
+	struct checkpoint_throttle throttle;
+	checkpoint_throttle_create(&throttle, ckpt->snap_io_rate_limit);
+
+	struct checkpoint_block block;
+	ibuf_create(&block.data, &cord()->slabc, MEMTX_SNAP_BLOCK_SIZE);
+	block.n_tuples = 0;
+	auto block_guard = make_scoped_guard([&]{
+		ibuf_destroy(&block.data);
+	});
+
 	say_info("saving snapshot `%s'", snap.filename);
 	struct checkpoint_entry *entry;
-	rlist_foreach_entry(entry, &ckpt->entries, link) {
+	uint16_t type = ckpt->is_incremental ? IPROTO_REPLACE : IPROTO_INSERT;
+	rlist_foreach_entry(entry, &part->entries, link) {
+		uint32_t n = space_id(entry->space);
+		if (ckpt->use_sections) {
+			/*
+			 * Start each section with a new xlog tx,
+			 * so that it can be read (and decompressed)
+			 * on its own, starting at entry->offset.
+			 */
+			if (xlog_flush(&snap) < 0)
+				tnt_raise(SystemError, "Can't write snapshot");
+			entry->offset = snap.offset;
+		}
 		struct tuple *tuple;
 		struct iterator *it = entry->iterator;
 		for (tuple = it->next(it); tuple; tuple = it->next(it)) {
-			checkpoint_write_tuple(&snap, space_id(entry->space),
-					       tuple, ckpt->snap_io_rate_limit);
+			/* Skip tuples already in the base snapshot. */
+			if (ckpt->is_incremental &&
+			    tuple->version < ckpt->base_version)
+				continue;
+			if (ckpt->use_sections) {
+				checkpoint_add_tuple(&snap, type, n, &block,
+						     tuple, &throttle);
+			} else {
+				checkpoint_write_tuple(&snap, type, n, tuple,
+						       &throttle);
+			}
+			entry->n_written++;
+		}
+		checkpoint_write_block(&snap, type, n, &block, &throttle);
+		struct memtx_deleted_key *key;
+		stailq_foreach_entry(key, &entry->deleted_keys, link) {
+			checkpoint_write_data(&snap, IPROTO_DELETE, n,
+					      IPROTO_KEY, key->data, key->size,
+					      &throttle);
 		}
 	}
+	if (ckpt->use_sections)
+		checkpoint_write_index(&snap, &part->entries, &throttle);
 	xlog_flush(&snap);
 	say_info("done");
 	return 0;
 }
 
+/**
+ * Wait for the started snapshot threads.
+ * @retval -1 if any of them failed
+ */
+static int
+checkpoint_join(struct checkpoint *ckpt)
+{
+	int result = 0;
+	for (uint32_t i = 0; i < ckpt->n_started; i++) {
+		if (cord_cojoin(&ckpt->parts[i].cord) != 0) {
+			error_log(diag_last_error(diag_get()));
+			result = -1;
+		}
+	}
+	ckpt->n_started = 0;
+	ckpt->waiting_for_snap_thread = false;
+	return result;
+}
+
 int
 MemtxEngine::beginCheckpoint()
 {
@@ -876,11 +2277,72 @@ MemtxEngine::beginCheckpoint()
 
 	m_checkpoint = region_alloc_object_xc(&fiber()->gc, struct checkpoint);
 
-	checkpoint_init(m_checkpoint, m_snap_dir.dirname, m_snap_io_rate_limit);
-	space_foreach(checkpoint_add_space, m_checkpoint);
+	struct checkpoint *ckpt = m_checkpoint;
+	checkpoint_init(ckpt, m_snap_dir.dirname, m_snap_io_rate_limit,
+			m_snap_threads);
+	ckpt->use_sections = m_snap_sections;
+	space_foreach(checkpoint_add_space, ckpt);
+	checkpoint_distribute(ckpt);
+
+	/*
+	 * A snapshot can be incremental only if all deletes
+	 * since the previous snapshot are known and there
+	 * was no DDL: a changed space is written in full.
+	 */
+	ckpt->is_incremental = m_delta_is_tracking && m_has_checkpoint &&
+			       m_delta_chain < m_snap_delta_count &&
+			       m_delta_sc_version == sc_version;
+	if (ckpt->is_incremental) {
+		ckpt->base = vclock_sum(&m_last_checkpoint);
+		ckpt->base_version = m_delta_base_version;
+	}
+	for (uint32_t i = 0; i < ckpt->n_parts; i++) {
+		struct checkpoint_entry *entry;
+		rlist_foreach_entry(entry, &ckpt->parts[i].entries, link) {
+			MemtxSpace *handler =
+				(MemtxSpace *) entry->space->handler;
+			stailq_concat(&entry->deleted_keys,
+				      &handler->deleted_keys);
+			if (!ckpt->is_incremental) {
+				memtx_deleted_keys_free(&entry->deleted_keys);
+				continue;
+			}
+			/*
+			 * A key could be inserted again after
+			 * the delete: then it's written as a
+			 * REPLACE.
+			 */
+			Index *pk = space_index(entry->space, 0);
+			struct stailq keys;
+			stailq_create(&keys);
+			stailq_concat(&keys, &entry->deleted_keys);
+			while (!stailq_empty(&keys)) {
+				struct memtx_deleted_key *key =
+					stailq_shift_entry(&keys,
+						struct memtx_deleted_key, link);
+				const char *data = key->data;
+				uint32_t part_count = mp_decode_array(&data);
+				if (pk->findByKey(data, part_count) != NULL) {
+					free(key);
+					continue;
+				}
+				stailq_add_tail_entry(&entry->deleted_keys,
+						      key, link);
+			}
+		}
+	}
+	/* Keys of the other spaces are of no use. */
+	space_foreach(memtx_drop_deleted_keys, NULL);
+	m_delta_keys_size = 0;
 
 	/* increment snapshot version; set tuple deletion to delayed mode */
 	tuple_begin_snapshot();
+	ckpt->has_read_view = true;
+	m_is_throttling = false;
+	ckpt->version = snapshot_version;
+	ckpt->sc_version = sc_version;
+	/* Track deletes for the next snapshot. */
+	m_delta_is_tracking = m_snap_delta_count > 0;
 	return 0;
 }
 
@@ -890,19 +2352,48 @@ MemtxEngine::waitCheckpoint(struct vclock *vclock)
 	assert(m_checkpoint);
 
 	vclock_copy(&m_checkpoint->vclock, vclock);
+	int64_t lsn = vclock_sum(vclock);
+	struct xdir *dir = &m_checkpoint->dir;
 
-	if (cord_costart(&m_checkpoint->cord, "snapshot",
-			 checkpoint_f, m_checkpoint)) {
-		return -1;
+	/*
+	 * Parts are renamed before the main file on commit, so
+	 * a crash in between may leave parts of a snapshot which
+	 * doesn't exist. Remove them, they would prevent parts
+	 * with the same name from being created.
+	 */
+	if (access(xdir_format_filename(dir, lsn, NONE), F_OK) != 0) {
+		for (uint32_t i = 1; i < m_checkpoint->n_parts; i++) {
+			(void) coeio_unlink(xdir_format_part_filename(dir,
+								lsn, i, NONE));
+		}
+	}
+
+	int result = 0;
+	for (uint32_t i = 0; i < m_checkpoint->n_parts; i++) {
+		char name[FIBER_NAME_MAX];
+		if (m_checkpoint->n_parts == 1)
+			snprintf(name, sizeof(name), "snapshot");
+		else
+			snprintf(name, sizeof(name), "snapshot.%u", i);
+		if (cord_costart(&m_checkpoint->parts[i].cord, name,
+				 checkpoint_f, &m_checkpoint->parts[i])) {
+			error_log(diag_last_error(diag_get()));
+			result = -1;
+			break;
+		}
+		m_checkpoint->n_started++;
 	}
 	m_checkpoint->waiting_for_snap_thread = true;
 
 	/* wait for memtx-part snapshot completion */
-	int result = cord_cojoin(&m_checkpoint->cord);
-	if (result != 0)
-		error_log(diag_last_error(diag_get()));
-
-	m_checkpoint->waiting_for_snap_thread = false;
+	if (checkpoint_join(m_checkpoint) != 0)
+		result = -1;
+	/*
+	 * The read view is not used any more: start reclaiming
+	 * the tuples freed meanwhile without waiting for the
+	 * other engines to finish the checkpoint.
+	 */
+	checkpoint_end_read_view(m_checkpoint);
 	return result;
 }
 
@@ -915,12 +2406,24 @@ MemtxEngine::commitCheckpoint(struct vclock *vclock)
 	/* waitCheckpoint() must have been done. */
 	assert(!m_checkpoint->waiting_for_snap_thread);
 
-	tuple_end_snapshot();
+	checkpoint_end_read_view(m_checkpoint);
 
 	int64_t lsn = vclock_sum(&m_checkpoint->vclock);
 	struct xdir *dir = &m_checkpoint->dir;
-	/* rename snapshot on completion */
 	char to[PATH_MAX];
+	/*
+	 * Rename parts first: the rename of the main file
+	 * commits the whole snapshot.
+	 */
+	for (uint32_t i = 1; i < m_checkpoint->n_parts; i++) {
+		snprintf(to, sizeof(to), "%s",
+			 xdir_format_part_filename(dir, lsn, i, NONE));
+		char *from = xdir_format_part_filename(dir, lsn, i,
+						       INPROGRESS);
+		if (coeio_rename(from, to) != 0)
+			panic("can't rename .snap.%u.inprogress", i);
+	}
+	/* rename snapshot on completion */
 	snprintf(to, sizeof(to), "%s",
 		 xdir_format_filename(dir, lsn, NONE));
 	char *from = xdir_format_filename(dir, lsn, INPROGRESS);
@@ -930,6 +2433,9 @@ MemtxEngine::commitCheckpoint(struct vclock *vclock)
 
 	vclock_copy(&m_last_checkpoint, &m_checkpoint->vclock);
 	m_has_checkpoint = true;
+	m_delta_base_version = m_checkpoint->version;
+	m_delta_sc_version = m_checkpoint->sc_version;
+	m_delta_chain = m_checkpoint->is_incremental ? m_delta_chain + 1 : 0;
 	checkpoint_destroy(m_checkpoint);
 	m_checkpoint = 0;
 }
@@ -942,102 +2448,199 @@ MemtxEngine::abortCheckpoint()
 	 */
 	if (m_checkpoint->waiting_for_snap_thread) {
 		/* wait for memtx-part snapshot completion */
-		if (cord_cojoin(&m_checkpoint->cord) != 0)
-			error_log(diag_last_error(diag_get()));
-		m_checkpoint->waiting_for_snap_thread = false;
+		checkpoint_join(m_checkpoint);
 	}
 
-	tuple_end_snapshot();
+	checkpoint_end_read_view(m_checkpoint);
 
-	/** Remove garbage .inprogress file. */
+	/** Remove garbage .inprogress files. */
+	int64_t lsn = vclock_sum(&m_checkpoint->vclock);
 	char *filename =
-		xdir_format_filename(&m_checkpoint->dir,
-				     vclock_sum(&m_checkpoint->vclock),
-				     INPROGRESS);
+		xdir_format_filename(&m_checkpoint->dir, lsn, INPROGRESS);
 	(void) coeio_unlink(filename);
+	for (uint32_t i = 1; i < m_checkpoint->n_parts; i++) {
+		filename = xdir_format_part_filename(&m_checkpoint->dir,
+						     lsn, i, INPROGRESS);
+		(void) coeio_unlink(filename);
+	}
 
+	/*
+	 * The deletes made before the checkpoint are lost with
+	 * it, so the next snapshot must be full.
+	 */
+	stopDeltaTracking();
 	checkpoint_destroy(m_checkpoint);
 	m_checkpoint = 0;
 }
 
-/** Used to pass arguments to memtx_initial_join_f */
-struct memtx_join_arg {
-	const char *snap_dirname;
-	int64_t checkpoint_lsn;
+/* {{{ Initial join */
+
+/**
+ * A space sent to a replica on initial join. The space may be
+ * dropped while it is being sent, so the entry doesn't refer
+ * to it and pins its primary key.
+ */
+struct memtx_join_entry {
+	uint32_t space_id;
+	/** The primary key, referenced by the entry. */
+	Index *pk;
+	/** Iterator over a read view of the primary key. */
+	struct iterator *iterator;
+	struct rlist link;
+};
+
+/**
+ * A consistent read view of all memtx spaces, sent to a new
+ * replica instead of the last snapshot file, so that the
+ * replica only needs the WAL written after the join started.
+ */
+struct memtx_join {
+	/** List of struct memtx_join_entry. */
+	struct rlist entries;
 	struct xstream *stream;
 };
 
+static void
+memtx_join_add_space(struct space *sp, void *data)
+{
+	if (space_is_temporary(sp))
+		return;
+	if (!space_is_memtx(sp))
+		return;
+	Index *pk = space_index(sp, 0);
+	if (!pk)
+		return;
+	struct memtx_join *join = (struct memtx_join *) data;
+	struct memtx_join_entry *entry = (struct memtx_join_entry *)
+		malloc(sizeof(*entry));
+	if (entry == NULL) {
+		tnt_raise(OutOfMemory, sizeof(*entry), "malloc",
+			  "struct memtx_join_entry");
+	}
+	entry->space_id = space_id(sp);
+	entry->pk = pk;
+	entry->iterator = pk->allocIterator();
+	index_ref(pk);
+	rlist_add_tail_entry(&join->entries, entry, link);
+
+	pk->initIterator(entry->iterator, ITER_ALL, NULL, 0);
+	pk->createReadViewForIterator(entry->iterator);
+}
+
+static void
+memtx_join_delete(struct memtx_join *join)
+{
+	struct memtx_join_entry *entry, *tmp;
+	rlist_foreach_entry_safe(entry, &join->entries, link, tmp) {
+		entry->pk->destroyReadViewForIterator(entry->iterator);
+		entry->iterator->free(entry->iterator);
+		index_unref(entry->pk);
+		free(entry);
+	}
+	free(join);
+}
+
 /**
- * Invoked from a thread to feed snapshot rows.
+ * Invoked from a thread to feed the read view rows.
  */
 static int
 memtx_initial_join_f(va_list ap)
 {
-	struct memtx_join_arg *arg = va_arg(ap, struct memtx_join_arg *);
-	const char *snap_dirname = arg->snap_dirname;
-	int64_t checkpoint_lsn = arg->checkpoint_lsn;
-	struct xstream *stream = arg->stream;
-
-	struct xdir dir;
-	/*
-	 * snap_dirname and SERVER_UUID don't change after start,
-	 * safe to use in another thread.
-	 */
-	xdir_create(&dir, snap_dirname, SNAP, &SERVER_UUID);
-	auto guard = make_scoped_guard([&]{
-		xdir_destroy(&dir);
-	});
-	struct xlog_cursor cursor;
-	xdir_open_cursor_xc(&dir, checkpoint_lsn, &cursor);
-	auto reader_guard = make_scoped_guard([&]{
-		xlog_cursor_close(&cursor, false);
-	});
+	struct memtx_join *join = va_arg(ap, struct memtx_join *);
+	struct request_replace_body body;
+	body.m_body = 0x82; /* map of two elements. */
+	body.k_space_id = IPROTO_SPACE_ID;
+	body.m_space_id = 0xce; /* uint32 */
+	body.k_tuple = IPROTO_TUPLE;
 
 	struct xrow_header row;
-	while (xlog_cursor_next_xc(&cursor, &row, true) == 0) {
-		xstream_write(stream, &row);
+	memset(&row, 0, sizeof(row));
+	row.type = IPROTO_INSERT;
+	row.bodycnt = 2;
+	row.body[0].iov_base = &body;
+	row.body[0].iov_len = sizeof(body);
+	/* The same numbering as in a snapshot. */
+	int64_t lsn = 0;
+	/* System spaces go first, as in a snapshot. */
+	struct memtx_join_entry *entry;
+	rlist_foreach_entry(entry, &join->entries, link) {
+		body.v_space_id = mp_bswap_u32(entry->space_id);
+		struct tuple *tuple;
+		struct iterator *it = entry->iterator;
+		for (tuple = it->next(it); tuple; tuple = it->next(it)) {
+			uint32_t bsize;
+			row.body[1].iov_base =
+				(char *) tuple_data_range(tuple, &bsize);
+			row.body[1].iov_len = bsize;
+			row.lsn = ++lsn;
+			xstream_write(join->stream, &row);
+		}
 	}
-
-	/**
-	 * We should never try to read snapshots with no EOF
-	 * marker - such snapshots are very likely corrupted and
-	 * should not be trusted.
-	 */
-	/* TODO: replace panic with tnt_raise() */
-	if (!cursor.eof_read)
-		panic("snapshot `%s' has no EOF marker",
-		      cursor.name);
 	return 0;
 }
 
+/** Initial joins are served one at a time. */
+static struct latch memtx_join_latch = LATCH_INITIALIZER(memtx_join_latch);
+
 void
-MemtxEngine::join(struct xstream *stream)
+MemtxEngine::beginJoin()
 {
+	latch_lock(&memtx_join_latch);
+	auto join_lock_guard = make_scoped_guard([&]{
+		latch_unlock(&memtx_join_latch);
+	});
+	assert(m_join == NULL);
+	struct memtx_join *join = (struct memtx_join *) malloc(sizeof(*join));
+	if (join == NULL) {
+		tnt_raise(OutOfMemory, sizeof(*join), "malloc",
+			  "struct memtx_join");
+	}
+	rlist_create(&join->entries);
+	join->stream = NULL;
+	auto join_guard = make_scoped_guard([&]{ memtx_join_delete(join); });
 	/*
-	 * The only case when the directory index is empty is
-	 * when someone has deleted a snapshot and tries to join
-	 * as a replica. Our best effort is to not crash in such
-	 * case: raise ER_MISSING_SNAPSHOT.
-	 */
-	if (!m_has_checkpoint)
-		tnt_raise(ClientError, ER_MISSING_SNAPSHOT);
-
-	/*
-	 * cord_costart() passes only void * pointer as an argument.
+	 * Don't let DDL change the schema while the read views
+	 * are created, so that they are consistent. Once they
+	 * are, DDL and checkpoints may go on: the entries pin
+	 * the indexes, and tuples freed from now on are not
+	 * reused until the join ends.
 	 */
-	struct memtx_join_arg arg = {
-		/* .snap_dirname   = */ m_snap_dir.dirname,
-		/* .checkpoint_lsn = */ vclock_sum(&m_last_checkpoint),
-		/* .stream         = */ stream
-	};
+	latch_lock(&schema_lock);
+	auto lock_guard = make_scoped_guard([&]{
+		latch_unlock(&schema_lock);
+	});
+	space_foreach(memtx_join_add_space, join);
+	tuple_begin_snapshot();
+	m_join = join;
+	join_guard.is_active = false;
+	join_lock_guard.is_active = false;
+}
 
-	/* Send snapshot using a thread */
+void
+MemtxEngine::join(struct xstream *stream)
+{
+	assert(m_join != NULL);
+	m_join->stream = stream;
+	/* Send the read view using a thread */
 	struct cord cord;
-	cord_costart(&cord, "initial_join", memtx_initial_join_f, &arg);
+	cord_costart(&cord, "initial_join", memtx_initial_join_f, m_join);
 	if (cord_cojoin(&cord) != 0)
 		diag_raise();
 }
 
+void
+MemtxEngine::endJoin()
+{
+	if (m_join == NULL)
+		return;
+	tuple_end_snapshot();
+	memtx_join_delete(m_join);
+	m_join = NULL;
+	latch_unlock(&memtx_join_latch);
+}
+
+/* }}} */
+
 /**
  * Initialize arena for indexes.
  * The arena is used for memtx_index_extent_alloc
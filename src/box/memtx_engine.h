@@ -32,6 +32,7 @@
  */
 #include "engine.h"
 #include "xlog.h"
+#include "salad/stailq.h"
 
 /**
  * The state of memtx recovery process.
@@ -70,6 +71,8 @@ enum memtx_recovery_state {
 /** Memtx extents pool, available to statistics. */
 extern struct mempool memtx_index_extent_pool;
 
+struct xlog_reader_batch;
+
 struct MemtxEngine: public Engine {
 	MemtxEngine(const char *snap_dirname, bool panic_on_snap_error,
 					      bool panic_on_wal_error);
@@ -82,6 +85,7 @@ struct MemtxEngine: public Engine {
 				       Index *new_index) override;
 	virtual void keydefCheck(struct space *space, struct key_def *key_def) override;
 	virtual void begin(struct txn *txn) override;
+	virtual void beginStatement(struct txn *txn) override;
 	virtual void rollbackStatement(struct txn *,
 				       struct txn_stmt *stmt) override;
 	virtual void rollback(struct txn *txn) override;
@@ -91,7 +95,9 @@ struct MemtxEngine: public Engine {
 	virtual void beginInitialRecovery(struct vclock *vclock) override;
 	virtual void beginFinalRecovery() override;
 	virtual void endRecovery() override;
+	virtual void beginJoin() override;
 	virtual void join(struct xstream *stream) override;
+	virtual void endJoin() override;
 	virtual int beginCheckpoint() override;
 	virtual int waitCheckpoint(struct vclock *vclock) override;
 	virtual void commitCheckpoint(struct vclock *vclock) override;
@@ -104,6 +110,20 @@ struct MemtxEngine: public Engine {
 		if (m_snap_io_rate_limit == 0)
 			m_snap_io_rate_limit = UINT64_MAX;
 	}
+	/* Update snap_threads, takes effect on the next checkpoint. */
+	void setSnapThreads(uint32_t snap_threads)
+	{
+		m_snap_threads = snap_threads;
+	}
+	/* Update snap_delta_count. */
+	void setSnapDeltaCount(uint32_t snap_delta_count);
+	/* Update snap_sections, takes effect on the next checkpoint. */
+	void setSnapSections(bool snap_sections)
+	{
+		m_snap_sections = snap_sections;
+	}
+	/** Free the keys remembered for a dropped space. */
+	void dropDeletedKeys(struct stailq *keys);
 	/**
 	 * Return LSN of the most recent snapshot or -1 if there is
 	 * no snapshot.
@@ -111,15 +131,71 @@ struct MemtxEngine: public Engine {
 	int64_t lastCheckpoint(struct vclock *vclock);
 	void recoverSnapshot();
 private:
+	/** Apply rows read from a snapshot and release the batch. */
+	void
+	recoverSnapshotBatch(struct xlog_reader_batch *batch,
+			     uint64_t *row_count);
 	void
 	recoverSnapshotRow(struct xrow_header *row);
+	/** Apply all tuples of an IPROTO_SNAP_BLOCK row. */
+	void
+	recoverSnapshotBlock(struct xrow_header *row, uint64_t *row_count);
+	/** Recover all parts of a snapshot file. */
+	void
+	recoverSnapshotFile(int64_t signature);
+	/** Remember the key of a deleted tuple, @sa commit(). */
+	void
+	trackDelete(struct space *space, struct tuple *tuple);
+	/**
+	 * Drop the keys remembered so far. The next snapshot
+	 * will be full.
+	 */
+	void
+	stopDeltaTracking();
 	/** Non-zero if there is a checkpoint (snapshot) in progress. */
 	struct checkpoint *m_checkpoint;
+	/** Non-zero if there is an initial join in progress. */
+	struct memtx_join *m_join;
 	enum memtx_recovery_state m_state;
 	/** The directory where to store snapshots. */
 	struct xdir m_snap_dir;
 	/** Limit disk usage of checkpointing (bytes per second). */
 	uint64_t m_snap_io_rate_limit;
+	/** The number of threads (and files) to write a snapshot. */
+	uint32_t m_snap_threads;
+	/**
+	 * The max number of incremental snapshots written after
+	 * a full one, 0 if all snapshots are full.
+	 */
+	uint32_t m_snap_delta_count;
+	/**
+	 * Set if tuples are written to snapshots in blocks,
+	 * grouped by space, see IPROTO_SNAP_BLOCK.
+	 */
+	bool m_snap_sections;
+	/**
+	 * Set if the keys of all tuples deleted since the start
+	 * of the last checkpoint are remembered, see
+	 * MemtxSpace::deleted_keys, so that the next snapshot
+	 * can be incremental.
+	 */
+	bool m_delta_is_tracking;
+	/** The total size of the remembered keys. */
+	size_t m_delta_keys_size;
+	/**
+	 * snapshot_version at the start of the last checkpoint:
+	 * tuples with a lesser version are in the snapshot.
+	 */
+	uint32_t m_delta_base_version;
+	/** Schema version at the start of the last checkpoint. */
+	uint32_t m_delta_sc_version;
+	/** Incremental snapshots since the last full one. */
+	uint32_t m_delta_chain;
+	/**
+	 * Set if writers have been throttled during the current
+	 * checkpoint, to log it only once.
+	 */
+	bool m_is_throttling;
 	struct vclock m_last_checkpoint;
 	bool m_has_checkpoint;
 	bool m_panic_on_wal_error;
@@ -127,9 +203,50 @@ private:
 
 enum {
 	MEMTX_EXTENT_SIZE = 16 * 1024,
-	MEMTX_SLAB_SIZE = 4 * 1024 * 1024
+	MEMTX_SLAB_SIZE = 4 * 1024 * 1024,
+	/** Max value of box.cfg.snap_threads. */
+	MEMTX_SNAP_THREADS_MAX = 64,
+	/** Max value of box.cfg.snap_delta_count. */
+	MEMTX_SNAP_DELTA_COUNT_MAX = 100,
+	/**
+	 * The size of tuple data in an IPROTO_SNAP_BLOCK row,
+	 * so that each block fills an xlog tx.
+	 */
+	MEMTX_SNAP_BLOCK_SIZE = 128 * 1024,
+	/**
+	 * Writers are throttled during a checkpoint if less
+	 * than 1/MEMTX_THROTTLE_QUOTA_FRACTION of the memory
+	 * quota is left, @sa MemtxEngine::beginStatement().
+	 */
+	MEMTX_THROTTLE_QUOTA_FRACTION = 10,
+};
+
+/**
+ * The key of a tuple deleted since the last checkpoint,
+ * @sa MemtxSpace::deleted_keys.
+ */
+struct memtx_deleted_key {
+	struct stailq_entry link;
+	uint32_t size;
+	/** MsgPack array of primary key parts. */
+	char data[0];
 };
 
+/**
+ * Free a list of struct memtx_deleted_key.
+ * @return the total size of the freed keys
+ */
+size_t
+memtx_deleted_keys_free(struct stailq *keys);
+
+/**
+ * Finish the bulk load of the primary key of a space, if it
+ * is in progress, so that the space accepts replaces and
+ * deletes. Used to apply incremental snapshots.
+ */
+void
+memtx_space_end_build(struct space *space);
+
 /**
  * Initialize arena for indexes.
  * The arena is used for memtx_index_extent_alloc
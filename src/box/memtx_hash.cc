@@ -153,43 +153,177 @@ key_hash(const char *key, const struct key_def *key_def)
 typedef uint32_t hash_t;
 #include "salad/light.h"
 
+#define SWISS_NAME _index
+#define SWISS_DATA_TYPE struct tuple *
+#define SWISS_KEY_TYPE const char *
+#define SWISS_CMP_ARG_TYPE struct key_def *
+#define SWISS_EQUAL(a, b, c) equal(a, b, c)
+#define SWISS_EQUAL_KEY(a, b, c) equal_key(a, b, c)
+#include "salad/swiss.h"
+
+/**
+ * Light and swiss tables have the same interface under different
+ * prefixes. hash_table_api<> gives it the same names for both, so that
+ * MemtxHashBase is written once.
+ */
+template <class HashTable>
+struct hash_table_api;
+
+#define HASH_TABLE_DEFINE(prefix)					\
+template <>								\
+struct hash_table_api<struct prefix##_core> {				\
+	typedef struct prefix##_core core;				\
+	typedef struct prefix##_iterator iterator;			\
+	static const hash_t end = prefix##_end;				\
+									\
+	static inline void						\
+	create(core *ht, struct key_def *key_def)			\
+	{								\
+		prefix##_create(ht, HASH_INDEX_EXTENT_SIZE,		\
+				memtx_index_extent_alloc,		\
+				memtx_index_extent_free, NULL, key_def);\
+	}								\
+	static inline void						\
+	destroy(core *ht)						\
+	{								\
+		prefix##_destroy(ht);					\
+	}								\
+	static inline bool						\
+	pos_valid(core *ht, hash_t pos)					\
+	{								\
+		return prefix##_pos_valid(ht, pos);			\
+	}								\
+	static inline struct tuple *					\
+	get(core *ht, hash_t pos)					\
+	{								\
+		return prefix##_get(ht, pos);				\
+	}								\
+	static inline hash_t						\
+	find_key(core *ht, uint32_t h, const char *key)			\
+	{								\
+		return prefix##_find_key(ht, h, key);			\
+	}								\
+	static inline void						\
+	prefetch(core *ht, uint32_t h)					\
+	{								\
+		prefix##_prefetch(ht, h);				\
+	}								\
+	static inline hash_t						\
+	replace(core *ht, uint32_t h, struct tuple *tuple,		\
+		struct tuple **replaced)				\
+	{								\
+		return prefix##_replace(ht, h, tuple, replaced);	\
+	}								\
+	static inline hash_t						\
+	insert(core *ht, uint32_t h, struct tuple *tuple)		\
+	{								\
+		return prefix##_insert(ht, h, tuple);			\
+	}								\
+	static inline void						\
+	remove(core *ht, hash_t pos)					\
+	{								\
+		prefix##_delete(ht, pos);				\
+	}								\
+	static inline int						\
+	remove_value(core *ht, uint32_t h, struct tuple *tuple)	\
+	{								\
+		return prefix##_delete_value(ht, h, tuple);		\
+	}								\
+	static inline void						\
+	iterator_begin(core *ht, iterator *itr)				\
+	{								\
+		prefix##_iterator_begin(ht, itr);			\
+	}								\
+	static inline void						\
+	iterator_key(core *ht, iterator *itr, uint32_t h,		\
+		     const char *key)					\
+	{								\
+		prefix##_iterator_key(ht, itr, h, key);			\
+	}								\
+	static inline struct tuple **					\
+	iterator_get_and_next(core *ht, iterator *itr)			\
+	{								\
+		return prefix##_iterator_get_and_next(ht, itr);		\
+	}								\
+	static inline void						\
+	iterator_freeze(core *ht, iterator *itr)			\
+	{								\
+		prefix##_iterator_freeze(ht, itr);			\
+	}								\
+	static inline void						\
+	iterator_destroy(core *ht, iterator *itr)			\
+	{								\
+		prefix##_iterator_destroy(ht, itr);			\
+	}								\
+};
+
+HASH_TABLE_DEFINE(light_index)
+HASH_TABLE_DEFINE(swiss_index)
+
+#undef HASH_TABLE_DEFINE
+
+/** Light grows incrementally and needs no reserve. */
+static inline int
+hash_table_reserve(struct light_index_core *ht, uint32_t count)
+{
+	(void)ht;
+	(void)count;
+	return 0;
+}
+
+/**
+ * Swiss table rehashes all values when it grows, so growing
+ * it once before the build saves a few full rehashes.
+ */
+static inline int
+hash_table_reserve(struct swiss_index_core *ht, uint32_t count)
+{
+	return swiss_index_reserve(ht, count);
+}
+
 /* {{{ MemtxHash Iterators ****************************************/
 
+template <class HashTable>
 struct hash_iterator {
 	struct iterator base; /* Must be the first member. */
-	struct light_index_core *hash_table;
-	struct light_index_iterator iterator;
+	HashTable *hash_table;
+	typename hash_table_api<HashTable>::iterator iterator;
 };
 
+template <class HashTable>
 void
 hash_iterator_free(struct iterator *iterator)
 {
-	assert(iterator->free == hash_iterator_free);
+	assert(iterator->free == hash_iterator_free<HashTable>);
 	free(iterator);
 }
 
+template <class HashTable>
 struct tuple *
 hash_iterator_ge(struct iterator *ptr)
 {
-	assert(ptr->free == hash_iterator_free);
-	struct hash_iterator *it = (struct hash_iterator *) ptr;
-	struct tuple **res = light_index_iterator_get_and_next(it->hash_table,
-							       &it->iterator);
+	assert(ptr->free == hash_iterator_free<HashTable>);
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) ptr;
+	struct tuple **res = hash_table_api<HashTable>::
+		iterator_get_and_next(it->hash_table, &it->iterator);
 	return res ? *res : 0;
 }
 
+template <class HashTable>
 struct tuple *
 hash_iterator_gt(struct iterator *ptr)
 {
-	assert(ptr->free == hash_iterator_free);
-	ptr->next = hash_iterator_ge;
-	struct hash_iterator *it = (struct hash_iterator *) ptr;
-	struct tuple **res = light_index_iterator_get_and_next(it->hash_table,
-							       &it->iterator);
+	assert(ptr->free == hash_iterator_free<HashTable>);
+	ptr->next = hash_iterator_ge<HashTable>;
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) ptr;
+	struct tuple **res = hash_table_api<HashTable>::
+		iterator_get_and_next(it->hash_table, &it->iterator);
 	if (!res)
 		return 0;
-	res = light_index_iterator_get_and_next(it->hash_table,
-						&it->iterator);
+	res = hash_table_api<HashTable>::
+		iterator_get_and_next(it->hash_table, &it->iterator);
 	return res ? *res : 0;
 }
 
@@ -199,112 +333,155 @@ hash_iterator_eq_next(MAYBE_UNUSED struct iterator *it)
 	return NULL;
 }
 
+template <class HashTable>
 static struct tuple *
 hash_iterator_eq(struct iterator *it)
 {
 	it->next = hash_iterator_eq_next;
-	return hash_iterator_ge(it);
+	return hash_iterator_ge<HashTable>(it);
 }
 
 /* }}} */
 
 /* {{{ MemtxHash -- implementation of all hashes. **********************/
 
-MemtxHash::MemtxHash(struct key_def *key_def_arg)
+template <class HashTable>
+MemtxHashBase<HashTable>::MemtxHashBase(struct key_def *key_def_arg)
 	: MemtxIndex(key_def_arg)
 {
 	memtx_index_arena_init();
-	hash_table = (struct light_index_core *) malloc(sizeof(*hash_table));
+	hash_table = (HashTable *) malloc(sizeof(*hash_table));
 	if (hash_table == NULL) {
-		tnt_raise(OutOfMemory, sizeof(hash_table),
+		tnt_raise(OutOfMemory, sizeof(*hash_table),
 			  "MemtxHash", "hash_table");
 	}
-	light_index_create(hash_table, HASH_INDEX_EXTENT_SIZE,
-			   memtx_index_extent_alloc, memtx_index_extent_free,
-			   NULL, this->key_def);
+	hash_table_api<HashTable>::create(hash_table, this->key_def);
 }
 
-MemtxHash::~MemtxHash()
+template <class HashTable>
+MemtxHashBase<HashTable>::~MemtxHashBase()
 {
-	light_index_destroy(hash_table);
+	hash_table_api<HashTable>::destroy(hash_table);
 	free(hash_table);
 }
 
+template <class HashTable>
 void
-MemtxHash::reserve(uint32_t size_hint)
+MemtxHashBase<HashTable>::reserve(uint32_t size_hint)
 {
-	(void)size_hint;
+	if (hash_table_reserve(hash_table, size_hint) != 0) {
+		tnt_raise(OutOfMemory, (ssize_t)size_hint,
+			  "hash_table", "reserve");
+	}
 }
 
+template <class HashTable>
 size_t
-MemtxHash::size() const
+MemtxHashBase<HashTable>::size() const
 {
 	return hash_table->count;
 }
 
+template <class HashTable>
 size_t
-MemtxHash::bsize() const
+MemtxHashBase<HashTable>::bsize() const
 {
         return matras_extent_count(&hash_table->mtable) * HASH_INDEX_EXTENT_SIZE;
 }
 
+template <class HashTable>
 struct tuple *
-MemtxHash::random(uint32_t rnd) const
+MemtxHashBase<HashTable>::random(uint32_t rnd) const
 {
+	typedef hash_table_api<HashTable> ht;
 	if (hash_table->count == 0)
 		return NULL;
 	rnd %= (hash_table->table_size);
-	while (!light_index_pos_valid(hash_table, rnd)) {
+	while (!ht::pos_valid(hash_table, rnd)) {
 		rnd++;
 		rnd %= (hash_table->table_size);
 	}
-	return light_index_get(hash_table, rnd);
+	return ht::get(hash_table, rnd);
 }
 
+template <class HashTable>
 struct tuple *
-MemtxHash::findByKey(const char *key, uint32_t part_count) const
+MemtxHashBase<HashTable>::findByKey(const char *key, uint32_t part_count) const
 {
+	typedef hash_table_api<HashTable> ht;
 	assert(key_def->opts.is_unique && part_count == key_def->part_count);
 	(void) part_count;
 
 	struct tuple *ret = NULL;
 	uint32_t h = key_hash(key, key_def);
-	uint32_t k = light_index_find_key(hash_table, h, key);
-	if (k != light_index_end)
-		ret = light_index_get(hash_table, k);
+	hash_t k = ht::find_key(hash_table, h, key);
+	if (k != ht::end)
+		ret = ht::get(hash_table, k);
 	return ret;
 }
 
+template <class HashTable>
+void
+MemtxHashBase<HashTable>::findByKeys(const char **keys, uint32_t key_count,
+				     struct tuple **result) const
+{
+	typedef hash_table_api<HashTable> ht;
+	assert(key_def->opts.is_unique);
+	/*
+	 * Hash a group of keys and prefetch their chains first,
+	 * so that the cache misses of the group are served in
+	 * parallel while the rest of the keys are hashed.
+	 */
+	enum { GROUP_SIZE = 16 };
+	uint32_t hashes[GROUP_SIZE];
+	for (uint32_t base = 0; base < key_count; base += GROUP_SIZE) {
+		uint32_t group = MIN((uint32_t) GROUP_SIZE, key_count - base);
+		for (uint32_t i = 0; i < group; i++) {
+			hashes[i] = key_hash(keys[base + i], key_def);
+			ht::prefetch(hash_table, hashes[i]);
+		}
+		for (uint32_t i = 0; i < group; i++) {
+			hash_t k = ht::find_key(hash_table, hashes[i],
+						keys[base + i]);
+			result[base + i] = k != ht::end ?
+					   ht::get(hash_table, k) : NULL;
+		}
+	}
+}
+
+template <class HashTable>
 struct tuple *
-MemtxHash::replace(struct tuple *old_tuple, struct tuple *new_tuple,
-		   enum dup_replace_mode mode)
+MemtxHashBase<HashTable>::replace(struct tuple *old_tuple,
+				  struct tuple *new_tuple,
+				  enum dup_replace_mode mode)
 {
+	typedef hash_table_api<HashTable> ht;
 	uint32_t errcode;
 
 	if (new_tuple) {
 		uint32_t h = tuple_hash(new_tuple, key_def);
 		struct tuple *dup_tuple = NULL;
-		hash_t pos = light_index_replace(hash_table, h, new_tuple, &dup_tuple);
-		if (pos == light_index_end)
-			pos = light_index_insert(hash_table, h, new_tuple);
+		hash_t pos = ht::replace(hash_table, h, new_tuple, &dup_tuple);
+		if (pos == ht::end)
+			pos = ht::insert(hash_table, h, new_tuple);
 
 		ERROR_INJECT(ERRINJ_INDEX_ALLOC,
 		{
-			light_index_delete(hash_table, pos);
-			pos = light_index_end;
+			ht::remove(hash_table, pos);
+			pos = ht::end;
 		});
 
-		if (pos == light_index_end) {
+		if (pos == ht::end) {
 			tnt_raise(OutOfMemory, (ssize_t)hash_table->count,
 				  "hash_table", "key");
 		}
 		errcode = replace_check_dup(old_tuple, dup_tuple, mode);
 
 		if (errcode) {
-			light_index_delete(hash_table, pos);
+			ht::remove(hash_table, pos);
 			if (dup_tuple) {
-				uint32_t pos = light_index_insert(hash_table, h, dup_tuple);
-				if (pos == light_index_end) {
+				hash_t pos = ht::insert(hash_table, h, dup_tuple);
+				if (pos == ht::end) {
 					panic("Failed to allocate memory in "
 					      "recover of int hash_table");
 				}
@@ -320,59 +497,66 @@ MemtxHash::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 
 	if (old_tuple) {
 		uint32_t h = tuple_hash(old_tuple, key_def);
-		int res = light_index_delete_value(hash_table, h, old_tuple);
+		int res = ht::remove_value(hash_table, h, old_tuple);
 		assert(res == 0); (void) res;
 	}
 	return old_tuple;
 }
 
+template <class HashTable>
 struct iterator *
-MemtxHash::allocIterator() const
+MemtxHashBase<HashTable>::allocIterator() const
 {
-	struct hash_iterator *it = (struct hash_iterator *)
-			calloc(1, sizeof(*it));
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) calloc(1, sizeof(*it));
 	if (it == NULL) {
-		tnt_raise(OutOfMemory, sizeof(struct hash_iterator),
+		tnt_raise(OutOfMemory, sizeof(*it),
 			  "MemtxHash", "iterator");
 	}
 
-	it->base.next = hash_iterator_ge;
-	it->base.free = hash_iterator_free;
+	it->base.next = hash_iterator_ge<HashTable>;
+	it->base.free = hash_iterator_free<HashTable>;
 	it->hash_table = hash_table;
-	light_index_iterator_begin(it->hash_table, &it->iterator);
+	typedef hash_table_api<HashTable> ht;
+	ht::iterator_begin(it->hash_table, &it->iterator);
 	return (struct iterator *) it;
 }
 
+template <class HashTable>
 void
-MemtxHash::initIterator(struct iterator *ptr, enum iterator_type type,
-			const char *key, uint32_t part_count) const
+MemtxHashBase<HashTable>::initIterator(struct iterator *ptr,
+				       enum iterator_type type,
+				       const char *key,
+				       uint32_t part_count) const
 {
+	typedef hash_table_api<HashTable> ht;
 	assert(part_count == 0 || key != NULL);
 	(void) part_count;
-	assert(ptr->free == hash_iterator_free);
+	assert(ptr->free == hash_iterator_free<HashTable>);
 
-	struct hash_iterator *it = (struct hash_iterator *) ptr;
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) ptr;
 
 	switch (type) {
 	case ITER_GT:
 		if (part_count != 0) {
-			light_index_iterator_key(it->hash_table, &it->iterator,
-					    key_hash(key, key_def), key);
-			it->base.next = hash_iterator_gt;
+			ht::iterator_key(it->hash_table, &it->iterator,
+					 key_hash(key, key_def), key);
+			it->base.next = hash_iterator_gt<HashTable>;
 		} else {
-			light_index_iterator_begin(it->hash_table, &it->iterator);
-			it->base.next = hash_iterator_ge;
+			ht::iterator_begin(it->hash_table, &it->iterator);
+			it->base.next = hash_iterator_ge<HashTable>;
 		}
 		break;
 	case ITER_ALL:
-		light_index_iterator_begin(it->hash_table, &it->iterator);
-		it->base.next = hash_iterator_ge;
+		ht::iterator_begin(it->hash_table, &it->iterator);
+		it->base.next = hash_iterator_ge<HashTable>;
 		break;
 	case ITER_EQ:
 		assert(part_count > 0);
-		light_index_iterator_key(it->hash_table, &it->iterator,
-				         key_hash(key, key_def), key);
-		it->base.next = hash_iterator_eq;
+		ht::iterator_key(it->hash_table, &it->iterator,
+				 key_hash(key, key_def), key);
+		it->base.next = hash_iterator_eq<HashTable>;
 		break;
 	default:
 		return Index::initIterator(ptr, type, key, part_count);
@@ -383,22 +567,31 @@ MemtxHash::initIterator(struct iterator *ptr, enum iterator_type type,
  * Create a read view for iterator so further index modifications
  * will not affect the iterator iteration.
  */
+template <class HashTable>
 void
-MemtxHash::createReadViewForIterator(struct iterator *iterator)
+MemtxHashBase<HashTable>::createReadViewForIterator(struct iterator *iterator)
 {
-	struct hash_iterator *it = (struct hash_iterator *) iterator;
-	light_index_iterator_freeze(it->hash_table, &it->iterator);
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) iterator;
+	typedef hash_table_api<HashTable> ht;
+	ht::iterator_freeze(it->hash_table, &it->iterator);
 }
 
 /**
  * Destroy a read view of an iterator. Must be called for iterators,
  * for which createReadViewForIterator was called.
  */
+template <class HashTable>
 void
-MemtxHash::destroyReadViewForIterator(struct iterator *iterator)
+MemtxHashBase<HashTable>::destroyReadViewForIterator(struct iterator *iterator)
 {
-	struct hash_iterator *it = (struct hash_iterator *) iterator;
-	light_index_iterator_destroy(it->hash_table, &it->iterator);
+	struct hash_iterator<HashTable> *it =
+		(struct hash_iterator<HashTable> *) iterator;
+	typedef hash_table_api<HashTable> ht;
+	ht::iterator_destroy(it->hash_table, &it->iterator);
 }
 
+template class MemtxHashBase<struct light_index_core>;
+template class MemtxHashBase<struct swiss_index_core>;
+
 /* }}} */
@@ -34,17 +34,26 @@
 #include "memtx_index.h"
 
 struct light_index_core;
+struct swiss_index_core;
 
-class MemtxHash: public MemtxIndex {
+/**
+ * HASH index over a hash table with the light.h interface:
+ * light_index_core (salad/light.h) or swiss_index_core
+ * (salad/swiss.h).
+ */
+template <class HashTable>
+class MemtxHashBase: public MemtxIndex {
 public:
-	MemtxHash(struct key_def *key_def);
-	virtual ~MemtxHash() override;
+	MemtxHashBase(struct key_def *key_def);
+	virtual ~MemtxHashBase() override;
 
 	virtual void reserve(uint32_t size_hint) override;
 	virtual size_t size() const override;
 	virtual struct tuple *random(uint32_t rnd) const override;
 	virtual struct tuple *findByKey(const char *key,
 					uint32_t part_count) const override;
+	virtual void findByKeys(const char **keys, uint32_t key_count,
+				struct tuple **result) const override;
 	virtual struct tuple *replace(struct tuple *old_tuple,
 				      struct tuple *new_tuple,
 				      enum dup_replace_mode mode) override;
@@ -69,7 +78,19 @@ public:
 	virtual size_t bsize() const override;
 
 protected:
-	struct light_index_core *hash_table;
+	HashTable *hash_table;
 };
 
+extern template class MemtxHashBase<struct light_index_core>;
+extern template class MemtxHashBase<struct swiss_index_core>;
+
+typedef MemtxHashBase<struct light_index_core> MemtxHash;
+
+/**
+ * HASH index over a swiss table, created with the 'swiss' index
+ * option. Faster lookups, especially misses, for more memory and
+ * a full rehash on growth.
+ */
+typedef MemtxHashBase<struct swiss_index_core> MemtxSwissHash;
+
 #endif /* TARANTOOL_BOX_MEMTX_HASH_H_INCLUDED */
@@ -87,7 +87,17 @@ MemtxIndex::count(enum iterator_type type, const char *key,
 }
 
 void
-index_build(MemtxIndex *index, MemtxIndex *pk)
+MemtxIndex::initIteratorWithOffset(struct iterator *iterator,
+				   enum iterator_type type, const char *key,
+				   uint32_t part_count, uint32_t offset) const
+{
+	initIterator(iterator, type, key, part_count);
+	while (offset > 0 && iterator->next(iterator) != NULL)
+		offset--;
+}
+
+void
+index_build_fill(MemtxIndex *index, MemtxIndex *pk)
 {
 	uint32_t n_tuples = pk->size();
 	uint32_t estimated_tuples = n_tuples * 1.2;
@@ -106,6 +116,11 @@ index_build(MemtxIndex *index, MemtxIndex *pk)
 	struct tuple *tuple;
 	while ((tuple = it->next(it)))
 		index->buildNext(tuple);
+}
 
+void
+index_build(MemtxIndex *index, MemtxIndex *pk)
+{
+	index_build_fill(index, pk);
 	index->endBuild();
 }
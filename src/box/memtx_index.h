@@ -48,6 +48,18 @@ public:
 	virtual size_t count(enum iterator_type type, const char *key,
 			     uint32_t part_count) const override;
 
+	/**
+	 * Initialize an iterator and skip @a offset tuples, so
+	 * that the first call of next() returns the tuple at
+	 * this offset. The default implementation just fetches
+	 * and drops the tuples.
+	 */
+	virtual void initIteratorWithOffset(struct iterator *iterator,
+					    enum iterator_type type,
+					    const char *key,
+					    uint32_t part_count,
+					    uint32_t offset) const;
+
 	inline struct iterator *position() const
 	{
 		if (m_position == NULL)
@@ -75,6 +87,14 @@ protected:
 	mutable struct iterator *m_position;
 };
 
+/**
+ * Begin building this index based on the contents of another
+ * index: pass all its tuples to buildNext(). The build must
+ * be finished with endBuild().
+ */
+void
+index_build_fill(MemtxIndex *index, MemtxIndex *pk);
+
 /** Build this index based on the contents of another index. */
 void
 index_build(MemtxIndex *index, MemtxIndex *pk);
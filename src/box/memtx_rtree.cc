@@ -317,3 +317,28 @@ MemtxRTree::beginBuild()
 	rtree_purge(&m_tree);
 }
 
+void
+MemtxRTree::reserve(uint32_t size_hint)
+{
+	/* Only a hint, buildNext() grows the buffer as needed. */
+	(void) rtree_bulk_reserve(&m_tree, size_hint);
+}
+
+void
+MemtxRTree::buildNext(struct tuple *tuple)
+{
+	struct rtree_rect rect;
+	extract_rectangle(&rect, tuple, key_def);
+	if (rtree_bulk_add(&m_tree, &rect, tuple) != 0) {
+		tnt_raise(OutOfMemory, m_tree.page_branch_size,
+			  "MemtxRTree", "buildNext");
+	}
+}
+
+void
+MemtxRTree::endBuild()
+{
+	/* Pack the collected records into full pages at once. */
+	rtree_bulk_load(&m_tree);
+}
+
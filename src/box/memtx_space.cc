@@ -29,6 +29,7 @@
  * SUCH DAMAGE.
  */
 #include "memtx_space.h"
+#include "memtx_engine.h"
 #include "space.h"
 #include "iproto_constants.h"
 #include "txn.h"
@@ -38,6 +39,7 @@
 #include "memtx_tree.h"
 #include "memtx_rtree.h"
 #include "memtx_bitset.h"
+#include "memtx_art.h"
 #include "port.h"
 
 /**
@@ -60,6 +62,12 @@ MemtxSpace::MemtxSpace(Engine *e)
 	: Handler(e)
 {
 	replace = memtx_replace_no_keys;
+	stailq_create(&deleted_keys);
+}
+
+MemtxSpace::~MemtxSpace()
+{
+	((MemtxEngine *) engine)->dropDeletedKeys(&deleted_keys);
 }
 
 static inline enum dup_replace_mode
@@ -90,7 +98,8 @@ memtx_txn_add_undo(struct txn *txn, struct tuple *old_tuple,
 void
 MemtxSpace::applySnapshotRow(struct space *space, struct request *request)
 {
-	assert(request->type == IPROTO_INSERT);
+	if (request->type != IPROTO_INSERT)
+		return applyIncrementalRow(space, request);
 	struct tuple *new_tuple = tuple_new(space->format, request->tuple,
 					    request->tuple_end);
 	if (new_tuple == NULL)
@@ -120,6 +129,64 @@ MemtxSpace::applySnapshotRow(struct space *space, struct request *request)
 	/** The new tuple is referenced by the primary key. */
 }
 
+void
+MemtxSpace::applyIncrementalRow(struct space *space, struct request *request)
+{
+	if (request->type != IPROTO_REPLACE &&
+	    request->type != IPROTO_DELETE) {
+		tnt_raise(ClientError, ER_UNKNOWN_REQUEST_TYPE,
+			  (uint32_t) request->type);
+	}
+	/*
+	 * All rows of the previous snapshots of this space have
+	 * been loaded, so the bulk load of the primary key can
+	 * be finished.
+	 */
+	memtx_space_end_build(space);
+	if (!rlist_empty(&space->on_replace)) {
+		/*
+		 * Emulate transactions for system spaces with triggers
+		 */
+		assert(in_txn() == NULL);
+		request->header->server_id = 0;
+		struct txn *txn = txn_begin_stmt(space);
+		try {
+			if (request->type == IPROTO_REPLACE)
+				executeReplace(txn, space, request);
+			else
+				executeDelete(txn, space, request);
+			txn_commit_stmt(txn, request);
+		} catch (Exception *e) {
+			say_error("rollback: %s", e->errmsg);
+			txn_rollback_stmt();
+			throw;
+		}
+		return;
+	}
+	struct tuple *old_tuple;
+	if (request->type == IPROTO_REPLACE) {
+		struct tuple *new_tuple = tuple_new(space->format,
+						    request->tuple,
+						    request->tuple_end);
+		if (new_tuple == NULL)
+			diag_raise();
+		TupleRef ref(new_tuple);
+		old_tuple = this->replace(space, NULL, new_tuple,
+					  DUP_REPLACE_OR_INSERT);
+	} else {
+		Index *pk = index_find_unique(space, 0);
+		const char *key = request->key;
+		uint32_t part_count = mp_decode_array(&key);
+		old_tuple = pk->findByKey(key, part_count);
+		if (old_tuple == NULL)
+			return;
+		this->replace(space, old_tuple, NULL, DUP_REPLACE_OR_INSERT);
+	}
+	/* There is no transaction to free the old tuple on commit. */
+	if (old_tuple != NULL)
+		tuple_unref(old_tuple);
+}
+
 struct tuple *
 MemtxSpace::executeReplace(struct txn *txn, struct space *space,
 			   struct request *request)
@@ -279,6 +346,8 @@ MemtxSpace::createIndex(struct space *space, struct key_def *key_def_arg)
 	(void) space;
 	switch (key_def_arg->type) {
 	case HASH:
+		if (key_def_arg->opts.swiss)
+			return new MemtxSwissHash(key_def_arg);
 		return new MemtxHash(key_def_arg);
 	case TREE:
 		return new MemtxTree(key_def_arg);
@@ -286,6 +355,8 @@ MemtxSpace::createIndex(struct space *space, struct key_def *key_def_arg)
 		return new MemtxRTree(key_def_arg);
 	case BITSET:
 		return new MemtxBitset(key_def_arg);
+	case ART:
+		return new MemtxArt(key_def_arg);
 	default:
 		unreachable();
 		return NULL;
@@ -337,14 +408,10 @@ MemtxSpace::executeSelect(struct txn *, struct space *space,
 		diag_raise();
 
 	struct iterator *it = index->position();
-	index->initIterator(it, type, key, part_count);
+	index->initIteratorWithOffset(it, type, key, part_count, offset);
 
 	struct tuple *tuple;
 	while ((tuple = it->next(it)) != NULL) {
-		if (offset > 0) {
-			offset--;
-			continue;
-		}
 		if (limit == found++)
 			break;
 		port_add_tuple(port, tuple);
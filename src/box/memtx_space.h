@@ -31,6 +31,7 @@
  * SUCH DAMAGE.
  */
 #include "engine.h"
+#include "salad/stailq.h"
 
 typedef struct tuple *
 (*engine_replace_f)(struct space *, struct tuple *, struct tuple *,
@@ -44,14 +45,16 @@ memtx_replace_no_keys(struct space *space,
 
 struct MemtxSpace: public Handler {
 	MemtxSpace(Engine *e);
-	virtual ~MemtxSpace()
-	{
-		/* do nothing */
-		/* engine->close(this); */
-	}
+	virtual ~MemtxSpace();
 	virtual void
 	applySnapshotRow(struct space *space,
 			 struct request *request) override;
+	/**
+	 * Apply a REPLACE or DELETE row of an incremental
+	 * snapshot on top of the previous snapshots.
+	 */
+	void
+	applyIncrementalRow(struct space *space, struct request *request);
 	virtual struct tuple *
 	executeReplace(struct txn *txn, struct space *space,
 		       struct request *request) override;
@@ -162,6 +165,13 @@ public:
 	 * primary key.
 	 */
 	engine_replace_f replace;
+	/**
+	 * Keys of the tuples which were in the last snapshot and
+	 * have been deleted since, to be written to the next
+	 * incremental snapshot, @sa MemtxEngine::commit().
+	 * A list of struct memtx_deleted_key.
+	 */
+	struct stailq deleted_keys;
 };
 
 #endif /* TARANTOOL_BOX_MEMTX_SPACE_H_INCLUDED */
@@ -39,14 +39,76 @@
 
 /* {{{ Utilities. *************************************************/
 
-struct key_data
+uint64_t
+memtx_tree_hint(const char *field, struct key_def *key_def)
 {
-	const char *key;
-	uint32_t part_count;
-};
+	switch (key_def->parts[0].type) {
+	case FIELD_TYPE_UNSIGNED:
+		if (mp_typeof(*field) != MP_UINT)
+			break;
+		return mp_decode_uint(&field);
+	case FIELD_TYPE_INTEGER:
+		if (mp_typeof(*field) == MP_UINT) {
+			uint64_t val = mp_decode_uint(&field);
+			/* Values >= INT64_MAX share the top hint. */
+			if (val > INT64_MAX)
+				return UINT64_MAX;
+			return val | (1ULL << 63);
+		} else if (mp_typeof(*field) == MP_INT) {
+			int64_t val = mp_decode_int(&field);
+			return (uint64_t) val ^ (1ULL << 63);
+		}
+		break;
+	case FIELD_TYPE_STRING: {
+		if (mp_typeof(*field) != MP_STR)
+			break;
+		uint32_t len;
+		const unsigned char *str =
+			(const unsigned char *) mp_decode_str(&field, &len);
+		uint64_t hint = 0;
+		for (uint32_t i = 0; i < sizeof(hint); i++) {
+			hint <<= 8;
+			if (i < len)
+				hint |= str[i];
+		}
+		return hint;
+	}
+	default:
+		break;
+	}
+	return 0;
+}
+
+uint64_t
+memtx_tree_tuple_hint(const struct tuple *tuple, struct key_def *key_def)
+{
+	const char *field = tuple_field(tuple, key_def->parts[0].fieldno);
+	return field != NULL ? memtx_tree_hint(field, key_def) : 0;
+}
+
+/** Make a tree element of a tuple. */
+static inline struct memtx_tree_data
+memtx_tree_elem(struct tuple *tuple, struct key_def *key_def)
+{
+	struct memtx_tree_data data;
+	data.tuple = tuple;
+	data.hint = memtx_tree_tuple_hint(tuple, key_def);
+	return data;
+}
+
+/** Initialize a search key, computing its hint. */
+static inline void
+key_data_create(struct key_data *key_data, const char *key,
+		uint32_t part_count, struct key_def *key_def)
+{
+	key_data->key = key;
+	key_data->part_count = part_count;
+	key_data->hint = part_count > 0 ? memtx_tree_hint(key, key_def) : 0;
+}
 
 int
-memtx_tree_compare(const tuple *a, const tuple *b, struct key_def *key_def)
+memtx_tree_compare_tuples(const tuple *a, const tuple *b,
+			  struct key_def *key_def)
 {
 	int r = tuple_compare(a, b, key_def);
 	if (r == 0 && !key_def->opts.is_unique)
@@ -55,8 +117,8 @@ memtx_tree_compare(const tuple *a, const tuple *b, struct key_def *key_def)
 }
 
 int
-memtx_tree_compare_key(const tuple *a, const struct key_data *key_data,
-		       struct key_def *key_def)
+memtx_tree_compare_tuple_key(const tuple *a, const struct key_data *key_data,
+			     struct key_def *key_def)
 {
 	return tuple_compare_with_key(a, key_data->key,
 				      key_data->part_count, key_def);
@@ -65,8 +127,8 @@ memtx_tree_compare_key(const tuple *a, const struct key_data *key_data,
 int
 memtx_tree_qcompare(const void* a, const void *b, void *c)
 {
-	return memtx_tree_compare(*(struct tuple **)a,
-		*(struct tuple **)b, (struct key_def *)c);
+	return memtx_tree_compare(*(struct memtx_tree_data *)a,
+		*(struct memtx_tree_data *)b, (struct key_def *)c);
 }
 
 /* {{{ MemtxTree Iterators ****************************************/
@@ -105,29 +167,29 @@ static struct tuple *
 tree_iterator_fwd(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_data *res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_bwd(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_data *res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_prev(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_fwd_check_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_data *res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	if (memtx_tree_compare_key(*res, &it->key_data, it->key_def) != 0) {
@@ -135,19 +197,19 @@ tree_iterator_fwd_check_equality(struct iterator *iterator)
 		return 0;
 	}
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_fwd_check_next_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_data *res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
 	iterator->next = tree_iterator_fwd_check_equality;
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
@@ -163,7 +225,7 @@ static struct tuple *
 tree_iterator_bwd_check_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_data *res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	if (memtx_tree_compare_key(*res, &it->key_data, it->key_def) != 0) {
@@ -171,7 +233,7 @@ tree_iterator_bwd_check_equality(struct iterator *iterator)
 		return 0;
 	}
 	memtx_tree_iterator_prev(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
@@ -188,7 +250,7 @@ tree_iterator_bwd_skip_one_check_next_equality(struct iterator *iterator)
 
 MemtxTree::MemtxTree(struct key_def *key_def_arg)
 	: MemtxIndex(key_def_arg), build_array(0), build_array_size(0),
-	  build_array_alloc_size(0)
+	  build_array_alloc_size(0), build_array_is_sorted(false)
 {
 	memtx_index_arena_init();
 	memtx_tree_create(&tree, key_def,
@@ -208,6 +270,62 @@ MemtxTree::size() const
 	return memtx_tree_size(&tree);
 }
 
+size_t
+MemtxTree::count(enum iterator_type type, const char *key,
+		 uint32_t part_count) const
+{
+	if (type == ITER_ALL)
+		return size(); /* the key is ignored, as in MemtxIndex */
+	size_t begin, end;
+	if (!rankRange(type, key, part_count, &begin, &end))
+		return MemtxIndex::count(type, key, part_count);
+	return end - begin;
+}
+
+bool
+MemtxTree::rankRange(enum iterator_type type, const char *key,
+		     uint32_t part_count, size_t *begin, size_t *end) const
+{
+	size_t size = memtx_tree_size(&tree);
+	if (part_count == 0) {
+		/* Same downgrade as in initIterator(). */
+		if (type < 0 || type > ITER_GT)
+			return false;
+		*begin = 0;
+		*end = size;
+		return true;
+	}
+	struct key_data key_data;
+	key_data_create(&key_data, key, part_count, key_def);
+	switch (type) {
+	case ITER_EQ:
+	case ITER_REQ:
+		*begin = memtx_tree_lower_bound_rank(&tree, &key_data);
+		*end = memtx_tree_upper_bound_rank(&tree, &key_data);
+		break;
+	case ITER_ALL:
+	case ITER_GE:
+		*begin = memtx_tree_lower_bound_rank(&tree, &key_data);
+		*end = size;
+		break;
+	case ITER_GT:
+		*begin = memtx_tree_upper_bound_rank(&tree, &key_data);
+		*end = size;
+		break;
+	case ITER_LE:
+		*begin = 0;
+		*end = memtx_tree_upper_bound_rank(&tree, &key_data);
+		break;
+	case ITER_LT:
+		*begin = 0;
+		*end = memtx_tree_lower_bound_rank(&tree, &key_data);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
 size_t
 MemtxTree::bsize() const
 {
@@ -217,8 +335,8 @@ MemtxTree::bsize() const
 struct tuple *
 MemtxTree::random(uint32_t rnd) const
 {
-	struct tuple **res = memtx_tree_random(&tree, rnd);
-	return res ? *res : 0;
+	struct memtx_tree_data *res = memtx_tree_random(&tree, rnd);
+	return res ? res->tuple : 0;
 }
 
 struct tuple *
@@ -227,10 +345,36 @@ MemtxTree::findByKey(const char *key, uint32_t part_count) const
 	assert(key_def->opts.is_unique && part_count == key_def->part_count);
 
 	struct key_data key_data;
-	key_data.key = key;
-	key_data.part_count = part_count;
-	struct tuple **res = memtx_tree_find(&tree, &key_data);
-	return res ? *res : 0;
+	key_data_create(&key_data, key, part_count, key_def);
+	struct memtx_tree_data *res = memtx_tree_find(&tree, &key_data);
+	return res ? res->tuple : 0;
+}
+
+void
+MemtxTree::findByKeys(const char **keys, uint32_t key_count,
+		      struct tuple **result) const
+{
+	assert(key_def->opts.is_unique);
+	/*
+	 * Keys descend the tree together, 16 at a time, the same
+	 * group as in memtx_tree_find_many().
+	 */
+	enum { BATCH_SIZE = 16 };
+	struct key_data key_data[BATCH_SIZE];
+	struct key_data *key_ptrs[BATCH_SIZE];
+	struct memtx_tree_data *found[BATCH_SIZE];
+	for (uint32_t base = 0; base < key_count; base += BATCH_SIZE) {
+		uint32_t batch = MIN((uint32_t) BATCH_SIZE, key_count - base);
+		for (uint32_t i = 0; i < batch; i++) {
+			key_data_create(&key_data[i], keys[base + i],
+					key_def->part_count, key_def);
+			key_ptrs[i] = &key_data[i];
+		}
+		memtx_tree_find_many(&tree, key_ptrs, batch, found);
+		for (uint32_t i = 0; i < batch; i++)
+			result[base + i] = found[i] != NULL ?
+					   found[i]->tuple : NULL;
+	}
 }
 
 struct tuple *
@@ -240,31 +384,34 @@ MemtxTree::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 	uint32_t errcode;
 
 	if (new_tuple) {
-		struct tuple *dup_tuple = NULL;
+		struct memtx_tree_data new_data = memtx_tree_elem(new_tuple,
+								  key_def);
+		struct memtx_tree_data dup_data;
+		dup_data.tuple = NULL;
 
 		/* Try to optimistically replace the new_tuple. */
 		int tree_res =
-		memtx_tree_insert(&tree, new_tuple, &dup_tuple);
+		memtx_tree_insert(&tree, new_data, &dup_data);
 		if (tree_res) {
 			tnt_raise(OutOfMemory, BPS_TREE_EXTENT_SIZE,
 				  "MemtxTree", "replace");
 		}
 
-		errcode = replace_check_dup(old_tuple, dup_tuple, mode);
+		errcode = replace_check_dup(old_tuple, dup_data.tuple, mode);
 
 		if (errcode) {
-			memtx_tree_delete(&tree, new_tuple);
-			if (dup_tuple)
-				memtx_tree_insert(&tree, dup_tuple, 0);
+			memtx_tree_delete(&tree, new_data);
+			if (dup_data.tuple)
+				memtx_tree_insert(&tree, dup_data, 0);
 			struct space *sp = space_cache_find(key_def->space_id);
 			tnt_raise(ClientError, errcode, index_name(this),
 				  space_name(sp));
 		}
-		if (dup_tuple)
-			return dup_tuple;
+		if (dup_data.tuple)
+			return dup_data.tuple;
 	}
 	if (old_tuple) {
-		memtx_tree_delete(&tree, old_tuple);
+		memtx_tree_delete(&tree, memtx_tree_elem(old_tuple, key_def));
 	}
 	return old_tuple;
 }
@@ -305,8 +452,7 @@ MemtxTree::initIterator(struct iterator *iterator, enum iterator_type type,
 		type = iterator_type_is_reverse(type) ? ITER_LE : ITER_GE;
 		key = 0;
 	}
-	it->key_data.key = key;
-	it->key_data.part_count = part_count;
+	key_data_create(&it->key_data, key, part_count, key_def);
 
 	bool exact = false;
 	if (key == 0) {
@@ -355,6 +501,43 @@ MemtxTree::initIterator(struct iterator *iterator, enum iterator_type type,
 	}
 }
 
+void
+MemtxTree::initIteratorWithOffset(struct iterator *iterator,
+				  enum iterator_type type, const char *key,
+				  uint32_t part_count, uint32_t offset) const
+{
+	size_t begin, end;
+	if (offset == 0 || !rankRange(type, key, part_count, &begin, &end)) {
+		return MemtxIndex::initIteratorWithOffset(iterator, type, key,
+							  part_count, offset);
+	}
+	initIterator(iterator, type, key, part_count);
+	struct tree_iterator *it = tree_iterator(iterator);
+	if (offset >= end - begin) {
+		it->tree_iterator = memtx_tree_invalid_iterator();
+		it->base.next = tree_iterator_dummie;
+		return;
+	}
+	/*
+	 * Position the iterator right at the wanted tuple.
+	 * It is inside the matched range, so only the
+	 * following tuples need the equality check.
+	 */
+	if (iterator_type_is_reverse(type)) {
+		it->tree_iterator =
+			memtx_tree_iterator_at(&tree, end - 1 - offset);
+		it->base.next = type == ITER_REQ ?
+				tree_iterator_bwd_check_equality :
+				tree_iterator_bwd;
+	} else {
+		it->tree_iterator =
+			memtx_tree_iterator_at(&tree, begin + offset);
+		it->base.next = type == ITER_EQ ?
+				tree_iterator_fwd_check_equality :
+				tree_iterator_fwd;
+	}
+}
+
 void
 MemtxTree::beginBuild()
 {
@@ -366,8 +549,8 @@ MemtxTree::reserve(uint32_t size_hint)
 {
 	if (size_hint < build_array_alloc_size)
 		return;
-	build_array = (struct tuple**)
-		realloc(build_array, size_hint * sizeof(struct tuple *));
+	build_array = (struct memtx_tree_data *)
+		realloc(build_array, size_hint * sizeof(*build_array));
 	build_array_alloc_size = size_hint;
 }
 
@@ -375,32 +558,93 @@ void
 MemtxTree::buildNext(struct tuple *tuple)
 {
 	if (!build_array) {
-		build_array = (struct tuple**)malloc(BPS_TREE_EXTENT_SIZE);
+		build_array = (struct memtx_tree_data *)
+			malloc(BPS_TREE_EXTENT_SIZE);
 		build_array_alloc_size =
-			BPS_TREE_EXTENT_SIZE / sizeof(struct tuple*);
+			BPS_TREE_EXTENT_SIZE / sizeof(*build_array);
 	}
 	assert(build_array_size <= build_array_alloc_size);
 	if (build_array_size == build_array_alloc_size) {
 		build_array_alloc_size = build_array_alloc_size +
 					 build_array_alloc_size / 2;
-		build_array = (struct tuple**)
+		build_array = (struct memtx_tree_data *)
 			realloc(build_array,
 				build_array_alloc_size *
-				sizeof(struct tuple *));
+				sizeof(*build_array));
 	}
-	build_array[build_array_size++] = tuple;
+	build_array[build_array_size++] = memtx_tree_elem(tuple, key_def);
+}
+
+void
+MemtxTree::sortBuildRange(size_t begin, size_t end)
+{
+	assert(begin <= end && end <= build_array_size);
+	qsort_arg(build_array + begin, end - begin, sizeof(*build_array),
+		  memtx_tree_qcompare, key_def);
+}
+
+void
+MemtxTree::mergeBuildRanges(size_t range_size)
+{
+	assert(range_size > 0);
+	if (range_size >= build_array_size) {
+		build_array_is_sorted = true;
+		return;
+	}
+	struct memtx_tree_data *src = build_array;
+	struct memtx_tree_data *dst = (struct memtx_tree_data *)
+		malloc(build_array_size * sizeof(*build_array));
+	if (dst == NULL) {
+		/* endBuild() will sort the presorted ranges. */
+		return;
+	}
+	/* Merge pairs of adjacent ranges until there is one left. */
+	for (size_t width = range_size; width < build_array_size;
+	     width *= 2) {
+		for (size_t lo = 0; lo < build_array_size; lo += 2 * width) {
+			size_t mid = MIN(lo + width, build_array_size);
+			size_t hi = MIN(lo + 2 * width, build_array_size);
+			size_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi) {
+				if (memtx_tree_compare(src[j], src[i],
+						       key_def) < 0)
+					dst[k++] = src[j++];
+				else
+					dst[k++] = src[i++];
+			}
+			memcpy(dst + k, src + i, (mid - i) * sizeof(*src));
+			k += mid - i;
+			memcpy(dst + k, src + j, (hi - j) * sizeof(*src));
+		}
+		struct memtx_tree_data *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != build_array) {
+		/* The result is in the temporary array, adopt it. */
+		free(build_array);
+		build_array = src;
+		build_array_alloc_size = build_array_size;
+	} else {
+		free(dst);
+	}
+	build_array_is_sorted = true;
 }
 
 void
 MemtxTree::endBuild()
 {
-	qsort_arg(build_array, build_array_size, sizeof(struct tuple *), memtx_tree_qcompare, key_def);
+	if (!build_array_is_sorted) {
+		qsort_arg(build_array, build_array_size,
+			  sizeof(*build_array), memtx_tree_qcompare, key_def);
+	}
 	memtx_tree_build(&tree, build_array, build_array_size);
 
 	free(build_array);
 	build_array = 0;
 	build_array_size = 0;
 	build_array_alloc_size = 0;
+	build_array_is_sorted = false;
 }
 
 /**
@@ -35,22 +35,82 @@
 #include "memtx_engine.h"
 
 struct tuple;
-struct key_data;
+
+/**
+ * An element of a TREE index: a tuple and its hint, an
+ * order-preserving digest of the first key part, see
+ * memtx_tree_hint(). The tree compares hints first and
+ * only looks into the tuples if the hints are equal, so most
+ * comparisons on a lookup don't touch tuple memory.
+ */
+struct memtx_tree_data {
+	struct tuple *tuple;
+	uint64_t hint;
+};
+
+/** A search key of a TREE index. */
+struct key_data {
+	const char *key;
+	uint32_t part_count;
+	/** Hint of the first part of the key, 0 if there are no parts. */
+	uint64_t hint;
+};
+
+/**
+ * Compute the hint of a field of the first key part type:
+ * an unsigned integer such that if a < b then
+ * hint(a) <= hint(b). Unsigned values are used as is,
+ * signed ones are shifted by 2^63, strings are represented
+ * by their first 8 bytes. Other types are not hinted and
+ * get 0, so that tuples are always compared.
+ */
+uint64_t
+memtx_tree_hint(const char *field, struct key_def *key_def);
+
+/** Hint of a tuple, @sa memtx_tree_hint(). */
+uint64_t
+memtx_tree_tuple_hint(const struct tuple *tuple, struct key_def *key_def);
 
 int
-memtx_tree_compare(const struct tuple *a, const struct tuple *b, struct key_def *key_def);
+memtx_tree_compare_tuples(const struct tuple *a, const struct tuple *b,
+			  struct key_def *key_def);
 
 int
-memtx_tree_compare_key(const tuple *a, const key_data *b, struct key_def *key_def);
+memtx_tree_compare_tuple_key(const struct tuple *a, const struct key_data *b,
+			     struct key_def *key_def);
+
+static inline int
+memtx_tree_compare(struct memtx_tree_data a, struct memtx_tree_data b,
+		   struct key_def *key_def)
+{
+	if (a.hint != b.hint)
+		return a.hint < b.hint ? -1 : 1;
+	return memtx_tree_compare_tuples(a.tuple, b.tuple, key_def);
+}
+
+static inline int
+memtx_tree_compare_key(struct memtx_tree_data a, const struct key_data *b,
+		       struct key_def *key_def)
+{
+	if (b->part_count > 0 && a.hint != b->hint)
+		return a.hint < b->hint ? -1 : 1;
+	return memtx_tree_compare_tuple_key(a.tuple, b, key_def);
+}
 
 #define BPS_TREE_NAME memtx_tree
 #define BPS_TREE_BLOCK_SIZE (512)
 #define BPS_TREE_EXTENT_SIZE MEMTX_EXTENT_SIZE
 #define BPS_TREE_COMPARE(a, b, arg) memtx_tree_compare(a, b, arg)
 #define BPS_TREE_COMPARE_KEY(a, b, arg) memtx_tree_compare_key(a, b, arg)
-#define bps_tree_elem_t struct tuple *
+#define bps_tree_elem_t struct memtx_tree_data
 #define bps_tree_key_t struct key_data *
 #define bps_tree_arg_t struct key_def *
+#define BPS_TREE_NO_DEBUG
+/*
+ * Keep subtree sizes in inner blocks to count tuples in a
+ * range and skip an offset in logarithmic time.
+ */
+#define BPS_TREE_RANK
 
 #include "salad/bps_tree.h"
 
@@ -64,9 +124,13 @@ public:
 	virtual void buildNext(struct tuple *tuple) override;
 	virtual void endBuild() override;
 	virtual size_t size() const override;
+	virtual size_t count(enum iterator_type type, const char *key,
+			     uint32_t part_count) const override;
 	virtual struct tuple *random(uint32_t rnd) const override;
 	virtual struct tuple *findByKey(const char *key,
 					uint32_t part_count) const override;
+	virtual void findByKeys(const char **keys, uint32_t key_count,
+				struct tuple **result) const override;
 	virtual struct tuple *replace(struct tuple *old_tuple,
 				      struct tuple *new_tuple,
 				      enum dup_replace_mode mode) override;
@@ -77,6 +141,11 @@ public:
 				  enum iterator_type type,
 				  const char *key,
 				  uint32_t part_count) const override;
+	virtual void initIteratorWithOffset(struct iterator *iterator,
+					    enum iterator_type type,
+					    const char *key,
+					    uint32_t part_count,
+					    uint32_t offset) const override;
 
 	/**
 	 * Create a read view for iterator so further index modifications
@@ -89,10 +158,39 @@ public:
 	 */
 	virtual void destroyReadViewForIterator(struct iterator *iterator) override;
 
+	/*
+	 * Sorting of the tuples passed to buildNext() in other
+	 * threads, @sa memtx_build_secondary_keys(). Neither
+	 * function allocates index memory, so both can be called
+	 * from any thread between buildNext() and endBuild().
+	 * endBuild() doesn't sort the tuples again.
+	 */
+	/** Sort a range of the build array. */
+	void
+	sortBuildRange(size_t begin, size_t end);
+	/**
+	 * Merge sorted ranges of the build array, each of
+	 * @a range_size tuples, except the last one.
+	 */
+	void
+	mergeBuildRanges(size_t range_size);
+
+	/**
+	 * Find ranks of the first and the one past the last
+	 * tuple matched by an iterator, i.e. the tuples in
+	 * [*begin, *end) are those that the iterator returns.
+	 * Return false if the iterator type is not supported.
+	 */
+	bool
+	rankRange(enum iterator_type type, const char *key,
+		  uint32_t part_count, size_t *begin, size_t *end) const;
+
 // protected:
 	struct memtx_tree tree;
-	struct tuple **build_array;
+	struct memtx_tree_data *build_array;
 	size_t build_array_size, build_array_alloc_size;
+	/** Set if the build array has been sorted by mergeBuildRanges(). */
+	bool build_array_is_sorted;
 };
 
 #endif /* TARANTOOL_BOX_MEMTX_TREE_H_INCLUDED */
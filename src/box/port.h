@@ -81,6 +81,11 @@ port_destroy(struct port *port);
 void
 port_dump(struct port *port, struct obuf *out);
 
+/**
+ * Add a tuple to the port. The tuple may be NULL: such an
+ * entry stands for a key without a match in box_get_many()
+ * and is dumped as MsgPack nil.
+ */
 void
 port_add_tuple(struct port *port, struct tuple *tuple);
 
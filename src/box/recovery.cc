@@ -38,6 +38,12 @@
 #include "wal.h" /* wal_watcher */
 #include "cluster.h"
 #include "session.h"
+#include "xlog_reader.h"
+
+#if defined(HAVE_INOTIFY_INIT1)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif /* HAVE_INOTIFY_INIT1 */
 
 /*
  * Recovery subsystem
@@ -200,6 +206,39 @@ recovery_exit(struct recovery *r)
 	recovery_delete(r);
 }
 
+/**
+ * Apply a row read from the current WAL unless it has
+ * already been applied.
+ * Return true if recovery has reached stop_vclock: the row
+ * is not applied and the caller must stop reading.
+ */
+static inline bool
+recovery_apply_row(struct recovery *r, struct xstream *stream,
+		   struct xrow_header *row, struct vclock *stop_vclock,
+		   uint64_t *row_count)
+{
+	if (stop_vclock != NULL &&
+	    r->vclock.signature >= stop_vclock->signature)
+		return true;
+	int64_t current_lsn = vclock_get(&r->vclock, row->server_id);
+	if (row->lsn <= current_lsn)
+		return false; /* already applied, skip */
+
+	try {
+		xstream_write(stream, row);
+		++*row_count;
+		if (*row_count % 100000 == 0)
+			say_info("%.1fM rows processed",
+				 *row_count / 1000000.);
+	} catch (ClientError *e) {
+		say_error("can't apply row: ");
+		e->log();
+		if (r->wal_dir.panic_if_error)
+			throw;
+	}
+	return false;
+}
+
 /**
  * Read all rows in a file starting from the last position.
  * Advance the position. If end of file is reached,
@@ -223,28 +262,78 @@ recover_xlog(struct recovery *r, struct xstream *stream,
 		 * the file is fully read: it's fully read only
 		 * when EOF marker has been read, see i.eof_read
 		 */
-		if (stop_vclock != NULL &&
-		    r->vclock.signature >= stop_vclock->signature)
+		if (recovery_apply_row(r, stream, &row, stop_vclock,
+				       &row_count))
 			return;
-		int64_t current_lsn = vclock_get(&r->vclock, row.server_id);
-		if (row.lsn <= current_lsn)
-			continue; /* already applied, skip */
-
-		try {
-			xstream_write(stream, &row);
-			++row_count;
-			if (row_count % 100000 == 0)
-				say_info("%.1fM rows processed",
-					 row_count / 1000000.);
-		} catch (ClientError *e) {
-			say_error("can't apply row: ");
-			e->log();
-			if (r->wal_dir.panic_if_error)
-				throw;
+	}
+}
+
+/* {{{ Pipelined recovery of complete xlogs */
+
+/*
+ * When recovering an xlog which is known to be complete (it
+ * is not the last one in the directory), the file is read
+ * and decoded by a separate "recovery" thread, see
+ * xlog_reader.h, while tx only applies the rows.
+ *
+ * The last xlog is always read by tx using recovery->cursor,
+ * since it may be still being written to, and has to be kept
+ * open to continue in local hot standby mode.
+ */
+
+/**
+ * Same as recover_xlog(), but for a complete file, which is
+ * read and decoded in a separate thread. The file is not left
+ * open on return.
+ */
+static void
+recover_xlog_pipelined(struct recovery *r, struct xstream *stream,
+		       int64_t signature, struct vclock *stop_vclock)
+{
+	struct ipc_cond tx_cond;
+	ipc_cond_create(&tx_cond);
+	auto cond_guard = make_scoped_guard([&]{
+		ipc_cond_destroy(&tx_cond);
+	});
+	struct xlog_reader reader;
+	xlog_reader_start(&reader, "recovery", &r->wal_dir, signature, 0,
+			  &tx_cond);
+	say_info("recover from `%s'", reader.name);
+
+	uint64_t row_count = 0;
+	try {
+		struct xlog_reader_batch *batch;
+		while ((batch = xlog_reader_next(&reader)) != NULL) {
+			bool stop = false;
+			for (int i = 0; i < batch->n_rows && !stop; i++) {
+				stop = recovery_apply_row(r, stream,
+							  &batch->rows[i],
+							  stop_vclock,
+							  &row_count);
+			}
+			xlog_reader_release(&reader, batch);
+			if (stop)
+				break;
 		}
+	} catch (Exception *e) {
+		xlog_reader_stop(&reader);
+		diag_destroy(&reader.diag);
+		throw;
+	}
+	xlog_reader_stop(&reader);
+	if (!diag_is_empty(&reader.diag)) {
+		diag_move(&reader.diag, diag_get());
+		diag_raise();
+	}
+	if (reader.eof_read) {
+		say_info("done `%s'", reader.name);
+	} else {
+		say_warn("file `%s` wasn't correctly closed", reader.name);
 	}
 }
 
+/* }}} */
+
 /**
  * Find out if there are new .xlog files since the current
  * LSN, and read them all up.
@@ -320,8 +409,26 @@ recover_remaining_wals(struct recovery *r, struct xstream *stream,
 		}
 		recovery_close_log(r);
 
+		if (cord_is_main() &&
+		    vclockset_next(&r->wal_dir.index, clock) != NULL) {
+			/* Not the last file, can be read ahead. */
+			recover_xlog_pipelined(r, stream, vclock_sum(clock),
+					       stop_vclock);
+			continue;
+		}
+
 		r->is_active = true;
-		xdir_open_cursor_xc(&r->wal_dir, vclock_sum(clock), &r->cursor);
+		if (vclockset_next(&r->wal_dir.index, clock) != NULL) {
+			/*
+			 * A complete file, which is not written
+			 * to any more, can be mapped to memory.
+			 */
+			xdir_open_cursor_mmap_xc(&r->wal_dir, vclock_sum(clock),
+						 &r->cursor);
+		} else {
+			xdir_open_cursor_xc(&r->wal_dir, vclock_sum(clock),
+					    &r->cursor);
+		}
 
 		say_info("recover from `%s'", r->cursor.name);
 
@@ -376,6 +483,12 @@ recovery_finalize(struct recovery *r, struct xstream *stream)
  * In the latter mode either a change to the WAL dir itself or a change
  * in the XLOG file triggers a wakeup. The WAL dir path is set in
  * constructor. XLOG file path is set via .set_log_path().
+ *
+ * On Linux fs events are delivered by inotify directly: every
+ * block appended to the XLOG file wakes the subscriber up at once.
+ * ev_stat is only used if inotify is not available: it stat()s the
+ * files on every event and may fall back to polling them once in a
+ * few seconds, depending on the kernel and the file system.
  */
 class WalSubscription {
 public:
@@ -387,6 +500,83 @@ public:
 	struct wal_watcher watcher;
 	char dir_path[PATH_MAX];
 	char file_path[PATH_MAX];
+#if defined(HAVE_INOTIFY_INIT1)
+	/** inotify instance, -1 if not used. */
+	int inotify_fd;
+	/** Watch descriptors of the WAL dir and the XLOG file. */
+	int dir_wd;
+	int file_wd;
+	struct ev_io inotify_io;
+
+	static void inotify_cb(struct ev_loop *, struct ev_io *io, int)
+	{
+		/*
+		 * Drain the queue: all pending events are
+		 * handled by a single wakeup.
+		 */
+		char buf[4096];
+		while (read(io->fd, buf, sizeof(buf)) > 0)
+			;
+		((WalSubscription *)io->data)->wakeup();
+	}
+
+	bool inotify_start()
+	{
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd < 0)
+			return false;
+		dir_wd = inotify_add_watch(inotify_fd, dir_path,
+					   IN_CREATE | IN_MOVED_TO |
+					   IN_DELETE | IN_ONLYDIR);
+		if (dir_wd < 0) {
+			close(inotify_fd);
+			inotify_fd = -1;
+			return false;
+		}
+		ev_io_init(&inotify_io, inotify_cb, inotify_fd, EV_READ);
+		inotify_io.data = this;
+		ev_io_start(loop(), &inotify_io);
+		return true;
+	}
+
+	void inotify_stop()
+	{
+		if (inotify_fd < 0)
+			return;
+		ev_io_stop(loop(), &inotify_io);
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+
+	void inotify_set_log_path(const char *path)
+	{
+		if (path != NULL && file_wd >= 0 &&
+		    strcmp(file_path, path) == 0)
+			return;
+		if (file_wd >= 0) {
+			inotify_rm_watch(inotify_fd, file_wd);
+			file_wd = -1;
+		}
+		if (path == NULL)
+			return;
+		if ((size_t)snprintf(file_path, sizeof(file_path), "%s", path) >=
+				sizeof(file_path)) {
+
+			panic("path too long: %s", path);
+		}
+		file_wd = inotify_add_watch(inotify_fd, file_path,
+					    IN_MODIFY | IN_CLOSE_WRITE |
+					    IN_DELETE_SELF | IN_MOVE_SELF);
+		if (file_wd < 0) {
+			/*
+			 * The file is gone: the directory watch
+			 * will notice the next one.
+			 */
+			say_syserror("failed to watch %s with inotify",
+				     file_path);
+		}
+	}
+#endif /* HAVE_INOTIFY_INIT1 */
 
 	static void stat_cb(struct ev_loop *, struct ev_stat *stat, int)
 	{
@@ -421,11 +611,22 @@ public:
 		dir_stat.data = this;
 		file_stat.data = this;
 		async.data = this;
+#if defined(HAVE_INOTIFY_INIT1)
+		inotify_fd = -1;
+		dir_wd = -1;
+		file_wd = -1;
+#endif /* HAVE_INOTIFY_INIT1 */
 
 		ev_async_start(loop(), &async);
 		if (wal_set_watcher(wal, &watcher, &async) == -1) {
 			/* Fallback to fs events. */
 			ev_async_stop(loop(), &async);
+#if defined(HAVE_INOTIFY_INIT1)
+			if (inotify_start())
+				return;
+			say_syserror("failed to watch %s with inotify",
+				     dir_path);
+#endif /* HAVE_INOTIFY_INIT1 */
 			ev_stat_set(&dir_stat, dir_path, 0.0);
 			ev_stat_start(loop(), &dir_stat);
 		}
@@ -433,6 +634,9 @@ public:
 
 	~WalSubscription()
 	{
+#if defined(HAVE_INOTIFY_INIT1)
+		inotify_stop();
+#endif /* HAVE_INOTIFY_INIT1 */
 		ev_stat_stop(loop(), &file_stat);
 		ev_stat_stop(loop(), &dir_stat);
 		wal_clear_watcher(wal, &watcher);
@@ -448,6 +652,12 @@ public:
 			 */
 			return;
 		}
+#if defined(HAVE_INOTIFY_INIT1)
+		if (inotify_fd >= 0) {
+			inotify_set_log_path(path);
+			return;
+		}
+#endif /* HAVE_INOTIFY_INIT1 */
 
 		/*
 		 * Avoid toggling ev_stat if the path didn't change.
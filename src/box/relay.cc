@@ -44,6 +44,7 @@
 #include "trigger.h"
 #include "errinj.h"
 #include "xrow_io.h"
+#include "gc.h"
 
 static void
 relay_send_initial_join_row(struct xstream *stream, struct xrow_header *row);
@@ -118,7 +119,13 @@ relay_final_join(int fd, uint64_t sync, struct vclock *start_vclock,
 			       cfg_geti("panic_on_wal_error"),
 			       start_vclock);
 	vclock_copy(&relay.stop_vclock, stop_vclock);
+	relay.gc = gc_consumer_register("join", vclock_sum(start_vclock));
+	if (relay.gc == NULL) {
+		recovery_delete(relay.r);
+		diag_raise();
+	}
 	auto scope_guard = make_scoped_guard([&]{
+		gc_consumer_unregister(relay.gc);
 		recovery_delete(relay.r);
 		relay_destroy(&relay);
 	});
@@ -221,10 +228,18 @@ relay_subscribe(int fd, uint64_t sync, struct server *server,
 			       replica_clock);
 	relay.r->server_id = server->id;
 	relay.wal_dir_rescan_delay = cfg_getd("wal_dir_rescan_delay");
+	char name[GC_NAME_MAX];
+	snprintf(name, sizeof(name), "replica %s", tt_uuid_str(&server->uuid));
+	relay.gc = gc_consumer_register(name, vclock_sum(replica_clock));
+	if (relay.gc == NULL) {
+		recovery_delete(relay.r);
+		diag_raise();
+	}
 	server_set_relay(server, &relay);
 
 	auto scope_guard = make_scoped_guard([&]{
 		server_clear_relay(server);
+		gc_consumer_unregister(relay.gc);
 		recovery_delete(relay.r);
 		relay_destroy(&relay);
 	});
@@ -252,6 +267,7 @@ relay_send_initial_join_row(struct xstream *stream, struct xrow_header *row)
 	{
 		fiber_sleep(1000.0);
 	});
+	ERROR_INJECT(ERRINJ_RELAY_JOIN_DELAY, fiber_sleep(0.01));
 }
 
 static void
@@ -262,6 +278,7 @@ relay_send_final_join_row(struct xstream *stream, struct xrow_header *row)
 	struct recovery *r = relay->r;
 
 	vclock_follow(&r->vclock, row->server_id, row->lsn);
+	gc_consumer_advance(relay->gc, vclock_sum(&r->vclock));
 
 	relay_send(relay, row);
 	ERROR_INJECT(ERRINJ_RELAY,
@@ -297,4 +314,5 @@ relay_send_subscribe_row(struct xstream *stream, struct xrow_header *packet)
 	 * it here.
 	 */
 	vclock_follow(&r->vclock, packet->server_id, packet->lsn);
+	gc_consumer_advance(relay->gc, vclock_sum(&r->vclock));
 }
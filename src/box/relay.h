@@ -37,6 +37,7 @@
 
 struct server;
 struct tt_uuid;
+struct gc_consumer;
 
 /** State of a replication relay. */
 struct relay {
@@ -50,6 +51,8 @@ struct relay {
 	struct xstream stream;
 	struct vclock stop_vclock;
 	ev_tstamp wal_dir_rescan_delay;
+	/** Pins the xlogs the replica hasn't received yet. */
+	struct gc_consumer *gc;
 };
 
 /**
@@ -140,7 +140,7 @@ void
 space_delete(struct space *space)
 {
 	for (uint32_t j = 0; j < space->index_count; j++)
-		delete space->index[j];
+		index_unref(space->index[j]);
 	if (space->format)
 		tuple_format_ref(space->format, -1);
 	if (space->handler)
@@ -105,6 +105,10 @@ space_name(struct space *space) { return space->def.name; }
 static inline bool
 space_is_temporary(struct space *space) { return space->def.opts.temporary; }
 
+/** Return true if changes of the space are committed asynchronously. */
+static inline bool
+space_is_async(struct space *space) { return space->def.opts.async; }
+
 #if defined(__cplusplus)
 extern "C"
 #endif
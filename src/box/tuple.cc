@@ -30,6 +30,8 @@
  */
 #include "tuple.h"
 
+#include <sys/mman.h>
+
 #include "small/small.h"
 #include "small/quota.h"
 
@@ -43,6 +45,7 @@ struct quota memtx_quota;
 struct slab_arena memtx_arena;
 static struct slab_cache memtx_slab_cache;
 struct small_alloc memtx_alloc;
+size_t memtx_delayed_free_size;
 
 enum {
 	/** Lowest allowed slab_alloc_minimal */
@@ -172,10 +175,17 @@ tuple_delete(struct tuple *tuple)
 		       format->field_map_size;
 	char *ptr = (char *) tuple - format->field_map_size;
 	tuple_format_ref(format, -1);
-	if (!memtx_alloc.is_delayed_free_mode || tuple->version == snapshot_version)
+	/*
+	 * A tuple created after the start of a snapshot is not
+	 * in its read view and can be freed right away.
+	 */
+	if (!memtx_alloc.is_delayed_free_mode ||
+	    tuple->version == snapshot_version) {
 		smfree(&memtx_alloc, ptr, total);
-	else
+	} else {
 		smfree_delayed(&memtx_alloc, ptr, total);
+		memtx_delayed_free_size += total;
+	}
 }
 
 /**
@@ -355,9 +365,29 @@ tuple_new(struct tuple_format *format, const char *data, const char *end)
 	return new_tuple;
 }
 
+/**
+ * mmap() flags to back the tuple arena with explicit huge pages
+ * of the given size, 0 if the system has no such pages.
+ */
+static int
+tuple_arena_huge_page_flags(size_t huge_page_size)
+{
+#if defined(MAP_HUGETLB)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+	/* The page size is passed as its log2, see mmap(2). */
+	int page_shift = __builtin_ctzll(huge_page_size);
+	return MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT);
+#else
+	(void) huge_page_size;
+	return 0;
+#endif
+}
+
 void
 tuple_init(float tuple_arena_max_size, uint32_t objsize_min,
-	   uint32_t objsize_max, float alloc_factor)
+	   uint32_t objsize_max, float alloc_factor, size_t huge_page_size)
 {
 	tuple_format_init();
 
@@ -378,13 +408,42 @@ tuple_init(float tuple_arena_max_size, uint32_t objsize_min,
 	 */
 	size_t prealloc = small_align(tuple_arena_max_size * 1024
 				      * 1024 * 1024, slab_size);
+	/*
+	 * Huge pages are mapped and unmapped whole, so the arena
+	 * is also a multiple of the page size. Both sizes are
+	 * powers of two.
+	 */
+	if (huge_page_size > 0)
+		prealloc = small_align(prealloc, MAX(huge_page_size,
+						     slab_size));
 	/** Preallocate entire quota. */
 	quota_init(&memtx_quota, prealloc);
 
 	say_info("mapping %zu bytes for tuple arena...", prealloc);
 
-	if (slab_arena_create(&memtx_arena, &memtx_quota,
-			      prealloc, slab_size, MAP_PRIVATE)) {
+	/*
+	 * Index extents are carved from the same arena, so huge
+	 * pages back both tuples and indexes. Explicit huge pages
+	 * are reserved by mmap(), so if the system has not
+	 * enough of them, mmap() fails right here and the arena
+	 * falls back to regular pages, which the kernel may still
+	 * merge into transparent huge pages.
+	 */
+	int huge_page_flags = huge_page_size > 0 ?
+			      tuple_arena_huge_page_flags(huge_page_size) : 0;
+	if (huge_page_flags != 0 &&
+	    slab_arena_create(&memtx_arena, &memtx_quota, prealloc,
+			      slab_size, MAP_PRIVATE | huge_page_flags)) {
+		say_warn("failed to map tuple arena with %zu byte huge "
+			 "pages: %s, falling back to transparent huge pages",
+			 huge_page_size, strerror(errno));
+		huge_page_flags = 0;
+	}
+	if (huge_page_flags != 0) {
+		say_info("tuple arena is backed by %zu byte huge pages",
+			 huge_page_size);
+	} else if (slab_arena_create(&memtx_arena, &memtx_quota,
+				     prealloc, slab_size, MAP_PRIVATE)) {
 		if (ENOMEM == errno) {
 			panic("failed to preallocate %zu bytes: "
 			      "Cannot allocate memory, check option "
@@ -394,6 +453,13 @@ tuple_init(float tuple_arena_max_size, uint32_t objsize_min,
 			panic_syserror("failed to preallocate %zu bytes",
 				       prealloc);
 		}
+	} else if (huge_page_size > 0) {
+#if defined(MADV_HUGEPAGE)
+		if (madvise(memtx_arena.arena, prealloc, MADV_HUGEPAGE) != 0)
+			say_syserror("madvise(MADV_HUGEPAGE)");
+#else
+		say_warn("transparent huge pages are not supported");
+#endif
 	}
 	slab_cache_create(&memtx_slab_cache, &memtx_arena);
 	small_alloc_create(&memtx_alloc, &memtx_slab_cache,
@@ -418,17 +484,32 @@ tuple_free()
 	tuple_format_free();
 }
 
+/**
+ * The number of open read views: a checkpoint and initial
+ * joins may be in progress at the same time.
+ */
+static uint32_t snapshot_count;
+
 void
 tuple_begin_snapshot()
 {
 	snapshot_version++;
-	small_alloc_setopt(&memtx_alloc, SMALL_DELAYED_FREE_MODE, true);
+	if (snapshot_count++ == 0)
+		small_alloc_setopt(&memtx_alloc, SMALL_DELAYED_FREE_MODE, true);
 }
 
 void
 tuple_end_snapshot()
 {
+	assert(snapshot_count > 0);
+	if (--snapshot_count > 0)
+		return;
+	/*
+	 * The delayed objects are then freed by the allocator
+	 * a few at a time, on subsequent allocations.
+	 */
 	small_alloc_setopt(&memtx_alloc, SMALL_DELAYED_FREE_MODE, false);
+	memtx_delayed_free_size = 0;
 }
 
 box_tuple_format_t *
@@ -557,6 +557,12 @@ extern struct quota memtx_quota;
 extern struct small_alloc memtx_alloc;
 /** Tuple slab arena */
 extern struct slab_arena memtx_arena;
+/**
+ * The size of tuples freed since the start of the current
+ * snapshot: the memory can't be reused until the snapshot
+ * read view is closed, see tuple_end_snapshot().
+ */
+extern size_t memtx_delayed_free_size;
 
 /**
  * Throw and exception about tuple reference counter overflow.
@@ -736,15 +742,33 @@ tuple_to_obuf(struct tuple *tuple, struct obuf *buf);
 ssize_t
 tuple_to_buf(const struct tuple *tuple, char *buf, size_t size);
 
-/** Initialize tuple library */
+/**
+ * Initialize tuple library
+ * @param huge_page_size - back the tuple arena with huge pages
+ *  of this size if not 0.
+ */
 void
 tuple_init(float alloc_arena_max_size, uint32_t slab_alloc_minimal,
-	   uint32_t slab_alloc_maximal, float alloc_factor);
+	   uint32_t slab_alloc_maximal, float alloc_factor,
+	   size_t huge_page_size);
 
 /** Cleanup tuple library */
 void
 tuple_free();
 
+/**
+ * Generation of tuples, stored in tuple->version of every
+ * new tuple. Incremented on every snapshot, so a tuple with
+ * version >= the value taken at the start of a snapshot was
+ * created after the snapshot had started.
+ */
+extern uint32_t snapshot_version;
+
+/**
+ * Open a read view of tuples: a tuple freed from now on is
+ * not reused until all read views it may be in are closed
+ * with tuple_end_snapshot(). Read views may overlap.
+ */
 void
 tuple_begin_snapshot();
 
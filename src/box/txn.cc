@@ -201,10 +201,17 @@ txn_write_to_wal(struct txn *txn)
 	 */
 	req->n_rows = 0;
 
+	/*
+	 * A transaction is committed asynchronously only if
+	 * all spaces it writes to are asynchronous.
+	 */
+	bool is_async = true;
 	struct txn_stmt *stmt;
 	stailq_foreach_entry(stmt, &txn->stmts, next) {
 		if (stmt->row == NULL)
 			continue; /* A read (e.g. select) request */
+		if (! space_is_async(stmt->space))
+			is_async = false;
 		/*
 		 * Bump current LSN even if wal_mode = NONE, so that
 		 * snapshots still works with WAL turned off.
@@ -220,6 +227,13 @@ txn_write_to_wal(struct txn *txn)
 	if (wal == NULL) {
 		/** wal_mode = NONE or initial recovery. */
 		res = vclock_sum(&recovery->vclock);
+	} else if (is_async) {
+		/*
+		 * Don't wait for the write to complete, use
+		 * the tentative vclock as the signature.
+		 */
+		res = wal_write_async(wal, req) == 0 ?
+		      vclock_sum(&recovery->vclock) : -1;
 	} else {
 		res = wal_write(wal, req);
 	}
@@ -230,6 +230,12 @@ VinylEngine::keydefCheck(struct space *space, struct key_def *key_def)
 		          key_def->name,
 		          space_name(space));
 	}
+	if (key_def->opts.swiss) {
+		tnt_raise(ClientError, ER_MODIFY_INDEX,
+			  key_def->name,
+			  space_name(space),
+			  "swiss option is only supported by HASH index");
+	}
 }
 
 void
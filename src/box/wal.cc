@@ -33,6 +33,7 @@
 #include "vclock.h"
 #include "fiber.h"
 #include "fio.h"
+#include "ipc.h"
 #include "errinj.h"
 
 #include "xlog.h"
@@ -42,6 +43,8 @@
 
 const char *wal_mode_STRS[] = { "none", "write", "fsync", NULL };
 
+int64_t wal_async_max_lag = 16 * 1024 * 1024;
+
 /*
  * WAL writer - maintain a Write Ahead Log for every change
  * in the data state.
@@ -64,6 +67,30 @@ struct wal_writer
 	struct stailq rollback;
 	/** A pipe from 'tx' thread to 'wal' */
 	struct cpipe wal_pipe;
+	/** Asynchronous requests queued but not yet written. */
+	int64_t async_pending;
+	/** The total size of the pending asynchronous requests. */
+	int64_t async_unflushed_bytes;
+	/** Queue-to-disk latency of the last asynchronous request. */
+	double async_lag;
+	/**
+	 * The number of asynchronous requests which failed to
+	 * get written. The rows of such a request are already
+	 * committed in memory, so the WAL misses them until
+	 * the next checkpoint.
+	 */
+	int64_t async_errors;
+	/**
+	 * The number of failed asynchronous requests whose rows
+	 * have been persisted by a checkpoint. While it is less
+	 * than async_errors, asynchronous writes are refused.
+	 */
+	int64_t async_errors_checkpointed;
+	/**
+	 * Signalled whenever an asynchronous request is
+	 * completed, to wake up throttled writers.
+	 */
+	struct ipc_cond async_cond;
 	/* ----------------- wal ------------------- */
 	/** A setting from server configuration - rows_per_wal */
 	int64_t rows_per_wal;
@@ -117,6 +144,13 @@ struct wal_msg: public cmsg {
 	 * be rolled back.
 	 */
 	struct stailq rollback;
+	/**
+	 * True if the batch was started by an asynchronous
+	 * request and thus is allocated with malloc() rather
+	 * than on the fiber region, and must be freed when
+	 * the batch is completed.
+	 */
+	bool is_heap;
 };
 
 static struct wal_writer wal_writer_singleton;
@@ -141,6 +175,7 @@ wal_msg_create(struct wal_msg *batch)
 	cmsg_init(batch, wal_request_route);
 	stailq_create(&batch->commit);
 	stailq_create(&batch->rollback);
+	batch->is_heap = false;
 }
 
 static struct wal_msg *
@@ -149,6 +184,27 @@ wal_msg(struct cmsg *msg)
 	return msg->route == wal_request_route ? (struct wal_msg *) msg : NULL;
 }
 
+/**
+ * Complete an asynchronous request: nobody waits for it,
+ * so only update the lag accounting and free the request.
+ */
+static void
+tx_complete_async(struct wal_request *req)
+{
+	struct wal_writer *writer = wal;
+	if (req->res < 0) {
+		say_error("failed to write an asynchronous transaction "
+			  "to WAL, %d rows are not persisted until the "
+			  "next checkpoint", req->n_rows);
+		writer->async_errors++;
+	}
+	writer->async_pending--;
+	writer->async_unflushed_bytes -= req->approx_len;
+	writer->async_lag = ev_now(loop()) - req->start;
+	ipc_cond_broadcast(&writer->async_cond);
+	free(req);
+}
+
 /**
  * Invoke fibers waiting for their wal_request's to be
  * completed. The fibers are invoked in strict fifo order:
@@ -163,9 +219,13 @@ tx_schedule_queue(struct stailq *queue)
 	 * fiber_wakeup() is faster than fiber_call() when there
 	 * are many ready fibers.
 	 */
-	struct wal_request *req;
-	stailq_foreach_entry(req, queue, fifo)
-		fiber_wakeup(req->fiber);
+	struct wal_request *req, *next;
+	stailq_foreach_entry_safe(req, next, queue, fifo) {
+		if (req->fiber != NULL)
+			fiber_wakeup(req->fiber);
+		else
+			tx_complete_async(req);
+	}
 }
 
 /**
@@ -189,6 +249,8 @@ tx_schedule_commit(struct cmsg *msg)
 		stailq_concat(&writer->rollback, &batch->rollback);
 	}
 	tx_schedule_queue(&batch->commit);
+	if (batch->is_heap)
+		free(batch);
 }
 
 static void
@@ -235,6 +297,13 @@ wal_writer_create(struct wal_writer *writer, enum wal_mode wal_mode,
 	stailq_create(&writer->rollback);
 	cmsg_init(&writer->in_rollback, NULL);
 
+	writer->async_pending = 0;
+	writer->async_unflushed_bytes = 0;
+	writer->async_lag = 0;
+	writer->async_errors = 0;
+	writer->async_errors_checkpointed = 0;
+	ipc_cond_create(&writer->async_cond);
+
 	/* Create and fill writer->vclock. */
 	vclock_create(&writer->vclock);
 	vclock_copy(&writer->vclock, vclock);
@@ -249,6 +318,7 @@ wal_writer_destroy(struct wal_writer *writer)
 {
 	xdir_destroy(&writer->wal_dir);
 	cbus_destroy(&writer->tx_wal_bus);
+	ipc_cond_destroy(&writer->async_cond);
 	tt_pthread_mutex_destroy(&writer->watchers_mutex);
 }
 
@@ -611,6 +681,53 @@ wal_writer_f(va_list ap)
 	return 0;
 }
 
+/**
+ * Append a request to the batch waiting in the WAL pipe input
+ * or start a new batch, and flush the pipe.
+ */
+static int
+wal_push_request(struct wal_writer *writer, struct wal_request *req)
+{
+	struct wal_msg *batch;
+	if (!stailq_empty(&writer->wal_pipe.input) &&
+	    (batch = wal_msg(stailq_first_entry(&writer->wal_pipe.input,
+						struct cmsg, fifo)))) {
+
+		stailq_add_tail_entry(&batch->commit, req, fifo);
+	} else {
+		if (req->fiber != NULL) {
+			batch = (struct wal_msg *)
+				region_alloc_xc(&fiber()->gc,
+						sizeof(struct wal_msg));
+			wal_msg_create(batch);
+		} else {
+			/*
+			 * Nobody waits for an asynchronous
+			 * request, so its batch can't live on
+			 * the fiber region.
+			 */
+			batch = (struct wal_msg *) malloc(sizeof(*batch));
+			if (batch == NULL) {
+				diag_set(OutOfMemory, sizeof(*batch),
+					 "malloc", "struct wal_msg");
+				return -1;
+			}
+			wal_msg_create(batch);
+			batch->is_heap = true;
+		}
+		/*
+		 * Sic: first add a request, then push the batch,
+		 * since cpipe_push() may pass the batch to WAL
+		 * thread right away.
+		 */
+		stailq_add_tail_entry(&batch->commit, req, fifo);
+		cpipe_push(&writer->wal_pipe, batch);
+	}
+	writer->wal_pipe.n_input += req->n_rows * XROW_IOVMAX;
+	cpipe_flush_input(&writer->wal_pipe);
+	return 0;
+}
+
 /**
  * WAL writer main entry point: queue a single request
  * to be written to disk and wait until this task is completed.
@@ -634,27 +751,7 @@ wal_write(struct wal_writer *writer, struct wal_request *req)
 	req->fiber = fiber();
 	req->res = -1;
 
-	struct wal_msg *batch;
-	if (!stailq_empty(&writer->wal_pipe.input) &&
-	    (batch = wal_msg(stailq_first_entry(&writer->wal_pipe.input,
-						struct cmsg, fifo)))) {
-
-		stailq_add_tail_entry(&batch->commit, req, fifo);
-	} else {
-		batch = (struct wal_msg *)
-			region_alloc_xc(&fiber()->gc,
-					sizeof(struct wal_msg));
-		wal_msg_create(batch);
-		/*
-		 * Sic: first add a request, then push the batch,
-		 * since cpipe_push() may pass the batch to WAL
-		 * thread right away.
-		 */
-		stailq_add_tail_entry(&batch->commit, req, fifo);
-		cpipe_push(&writer->wal_pipe, batch);
-	}
-	writer->wal_pipe.n_input += req->n_rows * XROW_IOVMAX;
-	cpipe_flush_input(&writer->wal_pipe);
+	wal_push_request(writer, req);
 	/**
 	 * It's not safe to spuriously wakeup this fiber
 	 * since in that case it will ignore a possible
@@ -667,6 +764,123 @@ wal_write(struct wal_writer *writer, struct wal_request *req)
 	return req->res;
 }
 
+/**
+ * Copy a request with all its rows to a single malloc()'ed
+ * block, so that it outlives the fiber region of the
+ * committing fiber. Row bodies are flattened into one iovec.
+ */
+static struct wal_request *
+wal_request_dup(struct wal_request *req)
+{
+	size_t size = sizeof(*req) + req->n_rows *
+		(sizeof(req->rows[0]) + sizeof(struct xrow_header));
+	for (int i = 0; i < req->n_rows; i++) {
+		struct xrow_header *row = req->rows[i];
+		for (int j = 0; j < row->bodycnt; j++)
+			size += row->body[j].iov_len;
+	}
+	struct wal_request *copy = (struct wal_request *) malloc(size);
+	if (copy == NULL) {
+		diag_set(OutOfMemory, size, "malloc", "struct wal_request");
+		return NULL;
+	}
+	memcpy(copy, req, sizeof(*req));
+	struct xrow_header *rows =
+		(struct xrow_header *) (copy->rows + req->n_rows);
+	char *pos = (char *) (rows + req->n_rows);
+	for (int i = 0; i < req->n_rows; i++) {
+		struct xrow_header *row = &rows[i];
+		*row = *req->rows[i];
+		char *body = pos;
+		for (int j = 0; j < row->bodycnt; j++) {
+			memcpy(pos, row->body[j].iov_base,
+			       row->body[j].iov_len);
+			pos += row->body[j].iov_len;
+		}
+		if (row->bodycnt > 0) {
+			row->bodycnt = 1;
+			row->body[0].iov_base = body;
+			row->body[0].iov_len = pos - body;
+		}
+		copy->rows[i] = row;
+	}
+	copy->approx_len = size;
+	return copy;
+}
+
+int
+wal_write_async(struct wal_writer *writer, struct wal_request *req)
+{
+	ERROR_INJECT_RETURN(ERRINJ_WAL_IO);
+
+	if (writer->async_unflushed_bytes > wal_async_max_lag) {
+		/*
+		 * The WAL has fallen behind: throttle the
+		 * writer rather than let the queue grow
+		 * unbounded. The wait can not be interrupted,
+		 * the transaction is already prepared.
+		 */
+		bool cancellable = fiber_set_cancellable(false);
+		while (writer->async_unflushed_bytes > wal_async_max_lag)
+			ipc_cond_wait(&writer->async_cond);
+		fiber_set_cancellable(cancellable);
+	}
+	/* See the comment in wal_write(). */
+	if (! stailq_empty(&writer->rollback))
+		return -1;
+	/*
+	 * An earlier asynchronous write has failed and its
+	 * rows are missing from the WAL. Don't let new
+	 * transactions, which may depend on the lost ones,
+	 * be acknowledged until a checkpoint persists them.
+	 */
+	if (writer->async_errors > writer->async_errors_checkpointed)
+		return -1;
+
+	struct wal_request *copy = wal_request_dup(req);
+	if (copy == NULL)
+		return -1;
+	copy->fiber = NULL;
+	copy->res = -1;
+	copy->start = ev_now(loop());
+	if (wal_push_request(writer, copy) != 0) {
+		free(copy);
+		return -1;
+	}
+	writer->async_pending++;
+	writer->async_unflushed_bytes += copy->approx_len;
+	return 0;
+}
+
+void
+wal_async_stat(struct wal_writer *writer, struct wal_async_stat *stat)
+{
+	if (writer == NULL) {
+		memset(stat, 0, sizeof(*stat));
+		return;
+	}
+	stat->pending = writer->async_pending;
+	stat->unflushed_bytes = writer->async_unflushed_bytes;
+	stat->lag = writer->async_lag;
+	stat->errors = writer->async_errors;
+}
+
+int64_t
+wal_async_errors(struct wal_writer *writer)
+{
+	return writer != NULL ? writer->async_errors : 0;
+}
+
+void
+wal_async_checkpoint_errors(struct wal_writer *writer, int64_t errors)
+{
+	if (writer == NULL)
+		return;
+	assert(errors <= writer->async_errors);
+	if (errors > writer->async_errors_checkpointed)
+		writer->async_errors_checkpointed = errors;
+}
+
 int
 wal_set_watcher(struct wal_writer *writer, struct wal_watcher *watcher,
 		struct ev_async *async)
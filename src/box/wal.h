@@ -31,6 +31,7 @@
  * SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include "small/rlist.h"
 #include "salad/stailq.h"
@@ -45,6 +46,19 @@ extern const char *wal_mode_STRS[];
 
 extern struct wal_writer *wal;
 extern struct rmean *rmean_tx_wal_bus;
+/**
+ * The maximal size, in bytes, of asynchronously committed
+ * rows which are queued but not yet written to the WAL.
+ * A writer exceeding the limit waits until the WAL thread
+ * catches up.
+ *
+ * An asynchronous transaction is acknowledged before it is
+ * written, so a failed write can't be reported to the
+ * committer: the error is logged, and all subsequent
+ * asynchronous commits fail with ER_WAL_IO until
+ * box.snapshot() persists the rows missing from the WAL.
+ */
+extern int64_t wal_async_max_lag;
 
 #if defined(__cplusplus)
 
@@ -55,7 +69,14 @@ struct wal_request {
 	 * committed transaction, on error is -1
 	 */
 	int64_t res;
+	/** The waiting fiber, NULL for an asynchronous request. */
 	struct fiber *fiber;
+	/**
+	 * Asynchronous requests only: the size of the request
+	 * accounted in the WAL lag, and the time it was queued.
+	 */
+	size_t approx_len;
+	double start;
 	/* Relative position of the start of request (used for rollback) */
 	off_t start_offset;
 	/* Relative position of the end of request (used for rollback) */
@@ -67,6 +88,16 @@ struct wal_request {
 int64_t
 wal_write(struct wal_writer *writer, struct wal_request *req);
 
+/**
+ * Queue a request for writing without waiting for the
+ * write to complete. The request rows are copied, so
+ * the caller is free to discard them right away.
+ *
+ * @retval 0 the request is queued
+ * @retval -1 the WAL is in rollback or out of memory
+ */
+int
+wal_write_async(struct wal_writer *writer, struct wal_request *req);
 
 void
 wal_writer_start(enum wal_mode wal_mode, const char *wal_dirname,
@@ -112,6 +143,45 @@ void
 wal_checkpoint(struct wal_writer *writer, struct vclock *vclock,
 	       bool rotate);
 
+/** Asynchronous commit statistics, see box.stat.wal(). */
+struct wal_async_stat {
+	/** The number of queued but not yet written transactions. */
+	int64_t pending;
+	/** The size of queued but not yet written rows. */
+	int64_t unflushed_bytes;
+	/**
+	 * Time between queueing and writing of the last
+	 * asynchronous transaction, in seconds.
+	 */
+	double lag;
+	/** The number of failed asynchronous writes. */
+	int64_t errors;
+};
+
+/**
+ * Fill in asynchronous commit statistics.
+ * @param writer WAL writer, may be NULL if wal_mode = 'none'
+ */
+void
+wal_async_stat(struct wal_writer *writer, struct wal_async_stat *stat);
+
+/**
+ * Return the number of failed asynchronous writes.
+ * @param writer WAL writer, may be NULL if wal_mode = 'none'
+ */
+int64_t
+wal_async_errors(struct wal_writer *writer);
+
+/**
+ * Notify the writer that a checkpoint has persisted the rows
+ * of the first @a errors failed asynchronous writes, as
+ * returned by wal_async_errors() before the checkpoint was
+ * started. Asynchronous writes are accepted again once all
+ * failed writes are covered by a checkpoint.
+ */
+void
+wal_async_checkpoint_errors(struct wal_writer *writer, int64_t errors);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
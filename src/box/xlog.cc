@@ -32,6 +32,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <sys/mman.h>
 
 #include "fiber.h"
 #include "crc32.h"
@@ -131,6 +132,8 @@ enum {
 
 #define SERVER_UUID_KEY "Server"
 #define VCLOCK_KEY "VClock"
+#define PARTS_KEY "Parts"
+#define BASE_KEY "Base"
 
 static const char v13[] = "0.13";
 static const char v12[] = "0.12";
@@ -155,9 +158,23 @@ xlog_meta_format(const struct xlog_meta *meta, char *buf, int size)
 		return -1;
 	char *server_uuid = tt_uuid_str(&meta->server_uuid);
 	int total = snprintf(buf, size, "%s\n%s\n" SERVER_UUID_KEY ": "
-		"%s\n" VCLOCK_KEY ": %s\n\n",
-		 meta->filetype, v13, server_uuid, vstr);
+			     "%s\n" VCLOCK_KEY ": %s\n",
+			     meta->filetype, v13, server_uuid, vstr);
 	assert(total > 0);
+	/*
+	 * If the buffer is too small, the result is still
+	 * >= size, which is all the caller needs to know.
+	 */
+	if (meta->parts > 1 && total < size) {
+		total += snprintf(buf + total, size - total,
+				  PARTS_KEY ": %u\n", meta->parts);
+	}
+	if (meta->is_incremental && total < size) {
+		total += snprintf(buf + total, size - total,
+				  BASE_KEY ": %lld\n", (long long) meta->base);
+	}
+	if (total < size)
+		total += snprintf(buf + total, size - total, "\n");
 	free(vstr);
 	return total;
 }
@@ -268,6 +285,29 @@ xlog_meta_parse(struct xlog_meta *meta, const char **data,
 					  "offset %zd", off);
 				return -1;
 			}
+		} else if (memcmp(key, PARTS_KEY, key_end - key) == 0) {
+			/*
+			 * Parts: <count>
+			 */
+			char *parts_end;
+			unsigned long parts = strtoul(val, &parts_end, 10);
+			if (parts_end != val_end || parts > UINT32_MAX) {
+				tnt_error(XlogError, "can't parse parts");
+				return -1;
+			}
+			meta->parts = parts;
+		} else if (memcmp(key, BASE_KEY, key_end - key) == 0) {
+			/*
+			 * Base: <signature>
+			 */
+			char *base_end;
+			long long base = strtoll(val, &base_end, 10);
+			if (base_end != val_end || base < 0) {
+				tnt_error(XlogError, "can't parse base");
+				return -1;
+			}
+			meta->is_incremental = true;
+			meta->base = base;
 		} else {
 			/*
 			 * Unknown key
@@ -387,17 +427,23 @@ xdir_index_file(struct xdir *dir, int64_t signature)
 	return 0;
 }
 
-int
-xdir_open_cursor(struct xdir *dir, int64_t signature,
-		 struct xlog_cursor *cursor)
+static int
+xlog_cursor_openfd_impl(struct xlog_cursor *i, int fd, const char *name,
+			bool use_mmap);
+
+static int
+xdir_open_cursor_impl(struct xdir *dir, int64_t signature, uint32_t part,
+		      struct xlog_cursor *cursor, bool use_mmap)
 {
-	const char *filename = xdir_format_filename(dir, signature, NONE);
+	const char *filename = part == 0 ?
+		xdir_format_filename(dir, signature, NONE) :
+		xdir_format_part_filename(dir, signature, part, NONE);
 	int fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		diag_set(SystemError, "failed to open '%s' file", filename);
 		return -1;
 	}
-	if (xlog_cursor_openfd(cursor, fd, filename) < 0) {
+	if (xlog_cursor_openfd_impl(cursor, fd, filename, use_mmap) < 0) {
 		close(fd);
 		return -1;
 	}
@@ -427,6 +473,27 @@ xdir_open_cursor(struct xdir *dir, int64_t signature,
 	return 0;
 }
 
+int
+xdir_open_cursor(struct xdir *dir, int64_t signature,
+		 struct xlog_cursor *cursor)
+{
+	return xdir_open_cursor_impl(dir, signature, 0, cursor, false);
+}
+
+int
+xdir_open_cursor_mmap(struct xdir *dir, int64_t signature,
+		      struct xlog_cursor *cursor)
+{
+	return xdir_open_cursor_impl(dir, signature, 0, cursor, true);
+}
+
+int
+xdir_open_part_cursor_mmap(struct xdir *dir, int64_t signature,
+			   uint32_t part, struct xlog_cursor *cursor)
+{
+	return xdir_open_cursor_impl(dir, signature, part, cursor, true);
+}
+
 static int
 cmp_i64(const void *_a, const void *_b)
 {
@@ -610,6 +677,19 @@ xdir_format_filename(struct xdir *dir, int64_t signature,
 	return filename;
 }
 
+char *
+xdir_format_part_filename(struct xdir *dir, int64_t signature,
+			  uint32_t part, enum log_suffix suffix)
+{
+	static __thread char filename[PATH_MAX + 1];
+	const char *suffix_str = (suffix == INPROGRESS ?
+				  inprogress_suffix : "");
+	snprintf(filename, PATH_MAX, "%s/%020lld%s.%u%s",
+		 dir->dirname, (long long) signature,
+		 dir->filename_ext, (unsigned) part, suffix_str);
+	return filename;
+}
+
 /* }}} */
 
 
@@ -678,6 +758,7 @@ xlog_create(struct xlog *xlog, const char *name,
 	xlog->sync_is_async = false;
 	xlog->sync_interval = SNAP_SYNC_INTERVAL;
 	xlog->synced_size = 0;
+	xlog->writeback_size = 0;
 
 	xlog->is_inprogress = true;
 	xlog->is_autocommit = true;
@@ -741,6 +822,9 @@ xdir_create_xlog(struct xdir *dir, struct xlog *xlog,
 	snprintf(meta.filetype, sizeof(meta.filetype), "%s", dir->filetype);
 	meta.server_uuid = *dir->server_uuid;
 	vclock_copy(&meta.vclock, vclock);
+	meta.parts = 0;
+	meta.is_incremental = false;
+	meta.base = 0;
 
 	if (xlog_create(xlog, filename, &meta) != 0)
 		return -1;
@@ -781,15 +865,8 @@ xlog_tx_write_plain(struct xlog *log)
 	/* Encode crc32 for previous row */
 	data = mp_encode_uint(data, 0);
 	/* Encode crc32 for current row */
-	uint32_t crc32c = 0;
-	struct iovec *iov;
-	size_t offset = XLOG_FIXHEADER_SIZE;
-	for (iov = log->obuf.iov; iov->iov_len; ++iov) {
-		crc32c = crc32_calc(crc32c,
-				    (char *)iov->iov_base + offset,
-				    iov->iov_len - offset);
-		offset = 0;
-	}
+	uint32_t crc32c = crc32_calc_iov(0, log->obuf.iov, log->obuf.pos + 1,
+					 XLOG_FIXHEADER_SIZE);
 	data = mp_encode_uint(data, crc32c);
 	/*
 	 * Encode a padding, to ensure the resulting
@@ -928,28 +1005,49 @@ xlog_tx_write(struct xlog *log)
 			panic_syserror("failed to truncate xlog after write error");
 	}
 	if (log->sync_interval && log->offset >=
-	    (off_t)(log->synced_size + log->sync_interval)) {
+	    (off_t)(log->writeback_size + log->sync_interval)) {
+#ifdef HAVE_SYNC_FILE_RANGE
+		/*
+		 * Write behind: start write back of the new data
+		 * without waiting for it, and wait only for the
+		 * data written back since the previous call,
+		 * which is likely to be on disk already. So the
+		 * disk is kept busy, while the writer is blocked
+		 * only if the disk can't keep up with it.
+		 */
+		off_t start_from = SYNC_ROUND_DOWN(log->writeback_size);
+		sync_file_range(log->fd, start_from,
+				SYNC_ROUND_UP(log->offset) - start_from,
+				SYNC_FILE_RANGE_WRITE);
+		off_t sync_from = SYNC_ROUND_DOWN(log->synced_size);
+		size_t sync_len = SYNC_ROUND_UP(log->writeback_size) -
+				  sync_from;
+		if (sync_len > 0) {
+			sync_file_range(log->fd, sync_from, sync_len,
+					SYNC_FILE_RANGE_WAIT_BEFORE |
+					SYNC_FILE_RANGE_WRITE |
+					SYNC_FILE_RANGE_WAIT_AFTER);
+		}
+		log->synced_size = log->writeback_size;
+		log->writeback_size = log->offset;
+#else
 		off_t sync_from = SYNC_ROUND_DOWN(log->synced_size);
 		size_t sync_len = SYNC_ROUND_UP(log->offset) -
 				  sync_from;
 		/** sync data from cache to disk */
-#ifdef HAVE_SYNC_FILE_RANGE
-		sync_file_range(log->fd, sync_from, sync_len,
-				SYNC_FILE_RANGE_WAIT_BEFORE |
-				SYNC_FILE_RANGE_WRITE |
-				SYNC_FILE_RANGE_WAIT_AFTER);
-#else
 		fdatasync(log->fd);
+		log->synced_size = log->writeback_size = log->offset;
 #endif /* HAVE_SYNC_FILE_RANGE */
 #ifdef HAVE_POSIX_FADVISE
 		/** free page cache */
-		posix_fadvise(log->fd, sync_from, sync_len,
-			      POSIX_FADV_DONTNEED);
+		if (sync_len > 0) {
+			posix_fadvise(log->fd, sync_from, sync_len,
+				      POSIX_FADV_DONTNEED);
+		}
 #else
 		(void) sync_from;
 		(void) sync_len;
 #endif /* HAVE_POSIX_FADVISE */
-		log->synced_size = log->offset;
 	}
 	return written;
 }
@@ -1130,7 +1228,17 @@ xlog_atfork(struct xlog *xlog)
 
 /* {{{ struct xlog_cursor */
 
-#define XLOG_READ_AHEAD		(1 << 14)
+enum {
+	/** Initial and minimal xlog cursor read-ahead. */
+	XLOG_READ_AHEAD = 1 << 14,
+	/** Max xlog cursor read-ahead. */
+	XLOG_READ_AHEAD_MAX = 4 << 20,
+	/**
+	 * Drop the page cache of a consumed snapshot range
+	 * once it gets this big.
+	 */
+	XLOG_DROP_CACHE_CHUNK = 16 << 20,
+};
 
 /**
  * Ensure that at least count bytes are in read buffer
@@ -1144,12 +1252,12 @@ xlog_cursor_ensure(struct xlog_cursor *cursor, size_t count)
 {
 	if (ibuf_used(&cursor->rbuf) >= count)
 		return 0;
-	/* in-memory mode */
-	if (cursor->fd < 0)
+	/* in-memory or mmap mode, the whole file is in rbuf */
+	if (cursor->fd < 0 || cursor->map != NULL)
 		return 1;
 
 	size_t to_load = count - ibuf_used(&cursor->rbuf);
-	to_load += XLOG_READ_AHEAD;
+	to_load += cursor->read_ahead;
 
 	void *dst = ibuf_reserve(&cursor->rbuf, to_load);
 	if (dst == NULL) {
@@ -1169,6 +1277,26 @@ xlog_cursor_ensure(struct xlog_cursor *cursor, size_t count)
 	assert((size_t)readen <= to_load);
 	ibuf_alloc(&cursor->rbuf, readen);
 	cursor->read_offset += readen;
+	if ((size_t)readen == to_load) {
+		/*
+		 * The file is being read sequentially, read
+		 * bigger chunks and ask the kernel to prefetch
+		 * the next one.
+		 */
+		cursor->read_ahead = MIN(cursor->read_ahead * 2,
+					 (size_t)XLOG_READ_AHEAD_MAX);
+#ifdef HAVE_POSIX_FADVISE
+		posix_fadvise(cursor->fd, cursor->read_offset,
+			      cursor->read_ahead, POSIX_FADV_WILLNEED);
+#endif /* HAVE_POSIX_FADVISE */
+	} else {
+		/*
+		 * Reached the end of file, e.g. following
+		 * a WAL in hot standby or relay mode: don't
+		 * keep a big buffer for small appends.
+		 */
+		cursor->read_ahead = XLOG_READ_AHEAD;
+	}
 	return ibuf_used(&cursor->rbuf) >= count ? 0: 1;
 }
 
@@ -1181,6 +1309,32 @@ xlog_cursor_pos(struct xlog_cursor *cursor)
 	return cursor->read_offset - ibuf_used(&cursor->rbuf);
 }
 
+/**
+ * Drop the page cache of the consumed part of a snapshot.
+ * The snapshot is read once, at recovery or initial join,
+ * and its pages would otherwise push out more useful cache.
+ * Not done for xlogs: relays of different replicas read
+ * the same files.
+ */
+static void
+xlog_cursor_drop_cache(struct xlog_cursor *cursor)
+{
+	if (cursor->fd < 0 || strcmp(cursor->meta.filetype, "SNAP") != 0)
+		return;
+	off_t pos = SYNC_ROUND_DOWN(xlog_cursor_pos(cursor));
+	if (pos - cursor->drop_offset < XLOG_DROP_CACHE_CHUNK)
+		return;
+	size_t len = pos - cursor->drop_offset;
+	/* Mapped pages are not evicted, unmap them first. */
+	if (cursor->map != NULL)
+		madvise(cursor->map + cursor->drop_offset, len, MADV_DONTNEED);
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(cursor->fd, cursor->drop_offset, len,
+		      POSIX_FADV_DONTNEED);
+#endif /* HAVE_POSIX_FADVISE */
+	cursor->drop_offset = pos;
+}
+
 /**
  * Decompress zstd-compressed buf into cursor row block
  */
@@ -1324,14 +1478,18 @@ xlog_fixheader_decode(struct xlog_fixheader *fixheader,
 }
 
 /**
+ * Create a tx cursor. If in_place is set, plain (not
+ * compressed) rows are decoded right from the data, which
+ * must outlive the tx cursor, otherwise they are copied.
+ *
  * @retval -1 error
  * @retval 0 success
  * @retval >0 how many bytes we will have for continue
  */
-ssize_t
-xlog_tx_cursor_create(struct xlog_tx_cursor *tx_cursor,
-		      const char **data, const char *data_end,
-		      ZSTD_DStream *zdctx)
+static ssize_t
+xlog_tx_cursor_create_impl(struct xlog_tx_cursor *tx_cursor,
+			   const char **data, const char *data_end,
+			   ZSTD_DStream *zdctx, bool in_place)
 {
 	const char *rpos = *data;
 	struct xlog_fixheader fixheader;
@@ -1356,6 +1514,18 @@ xlog_tx_cursor_create(struct xlog_tx_cursor *tx_cursor,
 
 	ibuf_create(&tx_cursor->rows, &cord()->slabc,
 		    XLOG_TX_AUTOCOMMIT_THRESHOLD);
+	if (fixheader.magic == row_marker && in_place) {
+		/*
+		 * The rows buffer doesn't own any memory,
+		 * ibuf_destroy() is a no-op for it.
+		 */
+		tx_cursor->rows.rpos = (char *)rpos;
+		tx_cursor->rows.wpos = (char *)rpos + fixheader.len;
+		tx_cursor->rows.end = tx_cursor->rows.wpos;
+		*data = (char *)rpos + fixheader.len;
+		assert(*data <= data_end);
+		return 0;
+	}
 	if (fixheader.magic == row_marker) {
 		void *dst = ibuf_alloc(&tx_cursor->rows, fixheader.len);
 		if (dst == NULL) {
@@ -1380,6 +1550,15 @@ xlog_tx_cursor_create(struct xlog_tx_cursor *tx_cursor,
 	return 0;
 }
 
+ssize_t
+xlog_tx_cursor_create(struct xlog_tx_cursor *tx_cursor,
+		      const char **data, const char *data_end,
+		      ZSTD_DStream *zdctx)
+{
+	return xlog_tx_cursor_create_impl(tx_cursor, data, data_end,
+					  zdctx, false);
+}
+
 int
 xlog_tx_cursor_next_row(struct xlog_tx_cursor *tx_cursor,
 		        struct xrow_header *xrow)
@@ -1439,6 +1618,7 @@ xlog_cursor_next_tx(struct xlog_cursor *i)
 	int rc;
 	assert(i->eof_read == false);
 
+	xlog_cursor_drop_cache(i);
 	/* load at least magic to check eof */
 	rc = xlog_cursor_ensure(i, sizeof(log_magic_t));
 	if (rc < 0)
@@ -1452,9 +1632,10 @@ xlog_cursor_next_tx(struct xlog_cursor *i)
 	}
 
 	ssize_t to_load;
-	while ((to_load = xlog_tx_cursor_create(&i->tx_cursor,
+	while ((to_load = xlog_tx_cursor_create_impl(&i->tx_cursor,
 						(const char **)&i->rbuf.rpos,
-						i->rbuf.wpos, i->zdctx)) > 0) {
+						i->rbuf.wpos, i->zdctx,
+						i->map != NULL)) > 0) {
 		/* not enough data in read buffer */
 		int rc = xlog_cursor_ensure(i, ibuf_used(&i->rbuf) + to_load);
 		if (rc < 0)
@@ -1497,14 +1678,57 @@ xlog_cursor_next_row(struct xlog_cursor *cursor, struct xrow_header *xrow)
 	return rc;
 }
 
-int
-xlog_cursor_openfd(struct xlog_cursor *i, int fd, const char *name)
+/**
+ * Map the whole file and point the read buffer to the
+ * mapping. The cursor is left in the buffered mode if the
+ * file can't be mapped.
+ */
+static void
+xlog_cursor_map(struct xlog_cursor *i)
+{
+	struct stat st;
+	if (fstat(i->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size == 0)
+		return;
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			 i->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+	(void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+	i->map = (char *)map;
+	i->map_size = st.st_size;
+	/* rbuf.buf stays NULL: the buffer owns no memory. */
+	i->rbuf.rpos = i->map;
+	i->rbuf.wpos = i->map + i->map_size;
+	i->rbuf.end = i->rbuf.wpos;
+	i->read_offset = i->map_size;
+}
+
+static void
+xlog_cursor_unmap(struct xlog_cursor *i)
+{
+	if (i->map == NULL)
+		return;
+	munmap(i->map, i->map_size);
+	i->map = NULL;
+}
+
+static int
+xlog_cursor_openfd_impl(struct xlog_cursor *i, int fd, const char *name,
+			bool use_mmap)
 {
 	memset(i, 0, sizeof(*i));
 	i->fd = fd;
 	i->eof_read = false;
+	i->read_ahead = XLOG_READ_AHEAD;
 	ibuf_create(&i->rbuf, &cord()->slabc,
 		    XLOG_TX_AUTOCOMMIT_THRESHOLD << 1);
+	if (use_mmap)
+		xlog_cursor_map(i);
+#ifdef HAVE_POSIX_FADVISE
+	else
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* HAVE_POSIX_FADVISE */
 
 	ssize_t rc;
 	/*
@@ -1532,18 +1756,26 @@ xlog_cursor_openfd(struct xlog_cursor *i, int fd, const char *name)
 	return 0;
 error:
 	ibuf_destroy(&i->rbuf);
+	xlog_cursor_unmap(i);
 	return -1;
 }
 
 int
-xlog_cursor_open(struct xlog_cursor *i, const char *name)
+xlog_cursor_openfd(struct xlog_cursor *i, int fd, const char *name)
+{
+	return xlog_cursor_openfd_impl(i, fd, name, false);
+}
+
+static int
+xlog_cursor_open_impl(struct xlog_cursor *i, const char *name,
+		      bool use_mmap)
 {
 	int fd = open(name, O_RDONLY);
 	if (fd < 0) {
 		diag_set(SystemError, "failed to open '%s' file", name);
 		return -1;
 	}
-	int rc = xlog_cursor_openfd(i, fd, name);
+	int rc = xlog_cursor_openfd_impl(i, fd, name, use_mmap);
 	if (rc < 0) {
 		close(fd);
 		return -1;
@@ -1551,6 +1783,18 @@ xlog_cursor_open(struct xlog_cursor *i, const char *name)
 	return 0;
 }
 
+int
+xlog_cursor_open(struct xlog_cursor *i, const char *name)
+{
+	return xlog_cursor_open_impl(i, name, false);
+}
+
+int
+xlog_cursor_open_mmap(struct xlog_cursor *i, const char *name)
+{
+	return xlog_cursor_open_impl(i, name, true);
+}
+
 int
 xlog_cursor_openmem(struct xlog_cursor *i, const char *data, size_t size,
 		    const char *name)
@@ -1599,6 +1843,7 @@ xlog_cursor_close(struct xlog_cursor *i, bool reuse_fd)
 	ibuf_destroy(&i->rbuf);
 	if (i->is_opened)
 		xlog_tx_cursor_destroy(&i->tx_cursor);
+	xlog_cursor_unmap(i);
 	ZSTD_freeDStream(i->zdctx);
 	TRASH(i);
 }
@@ -170,6 +170,14 @@ char *
 xdir_format_filename(struct xdir *dir, int64_t signature,
 		     enum log_suffix suffix);
 
+/**
+ * Return the name of a part of a partitioned snapshot,
+ * i.e. <signature>.snap.<part>, see xlog_meta::parts.
+ */
+char *
+xdir_format_part_filename(struct xdir *dir, int64_t signature,
+			  uint32_t part, enum log_suffix suffix);
+
 /* }}} */
 
 /* {{{ xlog meta */
@@ -196,6 +204,20 @@ struct xlog_meta {
 	 * is vector clock *at the time the snapshot is taken.
 	 */
 	struct vclock vclock;
+	/**
+	 * Text file header: the number of parts of a
+	 * partitioned snapshot, 0 or 1 if the file is not
+	 * partitioned. Part 0 is stored in the file itself,
+	 * the rest are stored in <signature>.snap.<part> files.
+	 */
+	uint32_t parts;
+	/**
+	 * Text file header: set for an incremental snapshot,
+	 * which only has the changes made since the snapshot
+	 * with signature @a base.
+	 */
+	bool is_incremental;
+	int64_t base;
 };
 
 /* }}} */
@@ -260,6 +282,11 @@ struct xlog {
 	 * synced file size
 	 */
 	uint64_t synced_size;
+	/**
+	 * The file size up to which write back has been started,
+	 * but may be not complete yet: >= synced_size.
+	 */
+	uint64_t writeback_size;
 };
 
 /**
@@ -424,6 +451,14 @@ struct xlog_cursor
 	struct ibuf rbuf;
 	/** file read position */
 	off_t read_offset;
+	/**
+	 * How much to read beyond the requested size. Grows
+	 * while the file is read sequentially in full chunks,
+	 * drops to the minimum on a short read.
+	 */
+	size_t read_ahead;
+	/** The start of the consumed range not yet dropped from cache. */
+	off_t drop_offset;
 	/** true if eof marker was readen */
 	bool eof_read;
 	/** cursor for current tx */
@@ -432,6 +467,14 @@ struct xlog_cursor
 	bool is_opened;
 	/** ZSTD context for decompression */
 	ZSTD_DStream *zdctx;
+	/**
+	 * The file mapping or NULL if the file is read into
+	 * rbuf. In mmap mode rbuf points into the mapping and
+	 * doesn't own any memory.
+	 */
+	char *map;
+	/** Size of the mapping. */
+	size_t map_size;
 };
 
 /**
@@ -455,6 +498,22 @@ xlog_cursor_openfd(struct xlog_cursor *cursor, int fd, const char *name);
 int
 xlog_cursor_open(struct xlog_cursor *cursor, const char *name);
 
+/**
+ * Open cursor from file, mapping the entire file to memory.
+ * Plain rows are decoded right from the mapping, only
+ * compressed tx are copied to a decompression buffer.
+ * Only suitable for files which are not being written to:
+ * rows appended after open are not visible to the cursor.
+ * Falls back to the buffered mode if the file can't be
+ * mapped.
+ * @param cursor cursor
+ * @param name file name
+ * @retval 0 succes
+ * @retval -1 error, check diag
+ */
+int
+xlog_cursor_open_mmap(struct xlog_cursor *cursor, const char *name);
+
 /**
  * Open cursor from memory
  * @param cursor cursor
@@ -521,6 +580,23 @@ int
 xdir_open_cursor(struct xdir *dir, int64_t signature,
 		 struct xlog_cursor *cursor);
 
+/**
+ * Same as xdir_open_cursor(), but the file is memory mapped,
+ * @sa xlog_cursor_open_mmap().
+ */
+int
+xdir_open_cursor_mmap(struct xdir *dir, int64_t signature,
+		      struct xlog_cursor *cursor);
+
+/**
+ * Same as xdir_open_cursor_mmap(), but opens the given part
+ * of a partitioned snapshot. Part 0 is the file itself.
+ * @sa xdir_format_part_filename()
+ */
+int
+xdir_open_part_cursor_mmap(struct xdir *dir, int64_t signature,
+			   uint32_t part, struct xlog_cursor *cursor);
+
 /** }}} */
 
 #if defined(__cplusplus)
@@ -619,6 +695,32 @@ xdir_open_cursor_xc(struct xdir *dir, int64_t signature,
 	return rc;
 }
 
+/**
+ * @copydoc xdir_open_cursor_mmap
+ */
+static inline int
+xdir_open_cursor_mmap_xc(struct xdir *dir, int64_t signature,
+			 struct xlog_cursor *cursor)
+{
+	int rc = xdir_open_cursor_mmap(dir, signature, cursor);
+	if (rc == -1)
+		diag_raise();
+	return rc;
+}
+
+/**
+ * @copydoc xdir_open_part_cursor_mmap
+ */
+static inline int
+xdir_open_part_cursor_mmap_xc(struct xdir *dir, int64_t signature,
+			      uint32_t part, struct xlog_cursor *cursor)
+{
+	int rc = xdir_open_part_cursor_mmap(dir, signature, part, cursor);
+	if (rc == -1)
+		diag_raise();
+	return rc;
+}
+
 /**
  * @copydoc xlog_cursor_openfd
  */
@@ -642,6 +744,18 @@ xlog_cursor_open_xc(struct xlog_cursor *cursor, const char *name)
 	return rc;
 }
 
+/**
+ * @copydoc xlog_cursor_open_mmap
+ */
+static inline int
+xlog_cursor_open_mmap_xc(struct xlog_cursor *cursor, const char *name)
+{
+	int rc = xlog_cursor_open_mmap(cursor, name);
+	if (rc == -1)
+		diag_raise();
+	return rc;
+}
+
 #endif /* defined(__cplusplus) */
 
 #endif /* TARANTOOL_XLOG_H_INCLUDED */
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "xlog_reader.h"
+
+#include "scoped_guard.h"
+#include "xlog.h"
+
+/** Queue a batch received from the reader for apply (tx). */
+static void
+xlog_reader_batch_deliver(struct cmsg *msg)
+{
+	struct xlog_reader_batch *batch = (struct xlog_reader_batch *) msg;
+	struct xlog_reader *reader = batch->reader;
+	stailq_add_tail_entry(&reader->batches, batch, in_tx);
+	ipc_cond_signal(reader->tx_cond);
+}
+
+/** Free a batch applied by tx (reader). */
+static void
+xlog_reader_batch_free(struct cmsg *msg)
+{
+	struct xlog_reader_batch *batch = (struct xlog_reader_batch *) msg;
+	struct xlog_reader *reader = batch->reader;
+	free(batch);
+	reader->in_flight--;
+	ipc_cond_signal(&reader->reader_cond);
+}
+
+/** The reader has sent the last batch (tx). */
+static void
+xlog_reader_done(struct cmsg *msg)
+{
+	struct xlog_reader *reader =
+		container_of(msg, struct xlog_reader, done_msg);
+	reader->is_done = true;
+	ipc_cond_signal(reader->tx_cond);
+}
+
+/** tx doesn't need more rows (reader). */
+static void
+xlog_reader_stop_f(struct cmsg *msg)
+{
+	struct xlog_reader *reader =
+		container_of(msg, struct xlog_reader, stop_msg);
+	reader->is_stopped = true;
+	ipc_cond_signal(&reader->reader_cond);
+}
+
+static struct cmsg_hop xlog_reader_batch_route[] = {
+	{ xlog_reader_batch_deliver, NULL },
+};
+
+static struct cmsg_hop xlog_reader_batch_free_route[] = {
+	{ xlog_reader_batch_free, NULL },
+};
+
+static struct cmsg_hop xlog_reader_done_route[] = {
+	{ xlog_reader_done, NULL },
+};
+
+static struct cmsg_hop xlog_reader_stop_route[] = {
+	{ xlog_reader_stop_f, NULL },
+};
+
+static struct xlog_reader_batch *
+xlog_reader_batch_new(struct xlog_reader *reader, size_t size)
+{
+	size = MAX(size, (size_t) XLOG_READER_BATCH_SIZE);
+	struct xlog_reader_batch *batch = (struct xlog_reader_batch *)
+		malloc(sizeof(*batch) + size);
+	if (batch == NULL) {
+		tnt_raise(OutOfMemory, sizeof(*batch) + size, "malloc",
+			  "struct xlog_reader_batch");
+	}
+	cmsg_init(&batch->base, xlog_reader_batch_route);
+	batch->reader = reader;
+	batch->n_rows = 0;
+	batch->used = 0;
+	batch->size = size;
+	return batch;
+}
+
+/**
+ * Copy a row to the batch, so that it outlives the cursor
+ * buffer it was decoded from.
+ * @retval false if there is no room for the row
+ */
+static bool
+xlog_reader_batch_add(struct xlog_reader_batch *batch,
+		      struct xrow_header *row)
+{
+	assert(row->bodycnt <= 1);
+	size_t len = row->bodycnt > 0 ? row->body[0].iov_len : 0;
+	if (batch->n_rows == XLOG_READER_BATCH_ROWS ||
+	    batch->used + len > batch->size)
+		return false;
+	struct xrow_header *copy = &batch->rows[batch->n_rows++];
+	*copy = *row;
+	if (row->bodycnt > 0) {
+		copy->body[0].iov_base = batch->data + batch->used;
+		memcpy(copy->body[0].iov_base, row->body[0].iov_base, len);
+		batch->used += len;
+	}
+	return true;
+}
+
+/** Pass a batch to tx, waiting if too many are in flight. */
+static void
+xlog_reader_send(struct xlog_reader *reader, struct cpipe *tx_pipe,
+		 struct xlog_reader_batch *batch)
+{
+	reader->in_flight++;
+	cpipe_push(tx_pipe, &batch->base);
+	while (reader->in_flight >= XLOG_READER_BATCHES_IN_FLIGHT &&
+	       !reader->is_stopped)
+		ipc_cond_wait(&reader->reader_cond);
+}
+
+static void
+xlog_reader_read(struct xlog_reader *reader, struct cpipe *tx_pipe)
+{
+	struct xlog_cursor cursor;
+	xdir_open_part_cursor_mmap_xc(reader->dir, reader->signature,
+				      reader->part, &cursor);
+	auto guard = make_scoped_guard([&]{
+		reader->eof_read = cursor.eof_read;
+		xlog_cursor_close(&cursor, false);
+	});
+	snprintf(reader->name, sizeof(reader->name), "%s", cursor.name);
+
+	struct xlog_reader_batch *batch = NULL;
+	auto batch_guard = make_scoped_guard([&]{ free(batch); });
+	struct xrow_header row;
+	while (!reader->is_stopped &&
+	       xlog_cursor_next_xc(&cursor, &row,
+				   reader->dir->panic_if_error) == 0) {
+		if (batch != NULL && !xlog_reader_batch_add(batch, &row)) {
+			xlog_reader_send(reader, tx_pipe, batch);
+			batch = NULL;
+		}
+		if (batch == NULL) {
+			batch = xlog_reader_batch_new(reader,
+				row.bodycnt > 0 ? row.body[0].iov_len : 0);
+			bool added = xlog_reader_batch_add(batch, &row);
+			assert(added);
+			(void) added;
+		}
+	}
+	if (batch != NULL) {
+		reader->in_flight++;
+		cpipe_push(tx_pipe, &batch->base);
+		batch = NULL;
+	}
+}
+
+static int
+xlog_reader_f(va_list ap)
+{
+	struct xlog_reader *reader = va_arg(ap, struct xlog_reader *);
+	struct cpipe *tx_pipe = cbus_join(&reader->bus, &reader->reader_pipe);
+	/* Don't delay delivery till the end of event loop iteration. */
+	cpipe_set_max_input(tx_pipe, 1);
+
+	try {
+		xlog_reader_read(reader, tx_pipe);
+	} catch (Exception *e) {
+		diag_move(diag_get(), &reader->diag);
+	}
+	cmsg_init(&reader->done_msg, xlog_reader_done_route);
+	cpipe_push(tx_pipe, &reader->done_msg);
+	/*
+	 * Wait for all batches to come back and for the stop
+	 * message: tx must not push anything to this thread
+	 * after it's gone.
+	 */
+	while (reader->in_flight > 0 || !reader->is_stopped)
+		ipc_cond_wait(&reader->reader_cond);
+	return 0;
+}
+
+void
+xlog_reader_start(struct xlog_reader *reader, const char *thread_name,
+		  struct xdir *dir, int64_t signature, uint32_t part,
+		  struct ipc_cond *tx_cond)
+{
+	reader->dir = dir;
+	reader->signature = signature;
+	reader->part = part;
+	cbus_create(&reader->bus);
+	cpipe_create(&reader->tx_pipe);
+	cpipe_create(&reader->reader_pipe);
+	reader->in_flight = 0;
+	reader->is_stopped = false;
+	ipc_cond_create(&reader->reader_cond);
+	cmsg_init(&reader->stop_msg, xlog_reader_stop_route);
+	reader->eof_read = false;
+	snprintf(reader->name, sizeof(reader->name), "%s", part == 0 ?
+		 xdir_format_filename(dir, signature, NONE) :
+		 xdir_format_part_filename(dir, signature, part, NONE));
+	diag_create(&reader->diag);
+	stailq_create(&reader->batches);
+	reader->is_done = false;
+	reader->tx_cond = tx_cond;
+
+	if (cord_costart(&reader->cord, thread_name, xlog_reader_f,
+			 reader) != 0) {
+		cbus_destroy(&reader->bus);
+		ipc_cond_destroy(&reader->reader_cond);
+		diag_raise();
+	}
+	cbus_join(&reader->bus, &reader->tx_pipe);
+	cpipe_set_max_input(&reader->reader_pipe, 1);
+}
+
+struct xlog_reader_batch *
+xlog_reader_next(struct xlog_reader *reader)
+{
+	while (stailq_empty(&reader->batches) && !reader->is_done)
+		ipc_cond_wait(reader->tx_cond);
+	return xlog_reader_first(reader);
+}
+
+void
+xlog_reader_release(struct xlog_reader *reader,
+		    struct xlog_reader_batch *batch)
+{
+	assert(xlog_reader_first(reader) == batch);
+	stailq_shift(&reader->batches);
+	cmsg_init(&batch->base, xlog_reader_batch_free_route);
+	cpipe_push(&reader->reader_pipe, &batch->base);
+}
+
+void
+xlog_reader_stop(struct xlog_reader *reader)
+{
+	cpipe_push(&reader->reader_pipe, &reader->stop_msg);
+	while (true) {
+		struct xlog_reader_batch *batch;
+		while ((batch = xlog_reader_first(reader)) != NULL)
+			xlog_reader_release(reader, batch);
+		if (reader->is_done)
+			break;
+		ipc_cond_wait(reader->tx_cond);
+	}
+	if (cord_cojoin(&reader->cord) != 0)
+		error_log(diag_last_error(diag_get()));
+	cbus_destroy(&reader->bus);
+	ipc_cond_destroy(&reader->reader_cond);
+}
@@ -0,0 +1,175 @@
+#ifndef TARANTOOL_XLOG_READER_H_INCLUDED
+#define TARANTOOL_XLOG_READER_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <limits.h>
+#include "salad/stailq.h"
+#include "fiber.h"
+#include "cbus.h"
+#include "ipc.h"
+#include "diag.h"
+#include "xrow.h"
+
+/*
+ * Reading an xlog or a snapshot is dominated by read(),
+ * decompression and checksum verification, none of which
+ * needs the tx thread. An xlog reader reads a complete file
+ * in a separate thread, decodes rows, copies them into
+ * batches and passes the batches to tx over cbus. The tx
+ * thread only applies the rows and returns the batches back
+ * for disposal. The number of batches in flight is limited
+ * to keep memory usage bounded when tx is slower than the
+ * reader.
+ *
+ * The file must be complete: the reader stops at the end of
+ * file and doesn't follow the file if it's still being
+ * written to.
+ */
+
+struct xdir;
+struct xlog_reader;
+
+enum {
+	/** Max number of rows in a batch. */
+	XLOG_READER_BATCH_ROWS = 1024,
+	/** Size of the row data area of a batch. */
+	XLOG_READER_BATCH_SIZE = 256 * 1024,
+	/** Max number of batches passed to tx and not freed yet. */
+	XLOG_READER_BATCHES_IN_FLIGHT = 32,
+};
+
+/** A batch of decoded rows passed from the reader to tx. */
+struct xlog_reader_batch {
+	struct cmsg base;
+	struct xlog_reader *reader;
+	/** Link in xlog_reader::batches. */
+	struct stailq_entry in_tx;
+	int n_rows;
+	/** Used and total size of the data area. */
+	size_t used;
+	size_t size;
+	struct xrow_header rows[XLOG_READER_BATCH_ROWS];
+	/** Row bodies, referenced by rows[i].body. */
+	char data[0];
+};
+
+struct xlog_reader {
+	/** The file to read, @sa xdir_open_part_cursor_mmap(). */
+	struct xdir *dir;
+	int64_t signature;
+	uint32_t part;
+	struct cord cord;
+	struct cbus bus;
+	/** Batches and the done message: reader -> tx. */
+	struct cpipe tx_pipe;
+	/** Used batches and the stop message: tx -> reader. */
+	struct cpipe reader_pipe;
+	/*
+	 * Reader thread state.
+	 */
+	/** The number of batches sent to tx and not freed yet. */
+	int in_flight;
+	/** Set when tx is not interested in more rows. */
+	bool is_stopped;
+	struct ipc_cond reader_cond;
+	struct cmsg stop_msg;
+	/*
+	 * Passed with the done message, read by tx only
+	 * after the message is delivered.
+	 */
+	bool eof_read;
+	char name[PATH_MAX];
+	struct diag diag;
+	struct cmsg done_msg;
+	/*
+	 * tx thread state.
+	 */
+	/** Batches received and not applied yet. */
+	struct stailq batches;
+	/** Set when the last batch has been received. */
+	bool is_done;
+	/**
+	 * Signalled when a batch or the done message arrives.
+	 * May be shared by several readers to wait for any
+	 * of them.
+	 */
+	struct ipc_cond *tx_cond;
+};
+
+/**
+ * Start a thread reading a part of a file from the
+ * directory. The thread name is taken from @a thread_name.
+ * @a tx_cond is signalled whenever there is something
+ * for tx to do, and must outlive the reader.
+ */
+void
+xlog_reader_start(struct xlog_reader *reader, const char *thread_name,
+		  struct xdir *dir, int64_t signature, uint32_t part,
+		  struct ipc_cond *tx_cond);
+
+/**
+ * Return the first batch received by tx, or NULL if there is
+ * none at the moment. Doesn't block.
+ */
+static inline struct xlog_reader_batch *
+xlog_reader_first(struct xlog_reader *reader)
+{
+	if (stailq_empty(&reader->batches))
+		return NULL;
+	return stailq_first_entry(&reader->batches,
+				  struct xlog_reader_batch, in_tx);
+}
+
+/**
+ * Wait for the next batch. Returns NULL when the reader
+ * has reached the end of file or failed, check reader->diag.
+ */
+struct xlog_reader_batch *
+xlog_reader_next(struct xlog_reader *reader);
+
+/**
+ * Remove an applied batch from the queue and return it to
+ * the reader. The batch must be the first one in the queue.
+ */
+void
+xlog_reader_release(struct xlog_reader *reader,
+		    struct xlog_reader_batch *batch);
+
+/**
+ * Tell the reader to stop, drop the batches it has already
+ * sent and wait for the thread to exit. The reader error,
+ * if any, is left in reader->diag, and must be destroyed
+ * or moved by the caller.
+ */
+void
+xlog_reader_stop(struct xlog_reader *reader);
+
+#endif /* TARANTOOL_XLOG_READER_H_INCLUDED */
@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "cpu_feature.h"
 
@@ -100,6 +102,155 @@ sse42_enabled_cpu()
 	return (cx & (1 << 20)) != 0;
 }
 
+bool
+pclmul_enabled_cpu()
+{
+	unsigned int ax, bx, cx, dx;
+
+	if (__get_cpuid(1, &ax, &bx, &cx, &dx) == 0)
+		return 0;
+
+	return (cx & (1 << 1)) != 0;
+}
+
+#if defined(HAVE_CRC32C_PCLMUL)
+
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+/*
+ * 3-way interleaved CRC32C.
+ *
+ * A crc32 instruction has a latency of 3 cycles, but a throughput
+ * of one instruction per cycle, so a single dependency chain uses
+ * a third of the available bandwidth. Split the buffer into three
+ * equal blocks, checksum them in parallel and then combine the
+ * partial results:
+ *
+ *   crc(A|B|C) = shift(crc(A), |B| + |C|) ^ shift(crc(B), |C|) ^ crc(C)
+ *
+ * shift(crc, n) appends n zero bytes to the message and is
+ * computed with a single carry-less multiplication by
+ * x^(8n - 33) mod P followed by a crc32 reduction of the 64-bit
+ * product.
+ */
+enum {
+	/** Block size of a long interleaved pass, per stream. */
+	CRC32C_LONG = 8192,
+	/** Block size of a short interleaved pass, per stream. */
+	CRC32C_SHORT = 256,
+};
+
+/**
+ * Multiplication constants for shift(), bit-reflected:
+ * x^(8 * n - 33) mod P for n = LONG, 2 * LONG, SHORT, 2 * SHORT.
+ */
+static uint64_t crc32c_k_long[2];
+static uint64_t crc32c_k_short[2];
+
+/** Bit-reflected x^n mod P, P is the Castagnoli polynomial. */
+static uint32_t
+crc32c_xpow(unsigned int n)
+{
+	uint32_t p = 0x80000000; /* x^0 */
+	while (n--)
+		p = (p >> 1) ^ (0x82f63b78 & -(p & 1));
+	return p;
+}
+
+static void
+crc32c_hw_3way_init(void)
+{
+	crc32c_k_long[0] = crc32c_xpow(8 * CRC32C_LONG - 33);
+	crc32c_k_long[1] = crc32c_xpow(8 * 2 * CRC32C_LONG - 33);
+	crc32c_k_short[0] = crc32c_xpow(8 * CRC32C_SHORT - 33);
+	crc32c_k_short[1] = crc32c_xpow(8 * 2 * CRC32C_SHORT - 33);
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static inline uint32_t
+crc32c_combine3(uint32_t crc0, uint32_t crc1, uint32_t crc2,
+		const uint64_t *k)
+{
+	__m128i a = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc0),
+					 _mm_cvtsi64_si128(k[1]), 0);
+	__m128i b = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc1),
+					 _mm_cvtsi64_si128(k[0]), 0);
+	uint64_t v = _mm_cvtsi128_si64(_mm_xor_si128(a, b));
+	return (uint32_t) _mm_crc32_u64(0, v) ^ crc2;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static inline const char *
+crc32c_hw_3way_pass(uint32_t *crc, const char *buf, size_t block,
+		    const uint64_t *k)
+{
+	uint64_t crc0 = *crc, crc1 = 0, crc2 = 0;
+	const char *end = buf + block;
+	while (buf < end) {
+		uint64_t v0, v1, v2;
+		memcpy(&v0, buf, sizeof(v0));
+		memcpy(&v1, buf + block, sizeof(v1));
+		memcpy(&v2, buf + 2 * block, sizeof(v2));
+		crc0 = _mm_crc32_u64(crc0, v0);
+		crc1 = _mm_crc32_u64(crc1, v1);
+		crc2 = _mm_crc32_u64(crc2, v2);
+		buf += sizeof(uint64_t);
+	}
+	*crc = crc32c_combine3(crc0, crc1, crc2, k);
+	return buf + 2 * block;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t
+crc32c_hw_3way(uint32_t crc, const char *buf, unsigned int len)
+{
+	const char *end = buf + len;
+	/* Align the input to speed up the main loops. */
+	while (buf < end && ((uintptr_t) buf & (sizeof(uint64_t) - 1))) {
+		crc = _mm_crc32_u8(crc, *buf);
+		buf++;
+	}
+	while (end - buf >= 3 * CRC32C_LONG)
+		buf = crc32c_hw_3way_pass(&crc, buf, CRC32C_LONG,
+					  crc32c_k_long);
+	while (end - buf >= 3 * CRC32C_SHORT)
+		buf = crc32c_hw_3way_pass(&crc, buf, CRC32C_SHORT,
+					  crc32c_k_short);
+	uint64_t crc64 = crc;
+	while (end - buf >= (ptrdiff_t) sizeof(uint64_t)) {
+		uint64_t v;
+		memcpy(&v, buf, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+		buf += sizeof(uint64_t);
+	}
+	crc = crc64;
+	while (buf < end) {
+		crc = _mm_crc32_u8(crc, *buf);
+		buf++;
+	}
+	return crc;
+}
+
+bool
+crc32c_hw_3way_enabled_cpu()
+{
+	if (!sse42_enabled_cpu() || !pclmul_enabled_cpu())
+		return false;
+	crc32c_hw_3way_init();
+	return true;
+}
+
+#else /* !defined(HAVE_CRC32C_PCLMUL) */
+
+bool
+crc32c_hw_3way_enabled_cpu()
+{
+	return false;
+}
+
+#endif /* defined(HAVE_CRC32C_PCLMUL) */
+
 #else /* !(defined (__x86_64__) || defined (__i386__)) */
 
 bool
@@ -108,4 +259,16 @@ sse42_enabled_cpu()
 	return false;
 }
 
+bool
+pclmul_enabled_cpu()
+{
+	return false;
+}
+
+bool
+crc32c_hw_3way_enabled_cpu()
+{
+	return false;
+}
+
 #endif
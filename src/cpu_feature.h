@@ -42,6 +42,16 @@
  */
 bool sse42_enabled_cpu();
 
+/* Check whether CPU supports carry-less multiplication (PCLMULQDQ). */
+bool pclmul_enabled_cpu();
+
+/*
+ * Check whether the CPU and the compiler support the 3-way
+ * interleaved CRC32 implementation, crc32c_hw_3way(), and
+ * prepare it for use.
+ */
+bool crc32c_hw_3way_enabled_cpu();
+
 #if defined (__x86_64__) || defined (__i386__)
 /* Hardware-calculate CRC32 for the given data buffer.
  *
@@ -53,6 +63,15 @@ bool sse42_enabled_cpu();
  * @return	CRC32 value
  */
 uint32_t crc32c_hw(uint32_t crc, const char *buf, unsigned int len);
+
+/* Hardware-calculate CRC32 for the given data buffer in three
+ * interleaved streams combined with carry-less multiplication.
+ * Several times faster than crc32c_hw() on large buffers.
+ *
+ * @pre 	true == crc32c_hw_3way_enabled_cpu()
+ * @return	CRC32 value
+ */
+uint32_t crc32c_hw_3way(uint32_t crc, const char *buf, unsigned int len);
 #endif
 
 #endif /* TARANTOOL_CPU_FEATURES_H */
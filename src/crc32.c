@@ -29,6 +29,7 @@
  * SUCH DAMAGE.
  */
 #include "crc32.h"
+#include <sys/uio.h>
 #include <third_party/crc32.h>
 #include <cpu_feature.h>
 /*
@@ -40,9 +41,27 @@ crc32_func crc32_calc = NULL;
 void
 crc32_init()
 {
+#if defined(HAVE_CRC32C_PCLMUL)
+	if (crc32c_hw_3way_enabled_cpu()) {
+		crc32_calc = &crc32c_hw_3way;
+		return;
+	}
+#endif
 #if defined (__x86_64__) || defined (__i386__)
 	crc32_calc = sse42_enabled_cpu() ? &crc32c_hw : &crc32c;
 #else
 	crc32_calc = &crc32c;
 #endif
 }
+
+uint32_t
+crc32_calc_iov(uint32_t crc, const struct iovec *iov, int iovcnt,
+	       size_t offset)
+{
+	for (int i = 0; i < iovcnt; i++) {
+		crc = crc32_calc(crc, (const char *) iov[i].iov_base + offset,
+				 iov[i].iov_len - offset);
+		offset = 0;
+	}
+	return crc;
+}
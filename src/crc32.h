@@ -47,6 +47,16 @@ extern crc32_func crc32_calc;
 
 void crc32_init();
 
+struct iovec;
+
+/**
+ * Calculate CRC32 of the data stored in an iovec array,
+ * skipping the first @a offset bytes of the first iovec.
+ */
+uint32_t
+crc32_calc_iov(uint32_t crc, const struct iovec *iov, int iovcnt,
+	       size_t offset);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
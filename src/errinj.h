@@ -52,12 +52,15 @@ struct errinj {
 	_(ERRINJ_WAL_WRITE_DISK, false) \
 	_(ERRINJ_WAL_DELAY, false) \
 	_(ERRINJ_INDEX_ALLOC, false) \
+	_(ERRINJ_MEMTX_BUILD_THREAD, false) \
 	_(ERRINJ_TUPLE_ALLOC, false) \
 	_(ERRINJ_TUPLE_FIELD, false) \
 	_(ERRINJ_VY_RANGE_DUMP, false) \
 	_(ERRINJ_VY_RANGE_SPLIT, false) \
 	_(ERRINJ_VY_GC, false) \
-	_(ERRINJ_RELAY, false)
+	_(ERRINJ_RELAY, false) \
+	_(ERRINJ_RELAY_JOIN_DELAY, false) \
+	_(ERRINJ_SNAP_DELTA_KEYS, false)
 
 ENUM0(errinj_enum, ERRINJ_LIST);
 extern struct errinj errinjs[];
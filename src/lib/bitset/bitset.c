@@ -51,7 +51,7 @@ bitset_destroy_iter_cb(bitset_pages_t *t, struct bitset_page *page, void *arg)
 {
 	(void) t;
 	struct bitset *bitset = (struct bitset *) arg;
-	bitset_page_destroy(page);
+	bitset_page_destroy(page, bitset->realloc);
 	bitset->realloc(page, 0);
 	return NULL;
 }
@@ -74,9 +74,9 @@ bitset_test(struct bitset *bitset, size_t pos)
 	if (page == NULL)
 		return false;
 
-	assert(page->first_pos <= pos && pos < page->first_pos +
-	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
-	return bit_test(bitset_page_data(page), pos - page->first_pos);
+	assert(page->first_pos <= pos &&
+	       pos < page->first_pos + BITSET_PAGE_BIT);
+	return bitset_page_test(page, pos - page->first_pos);
 }
 
 int
@@ -89,29 +89,34 @@ bitset_set(struct bitset *bitset, size_t pos)
 	struct bitset_page *page = bitset_pages_search(&bitset->pages, &key);
 	if (page == NULL) {
 		/* Allocate a new page */
-		size_t size = bitset_page_alloc_size(bitset->realloc);
-		page = bitset->realloc(NULL, size);
+		page = bitset->realloc(NULL, sizeof(*page));
 		if (page == NULL)
 			return -1;
 
 		bitset_page_create(page);
 		page->first_pos = key.first_pos;
+		if (bitset_page_set(page, pos - page->first_pos,
+				    bitset->realloc) != 0) {
+			bitset->realloc(page, 0);
+			return -1;
+		}
 
 		/* Insert the page into pages tree */
 		bitset_pages_insert(&bitset->pages, page);
+		bitset->cardinality++;
+		return 0;
 	}
 
-	assert(page->first_pos <= pos && pos < page->first_pos +
-	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
-	bool prev = bit_set(bitset_page_data(page), pos - page->first_pos);
-	if (prev) {
-		/* Value has not changed */
-		return 1;
+	assert(page->first_pos <= pos &&
+	       pos < page->first_pos + BITSET_PAGE_BIT);
+	int prev = bitset_page_set(page, pos - page->first_pos,
+				   bitset->realloc);
+	if (prev != 0) {
+		/* Value has not changed or out of memory */
+		return prev;
 	}
 
 	bitset->cardinality++;
-	page->cardinality++;
-
 	return 0;
 }
 
@@ -126,29 +131,43 @@ bitset_clear(struct bitset *bitset, size_t pos)
 	if (page == NULL)
 		return 0;
 
-	assert(page->first_pos <= pos && pos < page->first_pos +
-	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
-	bool prev = bit_clear(bitset_page_data(page), pos - page->first_pos);
-	if (!prev) {
-		return 0;
+	assert(page->first_pos <= pos &&
+	       pos < page->first_pos + BITSET_PAGE_BIT);
+	int prev = bitset_page_clear(page, pos - page->first_pos,
+				     bitset->realloc);
+	if (prev <= 0) {
+		/* Value has not changed or out of memory */
+		return prev;
 	}
 
 	assert(bitset->cardinality > 0);
-	assert(page->cardinality > 0);
 	bitset->cardinality--;
-	page->cardinality--;
 
 	if (page->cardinality == 0) {
 		/* Remove the page from the pages tree */
 		bitset_pages_remove(&bitset->pages, page);
 		/* Free the page */
-		bitset_page_destroy(page);
+		bitset_page_destroy(page, bitset->realloc);
 		bitset->realloc(page, 0);
 	}
 
 	return 1;
 }
 
+int
+bitset_reserve_clear(struct bitset *bitset, size_t pos)
+{
+	struct bitset_page key;
+	key.first_pos = bitset_page_first_pos(pos);
+
+	struct bitset_page *page = bitset_pages_search(&bitset->pages, &key);
+	if (page == NULL)
+		return 0;
+
+	return bitset_page_reserve_clear(page, pos - page->first_pos,
+					 bitset->realloc);
+}
+
 extern inline size_t
 bitset_cardinality(const struct bitset *bitset);
 
@@ -156,19 +175,30 @@ void
 bitset_info(struct bitset *bitset, struct bitset_info *info)
 {
 	memset(info, 0, sizeof(*info));
-	info->page_data_size = BITSET_PAGE_DATA_SIZE;
-	info->page_total_size = bitset_page_alloc_size(bitset->realloc);
-	info->page_data_alignment = BITSET_PAGE_DATA_ALIGNMENT;
+	info->page_bit = BITSET_PAGE_BIT;
 
 	size_t cardinality_check = 0;
 	struct bitset_page *page = bitset_pages_first(&bitset->pages);
 	while (page != NULL) {
 		info->pages++;
+		switch (page->type) {
+		case BITSET_PAGE_ARRAY:
+			info->array_pages++;
+			break;
+		case BITSET_PAGE_BITMAP:
+			info->bitmap_pages++;
+			break;
+		case BITSET_PAGE_RUN:
+			info->run_pages++;
+			break;
+		}
+		info->mem_total += bitset_page_mem_size(page);
 		cardinality_check += page->cardinality;
 		page = bitset_pages_next(&bitset->pages, page);
 	}
 
 	assert(bitset_cardinality(bitset) == cardinality_check);
+	(void) cardinality_check;
 }
 
 #if defined(DEBUG)
@@ -178,18 +208,15 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 	struct bitset_info info;
 	bitset_info(bitset, &info);
 
-	size_t PAGE_BIT = (info.page_data_size * CHAR_BIT);
-
 	fprintf(stream, "Bitset %p\n", bitset);
 	fprintf(stream, "{\n");
-	fprintf(stream, "    " "page_size   = %zu/%zu /* (data / total) */\n",
-		info.page_data_size, info.page_total_size);
-	fprintf(stream, "    " "page_bit    = %zu\n", PAGE_BIT);
-	fprintf(stream, "    " "pages       = %zu\n", info.pages);
-
+	fprintf(stream, "    " "page_bit    = %zu\n", info.page_bit);
+	fprintf(stream, "    " "pages       = %zu "
+		"/* %zu array, %zu bitmap, %zu run */\n", info.pages,
+		info.array_pages, info.bitmap_pages, info.run_pages);
 
 	size_t cardinality = bitset_cardinality(bitset);
-	size_t capacity = PAGE_BIT * info.pages;
+	size_t capacity = info.page_bit * info.pages;
 	fprintf(stream, "    " "cardinality = %zu\n", cardinality);
 	fprintf(stream, "    " "capacity    = %zu\n", capacity);
 
@@ -204,16 +231,13 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 		fprintf(stream, "    "
 			"utilization = undefined\n");
 	}
-	size_t mem_data  = info.page_data_size * info.pages;
-	size_t mem_total = info.page_total_size * info.pages;
 
-	fprintf(stream, "    " "mem_data    = %zu bytes\n", mem_data);
 	fprintf(stream, "    " "mem_total   = %zu bytes "
-		"/* data + padding + tree */\n", mem_total);
+		"/* pages + data */\n", info.mem_total);
 	if (cardinality > 0) {
 		fprintf(stream, "    "
 			"density     = %-8.4f bytes per value\n",
-			(float) mem_total / cardinality);
+			(float) info.mem_total / cardinality);
 	} else {
 		fprintf(stream, "    "
 			"density     = undefined\n");
@@ -225,18 +249,19 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 
 	fprintf(stream, "    " "pages = {\n");
 
+	static const char *type_strs[] = { "array", "bitmap", "run" };
 	for (struct bitset_page *page = bitset_pages_first(&bitset->pages);
 	     page != NULL; page = bitset_pages_next(&bitset->pages, page)) {
 
-		size_t page_last_pos = page->first_pos
-				+ BITSET_PAGE_DATA_SIZE * CHAR_BIT;
+		size_t page_last_pos = page->first_pos + BITSET_PAGE_BIT;
 
-		fprintf(stream, "        " "[%zu, %zu) ",
-			page->first_pos, page_last_pos);
+		fprintf(stream, "        " "[%zu, %zu) %s ",
+			page->first_pos, page_last_pos,
+			type_strs[page->type]);
 
 		fprintf(stream, "utilization = %8.4f%% (%zu/%zu)",
-			(float) page->cardinality * 1e2 / PAGE_BIT,
-			page->cardinality, PAGE_BIT);
+			(float) page->cardinality * 1e2 / info.page_bit,
+			page->cardinality, info.page_bit);
 
 		if (verbose < 2) {
 			fprintf(stream, "\n");
@@ -245,15 +270,10 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 		fprintf(stream, " ");
 
 		fprintf(stream, "vals = {");
-
-		size_t pos = 0;
-		struct bit_iterator it;
-		bit_iterator_init(&it, bitset_page_data(page),
-			      BITSET_PAGE_DATA_SIZE, true);
-		while ( (pos = bit_iterator_next(&it)) != SIZE_MAX) {
-			fprintf(stream, "%zu, ", page->first_pos + pos);
+		for (uint32_t pos = 0; pos < BITSET_PAGE_BIT; pos++) {
+			if (bitset_page_test(page, pos))
+				fprintf(stream, "%zu, ", page->first_pos + pos);
 		}
-
 		fprintf(stream, "}\n");
 	}
 
@@ -263,4 +283,3 @@ exit:
 	fprintf(stream, "}\n");
 }
 #endif /* defined(DEBUG) */
-
@@ -41,6 +41,12 @@
  * by \a size_t position number.  Initially all bits are set to
  * false. You can use any values in range [0,SIZE_MAX).  The
  * container grows automatically.
+ *
+ * The bits are stored as a Roaring bitmap: positions are split
+ * into pages of 2^16 bits, and each non-empty page is kept in one
+ * of three forms, whichever is smaller for its contents: a sorted
+ * array of set positions, a plain bitmap or a sorted array of
+ * runs of set positions.
  */
 
 #include "bit/bit.h"
@@ -70,7 +76,13 @@ struct bitset_page {
 	size_t first_pos;
 	rb_node(struct bitset_page) node;
 	size_t cardinality;
-	uint8_t data[0];
+	/** enum bitset_page_type */
+	uint32_t type;
+	/** Number of runs in a run page */
+	uint32_t size;
+	/** Number of array items or runs allocated in data */
+	uint32_t capacity;
+	void *data;
 };
 
 typedef rb_tree(struct bitset_page) bitset_pages_t;
@@ -134,6 +146,17 @@ bitset_set(struct bitset *bitset, size_t pos);
 int
 bitset_clear(struct bitset *bitset, size_t pos);
 
+/**
+ * @brief Make sure that bitset_clear(\a bitset, \a pos) won't
+ * need memory, so it can't fail
+ * @param bitset bitset
+ * @param pos bit number
+ * @retval 0 on success
+ * @retval -1 on memory error, the bits are not changed
+ */
+int
+bitset_reserve_clear(struct bitset *bitset, size_t pos);
+
 /**
  * @brief Return the number of bits set to \a true in \a bitset.
  * @param bitset bitset
@@ -151,12 +174,16 @@ bitset_cardinality(const struct bitset *bitset) {
 struct bitset_info {
 	/** Number of allocated pages */
 	size_t pages;
-	/** Data (payload) size of one page (in bytes) */
-	size_t page_data_size;
-	/** Full size of one page (in bytes, including padding and tree data) */
-	size_t page_total_size;
-	/** A multiplier by which an address of page data is aligned **/
-	size_t page_data_alignment;
+	/** Number of pages stored as arrays of positions */
+	size_t array_pages;
+	/** Number of pages stored as bitmaps */
+	size_t bitmap_pages;
+	/** Number of pages stored as arrays of runs */
+	size_t run_pages;
+	/** Number of bits covered by one page */
+	size_t page_bit;
+	/** Memory used by pages (in bytes, including tree data) */
+	size_t mem_total;
 };
 
 /**
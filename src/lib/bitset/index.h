@@ -87,7 +87,10 @@
  * mostly equivalent to inserting one value into \a k balanced
  * binary search trees, each of size \a m, where \a k is the number of
  * set bits in the key and \ m is the number of pairs in the index
- * divided by bitset page size.
+ * divided by bitset page size (65536 values). Sparse pages are
+ * kept as sorted arrays, dense ones as bitmaps and runs of
+ * consecutive values as arrays of runs, so the memory used by
+ * a bitset depends on the number of values, not on their range.
  *
  * The complexity of iteration is linear from the number of pairs
  * in which the search expression evaluates to true. The
@@ -175,8 +178,10 @@ bitset_index_insert(struct bitset_index *index, const void *key, size_t key_size
  * @brief Remove a pair with \a value (*, \a value) from \a index.
  * @param index bitset index
  * @param value value
+ * @retval 0 on success
+ * @retval -1 on memory error, the pair stays in the index
  */
-void
+int
 bitset_index_remove_value(struct bitset_index *index, size_t value);
 
 /**
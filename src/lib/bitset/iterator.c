@@ -82,12 +82,12 @@ bitset_iterator_destroy(struct bitset_iterator *it)
 	}
 
 	if (it->page != NULL) {
-		bitset_page_destroy(it->page);
+		it->realloc(it->page->data, 0);
 		it->realloc(it->page, 0);
 	}
 
-	if (it->page != NULL) {
-		bitset_page_destroy(it->page_tmp);
+	if (it->page_tmp != NULL) {
+		it->realloc(it->page_tmp->data, 0);
 		it->realloc(it->page_tmp, 0);
 	}
 
@@ -173,6 +173,25 @@ error_1:
 	return -1;
 }
 
+/**
+ * Allocate a page for the iterator kernels, with a buffer large
+ * enough for any of array and bitmap page forms.
+ */
+static struct bitset_page *
+bitset_iterator_page_new(struct bitset_iterator *it)
+{
+	struct bitset_page *page = it->realloc(NULL, sizeof(*page));
+	if (page == NULL)
+		return NULL;
+	bitset_page_create(page);
+	page->data = it->realloc(NULL, BITSET_PAGE_BITMAP_SIZE);
+	if (page->data == NULL) {
+		it->realloc(page, 0);
+		return NULL;
+	}
+	return page;
+}
+
 int
 bitset_iterator_init(struct bitset_iterator *it, struct bitset_expr *expr,
 		     struct bitset **p_bitsets, size_t bitsets_size)
@@ -183,25 +202,18 @@ bitset_iterator_init(struct bitset_iterator *it, struct bitset_expr *expr,
 		assert(p_bitsets != NULL);
 	}
 
-	size_t page_alloc_size = bitset_page_alloc_size(it->realloc);
-	if (it->page != NULL) {
-		bitset_page_destroy(it->page);
-	} else {
-		it->page = it->realloc(NULL, page_alloc_size);
+	if (it->page == NULL) {
+		it->page = bitset_iterator_page_new(it);
+		if (it->page == NULL)
+			return -1;
 	}
 
-	bitset_page_create(it->page);
-
-	if (it->page_tmp != NULL) {
-		bitset_page_destroy(it->page_tmp);
-	} else {
-		it->page_tmp = it->realloc(NULL, page_alloc_size);
+	if (it->page_tmp == NULL) {
+		it->page_tmp = bitset_iterator_page_new(it);
 		if (it->page_tmp == NULL)
 			return -1;
 	}
 
-	bitset_page_create(it->page_tmp);
-
 	if (bitset_iterator_reserve(it, expr->size) != 0)
 		return -1;
 
@@ -235,10 +247,10 @@ static void
 bitset_iterator_conj_rewind(struct bitset_iterator_conj *conj, size_t pos)
 {
 	assert(conj != NULL);
-	assert(pos % (BITSET_PAGE_DATA_SIZE * CHAR_BIT) == 0);
+	assert(pos == SIZE_MAX || pos % BITSET_PAGE_BIT == 0);
 	assert(conj->page_first_pos <= pos);
 
-	if (conj->size == 0) {
+	if (conj->size == 0 || pos == SIZE_MAX) {
 		conj->page_first_pos = SIZE_MAX;
 		return;
 	}
@@ -305,12 +317,36 @@ bitset_iterator_conj_prepare_page(struct bitset_iterator_conj *conj,
 	assert(conj->size > 0);
 	assert(conj->page_first_pos != SIZE_MAX);
 
-	bitset_page_set_ones(dst);
+	/*
+	 * Start from the smallest array page, so that the result
+	 * stays an array and intersections with other pages cost
+	 * O(size of the array). Without array pages start from any
+	 * page, and from ones if all bitsets are negated.
+	 */
+	struct bitset_page *base = NULL;
 	for (size_t b = 0; b < conj->size; b++) {
+		if (conj->pre_nots[b])
+			continue;
+		/* conj->pages[b] is rewinded to conj->page_first_pos */
+		struct bitset_page *page = conj->pages[b];
+		assert(page->first_pos == conj->page_first_pos);
+		if (base == NULL ||
+		    (page->type == BITSET_PAGE_ARRAY &&
+		     (base->type != BITSET_PAGE_ARRAY ||
+		      page->cardinality < base->cardinality)))
+			base = page;
+	}
+	if (base != NULL)
+		bitset_page_copy(dst, base);
+	else
+		bitset_page_set_ones(dst);
+
+	for (size_t b = 0; b < conj->size; b++) {
+		if (dst->type == BITSET_PAGE_ARRAY && dst->cardinality == 0)
+			break;
 		if (!conj->pre_nots[b]) {
-			/* conj->pages[b] is rewinded to conj->page_first_pos */
-			assert(conj->pages[b]->first_pos == conj->page_first_pos);
-			bitset_page_and(dst, conj->pages[b]);
+			if (conj->pages[b] != base)
+				bitset_page_and(dst, conj->pages[b]);
 		} else {
 			/*
 			 * If page is NULL or its position is not equal
@@ -332,10 +368,11 @@ bitset_iterator_conj_prepare_page(struct bitset_iterator_conj *conj,
 static void
 bitset_iterator_prepare_page(struct bitset_iterator *it)
 {
-	qsort(it->conjs, it->size, sizeof(*it->conjs),
-	      bitset_iterator_conj_cmp);
+	if (it->size > 1) {
+		qsort(it->conjs, it->size, sizeof(*it->conjs),
+		      bitset_iterator_conj_cmp);
+	}
 
-	bitset_page_set_zeros(it->page);
 	if (it->size > 0) {
 		it->page->first_pos = it->conjs[0].page_first_pos;
 	} else {
@@ -346,20 +383,32 @@ bitset_iterator_prepare_page(struct bitset_iterator *it)
 	if (it->page->first_pos == SIZE_MAX)
 		return;
 
-	/* For each conj where conj->page_first_pos == pos */
-	for (size_t c = 0; c < it->size; c++) {
-		if (it->conjs[c].page_first_pos > it->page->first_pos)
-			break;
-
-		/* Get result from conj */
-		bitset_iterator_conj_prepare_page(&it->conjs[c], it->page_tmp);
-		/* OR page from conjunction with it->page */
-		bitset_page_or(it->page, it->page_tmp);
+	if (it->size == 1 ||
+	    it->conjs[1].page_first_pos > it->page->first_pos) {
+		/* Only one conj has the page, no need to OR */
+		bitset_iterator_conj_prepare_page(&it->conjs[0], it->page);
+	} else {
+		bitset_page_set_zeros(it->page);
+		/* For each conj where conj->page_first_pos == pos */
+		for (size_t c = 0; c < it->size; c++) {
+			if (it->conjs[c].page_first_pos > it->page->first_pos)
+				break;
+
+			/* Get result from conj */
+			bitset_iterator_conj_prepare_page(&it->conjs[c],
+							  it->page_tmp);
+			/* OR page from conjunction with it->page */
+			bitset_page_or(it->page, it->page_tmp);
+		}
 	}
 
-	/* Init the bit iterator on it->page */
-	bit_iterator_init(&it->page_it, bitset_page_data(it->page),
-		      BITSET_PAGE_DATA_SIZE, true);
+	/* Init the page iterator on it->page */
+	if (it->page->type == BITSET_PAGE_ARRAY) {
+		it->page_array_pos = 0;
+	} else {
+		bit_iterator_init(&it->page_it, it->page->data,
+				  BITSET_PAGE_BITMAP_SIZE, true);
+	}
 }
 
 static void
@@ -381,8 +430,10 @@ bitset_iterator_next_page(struct bitset_iterator *it)
 {
 	assert(it != NULL);
 
-	size_t PAGE_BIT = BITSET_PAGE_DATA_SIZE * CHAR_BIT;
 	size_t pos = it->page->first_pos;
+	/* Don't overflow on the last page of the position space */
+	size_t next_pos = pos <= SIZE_MAX - BITSET_PAGE_BIT ?
+			  pos + BITSET_PAGE_BIT : SIZE_MAX;
 
 	/* Rewind all conjunctions that at the current position to the
 	 * next position */
@@ -390,8 +441,8 @@ bitset_iterator_next_page(struct bitset_iterator *it)
 		if (it->conjs[c].page_first_pos > pos)
 			break;
 
-		bitset_iterator_conj_rewind(&it->conjs[c], pos + PAGE_BIT);
-		assert(pos + PAGE_BIT <= it->conjs[c].page_first_pos);
+		bitset_iterator_conj_rewind(&it->conjs[c], next_pos);
+		assert(next_pos <= it->conjs[c].page_first_pos);
 	}
 
 	/* Prepare the result page */
@@ -417,7 +468,14 @@ bitset_iterator_next(struct bitset_iterator *it)
 		if (it->page->first_pos == SIZE_MAX)
 			return SIZE_MAX;
 
-		size_t pos = bit_iterator_next(&it->page_it);
+		size_t pos;
+		if (it->page->type == BITSET_PAGE_ARRAY) {
+			const uint16_t *array = (const uint16_t *) it->page->data;
+			pos = it->page_array_pos < it->page->cardinality ?
+			      array[it->page_array_pos++] : SIZE_MAX;
+		} else {
+			pos = bit_iterator_next(&it->page_it);
+		}
 		if (pos != SIZE_MAX) {
 			return it->page->first_pos + pos;
 		}
@@ -71,6 +71,7 @@ struct bitset_iterator {
 	struct bitset_page *page_tmp;
 	void *(*realloc)(void *ptr, size_t size);
 	struct bit_iterator page_it;
+	size_t page_array_pos;
 	/** @endcond **/
 };
 
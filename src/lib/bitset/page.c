@@ -31,46 +31,838 @@
 
 #include "page.h"
 #include "bitset/bitset.h"
+#include "bit/bit.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum {
+	/** Number of words in a bitmap page */
+	BITMAP_WORDS = BITSET_PAGE_BITMAP_SIZE / sizeof(uint64_t),
+	/** Minimal number of items allocated in an array or run page */
+	PAGE_CAPACITY_MIN = 4,
+};
 
 extern inline size_t
-bitset_page_alloc_size(void *(*realloc_arg)(void *ptr, size_t size));
+bitset_page_first_pos(size_t pos);
 
-extern inline void *
-bitset_page_data(struct bitset_page *page);
+static inline uint16_t *
+page_array(const struct bitset_page *page)
+{
+	assert(page->type == BITSET_PAGE_ARRAY);
+	return (uint16_t *) page->data;
+}
 
-extern inline void
-bitset_page_create(struct bitset_page *page);
+static inline uint64_t *
+page_bitmap(const struct bitset_page *page)
+{
+	assert(page->type == BITSET_PAGE_BITMAP);
+	return (uint64_t *) page->data;
+}
 
-extern inline void
-bitset_page_destroy(struct bitset_page *page);
+static inline struct bitset_run *
+page_runs(const struct bitset_page *page)
+{
+	assert(page->type == BITSET_PAGE_RUN);
+	return (struct bitset_run *) page->data;
+}
 
-extern inline size_t
-bitset_page_first_pos(size_t pos);
+/** Index of the first item of @a array not less than @a pos */
+static inline uint32_t
+array_lower_bound(const uint16_t *array, uint32_t size, uint32_t pos)
+{
+	uint32_t lo = 0, hi = size;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (array[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/** Index of the first run of @a runs starting after @a pos */
+static inline uint32_t
+runs_upper_bound(const struct bitset_run *runs, uint32_t size, uint32_t pos)
+{
+	uint32_t lo = 0, hi = size;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (runs[mid].start <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static inline bool
+bitmap_test(const uint64_t *bitmap, uint32_t pos)
+{
+	return (bitmap[pos / 64] >> (pos % 64)) & 1;
+}
+
+/** Set bits [start, last] of @a bitmap */
+static void
+bitmap_set_range(uint64_t *bitmap, uint32_t start, uint32_t last)
+{
+	uint32_t first_word = start / 64, last_word = last / 64;
+	uint64_t first_mask = ~0ULL << (start % 64);
+	uint64_t last_mask = ~0ULL >> (63 - last % 64);
+	if (first_word == last_word) {
+		bitmap[first_word] |= first_mask & last_mask;
+		return;
+	}
+	bitmap[first_word] |= first_mask;
+	for (uint32_t w = first_word + 1; w < last_word; w++)
+		bitmap[w] = ~0ULL;
+	bitmap[last_word] |= last_mask;
+}
+
+/** Clear bits [start, last] of @a bitmap */
+static void
+bitmap_clear_range(uint64_t *bitmap, uint32_t start, uint32_t last)
+{
+	uint32_t first_word = start / 64, last_word = last / 64;
+	uint64_t first_mask = ~0ULL << (start % 64);
+	uint64_t last_mask = ~0ULL >> (63 - last % 64);
+	if (first_word == last_word) {
+		bitmap[first_word] &= ~(first_mask & last_mask);
+		return;
+	}
+	bitmap[first_word] &= ~first_mask;
+	for (uint32_t w = first_word + 1; w < last_word; w++)
+		bitmap[w] = 0;
+	bitmap[last_word] &= ~last_mask;
+}
+
+/*
+ * Bitmap kernels, processing 128 or 256 bits per instruction
+ * if the target supports SSE2 or AVX2. The buffers may be
+ * unaligned, as they come from the user allocator.
+ */
+
+static void
+bitmap_and(uint64_t *dst, const uint64_t *src)
+{
+#if defined(__AVX2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 4) {
+		__m256i d = _mm256_loadu_si256((const __m256i *) (dst + w));
+		__m256i s = _mm256_loadu_si256((const __m256i *) (src + w));
+		_mm256_storeu_si256((__m256i *) (dst + w),
+				    _mm256_and_si256(d, s));
+	}
+#elif defined(__SSE2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 2) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + w));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + w));
+		_mm_storeu_si128((__m128i *) (dst + w), _mm_and_si128(d, s));
+	}
+#else
+	for (uint32_t w = 0; w < BITMAP_WORDS; w++)
+		dst[w] &= src[w];
+#endif
+}
+
+static void
+bitmap_nand(uint64_t *dst, const uint64_t *src)
+{
+#if defined(__AVX2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 4) {
+		__m256i d = _mm256_loadu_si256((const __m256i *) (dst + w));
+		__m256i s = _mm256_loadu_si256((const __m256i *) (src + w));
+		_mm256_storeu_si256((__m256i *) (dst + w),
+				    _mm256_andnot_si256(s, d));
+	}
+#elif defined(__SSE2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 2) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + w));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + w));
+		_mm_storeu_si128((__m128i *) (dst + w), _mm_andnot_si128(s, d));
+	}
+#else
+	for (uint32_t w = 0; w < BITMAP_WORDS; w++)
+		dst[w] &= ~src[w];
+#endif
+}
+
+static void
+bitmap_or(uint64_t *dst, const uint64_t *src)
+{
+#if defined(__AVX2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 4) {
+		__m256i d = _mm256_loadu_si256((const __m256i *) (dst + w));
+		__m256i s = _mm256_loadu_si256((const __m256i *) (src + w));
+		_mm256_storeu_si256((__m256i *) (dst + w),
+				    _mm256_or_si256(d, s));
+	}
+#elif defined(__SSE2__)
+	for (uint32_t w = 0; w < BITMAP_WORDS; w += 2) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + w));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + w));
+		_mm_storeu_si128((__m128i *) (dst + w), _mm_or_si128(d, s));
+	}
+#else
+	for (uint32_t w = 0; w < BITMAP_WORDS; w++)
+		dst[w] |= src[w];
+#endif
+}
+
+/* {{{ Page construction and conversion */
+
+void
+bitset_page_create(struct bitset_page *page)
+{
+	memset(page, 0, sizeof(*page));
+	page->type = BITSET_PAGE_ARRAY;
+}
+
+void
+bitset_page_destroy(struct bitset_page *page,
+		    void *(*realloc)(void *ptr, size_t size))
+{
+	if (page->data != NULL)
+		realloc(page->data, 0);
+	page->data = NULL;
+	page->capacity = 0;
+}
+
+size_t
+bitset_page_mem_size(const struct bitset_page *page)
+{
+	switch (page->type) {
+	case BITSET_PAGE_ARRAY:
+		return sizeof(*page) + page->capacity * sizeof(uint16_t);
+	case BITSET_PAGE_BITMAP:
+		return sizeof(*page) + BITSET_PAGE_BITMAP_SIZE;
+	case BITSET_PAGE_RUN:
+		return sizeof(*page) +
+		       page->capacity * sizeof(struct bitset_run);
+	default:
+		unreachable();
+	}
+	return 0;
+}
+
+/** Number of runs in a sorted array of positions */
+static uint32_t
+array_run_count(const uint16_t *array, uint32_t size)
+{
+	uint32_t count = size > 0 ? 1 : 0;
+	for (uint32_t i = 1; i < size; i++)
+		count += array[i] != array[i - 1] + 1;
+	return count;
+}
+
+/**
+ * Change the data buffer of @a page to one of @a capacity items
+ * of @a item_size bytes, keeping the contents.
+ */
+static int
+page_reserve(struct bitset_page *page, uint32_t capacity, size_t item_size,
+	     void *(*realloc)(void *ptr, size_t size))
+{
+	void *data = realloc(page->data, capacity * item_size);
+	if (data == NULL)
+		return -1;
+	page->data = data;
+	page->capacity = capacity;
+	return 0;
+}
+
+/** Convert a full array page to a run or a bitmap page */
+static int
+page_array_convert(struct bitset_page *page,
+		   void *(*realloc)(void *ptr, size_t size))
+{
+	uint16_t *array = page_array(page);
+	uint32_t size = page->cardinality;
+	uint32_t run_count = array_run_count(array, size);
+	if (run_count < BITSET_PAGE_RUN_MAX / 2) {
+		/* Leave room for new runs. */
+		uint32_t capacity = run_count + PAGE_CAPACITY_MIN;
+		struct bitset_run *runs =
+			realloc(NULL, capacity * sizeof(*runs));
+		if (runs == NULL)
+			return -1;
+		uint32_t r = 0;
+		runs[0].start = runs[0].last = array[0];
+		for (uint32_t i = 1; i < size; i++) {
+			if (array[i] == runs[r].last + 1) {
+				runs[r].last = array[i];
+			} else {
+				r++;
+				runs[r].start = runs[r].last = array[i];
+			}
+		}
+		assert(r + 1 == run_count);
+		realloc(page->data, 0);
+		page->data = runs;
+		page->capacity = capacity;
+		page->size = run_count;
+		page->type = BITSET_PAGE_RUN;
+		return 0;
+	}
+	uint64_t *bitmap = realloc(NULL, BITSET_PAGE_BITMAP_SIZE);
+	if (bitmap == NULL)
+		return -1;
+	memset(bitmap, 0, BITSET_PAGE_BITMAP_SIZE);
+	for (uint32_t i = 0; i < size; i++)
+		bitmap[array[i] / 64] |= 1ULL << (array[i] % 64);
+	realloc(page->data, 0);
+	page->data = bitmap;
+	page->capacity = 0;
+	page->type = BITSET_PAGE_BITMAP;
+	return 0;
+}
 
-extern inline void
-bitset_page_set_zeros(struct bitset_page *page);
+/** Convert a bitmap or a run page to an array page */
+static int
+page_to_array(struct bitset_page *page,
+	      void *(*realloc)(void *ptr, size_t size))
+{
+	assert(page->cardinality <= BITSET_PAGE_ARRAY_MAX);
+	uint32_t capacity = page->cardinality + PAGE_CAPACITY_MIN;
+	uint16_t *array = realloc(NULL, capacity * sizeof(*array));
+	if (array == NULL)
+		return -1;
+	uint32_t size = 0;
+	if (page->type == BITSET_PAGE_BITMAP) {
+		struct bit_iterator it;
+		bit_iterator_init(&it, page->data, BITSET_PAGE_BITMAP_SIZE,
+				  true);
+		size_t pos;
+		while ((pos = bit_iterator_next(&it)) != SIZE_MAX)
+			array[size++] = pos;
+	} else {
+		struct bitset_run *runs = page_runs(page);
+		for (uint32_t r = 0; r < page->size; r++) {
+			for (uint32_t pos = runs[r].start;
+			     pos <= runs[r].last; pos++)
+				array[size++] = pos;
+		}
+	}
+	assert(size == page->cardinality);
+	realloc(page->data, 0);
+	page->data = array;
+	page->capacity = capacity;
+	page->size = 0;
+	page->type = BITSET_PAGE_ARRAY;
+	return 0;
+}
 
-extern inline void
-bitset_page_set_ones(struct bitset_page *page);
+/** Convert a run page to a bitmap page */
+static int
+page_run_to_bitmap(struct bitset_page *page,
+		   void *(*realloc)(void *ptr, size_t size))
+{
+	uint64_t *bitmap = realloc(NULL, BITSET_PAGE_BITMAP_SIZE);
+	if (bitmap == NULL)
+		return -1;
+	memset(bitmap, 0, BITSET_PAGE_BITMAP_SIZE);
+	struct bitset_run *runs = page_runs(page);
+	for (uint32_t r = 0; r < page->size; r++)
+		bitmap_set_range(bitmap, runs[r].start, runs[r].last);
+	realloc(page->data, 0);
+	page->data = bitmap;
+	page->capacity = 0;
+	page->size = 0;
+	page->type = BITSET_PAGE_BITMAP;
+	return 0;
+}
+
+/* }}} */
 
-extern inline void
-bitset_page_and(struct bitset_page *dst, struct bitset_page *src);
+/* {{{ Single bit operations */
 
-extern inline void
-bitset_page_nand(struct bitset_page *dst, struct bitset_page *src);
+bool
+bitset_page_test(const struct bitset_page *page, uint32_t pos)
+{
+	assert(pos < BITSET_PAGE_BIT);
+	switch (page->type) {
+	case BITSET_PAGE_ARRAY: {
+		uint16_t *array = page_array(page);
+		uint32_t i = array_lower_bound(array, page->cardinality, pos);
+		return i < page->cardinality && array[i] == pos;
+	}
+	case BITSET_PAGE_BITMAP:
+		return bitmap_test(page_bitmap(page), pos);
+	case BITSET_PAGE_RUN: {
+		struct bitset_run *runs = page_runs(page);
+		uint32_t i = runs_upper_bound(runs, page->size, pos);
+		return i > 0 && pos <= runs[i - 1].last;
+	}
+	default:
+		unreachable();
+	}
+	return false;
+}
+
+static int
+page_array_set(struct bitset_page *page, uint32_t pos,
+	       void *(*realloc)(void *ptr, size_t size))
+{
+	uint16_t *array = page_array(page);
+	uint32_t size = page->cardinality;
+	uint32_t i = array_lower_bound(array, size, pos);
+	if (i < size && array[i] == pos)
+		return 1;
+	if (size == BITSET_PAGE_ARRAY_MAX) {
+		if (page_array_convert(page, realloc) != 0)
+			return -1;
+		return bitset_page_set(page, pos, realloc);
+	}
+	if (size == page->capacity) {
+		uint32_t capacity = page->capacity * 2;
+		if (capacity < PAGE_CAPACITY_MIN)
+			capacity = PAGE_CAPACITY_MIN;
+		if (capacity > BITSET_PAGE_ARRAY_MAX)
+			capacity = BITSET_PAGE_ARRAY_MAX;
+		if (page_reserve(page, capacity, sizeof(*array),
+				 realloc) != 0)
+			return -1;
+		array = page_array(page);
+	}
+	memmove(array + i + 1, array + i, (size - i) * sizeof(*array));
+	array[i] = pos;
+	page->cardinality++;
+	return 0;
+}
+
+static int
+page_bitmap_set(struct bitset_page *page, uint32_t pos,
+		void *(*realloc)(void *ptr, size_t size))
+{
+	uint64_t *bitmap = page_bitmap(page);
+	if (bitmap_test(bitmap, pos))
+		return 1;
+	bitmap[pos / 64] |= 1ULL << (pos % 64);
+	page->cardinality++;
+	if (page->cardinality == BITSET_PAGE_BIT) {
+		/*
+		 * A full page is a single run. Keep spare runs, so
+		 * that clearing the bit back doesn't need memory.
+		 */
+		struct bitset_run *runs =
+			realloc(NULL, PAGE_CAPACITY_MIN * sizeof(*runs));
+		if (runs == NULL)
+			return 0; /* stay a bitmap */
+		runs[0].start = 0;
+		runs[0].last = BITSET_PAGE_BIT - 1;
+		realloc(page->data, 0);
+		page->data = runs;
+		page->capacity = PAGE_CAPACITY_MIN;
+		page->size = 1;
+		page->type = BITSET_PAGE_RUN;
+	}
+	return 0;
+}
+
+static int
+page_run_set(struct bitset_page *page, uint32_t pos,
+	     void *(*realloc)(void *ptr, size_t size))
+{
+	struct bitset_run *runs = page_runs(page);
+	uint32_t size = page->size;
+	uint32_t i = runs_upper_bound(runs, size, pos);
+	if (i > 0 && pos <= runs[i - 1].last)
+		return 1;
+	bool extend_prev = i > 0 && runs[i - 1].last + 1 == pos;
+	bool extend_next = i < size && runs[i].start == pos + 1;
+	if (extend_prev && extend_next) {
+		/* Merge the runs around. */
+		runs[i - 1].last = runs[i].last;
+		memmove(runs + i, runs + i + 1,
+			(size - i - 1) * sizeof(*runs));
+		page->size--;
+	} else if (extend_prev) {
+		runs[i - 1].last = pos;
+	} else if (extend_next) {
+		runs[i].start = pos;
+	} else {
+		/* A new run: an array or a bitmap may be smaller. */
+		if (page->cardinality < BITSET_PAGE_ARRAY_MAX &&
+		    page->cardinality + 1 < 2 * (size + 1)) {
+			if (page_to_array(page, realloc) != 0)
+				return -1;
+			return bitset_page_set(page, pos, realloc);
+		}
+		if (size == BITSET_PAGE_RUN_MAX) {
+			if (page_run_to_bitmap(page, realloc) != 0)
+				return -1;
+			return bitset_page_set(page, pos, realloc);
+		}
+		if (size == page->capacity) {
+			uint32_t capacity = page->capacity * 2;
+			if (capacity < PAGE_CAPACITY_MIN)
+				capacity = PAGE_CAPACITY_MIN;
+			if (capacity > BITSET_PAGE_RUN_MAX)
+				capacity = BITSET_PAGE_RUN_MAX;
+			if (page_reserve(page, capacity, sizeof(*runs),
+					 realloc) != 0)
+				return -1;
+			runs = page_runs(page);
+		}
+		memmove(runs + i + 1, runs + i, (size - i) * sizeof(*runs));
+		runs[i].start = runs[i].last = pos;
+		page->size++;
+	}
+	page->cardinality++;
+	return 0;
+}
+
+int
+bitset_page_set(struct bitset_page *page, uint32_t pos,
+		void *(*realloc)(void *ptr, size_t size))
+{
+	assert(pos < BITSET_PAGE_BIT);
+	switch (page->type) {
+	case BITSET_PAGE_ARRAY:
+		return page_array_set(page, pos, realloc);
+	case BITSET_PAGE_BITMAP:
+		return page_bitmap_set(page, pos, realloc);
+	case BITSET_PAGE_RUN:
+		return page_run_set(page, pos, realloc);
+	default:
+		unreachable();
+	}
+	return -1;
+}
+
+static int
+page_array_clear(struct bitset_page *page, uint32_t pos,
+		 void *(*realloc)(void *ptr, size_t size))
+{
+	uint16_t *array = page_array(page);
+	uint32_t size = page->cardinality;
+	uint32_t i = array_lower_bound(array, size, pos);
+	if (i == size || array[i] != pos)
+		return 0;
+	memmove(array + i, array + i + 1, (size - i - 1) * sizeof(*array));
+	page->cardinality--;
+	if (page->cardinality < page->capacity / 4 &&
+	    page->capacity > PAGE_CAPACITY_MIN) {
+		/* Shrink, ignoring failures. */
+		page_reserve(page, page->capacity / 2, sizeof(*array),
+			     realloc);
+	}
+	return 1;
+}
+
+static int
+page_bitmap_clear(struct bitset_page *page, uint32_t pos,
+		  void *(*realloc)(void *ptr, size_t size))
+{
+	uint64_t *bitmap = page_bitmap(page);
+	if (!bitmap_test(bitmap, pos))
+		return 0;
+	bitmap[pos / 64] &= ~(1ULL << (pos % 64));
+	page->cardinality--;
+	/*
+	 * Convert to an array with a hysteresis, so that a bit
+	 * set and cleared at the limit doesn't convert the page
+	 * back and forth.
+	 */
+	if (page->cardinality <= BITSET_PAGE_ARRAY_MAX / 2)
+		page_to_array(page, realloc); /* stay a bitmap on error */
+	return 1;
+}
+
+/**
+ * Make room for one more run in a full run page: grow the page
+ * or, if it has the maximal number of runs, convert it to
+ * a bitmap page.
+ */
+static int
+page_run_reserve_split(struct bitset_page *page,
+		       void *(*realloc)(void *ptr, size_t size))
+{
+	assert(page->size == page->capacity);
+	if (page->size == BITSET_PAGE_RUN_MAX)
+		return page_run_to_bitmap(page, realloc);
+	uint32_t capacity = page->capacity * 2;
+	if (capacity > BITSET_PAGE_RUN_MAX)
+		capacity = BITSET_PAGE_RUN_MAX;
+	return page_reserve(page, capacity, sizeof(struct bitset_run),
+			    realloc);
+}
+
+static int
+page_run_clear(struct bitset_page *page, uint32_t pos,
+	       void *(*realloc)(void *ptr, size_t size))
+{
+	struct bitset_run *runs = page_runs(page);
+	uint32_t size = page->size;
+	uint32_t i = runs_upper_bound(runs, size, pos);
+	if (i == 0 || pos > runs[i - 1].last)
+		return 0;
+	struct bitset_run *run = &runs[i - 1];
+	if (run->start == pos && run->last == pos) {
+		memmove(run, run + 1, (size - i) * sizeof(*runs));
+		page->size--;
+	} else if (run->start == pos) {
+		run->start++;
+	} else if (run->last == pos) {
+		run->last--;
+	} else {
+		/* Split the run. */
+		if (size == page->capacity) {
+			if (page_run_reserve_split(page, realloc) != 0)
+				return -1;
+			return bitset_page_clear(page, pos, realloc);
+		}
+		memmove(run + 2, run + 1, (size - i) * sizeof(*runs));
+		run[1].start = pos + 1;
+		run[1].last = run->last;
+		run->last = pos - 1;
+		page->size++;
+	}
+	page->cardinality--;
+	if (page->cardinality > 0 &&
+	    page->cardinality < 2 * page->size) {
+		/* An array is smaller, stay a run page on error. */
+		page_to_array(page, realloc);
+	}
+	return 1;
+}
+
+int
+bitset_page_clear(struct bitset_page *page, uint32_t pos,
+		  void *(*realloc)(void *ptr, size_t size))
+{
+	assert(pos < BITSET_PAGE_BIT);
+	switch (page->type) {
+	case BITSET_PAGE_ARRAY:
+		return page_array_clear(page, pos, realloc);
+	case BITSET_PAGE_BITMAP:
+		return page_bitmap_clear(page, pos, realloc);
+	case BITSET_PAGE_RUN:
+		return page_run_clear(page, pos, realloc);
+	default:
+		unreachable();
+	}
+	return -1;
+}
+
+int
+bitset_page_reserve_clear(struct bitset_page *page, uint32_t pos,
+			  void *(*realloc)(void *ptr, size_t size))
+{
+	assert(pos < BITSET_PAGE_BIT);
+	/* Only a split of a run in a full run page needs memory. */
+	if (page->type != BITSET_PAGE_RUN || page->size < page->capacity)
+		return 0;
+	struct bitset_run *runs = page_runs(page);
+	uint32_t i = runs_upper_bound(runs, page->size, pos);
+	if (i == 0 || pos <= runs[i - 1].start || pos >= runs[i - 1].last)
+		return 0;
+	return page_run_reserve_split(page, realloc);
+}
+
+/* }}} */
+
+/* {{{ Iterator kernels */
+
+void
+bitset_page_set_zeros(struct bitset_page *dst)
+{
+	dst->type = BITSET_PAGE_BITMAP;
+	memset(dst->data, 0, BITSET_PAGE_BITMAP_SIZE);
+}
+
+void
+bitset_page_set_ones(struct bitset_page *dst)
+{
+	dst->type = BITSET_PAGE_BITMAP;
+	memset(dst->data, -1, BITSET_PAGE_BITMAP_SIZE);
+}
+
+void
+bitset_page_copy(struct bitset_page *dst, const struct bitset_page *src)
+{
+	switch (src->type) {
+	case BITSET_PAGE_ARRAY:
+		dst->type = BITSET_PAGE_ARRAY;
+		dst->cardinality = src->cardinality;
+		memcpy(dst->data, src->data,
+		       src->cardinality * sizeof(uint16_t));
+		break;
+	case BITSET_PAGE_BITMAP:
+		dst->type = BITSET_PAGE_BITMAP;
+		memcpy(dst->data, src->data, BITSET_PAGE_BITMAP_SIZE);
+		break;
+	case BITSET_PAGE_RUN:
+		bitset_page_set_zeros(dst);
+		bitset_page_or(dst, src);
+		break;
+	default:
+		unreachable();
+	}
+}
+
+/**
+ * Keep the items of the array page @a dst which are (if @a keep
+ * is true) or are not (otherwise) in @a src.
+ */
+static void
+array_filter(struct bitset_page *dst, const struct bitset_page *src,
+	     bool keep)
+{
+	uint16_t *array = page_array(dst);
+	uint32_t size = dst->cardinality;
+	uint32_t count = 0;
+	switch (src->type) {
+	case BITSET_PAGE_ARRAY: {
+		/* Merge the sorted arrays. */
+		const uint16_t *other = page_array(src);
+		uint32_t other_size = src->cardinality;
+		uint32_t j = 0;
+		for (uint32_t i = 0; i < size; i++) {
+			if (other_size > 32 * size) {
+				/* Gallop over a much larger array. */
+				j += array_lower_bound(other + j,
+						       other_size - j,
+						       array[i]);
+			} else {
+				while (j < other_size && other[j] < array[i])
+					j++;
+			}
+			bool found = j < other_size && other[j] == array[i];
+			if (found == keep)
+				array[count++] = array[i];
+		}
+		break;
+	}
+	case BITSET_PAGE_BITMAP: {
+		const uint64_t *bitmap = page_bitmap(src);
+		for (uint32_t i = 0; i < size; i++) {
+			if (bitmap_test(bitmap, array[i]) == keep)
+				array[count++] = array[i];
+		}
+		break;
+	}
+	case BITSET_PAGE_RUN: {
+		const struct bitset_run *runs = page_runs(src);
+		uint32_t run_count = src->size;
+		uint32_t r = 0;
+		for (uint32_t i = 0; i < size; i++) {
+			while (r < run_count && runs[r].last < array[i])
+				r++;
+			bool found = r < run_count &&
+				     runs[r].start <= array[i];
+			if (found == keep)
+				array[count++] = array[i];
+		}
+		break;
+	}
+	default:
+		unreachable();
+	}
+	dst->cardinality = count;
+}
+
+void
+bitset_page_and(struct bitset_page *dst, const struct bitset_page *src)
+{
+	if (dst->type == BITSET_PAGE_ARRAY) {
+		array_filter(dst, src, true);
+		return;
+	}
+	uint64_t *bitmap = page_bitmap(dst);
+	switch (src->type) {
+	case BITSET_PAGE_BITMAP:
+		bitmap_and(bitmap, page_bitmap(src));
+		break;
+	case BITSET_PAGE_RUN: {
+		/* Clear the gaps between the runs. */
+		const struct bitset_run *runs = page_runs(src);
+		uint32_t start = 0;
+		for (uint32_t r = 0; r < src->size; r++) {
+			if (runs[r].start > start)
+				bitmap_clear_range(bitmap, start,
+						   runs[r].start - 1);
+			start = runs[r].last + 1;
+		}
+		if (start < BITSET_PAGE_BIT)
+			bitmap_clear_range(bitmap, start, BITSET_PAGE_BIT - 1);
+		break;
+	}
+	default:
+		/* The iterator starts from the smallest array. */
+		unreachable();
+	}
+}
+
+void
+bitset_page_nand(struct bitset_page *dst, const struct bitset_page *src)
+{
+	if (dst->type == BITSET_PAGE_ARRAY) {
+		array_filter(dst, src, false);
+		return;
+	}
+	uint64_t *bitmap = page_bitmap(dst);
+	switch (src->type) {
+	case BITSET_PAGE_ARRAY: {
+		const uint16_t *array = page_array(src);
+		for (uint32_t i = 0; i < src->cardinality; i++)
+			bitmap[array[i] / 64] &= ~(1ULL << (array[i] % 64));
+		break;
+	}
+	case BITSET_PAGE_BITMAP:
+		bitmap_nand(bitmap, page_bitmap(src));
+		break;
+	case BITSET_PAGE_RUN: {
+		const struct bitset_run *runs = page_runs(src);
+		for (uint32_t r = 0; r < src->size; r++)
+			bitmap_clear_range(bitmap, runs[r].start, runs[r].last);
+		break;
+	}
+	default:
+		unreachable();
+	}
+}
+
+void
+bitset_page_or(struct bitset_page *dst, const struct bitset_page *src)
+{
+	uint64_t *bitmap = page_bitmap(dst);
+	switch (src->type) {
+	case BITSET_PAGE_ARRAY: {
+		const uint16_t *array = page_array(src);
+		for (uint32_t i = 0; i < src->cardinality; i++)
+			bitmap[array[i] / 64] |= 1ULL << (array[i] % 64);
+		break;
+	}
+	case BITSET_PAGE_BITMAP:
+		bitmap_or(bitmap, page_bitmap(src));
+		break;
+	case BITSET_PAGE_RUN: {
+		const struct bitset_run *runs = page_runs(src);
+		for (uint32_t r = 0; r < src->size; r++)
+			bitmap_set_range(bitmap, runs[r].start, runs[r].last);
+		break;
+	}
+	default:
+		unreachable();
+	}
+}
 
-extern inline void
-bitset_page_or(struct bitset_page *dst, struct bitset_page *src);
+/* }}} */
 
 #if defined(DEBUG)
 void
 bitset_page_dump(struct bitset_page *page, FILE *stream)
 {
-	fprintf(stream, "Page %zu:\n", page->first_pos);
-	char *d = bitset_page_data(page);
-	for (int i = 0; i < BITSET_PAGE_DATA_SIZE; i++) {
-		fprintf(stream, "%x ", *d);
-		d++;
+	static const char *type_strs[] = { "array", "bitmap", "run" };
+	fprintf(stream, "Page %zu (%s, %zu bits):\n", page->first_pos,
+		type_strs[page->type], page->cardinality);
+	for (uint32_t pos = 0; pos < BITSET_PAGE_BIT; pos++) {
+		if (bitset_page_test(page, pos))
+			fprintf(stream, "%u ", pos);
 	}
 	fprintf(stream, "\n--\n");
 }
@@ -35,6 +35,19 @@
  * @file
  * @brief Bitset page
  *
+ * A page holds the bits of a bitset in a range of BITSET_PAGE_BIT
+ * positions, as a container of a Roaring bitmap:
+ *
+ * - an array page is a sorted array of set positions (relative
+ *   to the page), used for up to BITSET_PAGE_ARRAY_MAX bits;
+ * - a bitmap page is a plain array of BITSET_PAGE_BIT bits;
+ * - a run page is a sorted array of runs of set positions, used
+ *   while it is smaller than a bitmap (e.g. dense ids).
+ *
+ * A page switches between the forms as bits are set and cleared.
+ * The iterator evaluates expressions page by page with the
+ * bitset_page_and/nand/or() kernels on pages of its own.
+ *
  * Private header file, please don't use directly.
  * @internal
  */
@@ -53,138 +66,124 @@
 extern "C" {
 #endif /* defined(__cplusplus) */
 
+/** A run of set positions [start, last] in a run page */
+struct bitset_run {
+	uint16_t start;
+	uint16_t last;
+};
+
 enum {
-	/** How many bytes to store in one page */
-	BITSET_PAGE_DATA_SIZE = 160
+	/** How many bits are stored in one page */
+	BITSET_PAGE_BIT = 1 << 16,
+	/** Size of a bitmap page data (in bytes) */
+	BITSET_PAGE_BITMAP_SIZE = BITSET_PAGE_BIT / CHAR_BIT,
+	/** Maximal number of positions in an array page */
+	BITSET_PAGE_ARRAY_MAX = 4096,
+	/** Maximal number of runs in a run page */
+	BITSET_PAGE_RUN_MAX = BITSET_PAGE_BITMAP_SIZE /
+			      sizeof(struct bitset_run),
 };
 
-#if defined(ENABLE_AVX)
-typedef __m256i bitset_word_t;
-#define BITSET_PAGE_DATA_ALIGNMENT 32
-#elif defined(ENABLE_SSE2)
-typedef __m128i bitset_word_t;
-#define BITSET_PAGE_DATA_ALIGNMENT 16
-#elif defined(__x86_64__)
-typedef uint64_t bitset_word_t;
-#define BITSET_PAGE_DATA_ALIGNMENT 1
-#else
-#define BITSET_PAGE_DATA_ALIGNMENT 1
-typedef uint32_t bitset_word_t;
-#endif
-
-#if (defined(__GLIBC__) && (__WORDSIZE == 64) && \
-     ((__GLIBC__ > 2) || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 8))) || \
-    (defined(__FreeBSD__) && !defined(__arm__) && !defined(__mips__)) || \
-    (defined(__APPLE__))
-/**
- * @brief Defined if malloc is 16-byte aligned
- * @see http://www.gnu.org/software/libc/manual/html_node/Aligned-Memory-Blocks.html
- * @see http://svn.freebsd.org/viewvc/base/stable/6/lib/libc/stdlib/malloc.c
- * @see http://svn.freebsd.org/viewvc/base/stable/7/lib/libc/stdlib/malloc.c
- * @see man malloc(2) on OS X
- */
-#define MALLOC_ALIGNMENT 16
-#else
-#define MALLOC_ALIGNMENT 8
-#endif /* aligned malloc */
+enum bitset_page_type {
+	BITSET_PAGE_ARRAY,
+	BITSET_PAGE_BITMAP,
+	BITSET_PAGE_RUN,
+};
 
 inline size_t
-bitset_page_alloc_size(void *(*realloc_arg)(void *ptr, size_t size))
-{
-	if (BITSET_PAGE_DATA_ALIGNMENT <= 1 || (
-		(MALLOC_ALIGNMENT % BITSET_PAGE_DATA_ALIGNMENT == 0) &&
-		(sizeof(struct bitset_page) % BITSET_PAGE_DATA_ALIGNMENT == 0) &&
-		(realloc_arg == realloc))) {
-
-		/* Alignment is not needed */
-		return sizeof(struct bitset_page) + BITSET_PAGE_DATA_SIZE;
-	}
-
-	return sizeof(struct bitset_page) + BITSET_PAGE_DATA_SIZE +
-			BITSET_PAGE_DATA_ALIGNMENT;
+bitset_page_first_pos(size_t pos) {
+	return pos - (pos % BITSET_PAGE_BIT);
 }
 
-#undef MALLOC_ALIGNMENT
+/**
+ * @brief Construct an empty page
+ * @param page page
+ */
+void
+bitset_page_create(struct bitset_page *page);
 
-inline void *
-bitset_page_data(struct bitset_page *page)
-{
-	uintptr_t r = (uintptr_t) (page->data + BITSET_PAGE_DATA_ALIGNMENT - 1);
-	return (void *) (r & ~((uintptr_t) BITSET_PAGE_DATA_ALIGNMENT - 1));
-}
+/**
+ * @brief Free the page data
+ * @param page page
+ * @param realloc memory allocator the page was filled with
+ */
+void
+bitset_page_destroy(struct bitset_page *page,
+		    void *(*realloc)(void *ptr, size_t size));
 
-inline void
-bitset_page_create(struct bitset_page *page)
-{
-	size_t size = ((char *) bitset_page_data(page) - (char *) page)
-			+ BITSET_PAGE_DATA_SIZE;
-	memset(page, 0, size);
-}
+/**
+ * @brief Return memory used by the page, including the header
+ * @param page page
+ */
+size_t
+bitset_page_mem_size(const struct bitset_page *page);
 
-inline void
-bitset_page_destroy(struct bitset_page *page)
-{
-	(void) page;
-	/* nothing */
-}
+/**
+ * @brief Test bit \a pos (relative to the page) in \a page
+ */
+bool
+bitset_page_test(const struct bitset_page *page, uint32_t pos);
 
-inline size_t
-bitset_page_first_pos(size_t pos) {
-	return pos - (pos % (BITSET_PAGE_DATA_SIZE * CHAR_BIT));
-}
+/**
+ * @brief Set bit \a pos (relative to the page) in \a page
+ * @retval 1 if the bit was set
+ * @retval 0 if the bit was not set
+ * @retval -1 on memory error, the page is not changed
+ */
+int
+bitset_page_set(struct bitset_page *page, uint32_t pos,
+		void *(*realloc)(void *ptr, size_t size));
 
-inline void
-bitset_page_set_zeros(struct bitset_page *page)
-{
-	void *data = bitset_page_data(page);
-	memset(data, 0, BITSET_PAGE_DATA_SIZE);
-}
+/**
+ * @brief Clear bit \a pos (relative to the page) in \a page
+ * @retval 1 if the bit was set
+ * @retval 0 if the bit was not set
+ * @retval -1 on memory error, the page is not changed
+ */
+int
+bitset_page_clear(struct bitset_page *page, uint32_t pos,
+		  void *(*realloc)(void *ptr, size_t size));
 
-inline void
-bitset_page_set_ones(struct bitset_page *page)
-{
-	void *data = bitset_page_data(page);
-	memset(data, -1, BITSET_PAGE_DATA_SIZE);
-}
+/**
+ * @brief Make sure that bitset_page_clear() of bit \a pos
+ * (relative to the page) in \a page won't need memory
+ * @retval 0 on success
+ * @retval -1 on memory error, the bits are not changed
+ */
+int
+bitset_page_reserve_clear(struct bitset_page *page, uint32_t pos,
+			  void *(*realloc)(void *ptr, size_t size));
 
-inline void
-bitset_page_and(struct bitset_page *dst, struct bitset_page *src)
-{
-	bitset_word_t *d = (bitset_word_t *) bitset_page_data(dst);
-	bitset_word_t *s = (bitset_word_t *) bitset_page_data(src);
-
-	assert(BITSET_PAGE_DATA_SIZE % sizeof(bitset_word_t) == 0);
-	int cnt = BITSET_PAGE_DATA_SIZE / sizeof(bitset_word_t);
-	for (int i = 0; i < cnt; i++) {
-		*d++ &= *s++;
-	}
-}
+/*
+ * Kernels for the iterator. They work on pages which data is
+ * a preallocated buffer of BITSET_PAGE_BITMAP_SIZE bytes, and
+ * keep them either arrays or bitmaps. The cardinality of such
+ * a bitmap page is not maintained.
+ */
 
-inline void
-bitset_page_nand(struct bitset_page *dst, struct bitset_page *src)
-{
-	bitset_word_t *d = (bitset_word_t *) bitset_page_data(dst);
-	bitset_word_t *s = (bitset_word_t *) bitset_page_data(src);
-
-	assert(BITSET_PAGE_DATA_SIZE % sizeof(bitset_word_t) == 0);
-	int cnt = BITSET_PAGE_DATA_SIZE / sizeof(bitset_word_t);
-	for (int i = 0; i < cnt; i++) {
-		*d++ &= ~*s++;
-	}
-}
+/** dst = zeros, a bitmap */
+void
+bitset_page_set_zeros(struct bitset_page *dst);
 
-inline void
-bitset_page_or(struct bitset_page *dst, struct bitset_page *src)
-{
-	bitset_word_t *d = (bitset_word_t *) bitset_page_data(dst);
-	bitset_word_t *s = (bitset_word_t *) bitset_page_data(src);
-
-	assert(BITSET_PAGE_DATA_SIZE % sizeof(bitset_word_t) == 0);
-	int cnt = BITSET_PAGE_DATA_SIZE / sizeof(bitset_word_t);
-	for (int i = 0; i < cnt; i++) {
-		*d++ |= *s++;
-	}
-}
+/** dst = ones, a bitmap */
+void
+bitset_page_set_ones(struct bitset_page *dst);
+
+/** dst = src, an array if src is an array, a bitmap otherwise */
+void
+bitset_page_copy(struct bitset_page *dst, const struct bitset_page *src);
+
+/** dst = dst & src, src can't be an array if dst is a bitmap */
+void
+bitset_page_and(struct bitset_page *dst, const struct bitset_page *src);
+
+/** dst = dst & ~src */
+void
+bitset_page_nand(struct bitset_page *dst, const struct bitset_page *src);
+
+/** dst = dst | src, dst must be a bitmap */
+void
+bitset_page_or(struct bitset_page *dst, const struct bitset_page *src);
 
 #if defined(DEBUG)
 void
@@ -0,0 +1,1239 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "art.h"
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*------------------------------------------------------------------------- */
+/* ART internal structures definition */
+/*------------------------------------------------------------------------- */
+
+enum art_node_type {
+	ART_NODE4,
+	ART_NODE16,
+	ART_NODE48,
+	ART_NODE256,
+};
+
+enum {
+	/* Extents start with a link in the list of extents */
+	ART_EXTENT_HEADER_SIZE = 16,
+	/* Initial number of frames of an iterator path */
+	ART_ITERATOR_PATH_MIN = 16,
+};
+
+/** Common header of inner nodes. */
+struct art_node {
+	/** Link in the list of free nodes or garbage. */
+	struct art_node *next;
+	/** Version of the tree the node was created in. */
+	uint32_t version;
+	/** Version of the tree the node was replaced in, if garbage. */
+	uint32_t retired;
+	/** Length of the compressed path. */
+	uint32_t prefix_len;
+	/** Number of children. */
+	uint16_t n_children;
+	/** enum art_node_type. */
+	uint8_t type;
+	/** First bytes of the compressed path. */
+	unsigned char prefix[ART_PREFIX_MAX];
+};
+
+/** Node of up to 4 children, sorted by their bytes. */
+struct art_node4 {
+	struct art_node base;
+	unsigned char keys[4];
+	struct art_node *children[4];
+};
+
+/** Node of up to 16 children, sorted by their bytes. */
+struct art_node16 {
+	struct art_node base;
+	unsigned char keys[16];
+	struct art_node *children[16];
+};
+
+/**
+ * Node of up to 48 children. A byte maps to a child slot + 1,
+ * or to 0 if there's no child for it.
+ */
+struct art_node48 {
+	struct art_node base;
+	uint8_t index[256];
+	struct art_node *children[48];
+};
+
+/** Node with a child slot for every byte. */
+struct art_node256 {
+	struct art_node base;
+	struct art_node *children[256];
+};
+
+static const size_t art_node_size[ART_NODE_TYPE_MAX] = {
+	sizeof(struct art_node4), sizeof(struct art_node16),
+	sizeof(struct art_node48), sizeof(struct art_node256),
+};
+
+static const uint16_t art_node_capacity[ART_NODE_TYPE_MAX] = {
+	4, 16, 48, 256
+};
+
+/*
+ * A node is replaced with a smaller one when a deletion leaves
+ * this many children. It is less than the capacity of the
+ * smaller node, so that a node doesn't flap between two sizes.
+ */
+static const uint16_t art_node_shrink_limit[ART_NODE_TYPE_MAX] = {
+	0, 3, 12, 37
+};
+
+/*------------------------------------------------------------------------- */
+/* Leaves */
+/*------------------------------------------------------------------------- */
+
+static inline bool
+art_is_leaf(const struct art_node *node)
+{
+	return ((uintptr_t) node & 1) != 0;
+}
+
+static inline struct art_node *
+art_leaf(void *value)
+{
+	assert(((uintptr_t) value & 1) == 0);
+	return (struct art_node *) ((uintptr_t) value | 1);
+}
+
+static inline void *
+art_leaf_value(const struct art_node *leaf)
+{
+	assert(art_is_leaf(leaf));
+	return (void *) ((uintptr_t) leaf & ~(uintptr_t) 1);
+}
+
+static inline uint32_t
+art_min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline const unsigned char *
+art_load_key(struct art *tree, const struct art_node *leaf, uint32_t *len)
+{
+	return tree->load_key(art_leaf_value(leaf), len, tree->arg);
+}
+
+/**
+ * Check if the key of a leaf is equal to the given one.
+ * @retval 1 - equal.
+ * @retval 0 - not equal.
+ * @retval -1 - memory error.
+ */
+static int
+art_leaf_matches(struct art *tree, const struct art_node *leaf,
+		 const unsigned char *key, uint32_t len)
+{
+	uint32_t leaf_len;
+	const unsigned char *leaf_key = art_load_key(tree, leaf, &leaf_len);
+	if (leaf_key == NULL)
+		return -1;
+	return leaf_len == len && memcmp(leaf_key, key, len) == 0;
+}
+
+/*------------------------------------------------------------------------- */
+/* Node allocation */
+/*------------------------------------------------------------------------- */
+
+/** Get a node of the type from the free list, carving a new extent. */
+static struct art_node *
+art_node_alloc(struct art *tree, enum art_node_type type)
+{
+	size_t size = art_node_size[type];
+	if (tree->free_nodes[type] == NULL) {
+		char *extent = (char *) tree->extent_alloc(tree->alloc_ctx);
+		if (extent == NULL)
+			return NULL;
+		*(void **) extent = tree->extents;
+		tree->extents = extent;
+		tree->n_extents++;
+		for (size_t offset = ART_EXTENT_HEADER_SIZE;
+		     offset + size <= tree->extent_size; offset += size) {
+			struct art_node *node =
+				(struct art_node *) (extent + offset);
+			node->next = tree->free_nodes[type];
+			tree->free_nodes[type] = node;
+		}
+	}
+	struct art_node *node = tree->free_nodes[type];
+	tree->free_nodes[type] = node->next;
+	memset(node, 0, size);
+	node->version = tree->version;
+	node->type = type;
+	return node;
+}
+
+static inline void
+art_node_free(struct art *tree, struct art_node *node)
+{
+	node->next = tree->free_nodes[node->type];
+	tree->free_nodes[node->type] = node;
+}
+
+/** Check if the node may be visible through a read view. */
+static inline bool
+art_node_is_shared(const struct art *tree, const struct art_node *node)
+{
+	return tree->views != NULL && node->version <= tree->views->version;
+}
+
+/**
+ * Free a node removed from the tree, or put it to garbage if
+ * a read view may still see it.
+ */
+static void
+art_node_retire(struct art *tree, struct art_node *node)
+{
+	if (!art_node_is_shared(tree, node)) {
+		art_node_free(tree, node);
+		return;
+	}
+	node->retired = tree->version;
+	node->next = tree->garbage;
+	tree->garbage = node;
+}
+
+/*------------------------------------------------------------------------- */
+/* Children */
+/*------------------------------------------------------------------------- */
+
+/** Index of the byte among the keys of a node16, -1 if none. */
+static inline int
+art_node16_find(const struct art_node16 *node, unsigned char byte)
+{
+#if defined(__SSE2__)
+	__m128i keys = _mm_loadu_si128((const __m128i *) node->keys);
+	__m128i cmp = _mm_cmpeq_epi8(keys, _mm_set1_epi8((char) byte));
+	unsigned mask = _mm_movemask_epi8(cmp) &
+			((1U << node->base.n_children) - 1);
+	return mask != 0 ? __builtin_ctz(mask) : -1;
+#else
+	for (int i = 0; i < node->base.n_children; i++) {
+		if (node->keys[i] == byte)
+			return i;
+	}
+	return -1;
+#endif
+}
+
+/**
+ * Index of the first key of a node16 not less than the byte,
+ * -1 if none.
+ */
+static inline int
+art_node16_seek(const struct art_node16 *node, unsigned char byte)
+{
+#if defined(__SSE2__)
+	__m128i keys = _mm_loadu_si128((const __m128i *) node->keys);
+	/* max(key, byte) == key iff key >= byte, unsigned. */
+	__m128i cmp = _mm_cmpeq_epi8(_mm_max_epu8(keys,
+				     _mm_set1_epi8((char) byte)), keys);
+	unsigned mask = _mm_movemask_epi8(cmp) &
+			((1U << node->base.n_children) - 1);
+	return mask != 0 ? __builtin_ctz(mask) : -1;
+#else
+	for (int i = 0; i < node->base.n_children; i++) {
+		if (node->keys[i] >= byte)
+			return i;
+	}
+	return -1;
+#endif
+}
+
+/** Sorted keys and children of a node4 or a node16. */
+static inline void
+art_node_arrays(struct art_node *node, unsigned char **keys,
+		struct art_node ***children)
+{
+	if (node->type == ART_NODE4) {
+		*keys = ((struct art_node4 *) node)->keys;
+		*children = ((struct art_node4 *) node)->children;
+	} else {
+		assert(node->type == ART_NODE16);
+		*keys = ((struct art_node16 *) node)->keys;
+		*children = ((struct art_node16 *) node)->children;
+	}
+}
+
+/** The child slot of the byte, NULL if there's no such child. */
+static struct art_node **
+art_node_find_child(struct art_node *node, unsigned char byte)
+{
+	switch (node->type) {
+	case ART_NODE4: {
+		struct art_node4 *n = (struct art_node4 *) node;
+		for (int i = 0; i < node->n_children; i++) {
+			if (n->keys[i] == byte)
+				return &n->children[i];
+		}
+		return NULL;
+	}
+	case ART_NODE16: {
+		struct art_node16 *n = (struct art_node16 *) node;
+		int i = art_node16_find(n, byte);
+		return i >= 0 ? &n->children[i] : NULL;
+	}
+	case ART_NODE48: {
+		struct art_node48 *n = (struct art_node48 *) node;
+		return n->index[byte] != 0 ? &n->children[n->index[byte] - 1] :
+		       NULL;
+	}
+	default: {
+		assert(node->type == ART_NODE256);
+		struct art_node256 *n = (struct art_node256 *) node;
+		return n->children[byte] != NULL ? &n->children[byte] : NULL;
+	}
+	}
+}
+
+/*
+ * Children are iterated by positions: an index in the keys of
+ * a node4 or a node16, a byte in a node48 or a node256.
+ */
+
+/**
+ * Position of the first child of a node with a byte not less
+ * than @a byte, which is in [0, 256]. -1 if there's none.
+ */
+static int
+art_node_seek(const struct art_node *node, int byte)
+{
+	switch (node->type) {
+	case ART_NODE4: {
+		const struct art_node4 *n = (const struct art_node4 *) node;
+		for (int i = 0; i < node->n_children; i++) {
+			if (n->keys[i] >= byte)
+				return i;
+		}
+		return -1;
+	}
+	case ART_NODE16:
+		if (byte > 255)
+			return -1;
+		return art_node16_seek((const struct art_node16 *) node,
+				       (unsigned char) byte);
+	case ART_NODE48: {
+		const struct art_node48 *n = (const struct art_node48 *) node;
+		for (int b = byte; b < 256; b++) {
+			if (n->index[b] != 0)
+				return b;
+		}
+		return -1;
+	}
+	default: {
+		assert(node->type == ART_NODE256);
+		const struct art_node256 *n =
+			(const struct art_node256 *) node;
+		for (int b = byte; b < 256; b++) {
+			if (n->children[b] != NULL)
+				return b;
+		}
+		return -1;
+	}
+	}
+}
+
+/** Position of the next child, -1 if there's none. */
+static inline int
+art_node_next_pos(const struct art_node *node, int pos)
+{
+	if (node->type <= ART_NODE16)
+		return pos + 1 < node->n_children ? pos + 1 : -1;
+	return art_node_seek(node, pos + 1);
+}
+
+/**
+ * Position of the previous child, -1 if there's none. @a pos
+ * may be one past the last position.
+ */
+static int
+art_node_prev_pos(const struct art_node *node, int pos)
+{
+	switch (node->type) {
+	case ART_NODE4:
+	case ART_NODE16:
+		return pos - 1;
+	case ART_NODE48: {
+		const struct art_node48 *n = (const struct art_node48 *) node;
+		for (int b = pos - 1; b >= 0; b--) {
+			if (n->index[b] != 0)
+				return b;
+		}
+		return -1;
+	}
+	default: {
+		assert(node->type == ART_NODE256);
+		const struct art_node256 *n =
+			(const struct art_node256 *) node;
+		for (int b = pos - 1; b >= 0; b--) {
+			if (n->children[b] != NULL)
+				return b;
+		}
+		return -1;
+	}
+	}
+}
+
+static inline int
+art_node_last_pos(const struct art_node *node)
+{
+	if (node->type <= ART_NODE16)
+		return node->n_children - 1;
+	return art_node_prev_pos(node, 256);
+}
+
+static inline struct art_node *
+art_node_child(const struct art_node *node, int pos)
+{
+	assert(pos >= 0);
+	switch (node->type) {
+	case ART_NODE4:
+		return ((const struct art_node4 *) node)->children[pos];
+	case ART_NODE16:
+		return ((const struct art_node16 *) node)->children[pos];
+	case ART_NODE48: {
+		const struct art_node48 *n = (const struct art_node48 *) node;
+		return n->children[n->index[pos] - 1];
+	}
+	default:
+		return ((const struct art_node256 *) node)->children[pos];
+	}
+}
+
+static inline unsigned char
+art_node_byte(const struct art_node *node, int pos)
+{
+	switch (node->type) {
+	case ART_NODE4:
+		return ((const struct art_node4 *) node)->keys[pos];
+	case ART_NODE16:
+		return ((const struct art_node16 *) node)->keys[pos];
+	default:
+		return (unsigned char) pos;
+	}
+}
+
+/** Add a child to a node with room for it. */
+static void
+art_node_add_child(struct art_node *node, unsigned char byte,
+		   struct art_node *child)
+{
+	assert(node->n_children < art_node_capacity[node->type]);
+	switch (node->type) {
+	case ART_NODE4:
+	case ART_NODE16: {
+		unsigned char *keys;
+		struct art_node **children;
+		art_node_arrays(node, &keys, &children);
+		int i = node->n_children;
+		while (i > 0 && keys[i - 1] > byte) {
+			keys[i] = keys[i - 1];
+			children[i] = children[i - 1];
+			i--;
+		}
+		keys[i] = byte;
+		children[i] = child;
+		break;
+	}
+	case ART_NODE48: {
+		struct art_node48 *n = (struct art_node48 *) node;
+		assert(n->index[byte] == 0);
+		int slot = 0;
+		while (n->children[slot] != NULL)
+			slot++;
+		n->children[slot] = child;
+		n->index[byte] = slot + 1;
+		break;
+	}
+	default: {
+		struct art_node256 *n = (struct art_node256 *) node;
+		assert(n->children[byte] == NULL);
+		n->children[byte] = child;
+		break;
+	}
+	}
+	node->n_children++;
+}
+
+/** Remove the child of the byte from a node. */
+static void
+art_node_remove_child(struct art_node *node, unsigned char byte)
+{
+	switch (node->type) {
+	case ART_NODE4:
+	case ART_NODE16: {
+		unsigned char *keys;
+		struct art_node **children;
+		art_node_arrays(node, &keys, &children);
+		int i = 0;
+		while (keys[i] != byte)
+			i++;
+		assert(i < node->n_children);
+		memmove(keys + i, keys + i + 1, node->n_children - i - 1);
+		memmove(children + i, children + i + 1,
+			(node->n_children - i - 1) * sizeof(*children));
+		break;
+	}
+	case ART_NODE48: {
+		struct art_node48 *n = (struct art_node48 *) node;
+		assert(n->index[byte] != 0);
+		n->children[n->index[byte] - 1] = NULL;
+		n->index[byte] = 0;
+		break;
+	}
+	default: {
+		struct art_node256 *n = (struct art_node256 *) node;
+		assert(n->children[byte] != NULL);
+		n->children[byte] = NULL;
+		break;
+	}
+	}
+	node->n_children--;
+}
+
+/**
+ * Copy a node into a new node of the type, without the child
+ * of @a skip byte if it is not negative.
+ * @retval NULL - memory error.
+ */
+static struct art_node *
+art_node_copy(struct art *tree, const struct art_node *node,
+	      enum art_node_type type, int skip)
+{
+	struct art_node *copy = art_node_alloc(tree, type);
+	if (copy == NULL)
+		return NULL;
+	if (type == node->type && skip < 0) {
+		uint32_t version = copy->version;
+		memcpy(copy, node, art_node_size[type]);
+		copy->next = NULL;
+		copy->version = version;
+		copy->retired = 0;
+		return copy;
+	}
+	copy->prefix_len = node->prefix_len;
+	memcpy(copy->prefix, node->prefix, sizeof(node->prefix));
+	for (int pos = art_node_seek(node, 0); pos >= 0;
+	     pos = art_node_next_pos(node, pos)) {
+		unsigned char byte = art_node_byte(node, pos);
+		if (byte != skip)
+			art_node_add_child(copy, byte, art_node_child(node, pos));
+	}
+	return copy;
+}
+
+/**
+ * Make the node referenced by @a ref private to the tree,
+ * copying it if a read view may see it.
+ * @retval NULL - memory error.
+ */
+static struct art_node *
+art_node_unshare(struct art *tree, struct art_node **ref)
+{
+	struct art_node *node = *ref;
+	if (!art_node_is_shared(tree, node))
+		return node;
+	struct art_node *copy = art_node_copy(tree, node, node->type, -1);
+	if (copy == NULL)
+		return NULL;
+	art_node_retire(tree, node);
+	*ref = copy;
+	return copy;
+}
+
+/** The leftmost leaf of a subtree. */
+static struct art_node *
+art_node_minimum(struct art_node *node)
+{
+	while (!art_is_leaf(node))
+		node = art_node_child(node, art_node_seek(node, 0));
+	return node;
+}
+
+/**
+ * Match the compressed path of a node at @a depth with a key.
+ * @param[out] matched - the number of matching bytes, the path
+ *  length if the whole path matches. The key may end inside
+ *  the path.
+ * @param[out] byte - the path byte at the mismatch.
+ * @retval -1 - memory error.
+ */
+static int
+art_prefix_match(struct art *tree, struct art_node *node,
+		 const unsigned char *key, uint32_t len, uint32_t depth,
+		 uint32_t *matched, int *byte)
+{
+	uint32_t stored = art_min(node->prefix_len, ART_PREFIX_MAX);
+	uint32_t i;
+	for (i = 0; i < stored; i++) {
+		if (depth + i >= len || key[depth + i] != node->prefix[i]) {
+			*matched = i;
+			*byte = node->prefix[i];
+			return 0;
+		}
+	}
+	if (node->prefix_len > stored) {
+		/* The rest of the path is only in the keys. */
+		uint32_t leaf_len;
+		const unsigned char *leaf_key =
+			art_load_key(tree, art_node_minimum(node), &leaf_len);
+		if (leaf_key == NULL)
+			return -1;
+		assert(leaf_len > depth + node->prefix_len);
+		for (; i < node->prefix_len; i++) {
+			if (depth + i >= len ||
+			    key[depth + i] != leaf_key[depth + i]) {
+				*matched = i;
+				*byte = leaf_key[depth + i];
+				return 0;
+			}
+		}
+	}
+	*matched = i;
+	return 0;
+}
+
+/*------------------------------------------------------------------------- */
+/* Tree */
+/*------------------------------------------------------------------------- */
+
+void
+art_create(struct art *tree, art_load_key_t load_key, void *arg,
+	   size_t extent_size, art_extent_alloc_t extent_alloc,
+	   art_extent_free_t extent_free, void *alloc_ctx)
+{
+	memset(tree, 0, sizeof(*tree));
+	assert(extent_size >= ART_EXTENT_HEADER_SIZE +
+			      sizeof(struct art_node256));
+	tree->load_key = load_key;
+	tree->arg = arg;
+	tree->extent_size = extent_size;
+	tree->extent_alloc = extent_alloc;
+	tree->extent_free = extent_free;
+	tree->alloc_ctx = alloc_ctx;
+}
+
+void
+art_destroy(struct art *tree)
+{
+	assert(tree->views == NULL);
+	void *extent = tree->extents;
+	while (extent != NULL) {
+		void *next = *(void **) extent;
+		tree->extent_free(tree->alloc_ctx, extent);
+		extent = next;
+	}
+	tree->extents = NULL;
+	tree->n_extents = 0;
+	tree->root = NULL;
+	tree->size = 0;
+	tree->garbage = NULL;
+	memset(tree->free_nodes, 0, sizeof(tree->free_nodes));
+}
+
+void *
+art_find(struct art *tree, const unsigned char *key, uint32_t len)
+{
+	struct art_node *node = tree->root;
+	uint32_t depth = 0;
+	while (node != NULL && !art_is_leaf(node)) {
+		/*
+		 * Only the stored part of the path is checked,
+		 * the leaf key is compared in whole at the end.
+		 */
+		uint32_t stored = art_min(node->prefix_len, ART_PREFIX_MAX);
+		if (depth + node->prefix_len >= len ||
+		    memcmp(key + depth, node->prefix, stored) != 0)
+			return NULL;
+		depth += node->prefix_len;
+		struct art_node **child = art_node_find_child(node, key[depth]);
+		if (child == NULL)
+			return NULL;
+		node = *child;
+		depth++;
+	}
+	if (node == NULL || art_leaf_matches(tree, node, key, len) <= 0)
+		return NULL;
+	return art_leaf_value(node);
+}
+
+/**
+ * Insert a value in place of the leaf referenced by @a ref:
+ * replace it if the keys are equal, or put both leaves under
+ * a new node.
+ */
+static int
+art_insert_at_leaf(struct art *tree, struct art_node **ref, uint32_t depth,
+		   const unsigned char *key, uint32_t len, void *value,
+		   void **replaced)
+{
+	struct art_node *leaf = *ref;
+	uint32_t leaf_len;
+	const unsigned char *leaf_key = art_load_key(tree, leaf, &leaf_len);
+	if (leaf_key == NULL)
+		return -1;
+	uint32_t limit = art_min(len, leaf_len);
+	uint32_t i = depth;
+	while (i < limit && key[i] == leaf_key[i])
+		i++;
+	if (i == len && i == leaf_len) {
+		*replaced = art_leaf_value(leaf);
+		*ref = art_leaf(value);
+		return 0;
+	}
+	/* No key is a prefix of another one. */
+	assert(i < len && i < leaf_len);
+	unsigned char leaf_byte = leaf_key[i];
+	struct art_node *node = art_node_alloc(tree, ART_NODE4);
+	if (node == NULL)
+		return -1;
+	node->prefix_len = i - depth;
+	memcpy(node->prefix, key + depth,
+	       art_min(node->prefix_len, ART_PREFIX_MAX));
+	art_node_add_child(node, key[i], art_leaf(value));
+	art_node_add_child(node, leaf_byte, leaf);
+	*ref = node;
+	tree->size++;
+	return 0;
+}
+
+/**
+ * Insert a value into the compressed path of the node
+ * referenced by @a ref, which differs from the key after
+ * @a matched bytes: split the path with a new node.
+ */
+static int
+art_insert_split(struct art *tree, struct art_node **ref, uint32_t depth,
+		 uint32_t matched, int byte, const unsigned char *key,
+		 uint32_t len, void *value)
+{
+	struct art_node *node = *ref;
+	assert(!art_node_is_shared(tree, node));
+	assert(matched < node->prefix_len && depth + matched < len);
+	(void) len;
+	/* The path of the node after the mismatch. */
+	uint32_t rest_len = node->prefix_len - matched - 1;
+	uint32_t rest_stored = art_min(rest_len, ART_PREFIX_MAX);
+	unsigned char rest[ART_PREFIX_MAX];
+	if (matched + 1 + rest_stored <= ART_PREFIX_MAX) {
+		memcpy(rest, node->prefix + matched + 1, rest_stored);
+	} else {
+		uint32_t leaf_len;
+		const unsigned char *leaf_key =
+			art_load_key(tree, art_node_minimum(node), &leaf_len);
+		if (leaf_key == NULL)
+			return -1;
+		memcpy(rest, leaf_key + depth + matched + 1, rest_stored);
+	}
+	struct art_node *parent = art_node_alloc(tree, ART_NODE4);
+	if (parent == NULL)
+		return -1;
+	parent->prefix_len = matched;
+	memcpy(parent->prefix, node->prefix, art_min(matched, ART_PREFIX_MAX));
+	node->prefix_len = rest_len;
+	memcpy(node->prefix, rest, rest_stored);
+	art_node_add_child(parent, (unsigned char) byte, node);
+	art_node_add_child(parent, key[depth + matched], art_leaf(value));
+	*ref = parent;
+	tree->size++;
+	return 0;
+}
+
+int
+art_insert(struct art *tree, const unsigned char *key, uint32_t len,
+	   void *value, void **replaced)
+{
+	*replaced = NULL;
+	tree->mod_count++;
+	struct art_node **ref = &tree->root;
+	uint32_t depth = 0;
+	while (true) {
+		struct art_node *node = *ref;
+		if (node == NULL) {
+			assert(ref == &tree->root);
+			*ref = art_leaf(value);
+			tree->size++;
+			return 0;
+		}
+		if (art_is_leaf(node)) {
+			return art_insert_at_leaf(tree, ref, depth, key, len,
+						  value, replaced);
+		}
+		/*
+		 * Copying a node doesn't change the tree, so a
+		 * memory error after it leaves the tree intact.
+		 */
+		node = art_node_unshare(tree, ref);
+		if (node == NULL)
+			return -1;
+		if (node->prefix_len > 0) {
+			uint32_t matched;
+			int byte;
+			if (art_prefix_match(tree, node, key, len, depth,
+					     &matched, &byte) != 0)
+				return -1;
+			if (matched < node->prefix_len) {
+				return art_insert_split(tree, ref, depth,
+							matched, byte, key,
+							len, value);
+			}
+			depth += node->prefix_len;
+		}
+		assert(depth < len);
+		struct art_node **child = art_node_find_child(node, key[depth]);
+		if (child != NULL) {
+			ref = child;
+			depth++;
+			continue;
+		}
+		if (node->n_children == art_node_capacity[node->type]) {
+			struct art_node *grown = art_node_copy(tree, node,
+				(enum art_node_type) (node->type + 1), -1);
+			if (grown == NULL)
+				return -1;
+			art_node_retire(tree, node);
+			*ref = node = grown;
+		}
+		art_node_add_child(node, key[depth], art_leaf(value));
+		tree->size++;
+		return 0;
+	}
+}
+
+/**
+ * Remove the child of the byte from the node referenced by
+ * @a ref, replacing the node with a smaller one if it is
+ * underfilled, or with its only child left.
+ */
+static int
+art_delete_child(struct art *tree, struct art_node **ref, unsigned char byte)
+{
+	struct art_node *node = *ref;
+	assert(!art_node_is_shared(tree, node));
+	if (node->type == ART_NODE4 && node->n_children == 2) {
+		int pos = art_node_seek(node, 0);
+		if (art_node_byte(node, pos) == byte)
+			pos = art_node_next_pos(node, pos);
+		unsigned char child_byte = art_node_byte(node, pos);
+		struct art_node *child = art_node_child(node, pos);
+		if (!art_is_leaf(child)) {
+			struct art_node **child_ref =
+				art_node_find_child(node, child_byte);
+			child = art_node_unshare(tree, child_ref);
+			if (child == NULL)
+				return -1;
+			/* Prepend the path of the node and the byte. */
+			unsigned char prefix[ART_PREFIX_MAX];
+			uint32_t n = art_min(node->prefix_len, ART_PREFIX_MAX);
+			memcpy(prefix, node->prefix, n);
+			if (n < ART_PREFIX_MAX)
+				prefix[n++] = child_byte;
+			if (n < ART_PREFIX_MAX) {
+				memcpy(prefix + n, child->prefix,
+				       art_min(child->prefix_len,
+					       ART_PREFIX_MAX - n));
+			}
+			child->prefix_len += node->prefix_len + 1;
+			memcpy(child->prefix, prefix, sizeof(prefix));
+		}
+		art_node_retire(tree, node);
+		*ref = child;
+		return 0;
+	}
+	if (node->n_children - 1 == art_node_shrink_limit[node->type]) {
+		struct art_node *shrunk = art_node_copy(tree, node,
+			(enum art_node_type) (node->type - 1), byte);
+		if (shrunk == NULL)
+			return -1;
+		art_node_retire(tree, node);
+		*ref = shrunk;
+		return 0;
+	}
+	art_node_remove_child(node, byte);
+	return 0;
+}
+
+int
+art_delete(struct art *tree, const unsigned char *key, uint32_t len,
+	   void **deleted)
+{
+	*deleted = NULL;
+	tree->mod_count++;
+	struct art_node **ref = &tree->root;
+	if (*ref == NULL)
+		return 0;
+	if (art_is_leaf(*ref)) {
+		int rc = art_leaf_matches(tree, *ref, key, len);
+		if (rc <= 0)
+			return rc;
+		*deleted = art_leaf_value(*ref);
+		*ref = NULL;
+		tree->size--;
+		return 0;
+	}
+	uint32_t depth = 0;
+	while (true) {
+		struct art_node *node = art_node_unshare(tree, ref);
+		if (node == NULL)
+			return -1;
+		uint32_t stored = art_min(node->prefix_len, ART_PREFIX_MAX);
+		if (depth + node->prefix_len >= len ||
+		    memcmp(key + depth, node->prefix, stored) != 0)
+			return 0;
+		depth += node->prefix_len;
+		struct art_node **child = art_node_find_child(node, key[depth]);
+		if (child == NULL)
+			return 0;
+		if (!art_is_leaf(*child)) {
+			ref = child;
+			depth++;
+			continue;
+		}
+		int rc = art_leaf_matches(tree, *child, key, len);
+		if (rc <= 0)
+			return rc;
+		void *value = art_leaf_value(*child);
+		if (art_delete_child(tree, ref, key[depth]) != 0)
+			return -1;
+		*deleted = value;
+		tree->size--;
+		return 0;
+	}
+}
+
+void *
+art_random(const struct art *tree, uint32_t rnd)
+{
+	struct art_node *node = tree->root;
+	if (node == NULL)
+		return NULL;
+	while (!art_is_leaf(node)) {
+		uint32_t skip = rnd % node->n_children;
+		int pos = art_node_seek(node, 0);
+		while (skip-- > 0)
+			pos = art_node_next_pos(node, pos);
+		node = art_node_child(node, pos);
+		rnd = rnd * 1103515245 + 12345;
+	}
+	return art_leaf_value(node);
+}
+
+/*------------------------------------------------------------------------- */
+/* Read views */
+/*------------------------------------------------------------------------- */
+
+void
+art_view_create(struct art *tree, struct art_view *view)
+{
+	view->root = tree->root;
+	view->version = tree->version++;
+	view->next = tree->views;
+	tree->views = view;
+}
+
+/** Check if a garbage node may be visible through a read view. */
+static bool
+art_node_is_visible(const struct art *tree, const struct art_node *node)
+{
+	for (struct art_view *view = tree->views; view != NULL;
+	     view = view->next) {
+		if (node->version <= view->version &&
+		    view->version < node->retired)
+			return true;
+	}
+	return false;
+}
+
+void
+art_view_destroy(struct art *tree, struct art_view *view)
+{
+	struct art_view **prev = &tree->views;
+	while (*prev != view) {
+		assert(*prev != NULL);
+		prev = &(*prev)->next;
+	}
+	*prev = view->next;
+	struct art_node **garbage = &tree->garbage;
+	while (*garbage != NULL) {
+		struct art_node *node = *garbage;
+		if (art_node_is_visible(tree, node)) {
+			garbage = &node->next;
+			continue;
+		}
+		*garbage = node->next;
+		art_node_free(tree, node);
+	}
+}
+
+/*------------------------------------------------------------------------- */
+/* Iterators */
+/*------------------------------------------------------------------------- */
+
+void
+art_iterator_create(struct art_iterator *it)
+{
+	it->path = NULL;
+	it->depth = 0;
+	it->capacity = 0;
+	it->leaf = NULL;
+}
+
+void
+art_iterator_destroy(struct art_iterator *it)
+{
+	free(it->path);
+	art_iterator_create(it);
+}
+
+static int
+art_iterator_push(struct art_iterator *it, struct art_node *node, int pos)
+{
+	if (it->depth == it->capacity) {
+		uint32_t capacity = it->capacity > 0 ? it->capacity * 2 :
+				    ART_ITERATOR_PATH_MIN;
+		struct art_iterator_frame *path = (struct art_iterator_frame *)
+			realloc(it->path, capacity * sizeof(*path));
+		if (path == NULL) {
+			it->depth = 0;
+			it->leaf = NULL;
+			return -1;
+		}
+		it->path = path;
+		it->capacity = capacity;
+	}
+	it->path[it->depth].node = node;
+	it->path[it->depth].pos = pos;
+	it->depth++;
+	return 0;
+}
+
+/** Descend to the first leaf of a subtree. */
+static int
+art_iterator_descend_first(struct art_iterator *it, struct art_node *node)
+{
+	while (!art_is_leaf(node)) {
+		int pos = art_node_seek(node, 0);
+		if (art_iterator_push(it, node, pos) != 0)
+			return -1;
+		node = art_node_child(node, pos);
+	}
+	it->leaf = node;
+	return 0;
+}
+
+/** Descend to the last leaf of a subtree. */
+static int
+art_iterator_descend_last(struct art_iterator *it, struct art_node *node)
+{
+	while (!art_is_leaf(node)) {
+		int pos = art_node_last_pos(node);
+		if (art_iterator_push(it, node, pos) != 0)
+			return -1;
+		node = art_node_child(node, pos);
+	}
+	it->leaf = node;
+	return 0;
+}
+
+int
+art_iterator_first(struct art_iterator *it, struct art_node *root)
+{
+	it->depth = 0;
+	it->leaf = NULL;
+	return root != NULL ? art_iterator_descend_first(it, root) : 0;
+}
+
+int
+art_iterator_last(struct art_iterator *it, struct art_node *root)
+{
+	it->depth = 0;
+	it->leaf = NULL;
+	return root != NULL ? art_iterator_descend_last(it, root) : 0;
+}
+
+/**
+ * Move to the first leaf after the subtree of the path top
+ * child, or to the end.
+ */
+static int
+art_iterator_advance(struct art_iterator *it)
+{
+	while (it->depth > 0) {
+		struct art_iterator_frame *frame = &it->path[it->depth - 1];
+		int pos = art_node_next_pos(frame->node, frame->pos);
+		if (pos >= 0) {
+			frame->pos = pos;
+			return art_iterator_descend_first(it,
+				art_node_child(frame->node, pos));
+		}
+		it->depth--;
+	}
+	it->leaf = NULL;
+	return 0;
+}
+
+int
+art_iterator_next(struct art_iterator *it)
+{
+	if (it->leaf == NULL)
+		return 0;
+	return art_iterator_advance(it);
+}
+
+int
+art_iterator_prev(struct art_iterator *it)
+{
+	if (it->leaf == NULL)
+		return 0;
+	while (it->depth > 0) {
+		struct art_iterator_frame *frame = &it->path[it->depth - 1];
+		int pos = art_node_prev_pos(frame->node, frame->pos);
+		if (pos >= 0) {
+			frame->pos = pos;
+			return art_iterator_descend_last(it,
+				art_node_child(frame->node, pos));
+		}
+		it->depth--;
+	}
+	it->leaf = NULL;
+	return 0;
+}
+
+/**
+ * Check if a subtree goes after the bound of a search, given
+ * the first byte its keys differ from the search key in, or -1
+ * if the search key or the subtree key ends there.
+ */
+static inline bool
+art_bound_is_before(int key_byte, int tree_byte, bool upper)
+{
+	if (key_byte < 0) {
+		/*
+		 * The key is a prefix of the subtree keys: they
+		 * are not less than the key, but are skipped by
+		 * an upper bound.
+		 */
+		return !upper;
+	}
+	return key_byte < tree_byte;
+}
+
+/**
+ * Position an iterator at the first leaf after the bound: the
+ * first key not less than @a key, or, if @a upper is set, the
+ * first key greater than @a key not starting with it.
+ */
+static int
+art_iterator_seek(struct art *tree, struct art_iterator *it,
+		  const unsigned char *key, uint32_t len, bool upper)
+{
+	it->depth = 0;
+	it->leaf = NULL;
+	struct art_node *node = tree->root;
+	if (node == NULL)
+		return 0;
+	uint32_t depth = 0;
+	while (!art_is_leaf(node)) {
+		/*
+		 * The path to the node matches the key. Either
+		 * descend further or find that the whole subtree
+		 * goes after the bound (and take its first leaf)
+		 * or before it (and take the leaf after it).
+		 */
+		int key_byte = -1, tree_byte = -1;
+		uint32_t matched = node->prefix_len;
+		if (node->prefix_len > 0 &&
+		    art_prefix_match(tree, node, key, len, depth,
+				     &matched, &tree_byte) != 0)
+			return -1;
+		if (matched < node->prefix_len || depth + matched == len) {
+			/* The subtree keys differ from the key here. */
+			if (depth + matched < len)
+				key_byte = key[depth + matched];
+			if (art_bound_is_before(key_byte, tree_byte, upper))
+				return art_iterator_descend_first(it, node);
+			return art_iterator_advance(it);
+		}
+		depth += node->prefix_len;
+		key_byte = key[depth];
+		int pos = art_node_seek(node, key_byte);
+		if (pos < 0)
+			return art_iterator_advance(it);
+		if (art_iterator_push(it, node, pos) != 0)
+			return -1;
+		struct art_node *child = art_node_child(node, pos);
+		if (art_node_byte(node, pos) != key_byte)
+			return art_iterator_descend_first(it, child);
+		node = child;
+		depth++;
+	}
+	uint32_t leaf_len;
+	const unsigned char *leaf_key = art_load_key(tree, node, &leaf_len);
+	if (leaf_key == NULL)
+		return -1;
+	uint32_t i = depth;
+	while (i < len && i < leaf_len && key[i] == leaf_key[i])
+		i++;
+	if (art_bound_is_before(i < len ? key[i] : -1,
+				i < leaf_len ? leaf_key[i] : -1, upper)) {
+		it->leaf = node;
+		return 0;
+	}
+	return art_iterator_advance(it);
+}
+
+int
+art_iterator_lower_bound(struct art *tree, struct art_iterator *it,
+			 const unsigned char *key, uint32_t len)
+{
+	return art_iterator_seek(tree, it, key, len, false);
+}
+
+int
+art_iterator_upper_bound(struct art *tree, struct art_iterator *it,
+			 const unsigned char *key, uint32_t len)
+{
+	return art_iterator_seek(tree, it, key, len, true);
+}
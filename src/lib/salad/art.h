@@ -0,0 +1,324 @@
+#ifndef TARANTOOL_LIB_SALAD_ART_H_INCLUDED
+#define TARANTOOL_LIB_SALAD_ART_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Adaptive radix tree (Leis, Kemper, Neumann, "The Adaptive
+ * Radix Tree: ARTful Indexing for Main-Memory Databases").
+ *
+ * The tree maps binary keys to values in the lexicographic
+ * order of the keys. An inner node branches on one byte of the
+ * key and has one of four sizes, 4, 16, 48 or 256 children,
+ * depending on how many bytes follow its path, so the memory
+ * taken by a node is proportional to its fan-out. A chain of
+ * nodes with one child is collapsed into a prefix of the node
+ * it leads to (path compression), and a subtree holding a
+ * single key is replaced with its value (lazy expansion).
+ *
+ * The tree doesn't store keys. Only the first ART_PREFIX_MAX
+ * bytes of a compressed path are kept in a node, the rest and
+ * the bytes below a value are obtained by loading the key of
+ * a value with a callback. So a lookup compares key bytes only
+ * once on the way down and loads a single key at the end to
+ * check the bytes skipped.
+ *
+ * Requirements:
+ *  - no key is a prefix of another one;
+ *  - a value is a pointer aligned to at least two bytes, the
+ *    lowest bit tags values in child slots.
+ *
+ * Read views. A read view (struct art_view) keeps the tree as
+ * it was when the view was created until the view is destroyed.
+ * The nodes visible through a view are never changed: a change
+ * copies the nodes on its path (copy-on-write), and the old
+ * ones are freed after the last view seeing them is destroyed.
+ * The view can be iterated in another thread meanwhile, as
+ * long as the tree is changed and views are created and
+ * destroyed in one thread.
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+enum {
+	/** Number of bytes of a compressed path stored in a node. */
+	ART_PREFIX_MAX = 8,
+	/** Number of node sizes. */
+	ART_NODE_TYPE_MAX = 4,
+};
+
+struct art_node;
+
+/** Pointers to the extent allocation and deallocation functions. */
+typedef void *(*art_extent_alloc_t)(void *ctx);
+typedef void (*art_extent_free_t)(void *ctx, void *extent);
+
+/**
+ * Load the key of a value: return the key and store its length
+ * in @a len. The key may be stored in a buffer owned by @a arg
+ * and must stay valid until the next call. Return NULL on
+ * memory error.
+ */
+typedef const unsigned char *(*art_load_key_t)(void *value, uint32_t *len,
+					       void *arg);
+
+/** A read view of a tree. */
+struct art_view {
+	/** Root of the tree when the view was created. */
+	struct art_node *root;
+	/** Version of the tree when the view was created. */
+	uint32_t version;
+	/** Next view of the tree, newer views go first. */
+	struct art_view *next;
+};
+
+/** Main ART struct. */
+struct art {
+	/** Root node, a tagged value if the tree holds one key. */
+	struct art_node *root;
+	/** Number of values in the tree. */
+	size_t size;
+	/** Key loader and its argument. */
+	art_load_key_t load_key;
+	void *arg;
+	/**
+	 * Incremented on every change of the tree. Changes
+	 * invalidate iterators, which must be positioned again.
+	 */
+	uint64_t mod_count;
+	/**
+	 * Version of the tree. Every read view increments it,
+	 * and a node is copied before a change if it is as
+	 * old as the newest view.
+	 */
+	uint32_t version;
+	/** Read views of the tree, newest first. */
+	struct art_view *views;
+	/**
+	 * Nodes replaced in the tree, but still visible through
+	 * some read views.
+	 */
+	struct art_node *garbage;
+	/** Free nodes of each size. */
+	struct art_node *free_nodes[ART_NODE_TYPE_MAX];
+	/** Extents the nodes are carved of, linked in a list. */
+	void *extents;
+	/** Number of allocated extents. */
+	size_t n_extents;
+	/** Size of an extent. */
+	size_t extent_size;
+	/** Extent allocator. */
+	art_extent_alloc_t extent_alloc;
+	art_extent_free_t extent_free;
+	void *alloc_ctx;
+};
+
+/** A frame of an iterator path: a node and a child position. */
+struct art_iterator_frame {
+	struct art_node *node;
+	int pos;
+};
+
+/**
+ * Iterator over a tree. It points to a value and keeps the
+ * path from the root to it. It is valid until the tree it
+ * iterates is changed, @sa art.mod_count, or until the read
+ * view it iterates is destroyed.
+ */
+struct art_iterator {
+	/** Path to the current value. */
+	struct art_iterator_frame *path;
+	/** Number of frames in the path. */
+	uint32_t depth;
+	/** Number of frames the path has room for. */
+	uint32_t capacity;
+	/** The current value (tagged), NULL at the end. */
+	struct art_node *leaf;
+};
+
+/**
+ * Initialize an empty tree.
+ * @param tree - tree to initialize.
+ * @param load_key - key loader.
+ * @param arg - argument of the key loader.
+ * @param extent_size - size of extents, not less than 4KB.
+ * @param extent_alloc - extent allocator.
+ * @param extent_free - extent deallocator.
+ * @param alloc_ctx - argument of the allocator.
+ */
+void
+art_create(struct art *tree, art_load_key_t load_key, void *arg,
+	   size_t extent_size, art_extent_alloc_t extent_alloc,
+	   art_extent_free_t extent_free, void *alloc_ctx);
+
+/**
+ * Destroy a tree and free its memory. All read views must be
+ * destroyed first.
+ */
+void
+art_destroy(struct art *tree);
+
+/** Number of values in the tree. */
+static inline size_t
+art_size(const struct art *tree)
+{
+	return tree->size;
+}
+
+/** Memory used by the tree, in bytes. */
+static inline size_t
+art_mem_used(const struct art *tree)
+{
+	return tree->n_extents * tree->extent_size;
+}
+
+/**
+ * Find the value with the key.
+ * @retval NULL - not found or memory error while loading a key.
+ */
+void *
+art_find(struct art *tree, const unsigned char *key, uint32_t len);
+
+/**
+ * Insert a value with the key, replacing the value with the
+ * same key if there is one.
+ * @param replaced - set to the replaced value or NULL.
+ * @retval 0 - success.
+ * @retval -1 - memory error, the tree is not changed.
+ */
+int
+art_insert(struct art *tree, const unsigned char *key, uint32_t len,
+	   void *value, void **replaced);
+
+/**
+ * Delete the value with the key.
+ * @param deleted - set to the deleted value or NULL if there's
+ *  no such key.
+ * @retval 0 - success.
+ * @retval -1 - memory error, the tree is not changed.
+ */
+int
+art_delete(struct art *tree, const unsigned char *key, uint32_t len,
+	   void **deleted);
+
+/** Get a value by a random number. */
+void *
+art_random(const struct art *tree, uint32_t rnd);
+
+/**
+ * Create a read view of the tree, @sa struct art. The view
+ * must be destroyed before the tree.
+ */
+void
+art_view_create(struct art *tree, struct art_view *view);
+
+/**
+ * Destroy a read view and free the nodes which are no longer
+ * visible through any view.
+ */
+void
+art_view_destroy(struct art *tree, struct art_view *view);
+
+/** Initialize an iterator, it points to nothing. */
+void
+art_iterator_create(struct art_iterator *it);
+
+/** Free the memory of an iterator. */
+void
+art_iterator_destroy(struct art_iterator *it);
+
+/**
+ * Position an iterator at the first value of a tree or a read
+ * view, given by its @a root.
+ * @retval -1 - memory error.
+ */
+int
+art_iterator_first(struct art_iterator *it, struct art_node *root);
+
+/**
+ * Position an iterator at the last value, @sa
+ * art_iterator_first().
+ */
+int
+art_iterator_last(struct art_iterator *it, struct art_node *root);
+
+/**
+ * Position an iterator at the first value whose key is not
+ * less than @a key.
+ * @retval -1 - memory error.
+ */
+int
+art_iterator_lower_bound(struct art *tree, struct art_iterator *it,
+			 const unsigned char *key, uint32_t len);
+
+/**
+ * Position an iterator at the first value whose key is greater
+ * than @a key and doesn't start with it. So if @a key is a
+ * prefix of some keys, they all are skipped.
+ * @retval -1 - memory error.
+ */
+int
+art_iterator_upper_bound(struct art *tree, struct art_iterator *it,
+			 const unsigned char *key, uint32_t len);
+
+/** The value an iterator points to, NULL at the end. */
+static inline void *
+art_iterator_get(const struct art_iterator *it)
+{
+	return (void *) ((uintptr_t) it->leaf & ~(uintptr_t) 1);
+}
+
+/**
+ * Move an iterator to the next value. The iterator at the
+ * last value moves to the end.
+ * @retval -1 - memory error.
+ */
+int
+art_iterator_next(struct art_iterator *it);
+
+/**
+ * Move an iterator to the previous value. The iterator at the
+ * first value moves to the end.
+ * @retval -1 - memory error.
+ */
+int
+art_iterator_prev(struct art_iterator *it);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_LIB_SALAD_ART_H_INCLUDED */
@@ -137,6 +137,7 @@
  * void bps_tree_destroy(tree);
  * int bps_tree_build(tree, sorted_array, array_size);
  * bps_tree_elem_t *bps_tree_find(tree, key);
+ * void bps_tree_find_many(tree, keys, count, result);
  * int bps_tree_insert(tree, new_elem, replaced_elem);
  * int bps_tree_delete(tree, elem);
  * size_t bps_tree_size(tree);
@@ -159,6 +160,10 @@
  * bool bps_tree_iterator_prev(tree, itr);
  * void bps_tree_iterator_freeze(tree, itr);
  * void bps_tree_iterator_destroy(tree, itr);
+ * // ranks (only with BPS_TREE_RANK):
+ * size_t bps_tree_lower_bound_rank(tree, key);
+ * size_t bps_tree_upper_bound_rank(tree, key);
+ * struct bps_tree_iterator bps_tree_iterator_at(tree, rank);
  */
 /* }}} */
 
@@ -286,6 +291,17 @@
  * #define BPS_TREE_DEBUG_BRANCH_VISIT
  */
 
+/**
+ * A switch that makes every inner block store the number of
+ * elements in the subtree of each of its children. That allows
+ * to find the rank (the number of preceding elements) of a key
+ * and an element by its rank in logarithmic time, see
+ * bps_tree_lower_bound_rank, bps_tree_upper_bound_rank and
+ * bps_tree_iterator_at. The price is a bit slower modification
+ * and a lower fan-out of inner blocks. To turn it on,
+ * #define BPS_TREE_RANK
+ */
+
 /* }}} */
 
 /* {{{ BPS-tree internal settings */
@@ -345,6 +361,7 @@ typedef uint32_t bps_tree_block_id_t;
 #define bps_tree_build _api_name(build)
 #define bps_tree_destroy _api_name(destroy)
 #define bps_tree_find _api_name(find)
+#define bps_tree_find_many _api_name(find_many)
 #define bps_tree_insert _api_name(insert)
 #define bps_tree_delete _api_name(delete)
 #define bps_tree_size _api_name(size)
@@ -363,6 +380,9 @@ typedef uint32_t bps_tree_block_id_t;
 #define bps_tree_iterator_prev _api_name(iterator_prev)
 #define bps_tree_iterator_freeze _api_name(iterator_freeze)
 #define bps_tree_iterator_destroy _api_name(iterator_destroy)
+#define bps_tree_lower_bound_rank _api_name(lower_bound_rank)
+#define bps_tree_upper_bound_rank _api_name(upper_bound_rank)
+#define bps_tree_iterator_at _api_name(iterator_at)
 #define bps_tree_debug_check _api_name(debug_check)
 #define bps_tree_print _api_name(print)
 #define bps_tree_debug_check_internal_functions \
@@ -430,6 +450,12 @@ typedef uint32_t bps_tree_block_id_t;
 #define bps_tree_process_insert_inner _bps_tree(process_insert_inner)
 #define bps_tree_process_delete_leaf _bps_tree(process_delete_leaf)
 #define bps_tree_process_delete_inner _bps_tree(process_delete_inner)
+#define bps_tree_block_card _bps_tree(block_card)
+#define bps_tree_child_card _bps_tree(child_card)
+#define bps_tree_cards_add _bps_tree(cards_add)
+#define bps_tree_cards_update _bps_tree(cards_update)
+#define bps_tree_cards_set_child _bps_tree(cards_set_child)
+#define bps_tree_cards_init_root _bps_tree(cards_init_root)
 #define bps_tree_debug_find_max_elem _bps_tree(debug_find_max_elem)
 #define bps_tree_debug_check_block _bps_tree(debug_check_block)
 #define bps_tree_print_indent _bps_tree(print_indent)
@@ -591,6 +617,22 @@ bps_tree_destroy(struct bps_tree *tree);
 bps_tree_elem_t *
 bps_tree_find(const struct bps_tree *tree, bps_tree_key_t key);
 
+/**
+ * @brief Find elements equal to each of the given keys.
+ * Unlike calling bps_tree_find in a loop, descends the tree for
+ *  a group of keys level by level and prefetches the next level
+ *  blocks of all keys of the group before visiting any of them, so
+ *  that cache misses of different keys overlap.
+ * @param tree - pointer to a tree
+ * @param keys - array of keys
+ * @param count - number of keys
+ * @param result - array of count pointers, filled with pointers to
+ *  the first equal element for each key or NULL if not found
+ */
+void
+bps_tree_find_many(const struct bps_tree *tree, bps_tree_key_t *keys,
+		   size_t count, bps_tree_elem_t **result);
+
 /**
  * @brief Insert an element to the tree or replace an element in the tree
  * In case of replacing, if 'replaced' argument is not null,
@@ -787,6 +829,39 @@ bps_tree_iterator_freeze(struct bps_tree *tree, struct bps_tree_iterator *itr);
 void
 bps_tree_iterator_destroy(struct bps_tree *tree, struct bps_tree_iterator *itr);
 
+#ifdef BPS_TREE_RANK
+/**
+ * @brief Get the number of elements that are less than the key.
+ * That is the rank of the element bps_tree_lower_bound points to.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @return - number of elements less than the key
+ */
+size_t
+bps_tree_lower_bound_rank(const struct bps_tree *tree, bps_tree_key_t key);
+
+/**
+ * @brief Get the number of elements that are less than or equal
+ * to the key. That is the rank of the element bps_tree_upper_bound
+ * points to.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @return - number of elements less than or equal to the key
+ */
+size_t
+bps_tree_upper_bound_rank(const struct bps_tree *tree, bps_tree_key_t key);
+
+/**
+ * @brief Get an iterator to the element with the given rank,
+ * i.e. to the element that has exactly @a rank elements before it.
+ * @param tree - pointer to a tree
+ * @param rank - rank of the element
+ * @return - Iterator to the element. Invalid if rank >= tree size.
+ */
+struct bps_tree_iterator
+bps_tree_iterator_at(const struct bps_tree *tree, size_t rank);
+#endif /* BPS_TREE_RANK */
+
 /**
  * @brief Debug self-checking. Returns bitmask of found errors (0
  * on success).
@@ -833,6 +908,20 @@ bps_tree_debug_check_internal_functions(bool assertme);
 /* Same as BPS_TREE_MEMMOVE but takes count of values instead of memory size */
 #define BPS_TREE_DATAMOVE(dst, src, num, dst_bck, src_bck) \
 	BPS_TREE_MEMMOVE(dst, src, (num) * sizeof((dst)[0]), dst_bck, src_bck)
+/* Same as BPS_TREE_DATAMOVE for child IDs, moves child cards too */
+#ifdef BPS_TREE_RANK
+#define BPS_TREE_CHILDMOVE(dst, src, num, dst_bck, src_bck) do { \
+	BPS_TREE_DATAMOVE(dst, src, num, dst_bck, src_bck); \
+	BPS_TREE_DATAMOVE((dst_bck)->child_cards + \
+			  ((dst) - (dst_bck)->child_ids), \
+			  (src_bck)->child_cards + \
+			  ((src) - (src_bck)->child_ids), \
+			  num, dst_bck, src_bck); \
+} while (0)
+#else
+#define BPS_TREE_CHILDMOVE(dst, src, num, dst_bck, src_bck) \
+	BPS_TREE_DATAMOVE(dst, src, num, dst_bck, src_bck)
+#endif
 
 /**
  * Types of a block
@@ -861,9 +950,16 @@ enum bps_tree_max_sizes {
 		(BPS_TREE_BLOCK_SIZE - sizeof(struct bps_block)
 		 - 2 * sizeof(bps_tree_block_id_t) )
 		/ sizeof(bps_tree_elem_t),
+#ifdef BPS_TREE_RANK
+	BPS_TREE_MAX_COUNT_IN_INNER =
+		(BPS_TREE_BLOCK_SIZE - sizeof(struct bps_block))
+		/ (sizeof(bps_tree_elem_t) + sizeof(bps_tree_block_id_t)
+		   + sizeof(size_t)),
+#else
 	BPS_TREE_MAX_COUNT_IN_INNER =
 		(BPS_TREE_BLOCK_SIZE - sizeof(struct bps_block))
 		/ (sizeof(bps_tree_elem_t) + sizeof(bps_tree_block_id_t)),
+#endif
 	BPS_TREE_MAX_DEPTH = 16
 };
 
@@ -909,6 +1005,10 @@ struct bps_inner {
 	bps_tree_elem_t elems[BPS_TREE_MAX_COUNT_IN_INNER - 1];
 	/* Corresponding child IDs */
 	bps_tree_block_id_t child_ids[BPS_TREE_MAX_COUNT_IN_INNER];
+#ifdef BPS_TREE_RANK
+	/* Number of elements in corresponding child subtrees */
+	size_t child_cards[BPS_TREE_MAX_COUNT_IN_INNER];
+#endif
 };
 
 /**
@@ -1118,6 +1218,9 @@ bps_tree_build(struct bps_tree *tree, bps_tree_elem_t *sorted_array,
 			}
 			parents[i]->child_ids[parents[i]->header.size] =
 				insert_id;
+#ifdef BPS_TREE_RANK
+			parents[i]->child_cards[parents[i]->header.size] = 0;
+#endif
 			if (new_id == (bps_tree_block_id_t)-1)
 				break;
 			if (i == depth - 2) {
@@ -1127,6 +1230,13 @@ bps_tree_build(struct bps_tree *tree, bps_tree_elem_t *sorted_array,
 			}
 		}
 
+#ifdef BPS_TREE_RANK
+		/* The last child of every parent is being filled now */
+		for (bps_tree_block_id_t i = 0; i < depth - 1; i++)
+			parents[i]->child_cards[parents[i]->header.size] +=
+				leaf->header.size;
+#endif
+
 		bps_tree_elem_t insert_value = current[leaf->header.size - 1];
 		for (bps_tree_block_id_t i = 0; i < depth - 1; i++) {
 			parents[i]->header.size++;
@@ -1742,7 +1852,106 @@ bps_tree_approximate_count(const struct bps_tree *tree, bps_tree_key_t key)
 	return result;
 }
 
+#ifdef BPS_TREE_RANK
 
+/**
+ * @brief Get the number of elements that are less than the key.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @return - number of elements less than the key
+ */
+inline size_t
+bps_tree_lower_bound_rank(const struct bps_tree *tree, bps_tree_key_t key)
+{
+	if (tree->root_id == (bps_tree_block_id_t)(-1))
+		return 0;
+	size_t rank = 0;
+	bool exact;
+	struct bps_block *block = bps_tree_root(tree);
+	for (bps_tree_block_id_t i = 0; i < tree->depth - 1; i++) {
+		struct bps_inner *inner = (struct bps_inner *)block;
+		bps_tree_pos_t pos;
+		pos = bps_tree_find_ins_point_key(tree, inner->elems,
+						  inner->header.size - 1,
+						  key, &exact);
+		for (bps_tree_pos_t j = 0; j < pos; j++)
+			rank += inner->child_cards[j];
+		block = bps_tree_restore_block(tree, inner->child_ids[pos]);
+	}
+	struct bps_leaf *leaf = (struct bps_leaf *)block;
+	rank += bps_tree_find_ins_point_key(tree, leaf->elems,
+					    leaf->header.size, key, &exact);
+	return rank;
+}
+
+/**
+ * @brief Get the number of elements that are less than or equal
+ * to the key.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @return - number of elements less than or equal to the key
+ */
+inline size_t
+bps_tree_upper_bound_rank(const struct bps_tree *tree, bps_tree_key_t key)
+{
+	if (tree->root_id == (bps_tree_block_id_t)(-1))
+		return 0;
+	size_t rank = 0;
+	bool exact;
+	struct bps_block *block = bps_tree_root(tree);
+	for (bps_tree_block_id_t i = 0; i < tree->depth - 1; i++) {
+		struct bps_inner *inner = (struct bps_inner *)block;
+		bps_tree_pos_t pos;
+		pos = bps_tree_find_after_ins_point_key(tree, inner->elems,
+							inner->header.size - 1,
+							key, &exact);
+		for (bps_tree_pos_t j = 0; j < pos; j++)
+			rank += inner->child_cards[j];
+		block = bps_tree_restore_block(tree, inner->child_ids[pos]);
+	}
+	struct bps_leaf *leaf = (struct bps_leaf *)block;
+	rank += bps_tree_find_after_ins_point_key(tree, leaf->elems,
+						  leaf->header.size,
+						  key, &exact);
+	return rank;
+}
+
+/**
+ * @brief Get an iterator to the element with the given rank.
+ * @param tree - pointer to a tree
+ * @param rank - number of elements before the wanted one
+ * @return - Iterator to the element. Invalid if rank >= tree size.
+ */
+inline struct bps_tree_iterator
+bps_tree_iterator_at(const struct bps_tree *tree, size_t rank)
+{
+	struct bps_tree_iterator res;
+	matras_head_read_view(&res.view);
+	if (rank >= tree->size) {
+		res.block_id = (bps_tree_block_id_t)(-1);
+		res.pos = 0;
+		return res;
+	}
+	struct bps_block *block = bps_tree_root(tree);
+	bps_tree_block_id_t block_id = tree->root_id;
+	for (bps_tree_block_id_t i = 0; i < tree->depth - 1; i++) {
+		struct bps_inner *inner = (struct bps_inner *)block;
+		bps_tree_pos_t pos = 0;
+		while (rank >= inner->child_cards[pos]) {
+			rank -= inner->child_cards[pos];
+			pos++;
+			assert(pos < inner->header.size);
+		}
+		block_id = inner->child_ids[pos];
+		block = bps_tree_restore_block(tree, block_id);
+	}
+	assert(rank < (size_t)block->size);
+	res.block_id = block_id;
+	res.pos = (bps_tree_pos_t)rank;
+	return res;
+}
+
+#endif /* BPS_TREE_RANK */
 
 /**
  * @brief Get a pointer to the element pointed by iterator.
@@ -1882,6 +2091,68 @@ bps_tree_find(const struct bps_tree *tree, bps_tree_key_t key)
 		return 0;
 }
 
+/**
+ * @brief Find elements equal to each of the given keys.
+ * @param tree - pointer to a tree
+ * @param keys - array of keys
+ * @param count - number of keys
+ * @param result - array of count pointers, filled with pointers to
+ *  the first equal element for each key or NULL if not found
+ */
+inline void
+bps_tree_find_many(const struct bps_tree *tree, bps_tree_key_t *keys,
+		   size_t count, bps_tree_elem_t **result)
+{
+	/* Number of keys that descend the tree simultaneously */
+	enum { GROUP_SIZE = 16 };
+	if (tree->root_id == (bps_tree_block_id_t)(-1)) {
+		for (size_t k = 0; k < count; k++)
+			result[k] = 0;
+		return;
+	}
+	struct bps_block *root = bps_tree_root(tree);
+	struct bps_block *blocks[GROUP_SIZE];
+	for (size_t base = 0; base < count; base += GROUP_SIZE) {
+		size_t group = GROUP_SIZE;
+		if (count - base < group)
+			group = count - base;
+		bps_tree_key_t *group_keys = keys + base;
+		for (size_t k = 0; k < group; k++)
+			blocks[k] = root;
+		for (bps_tree_block_id_t i = 0; i < tree->depth - 1; i++) {
+			for (size_t k = 0; k < group; k++) {
+				struct bps_inner *inner =
+					(struct bps_inner *)blocks[k];
+				bool exact = false;
+				bps_tree_pos_t pos;
+				pos = bps_tree_find_ins_point_key(tree,
+						inner->elems,
+						inner->header.size - 1,
+						group_keys[k], &exact);
+				struct bps_block *next = bps_tree_restore_block(
+					tree, inner->child_ids[pos]);
+				/*
+				 * Binary search starts with the header
+				 * and the middle of the block.
+				 */
+				__builtin_prefetch(next);
+				__builtin_prefetch((char *)next +
+						   BPS_TREE_BLOCK_SIZE / 2);
+				blocks[k] = next;
+			}
+		}
+		for (size_t k = 0; k < group; k++) {
+			struct bps_leaf *leaf = (struct bps_leaf *)blocks[k];
+			bool exact = false;
+			bps_tree_pos_t pos;
+			pos = bps_tree_find_ins_point_key(tree, leaf->elems,
+							  leaf->header.size,
+							  group_keys[k], &exact);
+			result[base + k] = exact ? leaf->elems + pos : 0;
+		}
+	}
+}
+
 /**
  * @brief Add a block to the garbage for future reuse
  */
@@ -2206,6 +2477,16 @@ bps_tree_debug_memmove(void *dst_arg, void *src_arg, size_t num,
 				assert(src < ((char *)src_inner->elems) +
 				       (BPS_TREE_MAX_COUNT_IN_INNER - 1) *
 				       sizeof(bps_tree_elem_t));
+#ifdef BPS_TREE_RANK
+			} else if (dst >= ((char *)dst_inner->child_cards)) {
+				assert(dst < ((char *)dst_inner->child_cards) +
+				       BPS_TREE_MAX_COUNT_IN_INNER *
+				       sizeof(size_t));
+				assert(src >= (char *)src_inner->child_cards);
+				assert(src < ((char *)src_inner->child_cards) +
+				       BPS_TREE_MAX_COUNT_IN_INNER *
+				       sizeof(size_t));
+#endif
 			} else {
 				assert(dst >= ((char *)dst_inner->child_ids));
 				assert(dst < ((char *)dst_inner->child_ids) +
@@ -2226,6 +2507,16 @@ bps_tree_debug_memmove(void *dst_arg, void *src_arg, size_t num,
 					(BPS_TREE_MAX_COUNT_IN_INNER - 1) *
 					sizeof(bps_tree_elem_t)) {
 				/* nothing to do due to if condition */
+#ifdef BPS_TREE_RANK
+			} else if (dst >= ((char *)dst_inner->child_cards)) {
+				assert(dst <= ((char *)dst_inner->child_cards) +
+				       BPS_TREE_MAX_COUNT_IN_INNER *
+				       sizeof(size_t));
+				assert(src >= (char *)src_inner->child_cards);
+				assert(src <= ((char *)src_inner->child_cards) +
+				       BPS_TREE_MAX_COUNT_IN_INNER *
+				       sizeof(size_t));
+#endif
 			} else {
 				assert(dst >= ((char *)dst_inner->child_ids));
 				assert(dst <= ((char *)dst_inner->child_ids) +
@@ -2297,9 +2588,9 @@ bps_tree_insert_into_inner(struct bps_tree *tree,
 		BPS_TREE_DATAMOVE(inner->elems + pos + 1, inner->elems + pos,
 				  inner->header.size - pos - 1, inner, inner);
 		inner->elems[pos] = max_elem;
-		BPS_TREE_DATAMOVE(inner->child_ids + pos + 1,
-				  inner->child_ids + pos,
-				  inner->header.size - pos, inner, inner);
+		BPS_TREE_CHILDMOVE(inner->child_ids + pos + 1,
+				   inner->child_ids + pos,
+				   inner->header.size - pos, inner, inner);
 	} else {
 		if (pos > 0)
 			inner->elems[pos - 1] = *inner_path_elem->max_elem_copy;
@@ -2361,9 +2652,9 @@ bps_tree_delete_from_inner(struct bps_tree *tree,
 	if (pos < inner->header.size - 1) {
 		BPS_TREE_DATAMOVE(inner->elems + pos, inner->elems + pos + 1,
 				  inner->header.size - 2 - pos, inner, inner);
-		BPS_TREE_DATAMOVE(inner->child_ids + pos,
-				  inner->child_ids + pos + 1,
-				  inner->header.size - 1 - pos, inner, inner);
+		BPS_TREE_CHILDMOVE(inner->child_ids + pos,
+				   inner->child_ids + pos + 1,
+				   inner->header.size - 1 - pos, inner, inner);
 	} else if (pos > 0) {
 		*inner_path_elem->max_elem_copy = inner->elems[pos - 1];
 	}
@@ -2433,10 +2724,10 @@ bps_tree_move_elems_to_right_inner(struct bps_tree *tree,
 	assert(a->header.size >= num);
 	assert(b->header.size + num <= BPS_TREE_MAX_COUNT_IN_INNER);
 
-	BPS_TREE_DATAMOVE(b->child_ids + num, b->child_ids,
-			  b->header.size, b, b);
-	BPS_TREE_DATAMOVE(b->child_ids, a->child_ids + a->header.size - num,
-			  num, b, a);
+	BPS_TREE_CHILDMOVE(b->child_ids + num, b->child_ids,
+			   b->header.size, b, b);
+	BPS_TREE_CHILDMOVE(b->child_ids, a->child_ids + a->header.size - num,
+			   num, b, a);
 
 	if (!move_to_empty)
 		BPS_TREE_DATAMOVE(b->elems + num, b->elems,
@@ -2513,10 +2804,10 @@ bps_tree_move_elems_to_left_inner(struct bps_tree *tree,
 	assert(b->header.size >= num);
 	assert(a->header.size + num <= BPS_TREE_MAX_COUNT_IN_INNER);
 
-	BPS_TREE_DATAMOVE(a->child_ids + a->header.size, b->child_ids,
-			  num, a, b);
-	BPS_TREE_DATAMOVE(b->child_ids, b->child_ids + num,
-			  b->header.size - num, b, b);
+	BPS_TREE_CHILDMOVE(a->child_ids + a->header.size, b->child_ids,
+			   num, a, b);
+	BPS_TREE_CHILDMOVE(b->child_ids, b->child_ids + num,
+			   b->header.size - num, b, b);
 
 	if (!move_to_empty)
 		a->elems[a->header.size - 1] =
@@ -2632,8 +2923,8 @@ bps_tree_insert_and_move_elems_to_right_inner(struct bps_tree *tree,
 	assert(pos >= 0);
 
 	if (!move_to_empty) {
-		BPS_TREE_DATAMOVE(b->child_ids + num, b->child_ids,
-				  b->header.size, b, b);
+		BPS_TREE_CHILDMOVE(b->child_ids + num, b->child_ids,
+				   b->header.size, b, b);
 		BPS_TREE_DATAMOVE(b->elems + num, b->elems,
 				  b->header.size - 1, b, b);
 	}
@@ -2641,11 +2932,11 @@ bps_tree_insert_and_move_elems_to_right_inner(struct bps_tree *tree,
 	bps_tree_pos_t mid_part_size = a->header.size - pos;
 	if (mid_part_size > num) {
 		/* In fact insert to 'a' block, to the internal position */
-		BPS_TREE_DATAMOVE(b->child_ids,
-				  a->child_ids + a->header.size - num,
-				  num, b, a);
-		BPS_TREE_DATAMOVE(a->child_ids + pos + 1, a->child_ids + pos,
-				  mid_part_size - num, a, a);
+		BPS_TREE_CHILDMOVE(b->child_ids,
+				   a->child_ids + a->header.size - num,
+				   num, b, a);
+		BPS_TREE_CHILDMOVE(a->child_ids + pos + 1, a->child_ids + pos,
+				   mid_part_size - num, a, a);
 		a->child_ids[pos] = block_id;
 
 		BPS_TREE_DATAMOVE(b->elems, a->elems + a->header.size - num,
@@ -2663,11 +2954,11 @@ bps_tree_insert_and_move_elems_to_right_inner(struct bps_tree *tree,
 		a->elems[pos] = max_elem;
 	} else if (mid_part_size == num) {
 		/* In fact insert to 'a' block, to the last position */
-		BPS_TREE_DATAMOVE(b->child_ids,
-				  a->child_ids + a->header.size - num,
-				  num, b, a);
-		BPS_TREE_DATAMOVE(a->child_ids + pos + 1, a->child_ids + pos,
-				  mid_part_size - num, a, a);
+		BPS_TREE_CHILDMOVE(b->child_ids,
+				   a->child_ids + a->header.size - num,
+				   num, b, a);
+		BPS_TREE_CHILDMOVE(a->child_ids + pos + 1, a->child_ids + pos,
+				   mid_part_size - num, a, a);
 		a->child_ids[pos] = block_id;
 
 		BPS_TREE_DATAMOVE(b->elems, a->elems + a->header.size - num,
@@ -2682,12 +2973,12 @@ bps_tree_insert_and_move_elems_to_right_inner(struct bps_tree *tree,
 	} else {
 		/* In fact insert to 'b' block */
 		bps_tree_pos_t new_pos = num - mid_part_size - 1;/* Can be 0 */
-		BPS_TREE_DATAMOVE(b->child_ids,
-				  a->child_ids + a->header.size - num + 1,
-				  new_pos, b, a);
+		BPS_TREE_CHILDMOVE(b->child_ids,
+				   a->child_ids + a->header.size - num + 1,
+				   new_pos, b, a);
 		b->child_ids[new_pos] = block_id;
-		BPS_TREE_DATAMOVE(b->child_ids + new_pos + 1,
-				  a->child_ids + pos, mid_part_size, b, a);
+		BPS_TREE_CHILDMOVE(b->child_ids + new_pos + 1,
+				   a->child_ids + pos, mid_part_size, b, a);
 
 		if (pos == a->header.size) {
 			/* +1 */
@@ -2832,14 +3123,14 @@ bps_tree_insert_and_move_elems_to_left_inner(struct bps_tree *tree,
 	if (pos >= num) {
 		/* In fact insert to 'b' block */
 		bps_tree_pos_t new_pos = pos - num; /* Can be 0 */
-		BPS_TREE_DATAMOVE(a->child_ids + a->header.size, b->child_ids,
-				  num, a, b);
-		BPS_TREE_DATAMOVE(b->child_ids, b->child_ids + num,
-				  new_pos, b, b);
+		BPS_TREE_CHILDMOVE(a->child_ids + a->header.size, b->child_ids,
+				   num, a, b);
+		BPS_TREE_CHILDMOVE(b->child_ids, b->child_ids + num,
+				   new_pos, b, b);
 		b->child_ids[new_pos] = block_id;
-		BPS_TREE_DATAMOVE(b->child_ids + new_pos + 1,
-				  b->child_ids + pos,
-				  b->header.size - pos, b, b);
+		BPS_TREE_CHILDMOVE(b->child_ids + new_pos + 1,
+				   b->child_ids + pos,
+				   b->header.size - pos, b, b);
 
 		if (!move_to_empty)
 			a->elems[a->header.size - 1] =
@@ -2873,14 +3164,14 @@ bps_tree_insert_and_move_elems_to_left_inner(struct bps_tree *tree,
 	} else {
 		/* In fact insert to 'a' block */
 		bps_tree_pos_t new_pos = a->header.size + pos; /* Can be 0 */
-		BPS_TREE_DATAMOVE(a->child_ids + a->header.size,
-				  b->child_ids, pos, a, b);
+		BPS_TREE_CHILDMOVE(a->child_ids + a->header.size,
+				   b->child_ids, pos, a, b);
 		a->child_ids[new_pos] = block_id;
-		BPS_TREE_DATAMOVE(a->child_ids + new_pos + 1,
-				  b->child_ids + pos, num - 1 - pos, a, b);
+		BPS_TREE_CHILDMOVE(a->child_ids + new_pos + 1,
+				   b->child_ids + pos, num - 1 - pos, a, b);
 		if (!move_all)
-			BPS_TREE_DATAMOVE(b->child_ids, b->child_ids + num - 1,
-					  b->header.size - num + 1, b, b);
+			BPS_TREE_CHILDMOVE(b->child_ids, b->child_ids + num - 1,
+					   b->header.size - num + 1, b, b);
 
 		if (!move_to_empty)
 			a->elems[a->header.size - 1] =
@@ -3111,6 +3402,149 @@ bps_tree_prepare_new_ext_inner(struct bps_inner_path_elem *path_elem,
 	new_path_elem->insertion_point = (bps_tree_pos_t)(-1); /* unused */
 }
 
+/**
+ * @brief Number of elements in a subtree. Inner blocks just sum
+ * the cards of their children, so the result is only correct if
+ * the cards of the block are up to date.
+ */
+static inline size_t
+bps_tree_block_card(const struct bps_block *block)
+{
+#ifdef BPS_TREE_RANK
+	if (block->type == BPS_TREE_BT_LEAF)
+		return block->size;
+	assert(block->type == BPS_TREE_BT_INNER);
+	const struct bps_inner *inner = (const struct bps_inner *)block;
+	size_t card = 0;
+	for (bps_tree_pos_t i = 0; i < block->size; i++)
+		card += inner->child_cards[i];
+	return card;
+#else
+	(void)block;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Number of elements in a subtree, given by the block ID.
+ */
+static inline size_t
+bps_tree_child_card(const struct bps_tree *tree, bps_tree_block_id_t id)
+{
+#ifdef BPS_TREE_RANK
+	return bps_tree_block_card(bps_tree_restore_block(tree, id));
+#else
+	(void)tree;
+	(void)id;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Add a delta to the card of the child at position pos of
+ * the inner block and to the cards of all the blocks on the path
+ * from the inner block to the root.
+ * Used when an element was inserted to or deleted from a subtree
+ * without changing the structure of blocks above it.
+ */
+static inline void
+bps_tree_cards_add(struct bps_tree *tree,
+		   struct bps_inner_path_elem *inner_path_elem,
+		   bps_tree_pos_t pos, int delta)
+{
+#ifdef BPS_TREE_RANK
+	for (; inner_path_elem != NULL;
+	     pos = inner_path_elem->pos_in_parent,
+	     inner_path_elem = inner_path_elem->parent) {
+		inner_path_elem->block = (struct bps_inner *)
+			bps_tree_touch_block(tree, inner_path_elem->block_id);
+		inner_path_elem->block->child_cards[pos] += delta;
+	}
+#else
+	(void)tree;
+	(void)inner_path_elem;
+	(void)pos;
+	(void)delta;
+#endif
+}
+
+/**
+ * @brief Recalculate the cards of the child at position pos of the
+ * inner block and of its two left and two right neighbours, i.e.
+ * of all the blocks that a rebalancing can affect, then add a delta
+ * to the cards of the path above the inner block, see
+ * bps_tree_cards_add.
+ */
+static inline void
+bps_tree_cards_update(struct bps_tree *tree,
+		      struct bps_inner_path_elem *inner_path_elem,
+		      bps_tree_pos_t pos, int delta)
+{
+#ifdef BPS_TREE_RANK
+	if (inner_path_elem == NULL)
+		return;
+	inner_path_elem->block = (struct bps_inner *)
+		bps_tree_touch_block(tree, inner_path_elem->block_id);
+	struct bps_inner *inner = inner_path_elem->block;
+	bps_tree_pos_t begin = pos > 2 ? pos - 2 : 0;
+	bps_tree_pos_t end = pos + 3 < inner->header.size ?
+			     pos + 3 : inner->header.size;
+	for (bps_tree_pos_t i = begin; i < end; i++)
+		inner->child_cards[i] =
+			bps_tree_child_card(tree, inner->child_ids[i]);
+	if (delta != 0)
+		bps_tree_cards_add(tree, inner_path_elem->parent,
+				   inner_path_elem->pos_in_parent, delta);
+#else
+	(void)tree;
+	(void)inner_path_elem;
+	(void)pos;
+	(void)delta;
+#endif
+}
+
+/**
+ * @brief Set the card of the child with the given ID, if the inner
+ * block of the path element has such a child.
+ * Used to find the place of a new child after a rebalancing.
+ */
+static inline void
+bps_tree_cards_set_child(struct bps_inner_path_elem *inner_path_elem,
+			 bps_tree_block_id_t id, size_t card)
+{
+#ifdef BPS_TREE_RANK
+	struct bps_inner *inner = inner_path_elem->block;
+	if (inner == NULL)
+		return;
+	for (bps_tree_pos_t i = 0; i < inner->header.size; i++) {
+		if (inner->child_ids[i] == id) {
+			inner->child_cards[i] = card;
+			return;
+		}
+	}
+#else
+	(void)inner_path_elem;
+	(void)id;
+	(void)card;
+#endif
+}
+
+/**
+ * @brief Set the cards of a new root block.
+ */
+static inline void
+bps_tree_cards_init_root(struct bps_tree *tree, struct bps_inner *root)
+{
+#ifdef BPS_TREE_RANK
+	for (bps_tree_pos_t i = 0; i < root->header.size; i++)
+		root->child_cards[i] =
+			bps_tree_child_card(tree, root->child_ids[i]);
+#else
+	(void)tree;
+	(void)root;
+#endif
+}
+
 /**
  * bps_tree_process_insert_inner declaration. See definition for details.
  */
@@ -3131,6 +3565,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 {
 	if (bps_tree_leaf_free_size(leaf_path_elem->block)) {
 		bps_tree_insert_into_leaf(tree, leaf_path_elem, new_elem);
+		bps_tree_cards_add(tree, leaf_path_elem->parent,
+				   leaf_path_elem->pos_in_parent, 1);
 		BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x0);
 		return 0;
 	}
@@ -3156,6 +3592,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_leaf(tree,
 					&left_ext, leaf_path_elem,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x1);
 			return 0;
 		} else if (bps_tree_leaf_free_size(right_ext.block) > 0) {
@@ -3164,6 +3602,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_leaf(tree,
 					leaf_path_elem, &right_ext,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x2);
 			return 0;
 		}
@@ -3174,6 +3614,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_leaf(tree,
 					&left_ext, leaf_path_elem,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x3);
 			return 0;
 		}
@@ -3190,6 +3632,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_leaf(tree,
 					&left_ext, leaf_path_elem,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x4);
 			return 0;
 		}
@@ -3200,6 +3644,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_leaf(tree,
 					leaf_path_elem, &right_ext,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x5);
 			return 0;
 		}
@@ -3216,6 +3662,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_leaf(tree,
 					leaf_path_elem, &right_ext,
 					move_count, new_elem);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent, 1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0x6);
 			return 0;
 		}
@@ -3434,6 +3882,7 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 		new_root->child_ids[0] = tree->root_id;
 		new_root->child_ids[1] = new_block_id;
 		new_root->elems[0] = tree->max_elem;
+		bps_tree_cards_init_root(tree, new_root);
 		tree->root_id = new_root_id;
 		tree->max_elem = new_max_elem;
 		tree->depth++;
@@ -3442,6 +3891,8 @@ bps_tree_process_insert_leaf(struct bps_tree *tree,
 		return 0;
 	}
 	assert(leaf_path_elem->parent);
+	bps_tree_cards_update(tree, leaf_path_elem->parent,
+			      leaf_path_elem->pos_in_parent, 0);
 	BPS_TREE_BRANCH_TRACE(tree, insert_leaf, 1 << 0xD);
 	return bps_tree_process_insert_inner(tree, leaf_path_elem->parent,
 			new_block_id, new_path_elem.pos_in_parent,
@@ -3458,9 +3909,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			      bps_tree_block_id_t block_id,
 			      bps_tree_pos_t pos, bps_tree_elem_t max_elem)
 {
+	size_t card = bps_tree_child_card(tree, block_id);
 	if (bps_tree_inner_free_size(inner_path_elem->block)) {
 		bps_tree_insert_into_inner(tree, inner_path_elem,
 					   block_id, pos, max_elem);
+		bps_tree_cards_set_child(inner_path_elem, block_id, card);
+		bps_tree_cards_add(tree, inner_path_elem->parent,
+				   inner_path_elem->pos_in_parent, 1);
 		BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x0);
 		return 0;
 	}
@@ -3484,6 +3939,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_inner(tree,
 					&left_ext, inner_path_elem, move_count,
 					block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x1);
 			return 0;
 		} else if (bps_tree_inner_free_size(right_ext.block) > 0) {
@@ -3492,6 +3954,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_inner(tree,
 					inner_path_elem, &right_ext,
 					move_count, block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x2);
 			return 0;
 		}
@@ -3502,6 +3971,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_inner(tree,
 					&left_ext, inner_path_elem,
 					move_count, block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x3);
 			return 0;
 		}
@@ -3518,6 +3994,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_left_inner(tree,
 					&left_ext, inner_path_elem, move_count,
 					block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x4);
 			return 0;
 		}
@@ -3528,6 +4011,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_inner(tree,
 					inner_path_elem, &right_ext,
 					move_count, block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x5);
 			return 0;
 		}
@@ -3544,6 +4034,13 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 			bps_tree_insert_and_move_elems_to_right_inner(tree,
 					inner_path_elem, &right_ext,
 					move_count, block_id, pos, max_elem);
+			bps_tree_cards_set_child(inner_path_elem, block_id,
+						 card);
+			bps_tree_cards_set_child(&left_ext, block_id, card);
+			bps_tree_cards_set_child(&right_ext, block_id, card);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      1);
 			BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0x6);
 			return 0;
 		}
@@ -3742,6 +4239,8 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 		bps_tree_insert_and_move_elems_to_right_inner(tree,
 				inner_path_elem, &new_path_elem,
 				mc1, block_id, pos, max_elem);
+		bps_tree_cards_set_child(inner_path_elem, block_id, card);
+		bps_tree_cards_set_child(&new_path_elem, block_id, card);
 
 		bps_tree_block_id_t new_root_id = (bps_tree_block_id_t)(-1);
 		struct bps_inner *new_root =
@@ -3750,6 +4249,7 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 		new_root->child_ids[0] = tree->root_id;
 		new_root->child_ids[1] = new_block_id;
 		new_root->elems[0] = tree->max_elem;
+		bps_tree_cards_init_root(tree, new_root);
 		tree->root_id = new_root_id;
 		tree->max_elem = new_max_elem;
 		tree->depth++;
@@ -3757,6 +4257,14 @@ bps_tree_process_insert_inner(struct bps_tree *tree,
 		return 0;
 	}
 	assert(inner_path_elem->parent);
+	bps_tree_cards_set_child(inner_path_elem, block_id, card);
+	bps_tree_cards_set_child(&new_path_elem, block_id, card);
+	bps_tree_cards_set_child(&left_ext, block_id, card);
+	bps_tree_cards_set_child(&right_ext, block_id, card);
+	bps_tree_cards_set_child(&left_left_ext, block_id, card);
+	bps_tree_cards_set_child(&right_right_ext, block_id, card);
+	bps_tree_cards_update(tree, inner_path_elem->parent,
+			      inner_path_elem->pos_in_parent, 0);
 	BPS_TREE_BRANCH_TRACE(tree, insert_inner, 1 << 0xD);
 	return bps_tree_process_insert_inner(tree, inner_path_elem->parent,
 			new_block_id, new_path_elem.pos_in_parent,
@@ -3782,6 +4290,8 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 
 	if (leaf_path_elem->block->header.size >=
 	    BPS_TREE_MAX_COUNT_IN_LEAF * 2 / 3) {
+		bps_tree_cards_add(tree, leaf_path_elem->parent,
+				   leaf_path_elem->pos_in_parent, -1);
 		BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x0);
 		return;
 	}
@@ -3807,6 +4317,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 				bps_tree_leaf_overmin_size(left_ext.block) / 2;
 			bps_tree_move_elems_to_right_leaf(tree, &left_ext,
 					leaf_path_elem, move_count);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x1);
 			return;
 		} else if (bps_tree_leaf_overmin_size(right_ext.block) > 0) {
@@ -3814,6 +4327,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 				bps_tree_leaf_overmin_size(right_ext.block) / 2;
 			bps_tree_move_elems_to_left_leaf(tree, leaf_path_elem,
 					&right_ext, move_count);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x2);
 			return;
 		}
@@ -3823,6 +4339,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 				bps_tree_leaf_overmin_size(left_ext.block) / 2;
 			bps_tree_move_elems_to_right_leaf(tree, &left_ext,
 					leaf_path_elem, move_count);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x3);
 			return;
 		}
@@ -3838,6 +4357,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 					leaf_path_elem, move_count1);
 			bps_tree_move_elems_to_right_leaf(tree, &left_left_ext,
 					&left_ext, move_count2);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x4);
 			return;
 		}
@@ -3848,6 +4370,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 				/ 2;
 			bps_tree_move_elems_to_left_leaf(tree, leaf_path_elem,
 					&right_ext, move_count);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x5);
 			return;
 		}
@@ -3863,6 +4388,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 					&right_ext, move_count1);
 			bps_tree_move_elems_to_left_leaf(tree, &right_ext,
 					&right_right_ext, move_count2);
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0x6);
 			return;
 		}
@@ -3898,6 +4426,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 	} else if (has_left_ext) {
 		if (leaf_path_elem->block->header.size +
 		    left_ext.block->header.size > BPS_TREE_MAX_COUNT_IN_LEAF) {
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0xA);
 			return;
 		}
@@ -3908,6 +4439,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 	} else if (has_right_ext) {
 		if (leaf_path_elem->block->header.size +
 		    right_ext.block->header.size > BPS_TREE_MAX_COUNT_IN_LEAF) {
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0xC);
 			return;
 		}
@@ -3917,6 +4451,9 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 		BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0xD);
 	} else {
 		if (leaf_path_elem->block->header.size > 0) {
+			bps_tree_cards_update(tree, leaf_path_elem->parent,
+					      leaf_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_leaf, 1 << 0xE);
 			return;
 		}
@@ -3934,6 +4471,8 @@ bps_tree_process_delete_leaf(struct bps_tree *tree,
 	}
 
 	assert(leaf_path_elem->block->header.size == 0);
+	bps_tree_cards_update(tree, leaf_path_elem->parent,
+			      leaf_path_elem->pos_in_parent, 0);
 
 	struct bps_leaf *leaf = (struct bps_leaf*)leaf_path_elem->block;
 	if (leaf->prev_id == (bps_tree_block_id_t)(-1)) {
@@ -3970,6 +4509,8 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 
 	if (inner_path_elem->block->header.size >=
 	    BPS_TREE_MAX_COUNT_IN_INNER * 2 / 3) {
+		bps_tree_cards_add(tree, inner_path_elem->parent,
+				   inner_path_elem->pos_in_parent, -1);
 		BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x0);
 		return;
 	}
@@ -3994,6 +4535,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 				/ 2;
 			bps_tree_move_elems_to_right_inner(tree, &left_ext,
 					inner_path_elem, move_count);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x1);
 			return;
 		} else if (bps_tree_inner_overmin_size(right_ext.block) > 0) {
@@ -4003,6 +4547,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 			bps_tree_move_elems_to_left_inner(tree,
 					inner_path_elem, &right_ext,
 					move_count);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x2);
 			return;
 		}
@@ -4013,6 +4560,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 				/ 2;
 			bps_tree_move_elems_to_right_inner(tree, &left_ext,
 					inner_path_elem, move_count);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x3);
 			return;
 		}
@@ -4029,6 +4579,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 					inner_path_elem, move_count1);
 			bps_tree_move_elems_to_right_inner(tree,
 					&left_left_ext, &left_ext, move_count2);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x4);
 			return;
 		}
@@ -4040,6 +4593,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 			bps_tree_move_elems_to_left_inner(tree,
 					inner_path_elem, &right_ext,
 					move_count);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x5);
 			return;
 		}
@@ -4056,6 +4612,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 					&right_ext, move_count1);
 			bps_tree_move_elems_to_left_inner(tree, &right_ext,
 					&right_right_ext, move_count2);
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0x6);
 			return;
 		}
@@ -4091,6 +4650,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 	} else if (has_left_ext) {
 		if (inner_path_elem->block->header.size +
 		    left_ext.block->header.size > BPS_TREE_MAX_COUNT_IN_INNER) {
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0xA);
 			//throw 1;
 			return;
@@ -4103,6 +4665,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 		if (inner_path_elem->block->header.size +
 		    right_ext.block->header.size >
 		    BPS_TREE_MAX_COUNT_IN_INNER) {
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0xC);
 			//throw 2;
 			return;
@@ -4113,6 +4678,9 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 		BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0xD);
 	} else {
 		if (inner_path_elem->block->header.size > 1) {
+			bps_tree_cards_update(tree, inner_path_elem->parent,
+					      inner_path_elem->pos_in_parent,
+					      -1);
 			BPS_TREE_BRANCH_TRACE(tree, delete_inner, 1 << 0xE);
 			return;
 		}
@@ -4126,6 +4694,8 @@ bps_tree_process_delete_inner(struct bps_tree *tree,
 		return;
 	}
 	assert(inner_path_elem->block->header.size == 0);
+	bps_tree_cards_update(tree, inner_path_elem->parent,
+			      inner_path_elem->pos_in_parent, 0);
 
 	bps_tree_dispose_inner(tree, inner_path_elem->block,
 			inner_path_elem->block_id);
@@ -4303,13 +4873,21 @@ bps_tree_debug_check_block(const struct bps_tree *tree, struct bps_block *block,
 				result |= 0x4000000;
 		}
 
-		for (bps_tree_pos_t i = 0; i < block->size; i++)
+		for (bps_tree_pos_t i = 0; i < block->size; i++) {
+			size_t prev_count = *calc_count;
 			result |= bps_tree_debug_check_block(tree,
 				bps_tree_restore_block(tree,
 						       inner->child_ids[i]),
 				inner->child_ids[i], level - 1, calc_count,
 				expected_prev_id, expected_this_id,
 				check_fullness_next);
+#ifdef BPS_TREE_RANK
+			if (inner->child_cards[i] != *calc_count - prev_count)
+				result |= 0x8000000;
+#else
+			(void)prev_count;
+#endif
+		}
 		return result;
 	}
 }
@@ -5685,6 +6263,7 @@ bps_tree_debug_check_internal_functions(bool assertme)
 
 #undef BPS_TREE_MEMMOVE
 #undef BPS_TREE_DATAMOVE
+#undef BPS_TREE_CHILDMOVE
 #undef BPS_TREE_BRANCH_TRACE
 
 /* {{{ Macros for custom naming of structs and functions */
@@ -5707,6 +6286,7 @@ bps_tree_debug_check_internal_functions(bool assertme)
 #undef bps_tree_build
 #undef bps_tree_destroy
 #undef bps_tree_find
+#undef bps_tree_find_many
 #undef bps_tree_insert
 #undef bps_tree_delete
 #undef bps_tree_size
@@ -5725,6 +6305,9 @@ bps_tree_debug_check_internal_functions(bool assertme)
 #undef bps_tree_iterator_prev
 #undef bps_tree_iterator_freeze
 #undef bps_tree_iterator_destroy
+#undef bps_tree_lower_bound_rank
+#undef bps_tree_upper_bound_rank
+#undef bps_tree_iterator_at
 #undef bps_tree_debug_check
 #undef bps_tree_print
 #undef bps_tree_debug_check_internal_functions
@@ -5785,6 +6368,12 @@ bps_tree_debug_check_internal_functions(bool assertme)
 #undef bps_tree_process_insert_inner
 #undef bps_tree_process_delete_leaf
 #undef bps_tree_process_delete_inner
+#undef bps_tree_block_card
+#undef bps_tree_child_card
+#undef bps_tree_cards_add
+#undef bps_tree_cards_update
+#undef bps_tree_cards_set_child
+#undef bps_tree_cards_init_root
 #undef bps_tree_debug_find_max_elem
 #undef bps_tree_debug_check_block
 #undef bps_tree_print_indent
@@ -216,6 +216,16 @@ LIGHT(find)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_DATA_TYPE data);
 uint32_t
 LIGHT(find_key)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_KEY_TYPE data);
 
+/**
+ * @brief Prefetch the first record of the chain of the given hash.
+ * Used to overlap cache misses of several lookups: prefetch records
+ * for a batch of hashes, then find them with LIGHT(find_key).
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is going to be looked up
+ */
+void
+LIGHT(prefetch)(const struct LIGHT(core) *ht, uint32_t hash);
+
 /**
  * @brief Insert a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -440,6 +450,20 @@ LIGHT(find_key)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_KEY_TYPE key)
 	return LIGHT(end);
 }
 
+/**
+ * @brief Prefetch the first record of the chain of the given hash.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is going to be looked up
+ */
+inline void
+LIGHT(prefetch)(const struct LIGHT(core) *ht, uint32_t hash)
+{
+	if (ht->count == 0)
+		return;
+	uint32_t slot = LIGHT(slot)(ht, hash);
+	__builtin_prefetch(matras_get(&ht->mtable, slot));
+}
+
 /**
  * @brief Replace a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -33,7 +33,14 @@
 #include <assert.h>
 #include <limits.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <sys/types.h>
+#include <third_party/qsort_arg.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*------------------------------------------------------------------------- */
 /* R-tree internal structures definition */
@@ -46,25 +53,49 @@ enum {
 	RTREE_MAXIMUM_BRANCHES_IN_PAGE = RTREE_OPTIMAL_BRANCHES_IN_PAGE * 2
 };
 
-struct rtree_page_branch {
-	union {
-		struct rtree_page *page;
-		record_t record;
-	} data;
-	struct rtree_rect rect;
+union rtree_branch_data {
+	struct rtree_page *page;
+	record_t record;
 };
 
-enum {
-	RTREE_BRANCH_DATA_SIZE = offsetof(struct rtree_page_branch, rect)
+/* Branch of a page, unpacked from the page by rtree_branch_load() */
+struct rtree_page_branch {
+	union rtree_branch_data data;
+	struct rtree_rect rect;
 };
 
+/*
+ * Branches of a page are stored column-wise: all page pointers or
+ * records go first and every coordinate of the rectangles has its
+ * own row of page_max_fill values after them, so a page is checked
+ * against a rectangle with a few vector comparisons per coordinate:
+ *
+ * data[0], data[1], ..., data[page_max_fill - 1]
+ * coords[0] of branch 0, 1, ..., page_max_fill - 1
+ * coords[1] of branch 0, 1, ..., page_max_fill - 1
+ * ...
+ */
 struct rtree_page {
 	/* number of branches at page */
 	unsigned n;
 	/* branches */
-	struct rtree_page_branch data[];
+	union rtree_branch_data data[];
+};
+
+enum {
+	RTREE_BRANCH_DATA_SIZE = sizeof(union rtree_branch_data),
+	RTREE_PAGE_HEADER_SIZE = offsetof(struct rtree_page, data)
 };
 
+/* Coordinate @a k of rectangles of all branches of the page */
+static inline coord_t *
+rtree_page_coords(const struct rtree *tree, const struct rtree_page *page,
+		  unsigned k)
+{
+	return (coord_t *)(page->data + tree->page_max_fill) +
+		k * tree->page_max_fill;
+}
+
 struct rtree_neighbor_page {
 	struct rtree_neighbor_page* next;
 	struct rtree_neighbor buf[];
@@ -222,21 +253,6 @@ rtree_max(coord_t a, coord_t b)
 	return a > b ? a : b;
 }
 
-static void
-rtree_rect_cover(const struct rtree_rect *item1,
-		 const struct rtree_rect *item2,
-		 struct rtree_rect *result,
-		 unsigned dimension)
-{
-	for (int i = dimension; --i >= 0; ) {
-		const coord_t *i1_coords = &item1->coords[2 * i];
-		const coord_t *i2_coords = &item2->coords[2 * i];
-		coord_t *r_coords = &result->coords[2 * i];
-		r_coords[0] = rtree_min(i1_coords[0], i2_coords[0]);
-		r_coords[1] = rtree_max(i1_coords[1], i2_coords[1]);
-	}
-}
-
 static void
 rtree_rect_intersection(const struct rtree_rect *item1,
 			const struct rtree_rect *item2,
@@ -256,86 +272,181 @@ rtree_rect_intersection(const struct rtree_rect *item1,
 	}
 }
 
-static bool
-rtree_rect_intersects_rect(const struct rtree_rect *rt1,
-			   const struct rtree_rect *rt2,
-			   unsigned dimension)
-{
-	for (int i = dimension; --i >= 0; ) {
-		const coord_t *coords1 = &rt1->coords[2 * i];
-		const coord_t *coords2 = &rt2->coords[2 * i];
-		if (coords1[0] > coords2[1] || coords1[1] < coords2[0])
-			return false;
-	}
-	return true;
-}
+/*------------------------------------------------------------------------- */
+/* R-tree page matchers */
+/*------------------------------------------------------------------------- */
 
-static bool
-rtree_rect_in_rect(const struct rtree_rect *rt1,
-		   const struct rtree_rect *rt2,
-		   unsigned dimension)
-{
-	for (int i = dimension; --i >= 0; ) {
-		const coord_t *coords1 = &rt1->coords[2 * i];
-		const coord_t *coords2 = &rt2->coords[2 * i];
-		if (coords1[0] < coords2[0] || coords1[1] > coords2[1])
-			return false;
-	}
-	return true;
-}
+/*
+ * Vector operations on coordinates used by page matchers and
+ * distance computation. Without SSE2 or AVX2 all branches are
+ * handled by the scalar tail loops.
+ */
+#if defined(__AVX2__)
+typedef __m256d rtree_vec_t;
+#define RTREE_VEC_WIDTH 4
+#define rtree_vec_load(p) _mm256_loadu_pd(p)
+#define rtree_vec_store(p, a) _mm256_storeu_pd(p, a)
+#define rtree_vec_set1(x) _mm256_set1_pd(x)
+#define rtree_vec_and(a, b) _mm256_and_pd(a, b)
+#define rtree_vec_andnot(a, b) _mm256_andnot_pd(a, b)
+#define rtree_vec_or(a, b) _mm256_or_pd(a, b)
+#define rtree_vec_add(a, b) _mm256_add_pd(a, b)
+#define rtree_vec_sub(a, b) _mm256_sub_pd(a, b)
+#define rtree_vec_mul(a, b) _mm256_mul_pd(a, b)
+#define rtree_vec_movemask(a) _mm256_movemask_pd(a)
+#define rtree_vec_lt(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define rtree_vec_gt(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define rtree_vec_eq(a, b) _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define rtree_vec_nlt(a, b) _mm256_cmp_pd(a, b, _CMP_NLT_UQ)
+#define rtree_vec_ngt(a, b) _mm256_cmp_pd(a, b, _CMP_NGT_UQ)
+#define rtree_vec_nle(a, b) _mm256_cmp_pd(a, b, _CMP_NLE_UQ)
+#define rtree_vec_nge(a, b) _mm256_cmp_pd(a, b, _CMP_NGE_UQ)
+#elif defined(__SSE2__)
+typedef __m128d rtree_vec_t;
+#define RTREE_VEC_WIDTH 2
+#define rtree_vec_load(p) _mm_loadu_pd(p)
+#define rtree_vec_store(p, a) _mm_storeu_pd(p, a)
+#define rtree_vec_set1(x) _mm_set1_pd(x)
+#define rtree_vec_and(a, b) _mm_and_pd(a, b)
+#define rtree_vec_andnot(a, b) _mm_andnot_pd(a, b)
+#define rtree_vec_or(a, b) _mm_or_pd(a, b)
+#define rtree_vec_add(a, b) _mm_add_pd(a, b)
+#define rtree_vec_sub(a, b) _mm_sub_pd(a, b)
+#define rtree_vec_mul(a, b) _mm_mul_pd(a, b)
+#define rtree_vec_movemask(a) _mm_movemask_pd(a)
+#define rtree_vec_lt(a, b) _mm_cmplt_pd(a, b)
+#define rtree_vec_gt(a, b) _mm_cmpgt_pd(a, b)
+#define rtree_vec_eq(a, b) _mm_cmpeq_pd(a, b)
+#define rtree_vec_nlt(a, b) _mm_cmpnlt_pd(a, b)
+#define rtree_vec_ngt(a, b) _mm_cmpngt_pd(a, b)
+#define rtree_vec_nle(a, b) _mm_cmpnle_pd(a, b)
+#define rtree_vec_nge(a, b) _mm_cmpnge_pd(a, b)
+#endif
 
-static bool
-rtree_rect_strict_in_rect(const struct rtree_rect *rt1,
-			  const struct rtree_rect *rt2,
-			  unsigned dimension)
-{
-	for (int i = dimension; --i >= 0; ) {
-		const coord_t *coords1 = &rt1->coords[2 * i];
-		const coord_t *coords2 = &rt2->coords[2 * i];
-		if (coords1[0] <= coords2[0] || coords1[1] >= coords2[1])
-			return false;
+#if defined(RTREE_VEC_WIDTH)
+#define RTREE_PAGE_MATCH_VEC(lo_vop, hi_vop)				\
+	rtree_vec_t lo_vec = rtree_vec_set1(lo_val);			\
+	rtree_vec_t hi_vec = rtree_vec_set1(hi_val);			\
+	for (; i + RTREE_VEC_WIDTH <= n; i += RTREE_VEC_WIDTH) {	\
+		rtree_vec_t ok = rtree_vec_and(				\
+			rtree_vec_##lo_vop(rtree_vec_load(lo + i), lo_vec), \
+			rtree_vec_##hi_vop(rtree_vec_load(hi + i), hi_vec)); \
+		axis_mask |= (uint64_t)rtree_vec_movemask(ok) << i;	\
 	}
-	return true;
-}
-
-static bool
-rtree_rect_holds_rect(const struct rtree_rect *rt1,
-		      const struct rtree_rect *rt2,
-		      unsigned dimension)
-{
-	return rtree_rect_in_rect(rt2, rt1, dimension);
-}
+#else
+#define RTREE_PAGE_MATCH_VEC(lo_vop, hi_vop)
+#endif
 
-static bool
-rtree_rect_strict_holds_rect(const struct rtree_rect *rt1,
-			     const struct rtree_rect *rt2,
-			     unsigned dimension)
-{
-	return rtree_rect_strict_in_rect(rt2, rt1, dimension);
+/*
+ * Define rtree_page_match_<name>(), a matcher of all branches of
+ * a page with a rectangle. A branch is rejected if its low
+ * coordinate on some axis is <lo_op> than the rectangle coordinate
+ * <lo_key> (0 - low, 1 - high) on the axis, or its high coordinate
+ * is <hi_op> than the rectangle coordinate <hi_key>. lo_vop and
+ * hi_vop are vector operations accepting the same branches, so
+ * that NaN coordinates are handled like in the scalar loop.
+ */
+#define RTREE_PAGE_MATCHER(name, lo_op, lo_vop, lo_key,			\
+			   hi_op, hi_vop, hi_key)				\
+static uint64_t								\
+rtree_page_match_##name(const struct rtree *tree,			\
+			const struct rtree_page *page,			\
+			const struct rtree_rect *rect)			\
+{									\
+	unsigned n = page->n;						\
+	uint64_t mask = ((uint64_t)1 << n) - 1;				\
+	for (unsigned k = 0; k < tree->dimension * 2 && mask != 0;	\
+	     k += 2) {							\
+		const coord_t *lo = rtree_page_coords(tree, page, k);	\
+		const coord_t *hi = rtree_page_coords(tree, page, k + 1); \
+		coord_t lo_val = rect->coords[k + lo_key];		\
+		coord_t hi_val = rect->coords[k + hi_key];		\
+		uint64_t axis_mask = 0;					\
+		unsigned i = 0;						\
+		RTREE_PAGE_MATCH_VEC(lo_vop, hi_vop)			\
+		for (; i < n; i++) {					\
+			if (!(lo[i] lo_op lo_val) && !(hi[i] hi_op hi_val)) \
+				axis_mask |= (uint64_t)1 << i;		\
+		}							\
+		mask &= axis_mask;					\
+	}								\
+	return mask;							\
 }
 
-static bool
-rtree_rect_equal_to_rect(const struct rtree_rect *rt1,
-			 const struct rtree_rect *rt2,
-			 unsigned dimension)
+/* Branch intersects the rectangle */
+RTREE_PAGE_MATCHER(overlaps, >, ngt, 1, <, nlt, 0)
+/* Branch contains the rectangle */
+RTREE_PAGE_MATCHER(contains, >, ngt, 0, <, nlt, 1)
+/* Branch contains the rectangle, borders don't touch */
+RTREE_PAGE_MATCHER(strict_contains, >=, nge, 0, <=, nle, 1)
+/* Branch is contained in the rectangle */
+RTREE_PAGE_MATCHER(belongs, <, nlt, 0, >, ngt, 1)
+/* Branch is contained in the rectangle, borders don't touch */
+RTREE_PAGE_MATCHER(strict_belongs, <=, nle, 0, >=, nge, 1)
+/* Branch is equal to the rectangle */
+RTREE_PAGE_MATCHER(equals, !=, eq, 0, !=, eq, 1)
+
+static uint64_t
+rtree_page_match_all(const struct rtree *tree, const struct rtree_page *page,
+		     const struct rtree_rect *rect)
 {
-	for (int i = dimension * 2; --i >= 0; )
-		if (rt1->coords[i] != rt2->coords[i])
-			return false;
-	return true;
+	(void) tree;
+	(void) rect;
+	return ((uint64_t)1 << page->n) - 1;
 }
 
-static bool
-rtree_always_true(const struct rtree_rect *rt1,
-		  const struct rtree_rect *rt2,
-		  unsigned dimension)
+/*
+ * Distances from the point at the low corner of @a rect to all
+ * branches of the page: squared Euclid or Manhattan one, like
+ * rtree_rect_neigh_distance2() and rtree_rect_neigh_distance().
+ */
+static void
+rtree_page_neigh_distance(const struct rtree *tree,
+			  const struct rtree_page *page,
+			  const struct rtree_rect *rect, sq_coord_t *distance)
 {
-	(void) rt1;
-	(void) rt2;
-	(void) dimension;
-	return true;
+	unsigned n = page->n;
+	bool euclid = tree->distance_type == RTREE_EUCLID;
+	for (unsigned i = 0; i < n; i++)
+		distance[i] = 0;
+	for (int k = tree->dimension; --k >= 0; ) {
+		const coord_t *lo = rtree_page_coords(tree, page, 2 * k);
+		const coord_t *hi = rtree_page_coords(tree, page, 2 * k + 1);
+		coord_t x = rect->coords[2 * k];
+		unsigned i = 0;
+#if defined(RTREE_VEC_WIDTH)
+		rtree_vec_t x_vec = rtree_vec_set1(x);
+		for (; i + RTREE_VEC_WIDTH <= n; i += RTREE_VEC_WIDTH) {
+			rtree_vec_t l = rtree_vec_load(lo + i);
+			rtree_vec_t h = rtree_vec_load(hi + i);
+			rtree_vec_t below = rtree_vec_lt(x_vec, l);
+			rtree_vec_t above = rtree_vec_andnot(below,
+						rtree_vec_gt(x_vec, h));
+			rtree_vec_t diff_lo = rtree_vec_sub(l, x_vec);
+			rtree_vec_t diff_hi = rtree_vec_sub(x_vec, h);
+			if (euclid) {
+				diff_lo = rtree_vec_mul(diff_lo, diff_lo);
+				diff_hi = rtree_vec_mul(diff_hi, diff_hi);
+			}
+			rtree_vec_t add = rtree_vec_or(
+				rtree_vec_and(below, diff_lo),
+				rtree_vec_and(above, diff_hi));
+			rtree_vec_store(distance + i,
+					rtree_vec_add(rtree_vec_load(distance + i),
+						      add));
+		}
+#endif
+		for (; i < n; i++) {
+			if (x < lo[i]) {
+				sq_coord_t diff = (sq_coord_t)(x - lo[i]);
+				distance[i] += euclid ? diff * diff : -diff;
+			} else if (x > hi[i]) {
+				sq_coord_t diff = (sq_coord_t)(x - hi[i]);
+				distance[i] += euclid ? diff * diff : diff;
+			}
+		}
+	}
 }
-
 /*------------------------------------------------------------------------- */
 /* R-tree page methods */
 /*------------------------------------------------------------------------- */
@@ -362,39 +473,65 @@ rtree_page_free(struct rtree *tree, struct rtree_page *page)
 	tree->free_pages = (void *)page;
 }
 
-static struct rtree_page_branch *
-rtree_branch_get(const struct rtree *tree, const struct rtree_page *page,
-		 unsigned ind)
+/* Get rectangle of branch @a i of the page */
+static void
+rtree_branch_rect(const struct rtree *tree, const struct rtree_page *page,
+		  unsigned i, struct rtree_rect *rect)
 {
-	return (struct rtree_page_branch *)
-		((char *)page->data + ind * tree->page_branch_size);
+	for (unsigned k = 0; k < tree->dimension * 2; k++)
+		rect->coords[k] = rtree_page_coords(tree, page, k)[i];
+}
+
+/* Set rectangle of branch @a i of the page */
+static void
+rtree_branch_set_rect(const struct rtree *tree, struct rtree_page *page,
+		      unsigned i, const struct rtree_rect *rect)
+{
+	for (unsigned k = 0; k < tree->dimension * 2; k++)
+		rtree_page_coords(tree, page, k)[i] = rect->coords[k];
+}
+
+static void
+rtree_branch_load(const struct rtree *tree, const struct rtree_page *page,
+		  unsigned i, struct rtree_page_branch *b)
+{
+	b->data = page->data[i];
+	rtree_branch_rect(tree, page, i, &b->rect);
 }
 
 static void
-rtree_branch_copy(struct rtree_page_branch *to,
-		  const struct rtree_page_branch *from, unsigned dimension)
+rtree_branch_store(const struct rtree *tree, struct rtree_page *page,
+		   unsigned i, const struct rtree_page_branch *b)
 {
-	to->data = from->data;
-	rtree_rect_copy(&to->rect, &from->rect, dimension);
+	page->data[i] = b->data;
+	rtree_branch_set_rect(tree, page, i, &b->rect);
 }
 
+/* Copy branch @a from of @a from_page to branch @a to of @a to_page */
+static void
+rtree_branch_copy(const struct rtree *tree, struct rtree_page *to_page,
+		  unsigned to, const struct rtree_page *from_page,
+		  unsigned from)
+{
+	to_page->data[to] = from_page->data[from];
+	for (unsigned k = 0; k < tree->dimension * 2; k++) {
+		rtree_page_coords(tree, to_page, k)[to] =
+			rtree_page_coords(tree, from_page, k)[from];
+	}
+}
 
 static void
 set_next_reinsert_page(const struct rtree *tree, struct rtree_page *page,
 		       struct rtree_page *next_page)
 {
 	/* The page must be MIN_FILLed, so last branch is unused */
-	struct rtree_page_branch *b = rtree_branch_get(tree, page,
-						       tree->page_max_fill - 1);
-	b->data.page = next_page;
+	page->data[tree->page_max_fill - 1].page = next_page;
 }
 
 struct rtree_page *
 get_next_reinsert_page(const struct rtree *tree, const struct rtree_page *page)
 {
-	struct rtree_page_branch *b = rtree_branch_get(tree, page,
-						       tree->page_max_fill - 1);
-	return b->data.page;
+	return page->data[tree->page_max_fill - 1].page;
 }
 
 /* Calculate cover of all rectangles at page */
@@ -402,11 +539,20 @@ static void
 rtree_page_cover(const struct rtree *tree, const struct rtree_page *page,
 		 struct rtree_rect *res)
 {
-	rtree_rect_copy(res, &rtree_branch_get(tree, page, 0)->rect,
-			tree->dimension);
-	for (unsigned i = 1; i < page->n; i++) {
-		rtree_rect_add(res, &rtree_branch_get(tree, page, i)->rect,
-			       tree->dimension);
+	assert(page->n > 0);
+	for (unsigned k = 0; k < tree->dimension * 2; k += 2) {
+		const coord_t *lo = rtree_page_coords(tree, page, k);
+		const coord_t *hi = rtree_page_coords(tree, page, k + 1);
+		coord_t min_lo = lo[0];
+		coord_t max_hi = hi[0];
+		for (unsigned i = 1; i < page->n; i++) {
+			if (min_lo > lo[i])
+				min_lo = lo[i];
+			if (max_hi < hi[i])
+				max_hi = hi[i];
+		}
+		res->coords[k] = min_lo;
+		res->coords[k + 1] = max_hi;
 	}
 }
 
@@ -415,10 +561,9 @@ static void
 rtree_page_init_with_record(const struct rtree *tree, struct rtree_page *page,
 			    struct rtree_rect *rect, record_t obj)
 {
-	struct rtree_page_branch *b = rtree_branch_get(tree, page, 0);
 	page->n = 1;
-	rtree_rect_copy(&b->rect, rect, tree->dimension);
-	b->data.record = obj;
+	page->data[0].record = obj;
+	rtree_branch_set_rect(tree, page, 0, rect);
 }
 
 /* Create new root page (root splitting) */
@@ -426,13 +571,83 @@ static void
 rtree_page_init_with_pages(const struct rtree *tree, struct rtree_page *page,
 			   struct rtree_page *page1, struct rtree_page *page2)
 {
+	struct rtree_rect cover;
 	page->n = 2;
-	struct rtree_page_branch *b = rtree_branch_get(tree, page, 0);
-	rtree_page_cover(tree, page1, &b->rect);
-	b->data.page = page1;
-	b = rtree_branch_get(tree, page, 1);
-	rtree_page_cover(tree, page2, &b->rect);
-	b->data.page = page2;
+	page->data[0].page = page1;
+	rtree_page_cover(tree, page1, &cover);
+	rtree_branch_set_rect(tree, page, 0, &cover);
+	page->data[1].page = page2;
+	rtree_page_cover(tree, page2, &cover);
+	rtree_branch_set_rect(tree, page, 1, &cover);
+}
+
+/*
+ * Coordinate @a k of a branch of a page being split: @a id 0 is
+ * the new branch @a br, @a id i + 1 is branch i of the page.
+ */
+static coord_t
+rtree_split_coord(const struct rtree *tree, const struct rtree_page *page,
+		  const struct rtree_page_branch *br, unsigned id, unsigned k)
+{
+	if (id == 0)
+		return br->rect.coords[k];
+	return rtree_page_coords(tree, page, k)[id - 1];
+}
+
+/* Get rectangle of a branch of a page being split */
+static void
+rtree_split_rect(const struct rtree *tree, const struct rtree_page *page,
+		 const struct rtree_page_branch *br, unsigned id,
+		 struct rtree_rect *rect)
+{
+	if (id == 0)
+		rtree_rect_copy(rect, &br->rect, tree->dimension);
+	else
+		rtree_branch_rect(tree, page, id - 1, rect);
+}
+
+/* Add rectangle of a branch of a page being split to @a rect */
+static void
+rtree_split_rect_add(const struct rtree *tree, const struct rtree_page *page,
+		     const struct rtree_page_branch *br, unsigned id,
+		     struct rtree_rect *rect)
+{
+	for (unsigned k = 0; k < tree->dimension * 2; k += 2) {
+		coord_t lo = rtree_split_coord(tree, page, br, id, k);
+		coord_t hi = rtree_split_coord(tree, page, br, id, k + 1);
+		if (rect->coords[k] > lo)
+			rect->coords[k] = lo;
+		if (rect->coords[k + 1] < hi)
+			rect->coords[k + 1] = hi;
+	}
+}
+
+/* Sort branches of a page being split by axis @a a */
+static void
+rtree_split_sort(const struct rtree *tree, const struct rtree_page *page,
+		 const struct rtree_page_branch *br, unsigned *ids,
+		 unsigned n, unsigned a)
+{
+	for (unsigned i = 0; i < n - 1; i++) {
+		unsigned min_i = i;
+		coord_t min_l = rtree_split_coord(tree, page, br, ids[i], 2 * a);
+		coord_t min_r = rtree_split_coord(tree, page, br, ids[i],
+						  2 * a + 1);
+		for (unsigned j = i + 1; j < n; j++) {
+			coord_t l = rtree_split_coord(tree, page, br, ids[j],
+						      2 * a);
+			coord_t r = rtree_split_coord(tree, page, br, ids[j],
+						      2 * a + 1);
+			if (l < min_l || (l == min_l && r < min_r)) {
+				min_i = j;
+				min_l = l;
+				min_r = r;
+			}
+		}
+		unsigned tmp = ids[i];
+		ids[i] = ids[min_i];
+		ids[min_i] = tmp;
+	}
 }
 
 static struct rtree_page *
@@ -440,53 +655,32 @@ rtree_split_page(struct rtree *tree, struct rtree_page *page,
 		 const struct rtree_page_branch *br)
 {
 	assert(page->n == tree->page_max_fill);
-	const struct rtree_rect *rects[RTREE_MAXIMUM_BRANCHES_IN_PAGE + 1];
 	unsigned ids[RTREE_MAXIMUM_BRANCHES_IN_PAGE + 1];
-	rects[0] = &br->rect;
-	ids[0] = 0;
-	for (unsigned i = 0; i < page->n; i++) {
-		struct rtree_page_branch *b = rtree_branch_get(tree, page, i);
-		rects[i + 1] = &b->rect;
-		ids[i + 1] = i + 1;
-	}
+	for (unsigned i = 0; i <= page->n; i++)
+		ids[i] = i;
 	const unsigned n = page->n + 1;
 	const unsigned k_max = n - 2 * tree->page_min_fill;
 	unsigned d = tree->dimension;
 	unsigned best_axis = 0;
 	coord_t best_s = 0;
 	for (unsigned a = 0; a < d; a++) {
-		for (unsigned i = 0; i < n - 1; i++) {
-			unsigned min_i = i;
-			coord_t min_l = rects[ids[i]]->coords[2 * a];
-			coord_t min_r = rects[ids[i]]->coords[2 * a + 1];
-			for (unsigned j = i + 1; j < n; j++) {
-				coord_t l = rects[ids[j]]->coords[2 * a];
-				coord_t r = rects[ids[j]]->coords[2 * a + 1];
-				if (l < min_l || (l == min_l && r < min_r)) {
-					min_i = j;
-					min_l = l;
-					min_r = r;
-				}
-			}
-			unsigned tmp = ids[i];
-			ids[i] = ids[min_i];
-			ids[min_i] = tmp;
-		}
+		rtree_split_sort(tree, page, br, ids, n, a);
 		struct rtree_rect test_rect;
 		coord_t dir_hm[RTREE_MAXIMUM_BRANCHES_IN_PAGE + 1];
 		coord_t rev_hm[RTREE_MAXIMUM_BRANCHES_IN_PAGE + 1];
 		dir_hm[0] = 0;
-		rtree_rect_copy(&test_rect, rects[ids[0]], d);
+		rtree_split_rect(tree, page, br, ids[0], &test_rect);
 		dir_hm[1] = rtree_rect_half_margin(&test_rect, d);
 		for (unsigned i = 1; i < n - tree->page_min_fill; i++) {
-			rtree_rect_add(&test_rect, rects[ids[i]], d);
+			rtree_split_rect_add(tree, page, br, ids[i], &test_rect);
 			dir_hm[i + 1] = rtree_rect_half_margin(&test_rect, d);
 		}
 		rev_hm[0] = 0;
-		rtree_rect_copy(&test_rect, rects[ids[n - 1]], d);
+		rtree_split_rect(tree, page, br, ids[n - 1], &test_rect);
 		rev_hm[1] = rtree_rect_half_margin(&test_rect, d);
 		for (unsigned i = 1; i < n - tree->page_min_fill; i++) {
-			rtree_rect_add(&test_rect, rects[ids[n - i - 1]], d);
+			rtree_split_rect_add(tree, page, br, ids[n - i - 1],
+					     &test_rect);
 			rev_hm[i + 1] = rtree_rect_half_margin(&test_rect, d);
 		}
 		coord_t s = 0;
@@ -500,24 +694,7 @@ rtree_split_page(struct rtree *tree, struct rtree_page *page,
 			best_s = s;
 		}
 	}
-	unsigned a = best_axis;
-	for (unsigned i = 0; i < n - 1; i++) {
-		unsigned min_i = i;
-		coord_t min_l = rects[ids[i]]->coords[2 * a];
-		coord_t min_r = rects[ids[i]]->coords[2 * a + 1];
-		for (unsigned j = i + 1; j < n; j++) {
-			coord_t l = rects[ids[j]]->coords[2 * a];
-			coord_t r = rects[ids[j]]->coords[2 * a + 1];
-			if (l < min_l || (l == min_l && r < min_r)) {
-				min_i = j;
-				min_l = l;
-				min_r = r;
-			}
-		}
-		unsigned tmp = ids[i];
-		ids[i] = ids[min_i];
-		ids[min_i] = tmp;
-	}
+	rtree_split_sort(tree, page, br, ids, n, best_axis);
 	area_t min_overlap = 0;
 	area_t min_area = 0;
 	unsigned min_k = 0;
@@ -525,13 +702,13 @@ rtree_split_page(struct rtree *tree, struct rtree_page *page,
 		unsigned k1 = tree->page_min_fill + k;
 		/* unsigned k2 = n - k1; */
 		struct rtree_rect rt1, rt2, over_rt;
-		rtree_rect_copy(&rt1, rects[ids[0]], d);
+		rtree_split_rect(tree, page, br, ids[0], &rt1);
 		for (unsigned i = 1; i < k1; i++) {
-			rtree_rect_add(&rt1, rects[ids[i]], d);
+			rtree_split_rect_add(tree, page, br, ids[i], &rt1);
 		}
-		rtree_rect_copy(&rt2, rects[ids[k1]], d);
+		rtree_split_rect(tree, page, br, ids[k1], &rt2);
 		for (unsigned i = k1 + 1; i < n; i++) {
-			rtree_rect_add(&rt2, rects[ids[i]], d);
+			rtree_split_rect_add(tree, page, br, ids[i], &rt2);
 		}
 		rtree_rect_intersection(&rt1, &rt2, &over_rt, d);
 		area_t overlap = rtree_rect_area(&over_rt, d);
@@ -552,31 +729,23 @@ rtree_split_page(struct rtree *tree, struct rtree_page *page,
 	char taken[RTREE_MAXIMUM_BRANCHES_IN_PAGE];
 	memset(taken, 0, sizeof(taken));
 	for (unsigned i = 0; i < k1; i++) {
-		struct rtree_page_branch *new_b =
-			rtree_branch_get(tree, new_page, i);
-		const struct rtree_page_branch *from_b = br;
 		if (ids[i]) {
-			from_b = rtree_branch_get(tree, page, ids[i] - 1);
+			rtree_branch_copy(tree, new_page, i, page, ids[i] - 1);
 			taken[ids[i] - 1] = 1;
+		} else {
+			rtree_branch_store(tree, new_page, i, br);
 		}
-		rtree_branch_copy(new_b, from_b, d);
 	}
 	unsigned moved = 0;
 	for (unsigned i = 0, j = 0; j < page->n; j++) {
 		if (taken[j] == 0) {
-			struct rtree_page_branch *to, *from;
-			to = rtree_branch_get(tree, page, i++);
-			from = rtree_branch_get(tree, page, j);
-			rtree_branch_copy(to, from, tree->dimension);
+			rtree_branch_copy(tree, page, i++, page, j);
 			moved++;
 		}
 	}
 	assert(moved == k2 || moved + 1 == k2);
-	if (moved + 1 == k2) {
-		struct rtree_page_branch *to;
-		to = rtree_branch_get(tree, page, moved);
-		rtree_branch_copy(to, br, tree->dimension);
-	}
+	if (moved + 1 == k2)
+		rtree_branch_store(tree, page, moved, br);
 	new_page->n = k1;
 	page->n = k2;
 	return new_page;
@@ -587,9 +756,7 @@ rtree_page_add_branch(struct rtree *tree, struct rtree_page *page,
 		      const struct rtree_page_branch *br)
 {
 	if (page->n < tree->page_max_fill) {
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(tree, page, page->n++);
-		rtree_branch_copy(b, br, tree->dimension);
+		rtree_branch_store(tree, page, page->n++, br);
 		return NULL;
 	} else {
 		return rtree_split_page(tree, page, br);
@@ -600,12 +767,8 @@ static void
 rtree_page_remove_branch(struct rtree *tree, struct rtree_page *page, int i)
 {
 	page->n--;
-	for (unsigned j = i; j < page->n; j++) {
-		struct rtree_page_branch *to, *from;
-		to = rtree_branch_get(tree, page, j);
-		from = rtree_branch_get(tree, page, j + 1);
-		rtree_branch_copy(to, from, tree->dimension);
-	}
+	for (unsigned j = i; j < page->n; j++)
+		rtree_branch_copy(tree, page, j, page, j + 1);
 }
 
 static struct rtree_page *
@@ -619,15 +782,17 @@ rtree_page_insert(struct rtree *tree, struct rtree_page *page,
 		char found = 0;
 		area_t min_incr = 0, best_area = 0;
 		for (unsigned i = 0; i < page->n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, page, i);
-			area_t r_area = rtree_rect_area(&b->rect,
-							tree->dimension);
-			struct rtree_rect cover;
-			rtree_rect_cover(&b->rect, rect,
-					 &cover, tree->dimension);
-			area_t incr = rtree_rect_area(&cover,
-						      tree->dimension);
+			/* areas of the branch and of its cover with rect */
+			area_t r_area = 1, incr = 1;
+			for (int k = tree->dimension; --k >= 0; ) {
+				coord_t lo = rtree_page_coords(tree, page,
+							       2 * k)[i];
+				coord_t hi = rtree_page_coords(tree, page,
+							       2 * k + 1)[i];
+				r_area *= hi - lo;
+				incr *= rtree_max(hi, rect->coords[2 * k + 1]) -
+					rtree_min(lo, rect->coords[2 * k]);
+			}
 			incr -= r_area;
 			assert(incr >= 0);
 			if (i == 0 || incr < min_incr || (incr == min_incr && r_area < best_area)) {
@@ -639,18 +804,20 @@ rtree_page_insert(struct rtree *tree, struct rtree_page *page,
 		}
 		assert(found);
 		(void) found;
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(tree, page, mini);
-		struct rtree_page *p = b->data.page;
+		struct rtree_page *p = page->data[mini].page;
 		struct rtree_page *q = rtree_page_insert(tree, p,
 							 rect, obj, level);
+		struct rtree_rect b_rect;
 		if (q == NULL) {
 			/* child was not split */
-			rtree_rect_add(&b->rect, rect, tree->dimension);
+			rtree_branch_rect(tree, page, mini, &b_rect);
+			rtree_rect_add(&b_rect, rect, tree->dimension);
+			rtree_branch_set_rect(tree, page, mini, &b_rect);
 			return NULL;
 		} else {
 			/* child was split */
-			rtree_page_cover(tree, p, &b->rect);
+			rtree_page_cover(tree, p, &b_rect);
+			rtree_branch_set_rect(tree, page, mini, &b_rect);
 			br.data.page = q;
 			rtree_page_cover(tree, q, &br.rect);
 			return rtree_page_add_branch(tree, page, &br);
@@ -667,19 +834,18 @@ rtree_page_remove(struct rtree *tree, struct rtree_page *page,
 		  const struct rtree_rect *rect, record_t obj,
 		  int level, struct rtree_reinsert_list *rlist)
 {
-	unsigned d = tree->dimension;
 	if (--level != 0) {
-		for (unsigned i = 0; i < page->n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, page, i);
-			if (!rtree_rect_intersects_rect(&b->rect, rect, d))
-				continue;
-			struct rtree_page *next_page = b->data.page;
+		uint64_t mask = rtree_page_match_overlaps(tree, page, rect);
+		for (; mask != 0; mask &= mask - 1) {
+			unsigned i = __builtin_ctzll(mask);
+			struct rtree_page *next_page = page->data[i].page;
 			if (!rtree_page_remove(tree, next_page, rect,
 					       obj, level, rlist))
 				continue;
 			if (next_page->n >= tree->page_min_fill) {
-				rtree_page_cover(tree, next_page, &b->rect);
+				struct rtree_rect cover;
+				rtree_page_cover(tree, next_page, &cover);
+				rtree_branch_set_rect(tree, page, i, &cover);
 			} else {
 				/* not enough entries in child */
 				set_next_reinsert_page(tree, next_page,
@@ -692,9 +858,7 @@ rtree_page_remove(struct rtree *tree, struct rtree_page *page,
 		}
 	} else {
 		for (unsigned i = 0; i < page->n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, page, i);
-			if (b->data.page == obj) {
+			if (page->data[i].record == obj) {
 				rtree_page_remove_branch(tree, page, i);
 				return true;
 			}
@@ -707,15 +871,129 @@ static void
 rtree_page_purge(struct rtree *tree, struct rtree_page *page, int level)
 {
 	if (--level != 0) { /* this is an internal node in the tree */
-		for (unsigned i = 0; i < page->n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, page, i);
-			rtree_page_purge(tree, b->data.page, level);
-		}
+		for (unsigned i = 0; i < page->n; i++)
+			rtree_page_purge(tree, page->data[i].page, level);
 	}
 	rtree_page_free(tree, page);
 }
 
+/*------------------------------------------------------------------------- */
+/* R-tree bulk load */
+/*------------------------------------------------------------------------- */
+
+/* State of a bulk load of one tree level */
+struct rtree_bulk {
+	struct rtree *tree;
+	/* Branches of the level, replaced with branches of the next one */
+	char *branches;
+	/* Number of branches of the level */
+	size_t n_branches;
+	/* Number of pages of the level */
+	size_t n_pages;
+	/* Number of pages built so far */
+	size_t n_built;
+};
+
+static struct rtree_page_branch *
+rtree_bulk_branch(const struct rtree_bulk *bulk, size_t i)
+{
+	return (struct rtree_page_branch *)
+		(bulk->branches + i * bulk->tree->page_branch_size);
+}
+
+/* Index of the first branch of the page @a page of the level */
+static size_t
+rtree_bulk_page_begin(const struct rtree_bulk *bulk, size_t page)
+{
+	/* Spread the branches evenly, so every page is nearly full */
+	return bulk->n_branches * page / bulk->n_pages;
+}
+
+static int
+rtree_bulk_cmp(const void *a, const void *b, void *arg)
+{
+	unsigned axis = *(unsigned *)arg;
+	const coord_t *ca = &((const struct rtree_page_branch *)a)->
+		rect.coords[2 * axis];
+	const coord_t *cb = &((const struct rtree_page_branch *)b)->
+		rect.coords[2 * axis];
+	/* Compare doubled centers */
+	coord_t sa = ca[0] + ca[1];
+	coord_t sb = cb[0] + cb[1];
+	return sa < sb ? -1 : sa > sb ? 1 : 0;
+}
+
+/* Smallest number of slabs s such that s ^ dims >= n_pages */
+static size_t
+rtree_bulk_slab_count(size_t n_pages, unsigned dims)
+{
+	for (size_t s = 1; ; s++) {
+		size_t p = 1;
+		for (unsigned i = 0; i < dims && p < n_pages; i++)
+			p *= s;
+		if (p >= n_pages)
+			return s;
+	}
+}
+
+/*
+ * Build the next page of the level from its branches and put
+ * a branch pointing to the page in place of the level branches.
+ * The page is never built before its own branches are copied,
+ * so the next level doesn't overwrite unused branches.
+ */
+static void
+rtree_bulk_build_page(struct rtree_bulk *bulk)
+{
+	struct rtree *tree = bulk->tree;
+	size_t begin = rtree_bulk_page_begin(bulk, bulk->n_built);
+	size_t end = rtree_bulk_page_begin(bulk, bulk->n_built + 1);
+	assert(end > begin && end - begin <= tree->page_max_fill);
+	struct rtree_page *page = rtree_page_alloc(tree);
+	tree->n_pages++;
+	page->n = end - begin;
+	for (size_t i = begin; i < end; i++) {
+		rtree_branch_store(tree, page, i - begin,
+				   rtree_bulk_branch(bulk, i));
+	}
+	assert(bulk->n_built <= begin);
+	struct rtree_page_branch *b = rtree_bulk_branch(bulk, bulk->n_built);
+	b->data.page = page;
+	rtree_page_cover(tree, page, &b->rect);
+	bulk->n_built++;
+}
+
+/*
+ * Sort-Tile-Recursive: sort the branches of @a n_pages pages by
+ * @a axis, cut them into slabs of whole pages, and tile every
+ * slab by the next axis. Pages of the last axis are runs of
+ * consecutive branches.
+ */
+static void
+rtree_bulk_tile(struct rtree_bulk *bulk, size_t n_pages, unsigned axis)
+{
+	size_t first_page = bulk->n_built;
+	if (n_pages > 1) {
+		size_t begin = rtree_bulk_page_begin(bulk, first_page);
+		size_t end = rtree_bulk_page_begin(bulk, first_page + n_pages);
+		qsort_arg(rtree_bulk_branch(bulk, begin), end - begin,
+			  bulk->tree->page_branch_size, rtree_bulk_cmp, &axis);
+	}
+	unsigned dims = bulk->tree->dimension - axis;
+	if (dims == 1 || n_pages == 1) {
+		for (size_t i = 0; i < n_pages; i++)
+			rtree_bulk_build_page(bulk);
+		return;
+	}
+	size_t n_slabs = rtree_bulk_slab_count(n_pages, dims);
+	for (size_t i = 0; i < n_slabs; i++) {
+		size_t slab_pages = n_pages / n_slabs + (i < n_pages % n_slabs);
+		if (slab_pages > 0)
+			rtree_bulk_tile(bulk, slab_pages, axis + 1);
+	}
+	assert(bulk->n_built == first_page + n_pages);
+}
+
 /*------------------------------------------------------------------------- */
 /* R-tree iterator methods */
 /*------------------------------------------------------------------------- */
@@ -724,26 +1002,23 @@ static bool
 rtree_iterator_goto_first(struct rtree_iterator *itr, unsigned sp,
 			  struct rtree_page* pg)
 {
-	unsigned d = itr->tree->dimension;
-	if (sp + 1 == itr->tree->height) {
-		for (unsigned i = 0, n = pg->n; i < n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(itr->tree, pg, i);
-			if (itr->leaf_cmp(&itr->rect, &b->rect, d)) {
-				itr->stack[sp].page = pg;
-				itr->stack[sp].pos = i;
-				return true;
-			}
+	const struct rtree *tree = itr->tree;
+	if (sp + 1 == tree->height) {
+		uint64_t mask = itr->leaf_match(tree, pg, &itr->rect);
+		if (mask != 0) {
+			itr->stack[sp].page = pg;
+			itr->stack[sp].mask = mask;
+			itr->stack[sp].pos = __builtin_ctzll(mask);
+			return true;
 		}
 	} else {
-		for (unsigned i = 0, n = pg->n; i < n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(itr->tree, pg, i);
-			if (itr->intr_cmp(&itr->rect, &b->rect, d)
-			    && rtree_iterator_goto_first(itr, sp + 1,
-							 b->data.page))
-			{
+		uint64_t mask = itr->intr_match(tree, pg, &itr->rect);
+		for (uint64_t m = mask; m != 0; m &= m - 1) {
+			unsigned i = __builtin_ctzll(m);
+			if (rtree_iterator_goto_first(itr, sp + 1,
+						      pg->data[i].page)) {
 				itr->stack[sp].page = pg;
+				itr->stack[sp].mask = mask;
 				itr->stack[sp].pos = i;
 				return true;
 			}
@@ -756,26 +1031,20 @@ rtree_iterator_goto_first(struct rtree_iterator *itr, unsigned sp,
 static bool
 rtree_iterator_goto_next(struct rtree_iterator *itr, unsigned sp)
 {
-	unsigned d = itr->tree->dimension;
 	struct rtree_page *pg = itr->stack[sp].page;
+	/* Accepted branches after the current one */
+	uint64_t mask = itr->stack[sp].mask &
+			(UINT64_MAX << (itr->stack[sp].pos + 1));
 	if (sp + 1 == itr->tree->height) {
-		for (unsigned i = itr->stack[sp].pos, n = pg->n; ++i < n;) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(itr->tree, pg, i);
-			if (itr->leaf_cmp(&itr->rect, &b->rect, d)) {
-				itr->stack[sp].pos = i;
-				return true;
-			}
+		if (mask != 0) {
+			itr->stack[sp].pos = __builtin_ctzll(mask);
+			return true;
 		}
 	} else {
-		for (int i = itr->stack[sp].pos, n = pg->n; ++i < n;) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(itr->tree, pg, i);
-			if (itr->intr_cmp(&itr->rect, &b->rect, d)
-			    && rtree_iterator_goto_first(itr, sp + 1,
-							 b->data.page))
-			{
-				itr->stack[sp].page = pg;
+		for (; mask != 0; mask &= mask - 1) {
+			unsigned i = __builtin_ctzll(mask);
+			if (rtree_iterator_goto_first(itr, sp + 1,
+						      pg->data[i].page)) {
 				itr->stack[sp].pos = i;
 				return true;
 			}
@@ -865,24 +1134,16 @@ static void
 rtree_iterator_process_neigh(struct rtree_iterator *itr,
 			     struct rtree_neighbor *neighbor)
 {
-	unsigned d = itr->tree->dimension;
 	void *child = neighbor->child;
 	struct rtree_page *pg = (struct rtree_page *)child;
 	int level = neighbor->level;
 	rtree_iterator_free_neighbor(itr, neighbor);
+	sq_coord_t distance[RTREE_MAXIMUM_BRANCHES_IN_PAGE];
+	rtree_page_neigh_distance(itr->tree, pg, &itr->rect, distance);
 	for (int i = 0, n = pg->n; i < n; i++) {
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(itr->tree, pg, i);
-		coord_t distance;
-		if (itr->tree->distance_type == RTREE_EUCLID)
-			distance = rtree_rect_neigh_distance2(&b->rect,
-							      &itr->rect, d);
-		else
-			distance = rtree_rect_neigh_distance(&b->rect,
-							     &itr->rect, d);
 		struct rtree_neighbor *neigh =
-			rtree_iterator_new_neighbor(itr, b->data.page,
-						    distance, level - 1);
+			rtree_iterator_new_neighbor(itr, pg->data[i].page,
+						    distance[i], level - 1);
 		rtnt_insert(&itr->neigh_tree, neigh);
 	}
 }
@@ -927,10 +1188,7 @@ rtree_iterator_next(struct rtree_iterator *itr)
 	}
 	int sp = itr->tree->height - 1;
 	if (!itr->eof && rtree_iterator_goto_next(itr, sp)) {
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(itr->tree,
-				     itr->stack[sp].page, itr->stack[sp].pos);
-		return b->data.record;
+		return itr->stack[sp].page->data[itr->stack[sp].pos].record;
 	}
 	itr->eof = true;
 	return NULL;
@@ -951,20 +1209,25 @@ rtree_init(struct rtree *tree, unsigned dimension, uint32_t extent_size,
 	tree->version = 0;
 	tree->n_pages = 0;
 	tree->free_pages = 0;
+	tree->bulk_branches = NULL;
+	tree->bulk_size = 0;
+	tree->bulk_capacity = 0;
 
 	tree->dimension = dimension;
 	tree->distance_type = distance_type;
 	tree->page_branch_size =
 		(RTREE_BRANCH_DATA_SIZE + dimension * 2 * sizeof(coord_t));
 	tree->page_size = RTREE_OPTIMAL_BRANCHES_IN_PAGE *
-		tree->page_branch_size + sizeof(int);
+		tree->page_branch_size + RTREE_PAGE_HEADER_SIZE;
 	/* round up to closest power of 2 */
 	int lz = __builtin_clz(tree->page_size - 1);
 	tree->page_size = 1u << (sizeof(int) * CHAR_BIT - lz);
-	assert(tree->page_size - sizeof(int) >=
+	assert(tree->page_size - RTREE_PAGE_HEADER_SIZE >=
 	       tree->page_branch_size * RTREE_OPTIMAL_BRANCHES_IN_PAGE);
-	tree->page_max_fill = (tree->page_size - sizeof(int)) /
+	tree->page_max_fill = (tree->page_size - RTREE_PAGE_HEADER_SIZE) /
 		tree->page_branch_size;
+	/* A page must fit into a mask of page matchers */
+	assert(tree->page_max_fill <= RTREE_MAXIMUM_BRANCHES_IN_PAGE);
 	tree->page_min_fill = tree->page_max_fill * 2 / 5;
 	tree->neighbours_in_page = (tree->page_size - sizeof(void *))
 		/ sizeof(struct rtree_neighbor);
@@ -1006,6 +1269,86 @@ rtree_insert(struct rtree *tree, struct rtree_rect *rect, record_t obj)
 	tree->n_records++;
 }
 
+int
+rtree_bulk_reserve(struct rtree *tree, size_t count)
+{
+	if (count <= tree->bulk_capacity)
+		return 0;
+	char *branches = (char *)realloc(tree->bulk_branches,
+					 count * tree->page_branch_size);
+	if (branches == NULL)
+		return -1;
+	tree->bulk_branches = branches;
+	tree->bulk_capacity = count;
+	return 0;
+}
+
+int
+rtree_bulk_add(struct rtree *tree, const struct rtree_rect *rect,
+	       record_t obj)
+{
+	if (tree->bulk_size == tree->bulk_capacity &&
+	    rtree_bulk_reserve(tree, tree->bulk_capacity > 0 ?
+				     tree->bulk_capacity * 2 :
+				     tree->page_size) != 0)
+		return -1;
+	struct rtree_page_branch *b = (struct rtree_page_branch *)
+		(tree->bulk_branches + tree->bulk_size * tree->page_branch_size);
+	b->data.record = obj;
+	rtree_rect_copy(&b->rect, rect, tree->dimension);
+	tree->bulk_size++;
+	return 0;
+}
+
+static void
+rtree_bulk_free(struct rtree *tree)
+{
+	free(tree->bulk_branches);
+	tree->bulk_branches = NULL;
+	tree->bulk_size = 0;
+	tree->bulk_capacity = 0;
+}
+
+void
+rtree_bulk_load(struct rtree *tree)
+{
+	size_t n_records = tree->bulk_size;
+	if (tree->root != NULL) {
+		for (size_t i = 0; i < n_records; i++) {
+			struct rtree_page_branch *b = (struct rtree_page_branch *)
+				(tree->bulk_branches +
+				 i * tree->page_branch_size);
+			rtree_insert(tree, &b->rect, b->data.record);
+		}
+		rtree_bulk_free(tree);
+		return;
+	}
+	if (n_records == 0) {
+		rtree_bulk_free(tree);
+		return;
+	}
+	/* Build the tree bottom-up, one level per pass */
+	struct rtree_bulk bulk;
+	bulk.tree = tree;
+	bulk.branches = tree->bulk_branches;
+	bulk.n_branches = n_records;
+	unsigned height = 0;
+	do {
+		bulk.n_pages = (bulk.n_branches + tree->page_max_fill - 1) /
+			       tree->page_max_fill;
+		bulk.n_built = 0;
+		rtree_bulk_tile(&bulk, bulk.n_pages, 0);
+		bulk.n_branches = bulk.n_pages;
+		height++;
+	} while (bulk.n_branches > 1);
+	assert(height <= RTREE_MAX_HEIGHT);
+	tree->root = rtree_bulk_branch(&bulk, 0)->data.page;
+	tree->height = height;
+	tree->n_records = n_records;
+	tree->version++;
+	rtree_bulk_free(tree);
+}
+
 bool
 rtree_remove(struct rtree *tree, const struct rtree_rect *rect, record_t obj)
 {
@@ -1019,11 +1362,11 @@ rtree_remove(struct rtree *tree, const struct rtree_rect *rect, record_t obj)
 	int level = rlist.level;
 	while (pg != NULL) {
 		for (int i = 0, n = pg->n; i < n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, pg, i);
+			struct rtree_page_branch b;
+			rtree_branch_load(tree, pg, i, &b);
 			struct rtree_page *p =
 				rtree_page_insert(tree, tree->root,
-						  &b->rect, b->data.record,
+						  &b.rect, b.data.record,
 						  tree->height - level);
 			if (p != NULL) {
 				/* root splitted */
@@ -1043,9 +1386,7 @@ rtree_remove(struct rtree *tree, const struct rtree_rect *rect, record_t obj)
 		pg = next;
 	}
 	if (tree->root->n == 1 && tree->height > 1) {
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(tree, tree->root, 0);
-		struct rtree_page *new_root = b->data.page;
+		struct rtree_page *new_root = tree->root->data[0].page;
 		rtree_page_free(tree, tree->root);
 		tree->root = new_root;
 		tree->height--;
@@ -1069,28 +1410,29 @@ rtree_search(const struct rtree *tree, const struct rtree_rect *rect,
 	assert(tree->height <= RTREE_MAX_HEIGHT);
 	switch (op) {
 	case SOP_ALL:
-		itr->intr_cmp = itr->leaf_cmp = rtree_always_true;
+		itr->intr_match = itr->leaf_match = rtree_page_match_all;
 		break;
 	case SOP_EQUALS:
-		itr->intr_cmp = rtree_rect_in_rect;
-		itr->leaf_cmp = rtree_rect_equal_to_rect;
+		itr->intr_match = rtree_page_match_contains;
+		itr->leaf_match = rtree_page_match_equals;
 		break;
 	case SOP_CONTAINS:
-		itr->intr_cmp = itr->leaf_cmp = rtree_rect_in_rect;
+		itr->intr_match = itr->leaf_match = rtree_page_match_contains;
 		break;
 	case SOP_STRICT_CONTAINS:
-		itr->intr_cmp = itr->leaf_cmp = rtree_rect_strict_in_rect;
+		itr->intr_match = itr->leaf_match =
+			rtree_page_match_strict_contains;
 		break;
 	case SOP_OVERLAPS:
-		itr->intr_cmp = itr->leaf_cmp = rtree_rect_intersects_rect;
+		itr->intr_match = itr->leaf_match = rtree_page_match_overlaps;
 		break;
 	case SOP_BELONGS:
-		itr->intr_cmp = rtree_rect_intersects_rect;
-		itr->leaf_cmp = rtree_rect_holds_rect;
+		itr->intr_match = rtree_page_match_overlaps;
+		itr->leaf_match = rtree_page_match_belongs;
 		break;
 	case SOP_STRICT_BELONGS:
-		itr->intr_cmp = rtree_rect_intersects_rect;
-		itr->leaf_cmp = rtree_rect_strict_holds_rect;
+		itr->intr_match = rtree_page_match_overlaps;
+		itr->leaf_match = rtree_page_match_strict_belongs;
 		break;
 	case SOP_NEIGHBOR:
 		if (tree->root) {
@@ -1129,6 +1471,7 @@ rtree_search(const struct rtree *tree, const struct rtree_rect *rect,
 void
 rtree_purge(struct rtree *tree)
 {
+	rtree_bulk_free(tree);
 	if (tree->root != NULL) {
 		rtree_page_purge(tree, tree->root, tree->height);
 		tree->root = NULL;
@@ -1158,12 +1501,12 @@ rtree_debug_print_page(const struct rtree *tree, const struct rtree_page *page,
 	printf("%d:\n", path);
 	unsigned d = tree->dimension;
 	for (int i = 0; i < page->n; i++) {
-		struct rtree_page_branch *b;
-		b = rtree_branch_get(tree, page, i);
+		struct rtree_rect rect;
+		rtree_branch_rect(tree, page, i, &rect);
 		double v = 1;
 		for (unsigned j = 0; j < d; j++) {
-			double d1 = b->rect.coords[j * 2];
-			double d2 = b->rect.coords[j * 2 + 1];
+			double d1 = rect.coords[j * 2];
+			double d2 = rect.coords[j * 2 + 1];
 			v *= (d2 - d1) / 100;
 			printf("[%04.1lf-%04.1lf:%04.1lf]", d2, d1, d2 - d1);
 		}
@@ -1171,9 +1514,7 @@ rtree_debug_print_page(const struct rtree *tree, const struct rtree_page *page,
 	}
 	if (--level > 1) {
 		for (int i = 0; i < page->n; i++) {
-			struct rtree_page_branch *b;
-			b = rtree_branch_get(tree, page, i);
-			rtree_debug_print_page(tree, b->data.page, level,
+			rtree_debug_print_page(tree, page->data[i].page, level,
 					       path * 100 + i + 1);
 		}
 	}
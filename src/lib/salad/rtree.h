@@ -31,6 +31,7 @@
  * SUCH DAMAGE.
  */
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "small/matras.h"
 
@@ -109,10 +110,14 @@ struct rtree_rect
 	coord_t coords[RTREE_MAX_DIMENSION * 2];
 };
 
-/* Type of function, comparing two rectangles */
-typedef bool (*rtree_comparator_t)(const struct rtree_rect *rt1,
-				   const struct rtree_rect *rt2,
-				   unsigned dimension);
+struct rtree;
+struct rtree_page;
+
+/* Type of function, matching rectangles of all branches of a page
+ * with a rectangle. Bit i of the result is set if branch i matches */
+typedef uint64_t (*rtree_page_matcher_t)(const struct rtree *tree,
+					 const struct rtree_page *page,
+					 const struct rtree_rect *rect);
 
 /* Type distance comparison */
 enum rtree_distance_type {
@@ -152,6 +157,12 @@ struct rtree
 	void *free_pages;
 	/* Distance type */
 	enum rtree_distance_type distance_type;
+	/* Records collected by rtree_bulk_add(), as page branches */
+	char *bulk_branches;
+	/* Number of collected records */
+	size_t bulk_size;
+	/* Number of records bulk_branches has room for */
+	size_t bulk_capacity;
 };
 
 /* Struct for iteration and retrieving rtree values */
@@ -182,18 +193,20 @@ struct rtree_iterator
 	/* Position of ready-to-use list entry in allocated page */
 	unsigned page_pos;
 
-	/* Comparators for comparison rectagnle of the iterator with
-	 * rectangles of tree nodes. If the comparator returns true,
-	 * the node is accepted; if false - skipped.
+	/* Matchers of the rectangle of the iterator with rectangles of
+	 * tree nodes. The nodes whose bits are set are accepted, others
+	 * are skipped. A matcher checks all nodes of a page at once.
 	 */
-	/* Comparator for interanal (not leaf) nodes of the tree */
-	rtree_comparator_t intr_cmp;
-	/* Comparator for leaf nodes of the tree */
-	rtree_comparator_t leaf_cmp;
+	/* Matcher for interanal (not leaf) nodes of the tree */
+	rtree_page_matcher_t intr_match;
+	/* Matcher for leaf nodes of the tree */
+	rtree_page_matcher_t leaf_match;
 
 	/* Current path of search in tree */
 	struct {
 		struct rtree_page *page;
+		/* Accepted nodes of the page */
+		uint64_t mask;
 		int pos;
 	} stack[RTREE_MAX_HEIGHT];
 };
@@ -275,6 +288,37 @@ rtree_search(const struct rtree *tree, const struct rtree_rect *rect,
 void
 rtree_insert(struct rtree *tree, struct rtree_rect *rect, record_t obj);
 
+/**
+ * @brief Reserve memory for records added with rtree_bulk_add()
+ * @return 0 on success, -1 on memory error
+ * @param tree - pointer to a tree
+ * @param count - expected number of records
+ */
+int
+rtree_bulk_reserve(struct rtree *tree, size_t count);
+
+/**
+ * @brief Add a record to be loaded by rtree_bulk_load()
+ * @return 0 on success, -1 on memory error
+ * @param tree - pointer to a tree
+ * @param rect - rectangle of the record
+ * @param obj - record to add
+ */
+int
+rtree_bulk_add(struct rtree *tree, const struct rtree_rect *rect,
+	       record_t obj);
+
+/**
+ * @brief Load the records added with rtree_bulk_add() to the tree.
+ * An empty tree is packed with the Sort-Tile-Recursive algorithm:
+ * the records are sorted into tiles along each axis in turn and
+ * every tile fills a page, so the pages are full and overlap
+ * little. Otherwise the records are inserted one by one.
+ * @param tree - pointer to a tree
+ */
+void
+rtree_bulk_load(struct rtree *tree);
+
 /**
  * @brief Remove the record from a tree
  * @return true if the record deleted (false otherwise)
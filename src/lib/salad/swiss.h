@@ -0,0 +1,1003 @@
+/*
+ * *No header guard*: the header is allowed to be included twice
+ * with different sets of defines.
+ */
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Swiss is an open addressing hash table with the same interface
+ * as light (see light.h), but a different layout.
+ *
+ * Slots are organized in groups of SWISS_GROUP_SIZE. Each slot
+ * has a control byte: either a mark of an empty or a deleted slot,
+ * or 7 bits of the hash of the value in the slot (fingerprint).
+ * A lookup compares the fingerprint with all control bytes of a
+ * group at once (with SSE2 if available) and compares values only
+ * on a fingerprint match. Groups are probed quadratically until
+ * a group with an empty slot is met. A group is one matras block,
+ * so the table supports read views for iteration just like light.
+ *
+ * The table grows by doubling the number of groups and rehashing
+ * the values in place. Full 32-bit hashes are stored next to the
+ * values, so rehashing never calls for the values themselves.
+ */
+
+#include <string.h>
+#include "small/matras.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Additional user defined name that appended to prefix 'swiss'
+ *  for all names of structs and functions in this header file.
+ * All names use pattern: swiss<SWISS_NAME>_<name of func/struct>
+ * May be empty, but still have to be defined (just #define SWISS_NAME)
+ * Example:
+ * #define SWISS_NAME _test
+ * ...
+ * struct swiss_test_core hash_table;
+ * swiss_test_create(&hash_table, ...);
+ */
+#ifndef SWISS_NAME
+#error "SWISS_NAME must be defined"
+#endif
+
+/**
+ * Data type that hash table holds. Must be not greater than 8 bytes.
+ */
+#ifndef SWISS_DATA_TYPE
+#error "SWISS_DATA_TYPE must be defined"
+#endif
+
+/**
+ * Data type that used to for finding values.
+ */
+#ifndef SWISS_KEY_TYPE
+#error "SWISS_KEY_TYPE must be defined"
+#endif
+
+/**
+ * Type of optional third parameter of comparing function.
+ * If not needed, simply use #define SWISS_CMP_ARG_TYPE int
+ */
+#ifndef SWISS_CMP_ARG_TYPE
+#error "SWISS_CMP_ARG_TYPE must be defined"
+#endif
+
+/**
+ * Data comparing function. Takes 3 parameters - value1, value2 and
+ * optional value that stored in hash table struct.
+ */
+#ifndef SWISS_EQUAL
+#error "SWISS_EQUAL must be defined"
+#endif
+
+/**
+ * Data comparing function. Takes 3 parameters - value, key and
+ * optional value that stored in hash table struct.
+ */
+#ifndef SWISS_EQUAL_KEY
+#error "SWISS_EQUAL_KEY must be defined"
+#endif
+
+/**
+ * Tools for name substitution:
+ */
+#ifndef CONCAT4
+#define CONCAT4_R(a, b, c, d) a##b##c##d
+#define CONCAT4(a, b, c, d) CONCAT4_R(a, b, c, d)
+#endif
+
+#define SWISS(name) CONCAT4(swiss, SWISS_NAME, _, name)
+
+#ifndef SWISS_GROUP_SIZE
+/** Number of slots in a group, all probed at once. */
+#define SWISS_GROUP_SIZE 16
+/** Control byte of a slot that has never been used. */
+#define SWISS_CTRL_EMPTY ((int8_t)-128)
+/**
+ * Control byte of a slot which value was deleted. Lookups
+ * don't stop at such slots, unlike the empty ones.
+ */
+#define SWISS_CTRL_DELETED ((int8_t)-2)
+#endif
+
+/**
+ * A group of slots, the unit of probing and of matras allocation.
+ */
+struct SWISS(group) {
+	/* fingerprint of each value or SWISS_CTRL_* mark */
+	int8_t ctrl[SWISS_GROUP_SIZE];
+	/* full hashes of the values */
+	uint32_t hash[SWISS_GROUP_SIZE];
+	/* the values */
+	union {
+		SWISS_DATA_TYPE value;
+		uint64_t uint64_padding;
+	} slots[SWISS_GROUP_SIZE];
+	/* matras requires the block size to be a power of two */
+	char padding[256 - SWISS_GROUP_SIZE * (1 + 4 + 8)];
+};
+
+/**
+ * Main struct for holding hash table
+ */
+struct SWISS(core) {
+	/* count of values in hash table */
+	uint32_t count;
+	/* number of slots ( equal to mtable.size * SWISS_GROUP_SIZE ) */
+	uint32_t table_size;
+	/* number of groups minus one; the number of groups is 2^n */
+	uint32_t group_mask;
+	/*
+	 * Number of empty slots that may be used before the table
+	 * must be rehashed: the maximal load (7/8) minus values
+	 * and deleted slots. Negative if the table failed to grow
+	 * and was loaded above the limit.
+	 */
+	int32_t growth_left;
+	/* additional parameter for data comparison */
+	SWISS_CMP_ARG_TYPE arg;
+	/* dynamic storage for groups */
+	struct matras mtable;
+};
+
+/**
+ * Iterator, for iterating all values in hash_table.
+ * It also may be used for restoring one value by key.
+ */
+struct SWISS(iterator) {
+	/* Current position on table (ID of a current slot) */
+	uint32_t slotpos;
+	/* Version of matras memory for MVCC */
+	struct matras_view view;
+};
+
+/**
+ * Type of functions for memory allocation and deallocation
+ */
+typedef void *(*SWISS(extent_alloc_t))(void *ctx);
+typedef void (*SWISS(extent_free_t))(void *ctx, void *extent);
+
+/**
+ * Special result of swiss_find that means that nothing was found
+ * Must be equal or greater than possible hash table size
+ */
+static const uint32_t SWISS(end) = 0xFFFFFFFF;
+
+/* Functions declaration */
+
+/**
+ * @brief Hash table construction. Fills struct swiss members.
+ * @param ht - pointer to a hash table struct
+ * @param extent_size - size of allocating memory blocks
+ * @param extent_alloc_func - memory blocks allocation function
+ * @param extent_free_func - memory blocks allocation function
+ * @param alloc_ctx - argument passed to memory block allocator
+ * @param arg - optional parameter to save for comparing function
+ */
+void
+SWISS(create)(struct SWISS(core) *ht, size_t extent_size,
+	      SWISS(extent_alloc_t) extent_alloc_func,
+	      SWISS(extent_free_t) extent_free_func,
+	      void *alloc_ctx, SWISS_CMP_ARG_TYPE arg);
+
+/**
+ * @brief Hash table destruction. Frees all allocated memory
+ * @param ht - pointer to a hash table struct
+ */
+void
+SWISS(destroy)(struct SWISS(core) *ht);
+
+/**
+ * @brief Find a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - value to find
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+uint32_t
+SWISS(find)(const struct SWISS(core) *ht, uint32_t hash, SWISS_DATA_TYPE data);
+
+/**
+ * @brief Find a record with given hash and key
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - key to find
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+uint32_t
+SWISS(find_key)(const struct SWISS(core) *ht, uint32_t hash, SWISS_KEY_TYPE data);
+
+/**
+ * @brief Prefetch the first group probed for the given hash.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is going to be looked up
+ */
+void
+SWISS(prefetch)(const struct SWISS(core) *ht, uint32_t hash);
+
+/**
+ * @brief Insert a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to insert
+ * @param data - value to insert
+ * @return integer ID of inserted record or swiss_end if failed
+ */
+uint32_t
+SWISS(insert)(struct SWISS(core) *ht, uint32_t hash, SWISS_DATA_TYPE data);
+
+/**
+ * @brief Replace a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - value to find and replace
+ * @param replaced - pointer to a value that was stored in table before replace
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+uint32_t
+SWISS(replace)(struct SWISS(core) *ht, uint32_t hash,
+	       SWISS_DATA_TYPE data, SWISS_DATA_TYPE *replaced);
+
+/**
+ * @brief Delete a record from a hash table by given record ID
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record. See SWISS(find) for details.
+ * @return 0 if ok, -1 on memory error (only with freezed iterators)
+ */
+int
+SWISS(delete)(struct SWISS(core) *ht, uint32_t slotpos);
+
+/**
+ * @brief Delete a record from a hash table by that value and its hash.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash of the value
+ * @param data - value to delete
+ * @return 0 if ok, -1 on memory error or if not found
+ */
+int
+SWISS(delete_value)(struct SWISS(core) *ht, uint32_t hash,
+		    SWISS_DATA_TYPE value);
+
+/**
+ * @brief Make room for the given number of values, so that no
+ * rehashing happens until the table holds that many values.
+ * @param ht - pointer to a hash table struct
+ * @param count - expected number of values
+ * @return 0 if ok, -1 on memory error
+ */
+int
+SWISS(reserve)(struct SWISS(core) *ht, uint32_t count);
+
+/**
+ * @brief Get a value from a desired position
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record
+ *  ID must be vaild, check it by swiss_pos_valid (asserted).
+ */
+SWISS_DATA_TYPE
+SWISS(get)(struct SWISS(core) *ht, uint32_t slotpos);
+
+/**
+ * @brief Determine if posision holds a value
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record
+ *  ID must be in valid range [0, ht->table_size) (asserted).
+ */
+bool
+SWISS(pos_valid)(struct SWISS(core) *ht, uint32_t slotpos);
+
+/**
+ * @brief Set iterator to the beginning of hash table
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ */
+void
+SWISS(iterator_begin)(const struct SWISS(core) *ht,
+		      struct SWISS(iterator) *itr);
+
+/**
+ * @brief Set iterator to position determined by key
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ * @param hash - hash to find
+ * @param data - key to find
+ */
+void
+SWISS(iterator_key)(const struct SWISS(core) *ht, struct SWISS(iterator) *itr,
+		    uint32_t hash, SWISS_KEY_TYPE data);
+
+/**
+ * @brief Get the value that iterator currently points to
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ * @return poiner to the value or NULL if iteration is complete
+ */
+SWISS_DATA_TYPE *
+SWISS(iterator_get_and_next)(const struct SWISS(core) *ht,
+			     struct SWISS(iterator) *itr);
+
+/**
+ * @brief Freezes state for given iterator. All following hash table
+ * modification will not apply to that iterator iteration. That
+ * iterator should be destroyed with a swiss_iterator_destroy call
+ * after usage.
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to freeze
+ */
+void
+SWISS(iterator_freeze)(struct SWISS(core) *ht, struct SWISS(iterator) *itr);
+
+/**
+ * @brief Destroy an iterator that was frozen before. Useless for not
+ * frozen iterators.
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to destroy
+ */
+void
+SWISS(iterator_destroy)(struct SWISS(core) *ht, struct SWISS(iterator) *itr);
+
+/*
+ * Selfcheck of the internal state of hash table. Used only for debugging.
+ * That means that you should not use this function.
+ * If return not zero, something went terribly wrong.
+ */
+int
+SWISS(selfcheck)(const struct SWISS(core) *ht);
+
+/* Functions definition */
+
+/**
+ * @brief Hash table construction. Fills struct swiss members.
+ * @param ht - pointer to a hash table struct
+ * @param extent_size - size of allocating memory blocks
+ * @param extent_alloc_func - memory blocks allocation function
+ * @param extent_free_func - memory blocks allocation function
+ * @param alloc_ctx - argument passed to memory block allocator
+ * @param arg - optional parameter to save for comparing function
+ */
+inline void
+SWISS(create)(struct SWISS(core) *ht, size_t extent_size,
+	      SWISS(extent_alloc_t) extent_alloc_func,
+	      SWISS(extent_free_t) extent_free_func,
+	      void *alloc_ctx, SWISS_CMP_ARG_TYPE arg)
+{
+	assert(sizeof(struct SWISS(group)) == 256);
+	assert(sizeof(SWISS_DATA_TYPE) <= sizeof(uint64_t));
+	ht->count = 0;
+	ht->table_size = 0;
+	ht->group_mask = 0;
+	ht->growth_left = 0;
+	ht->arg = arg;
+	matras_create(&ht->mtable,
+		      extent_size, sizeof(struct SWISS(group)),
+		      extent_alloc_func, extent_free_func, alloc_ctx);
+}
+
+/**
+ * @brief Hash table destruction. Frees all allocated memory
+ * @param ht - pointer to a hash table struct
+ */
+inline void
+SWISS(destroy)(struct SWISS(core) *ht)
+{
+	matras_destroy(&ht->mtable);
+}
+
+/**
+ * Mix the user hash, so that the fingerprint (the highest 7
+ * bits) and the first group (the lowest bits) are independent
+ * even for an identity hash of small integers.
+ */
+inline uint32_t
+SWISS(mix)(uint32_t hash)
+{
+	return hash * 2654435769U;
+}
+
+/** Fingerprint of a mixed hash, stored in the control byte. */
+inline int8_t
+SWISS(h2)(uint32_t mixed)
+{
+	return (int8_t)(mixed >> 25);
+}
+
+/** Bit mask of control bytes of a group equal to @a ctrl. */
+inline uint32_t
+SWISS(match)(const int8_t *group_ctrl, int8_t ctrl)
+{
+#if defined(__SSE2__)
+	__m128i c = _mm_loadu_si128((const __m128i *)group_ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(ctrl)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < SWISS_GROUP_SIZE; i++)
+		mask |= (uint32_t)(group_ctrl[i] == ctrl) << i;
+	return mask;
+#endif
+}
+
+/** Bit mask of empty or deleted slots of a group. */
+inline uint32_t
+SWISS(match_free)(const int8_t *group_ctrl)
+{
+#if defined(__SSE2__)
+	__m128i c = _mm_loadu_si128((const __m128i *)group_ctrl);
+	/* Both marks are negative and less than -1. */
+	return _mm_movemask_epi8(_mm_cmplt_epi8(c, _mm_set1_epi8(-1)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < SWISS_GROUP_SIZE; i++)
+		mask |= (uint32_t)(group_ctrl[i] < -1) << i;
+	return mask;
+#endif
+}
+
+/**
+ * @brief Find a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - value to find
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+inline uint32_t
+SWISS(find)(const struct SWISS(core) *ht, uint32_t hash, SWISS_DATA_TYPE value)
+{
+	if (ht->count == 0)
+		return SWISS(end);
+	uint32_t mixed = SWISS(mix)(hash);
+	int8_t h2 = SWISS(h2)(mixed);
+	uint32_t group_id = mixed & ht->group_mask;
+	for (uint32_t step = 1; step <= ht->group_mask + 1; step++) {
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, group_id);
+		uint32_t mask = SWISS(match)(group->ctrl, h2);
+		while (mask != 0) {
+			uint32_t i = __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (group->hash[i] == hash &&
+			    SWISS_EQUAL((group->slots[i].value), (value),
+					(ht->arg)))
+				return group_id * SWISS_GROUP_SIZE + i;
+		}
+		if (SWISS(match)(group->ctrl, SWISS_CTRL_EMPTY) != 0)
+			return SWISS(end);
+		group_id = (group_id + step) & ht->group_mask;
+	}
+	/* all groups are probed */
+	return SWISS(end);
+}
+
+/**
+ * @brief Find a record with given hash and key
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - key to find
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+inline uint32_t
+SWISS(find_key)(const struct SWISS(core) *ht, uint32_t hash, SWISS_KEY_TYPE key)
+{
+	if (ht->count == 0)
+		return SWISS(end);
+	uint32_t mixed = SWISS(mix)(hash);
+	int8_t h2 = SWISS(h2)(mixed);
+	uint32_t group_id = mixed & ht->group_mask;
+	for (uint32_t step = 1; step <= ht->group_mask + 1; step++) {
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, group_id);
+		uint32_t mask = SWISS(match)(group->ctrl, h2);
+		while (mask != 0) {
+			uint32_t i = __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (group->hash[i] == hash &&
+			    SWISS_EQUAL_KEY((group->slots[i].value), (key),
+					    (ht->arg)))
+				return group_id * SWISS_GROUP_SIZE + i;
+		}
+		if (SWISS(match)(group->ctrl, SWISS_CTRL_EMPTY) != 0)
+			return SWISS(end);
+		group_id = (group_id + step) & ht->group_mask;
+	}
+	/* all groups are probed */
+	return SWISS(end);
+}
+
+/**
+ * @brief Prefetch the first group probed for the given hash.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is going to be looked up
+ */
+inline void
+SWISS(prefetch)(const struct SWISS(core) *ht, uint32_t hash)
+{
+	if (ht->count == 0)
+		return;
+	uint32_t group_id = SWISS(mix)(hash) & ht->group_mask;
+	const char *group = (const char *)matras_get(&ht->mtable, group_id);
+	/* Control bytes and hashes, then the values. */
+	__builtin_prefetch(group);
+	__builtin_prefetch(group + 64);
+	__builtin_prefetch(group + 128);
+}
+
+/**
+ * Find the first empty or deleted slot on the probe sequence
+ * of the given mixed hash. The probe sequence visits every
+ * group, so the table must have a free slot.
+ */
+inline uint32_t
+SWISS(find_free)(const struct SWISS(core) *ht, uint32_t mixed)
+{
+	uint32_t group_id = mixed & ht->group_mask;
+	for (uint32_t step = 1; ; step++) {
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, group_id);
+		uint32_t mask = SWISS(match_free)(group->ctrl);
+		if (mask != 0)
+			return group_id * SWISS_GROUP_SIZE +
+			       __builtin_ctz(mask);
+		group_id = (group_id + step) & ht->group_mask;
+	}
+	/* unreachable */
+	return SWISS(end);
+}
+
+/** Maximal number of values and deleted slots in a table. */
+inline uint32_t
+SWISS(max_load)(uint32_t table_size)
+{
+	return table_size - table_size / 8;
+}
+
+/**
+ * Put every value of the table to its place for the current
+ * number of groups and turn deleted slots into empty ones.
+ * Values are moved in place, as in abseil's
+ * drop_deletes_without_resize(): all values are marked deleted
+ * at first, then every such value is either left where it is
+ * (if it is in the first free group of its probe sequence),
+ * moved to an empty slot or swapped with another marked value,
+ * which is then processed in its turn.
+ * All groups must be touched (private to the head view).
+ */
+inline void
+SWISS(rehash_in_place)(struct SWISS(core) *ht)
+{
+	uint32_t group_count = ht->group_mask + 1;
+	for (uint32_t g = 0; g < group_count; g++) {
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, g);
+		for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+			if (group->ctrl[i] >= 0)
+				group->ctrl[i] = SWISS_CTRL_DELETED;
+			else
+				group->ctrl[i] = SWISS_CTRL_EMPTY;
+		}
+	}
+	for (uint32_t pos = 0; pos < ht->table_size; pos++) {
+		uint32_t g = pos / SWISS_GROUP_SIZE;
+		uint32_t i = pos % SWISS_GROUP_SIZE;
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, g);
+		if (group->ctrl[i] != SWISS_CTRL_DELETED)
+			continue;
+		uint32_t mixed = SWISS(mix)(group->hash[i]);
+		uint32_t new_pos = SWISS(find_free)(ht, mixed);
+		uint32_t new_g = new_pos / SWISS_GROUP_SIZE;
+		uint32_t new_i = new_pos % SWISS_GROUP_SIZE;
+		if (new_g == g) {
+			group->ctrl[i] = SWISS(h2)(mixed);
+			continue;
+		}
+		struct SWISS(group) *new_group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, new_g);
+		if (new_group->ctrl[new_i] == SWISS_CTRL_EMPTY) {
+			new_group->ctrl[new_i] = SWISS(h2)(mixed);
+			new_group->hash[new_i] = group->hash[i];
+			new_group->slots[new_i].value = group->slots[i].value;
+			group->ctrl[i] = SWISS_CTRL_EMPTY;
+			continue;
+		}
+		/* Swap with a marked value and process it now. */
+		assert(new_group->ctrl[new_i] == SWISS_CTRL_DELETED);
+		new_group->ctrl[new_i] = SWISS(h2)(mixed);
+		uint32_t tmp_hash = new_group->hash[new_i];
+		SWISS_DATA_TYPE tmp_value = new_group->slots[new_i].value;
+		new_group->hash[new_i] = group->hash[i];
+		new_group->slots[new_i].value = group->slots[i].value;
+		group->hash[i] = tmp_hash;
+		group->slots[i].value = tmp_value;
+		pos--;
+	}
+	ht->growth_left = (int32_t)SWISS(max_load)(ht->table_size) -
+			  (int32_t)ht->count;
+}
+
+/**
+ * Set the number of groups to @a group_count (a power of two,
+ * not less than the current one) and rehash the table.
+ * Either does nothing or succeeds: all memory (new groups and
+ * copies of groups shared with read views) is allocated before
+ * the table is changed.
+ */
+inline int
+SWISS(resize)(struct SWISS(core) *ht, uint32_t group_count)
+{
+	assert((group_count & (group_count - 1)) == 0);
+	uint32_t old_count = ht->table_size / SWISS_GROUP_SIZE;
+	assert(group_count >= old_count);
+	for (uint32_t g = old_count; g < group_count; g++) {
+		uint32_t id;
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_alloc(&ht->mtable, &id);
+		if (group == NULL) {
+			matras_dealloc_range(&ht->mtable, g - old_count);
+			return -1;
+		}
+		assert(id == g);
+		memset(group->ctrl, SWISS_CTRL_EMPTY, sizeof(group->ctrl));
+	}
+	for (uint32_t g = 0; g < old_count; g++) {
+		if (matras_touch(&ht->mtable, g) == NULL) {
+			matras_dealloc_range(&ht->mtable,
+					     group_count - old_count);
+			return -1;
+		}
+	}
+	ht->table_size = group_count * SWISS_GROUP_SIZE;
+	ht->group_mask = group_count - 1;
+	SWISS(rehash_in_place)(ht);
+	return 0;
+}
+
+/**
+ * Make room for one more value in an empty slot: clear deleted
+ * slots if there are many of them, otherwise double the table.
+ */
+inline int
+SWISS(grow)(struct SWISS(core) *ht)
+{
+	uint32_t group_count = ht->table_size / SWISS_GROUP_SIZE;
+	if (group_count == 0)
+		return SWISS(resize)(ht, 1);
+	if (ht->count < SWISS(max_load)(ht->table_size) / 2)
+		return SWISS(resize)(ht, group_count);
+	return SWISS(resize)(ht, group_count * 2);
+}
+
+/**
+ * @brief Insert a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to insert
+ * @param data - value to insert
+ * @return integer ID of inserted record or swiss_end if failed
+ */
+inline uint32_t
+SWISS(insert)(struct SWISS(core) *ht, uint32_t hash, SWISS_DATA_TYPE value)
+{
+	uint32_t mixed = SWISS(mix)(hash);
+	if (ht->count == ht->table_size && SWISS(grow)(ht) != 0)
+		return SWISS(end);
+	uint32_t pos = SWISS(find_free)(ht, mixed);
+	struct SWISS(group) *group = (struct SWISS(group) *)
+		matras_get(&ht->mtable, pos / SWISS_GROUP_SIZE);
+	bool is_empty = group->ctrl[pos % SWISS_GROUP_SIZE] ==
+			SWISS_CTRL_EMPTY;
+	/*
+	 * If the table can't grow, the value still goes to the
+	 * free slot above the load limit. Thus reinsertion of a
+	 * just deleted value (a rollback) needs no more memory
+	 * than copies of the touched groups, as in light.
+	 */
+	if (is_empty && ht->growth_left <= 0 && SWISS(grow)(ht) == 0)
+		pos = SWISS(find_free)(ht, mixed);
+	group = (struct SWISS(group) *)
+		matras_touch(&ht->mtable, pos / SWISS_GROUP_SIZE);
+	if (group == NULL)
+		return SWISS(end);
+	uint32_t i = pos % SWISS_GROUP_SIZE;
+	if (group->ctrl[i] == SWISS_CTRL_EMPTY)
+		ht->growth_left--;
+	group->ctrl[i] = SWISS(h2)(mixed);
+	group->hash[i] = hash;
+	group->slots[i].value = value;
+	ht->count++;
+	return pos;
+}
+
+/**
+ * @brief Replace a record with given hash and value
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash to find
+ * @param data - value to find and replace
+ * @param replaced - pointer to a value that was stored in table before replace
+ * @return integer ID of found record or swiss_end if nothing found
+ */
+inline uint32_t
+SWISS(replace)(struct SWISS(core) *ht, uint32_t hash,
+	       SWISS_DATA_TYPE value, SWISS_DATA_TYPE *replaced)
+{
+	uint32_t pos = SWISS(find)(ht, hash, value);
+	if (pos == SWISS(end))
+		return SWISS(end);
+	struct SWISS(group) *group = (struct SWISS(group) *)
+		matras_touch(&ht->mtable, pos / SWISS_GROUP_SIZE);
+	if (group == NULL)
+		return SWISS(end);
+	uint32_t i = pos % SWISS_GROUP_SIZE;
+	*replaced = group->slots[i].value;
+	group->slots[i].value = value;
+	return pos;
+}
+
+/**
+ * @brief Delete a record from a hash table by given record ID
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record. See SWISS(find) for details.
+ * @return 0 if ok, -1 on memory error (only with freezed iterators)
+ */
+inline int
+SWISS(delete)(struct SWISS(core) *ht, uint32_t slotpos)
+{
+	assert(slotpos < ht->table_size);
+	struct SWISS(group) *group = (struct SWISS(group) *)
+		matras_touch(&ht->mtable, slotpos / SWISS_GROUP_SIZE);
+	if (group == NULL)
+		return -1;
+	uint32_t i = slotpos % SWISS_GROUP_SIZE;
+	assert(group->ctrl[i] >= 0);
+	/*
+	 * A group with an empty slot has never been full, so no
+	 * probe sequence goes through it and the slot may become
+	 * empty again. Otherwise lookups must go on past it.
+	 */
+	if (SWISS(match)(group->ctrl, SWISS_CTRL_EMPTY) != 0) {
+		group->ctrl[i] = SWISS_CTRL_EMPTY;
+		ht->growth_left++;
+	} else {
+		group->ctrl[i] = SWISS_CTRL_DELETED;
+	}
+	ht->count--;
+	return 0;
+}
+
+/**
+ * @brief Delete a record from a hash table by that value and its hash.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash of the value
+ * @param data - value to delete
+ * @return 0 if ok, -1 on memory error or if not found
+ */
+inline int
+SWISS(delete_value)(struct SWISS(core) *ht, uint32_t hash,
+		    SWISS_DATA_TYPE value)
+{
+	uint32_t slotpos = SWISS(find)(ht, hash, value);
+	if (slotpos == SWISS(end))
+		return -1;
+	return SWISS(delete)(ht, slotpos);
+}
+
+/**
+ * @brief Make room for the given number of values, so that no
+ * rehashing happens until the table holds that many values.
+ * @param ht - pointer to a hash table struct
+ * @param count - expected number of values
+ * @return 0 if ok, -1 on memory error
+ */
+inline int
+SWISS(reserve)(struct SWISS(core) *ht, uint32_t count)
+{
+	uint32_t group_count = ht->table_size / SWISS_GROUP_SIZE;
+	uint32_t new_count = group_count > 0 ? group_count : 1;
+	while (SWISS(max_load)(new_count * SWISS_GROUP_SIZE) < count)
+		new_count *= 2;
+	if (new_count == group_count)
+		return 0;
+	return SWISS(resize)(ht, new_count);
+}
+
+/**
+ * @brief Get a value from a desired position
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record
+ *  ID must be vaild, check it by swiss_pos_valid (asserted).
+ */
+inline SWISS_DATA_TYPE
+SWISS(get)(struct SWISS(core) *ht, uint32_t slotpos)
+{
+	assert(slotpos < ht->table_size);
+	struct SWISS(group) *group = (struct SWISS(group) *)
+		matras_get(&ht->mtable, slotpos / SWISS_GROUP_SIZE);
+	assert(group->ctrl[slotpos % SWISS_GROUP_SIZE] >= 0);
+	return group->slots[slotpos % SWISS_GROUP_SIZE].value;
+}
+
+/**
+ * @brief Determine if posision holds a value
+ * @param ht - pointer to a hash table struct
+ * @param slotpos - ID of an record
+ *  ID must be in valid range [0, ht->table_size) (asserted).
+ */
+inline bool
+SWISS(pos_valid)(struct SWISS(core) *ht, uint32_t slotpos)
+{
+	assert(slotpos < ht->table_size);
+	struct SWISS(group) *group = (struct SWISS(group) *)
+		matras_get(&ht->mtable, slotpos / SWISS_GROUP_SIZE);
+	return group->ctrl[slotpos % SWISS_GROUP_SIZE] >= 0;
+}
+
+/**
+ * @brief Set iterator to the beginning of hash table
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ */
+inline void
+SWISS(iterator_begin)(const struct SWISS(core) *ht,
+		      struct SWISS(iterator) *itr)
+{
+	(void)ht;
+	itr->slotpos = 0;
+	matras_head_read_view(&itr->view);
+}
+
+/**
+ * @brief Set iterator to position determined by key
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ * @param hash - hash to find
+ * @param data - key to find
+ */
+inline void
+SWISS(iterator_key)(const struct SWISS(core) *ht, struct SWISS(iterator) *itr,
+		    uint32_t hash, SWISS_KEY_TYPE data)
+{
+	itr->slotpos = SWISS(find_key)(ht, hash, data);
+	matras_head_read_view(&itr->view);
+}
+
+/**
+ * @brief Get the value that iterator currently points to
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to set
+ * @return poiner to the value or NULL if iteration is complete
+ */
+inline SWISS_DATA_TYPE *
+SWISS(iterator_get_and_next)(const struct SWISS(core) *ht,
+			     struct SWISS(iterator) *itr)
+{
+	const struct matras_view *view;
+	view = matras_is_read_view_created(&itr->view) ?
+	       &itr->view : &ht->mtable.head;
+	while (itr->slotpos / SWISS_GROUP_SIZE < view->block_count) {
+		uint32_t slotpos = itr->slotpos;
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_view_get(&ht->mtable, view,
+					slotpos / SWISS_GROUP_SIZE);
+		itr->slotpos++;
+		if (group->ctrl[slotpos % SWISS_GROUP_SIZE] >= 0)
+			return &group->slots[slotpos % SWISS_GROUP_SIZE].value;
+	}
+	return 0;
+}
+
+/**
+ * @brief Freezes state for given iterator. All following hash table
+ * modification will not apply to that iterator iteration. That
+ * iterator should be destroyed with a swiss_iterator_destroy call
+ * after usage.
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to freeze
+ */
+inline void
+SWISS(iterator_freeze)(struct SWISS(core) *ht, struct SWISS(iterator) *itr)
+{
+	assert(!matras_is_read_view_created(&itr->view));
+	matras_create_read_view(&ht->mtable, &itr->view);
+}
+
+/**
+ * @brief Destroy an iterator that was frozen before. Useless for not
+ * frozen iterators.
+ * @param ht - pointer to a hash table struct
+ * @param itr - iterator to destroy
+ */
+inline void
+SWISS(iterator_destroy)(struct SWISS(core) *ht, struct SWISS(iterator) *itr)
+{
+	matras_destroy_read_view(&ht->mtable, &itr->view);
+}
+
+/*
+ * Selfcheck of the internal state of hash table. Used only for debugging.
+ * That means that you should not use this function.
+ * If return not zero, something went terribly wrong.
+ */
+inline int
+SWISS(selfcheck)(const struct SWISS(core) *ht)
+{
+	int res = 0;
+	uint32_t group_count = ht->table_size / SWISS_GROUP_SIZE;
+	if (group_count != ht->mtable.head.block_count)
+		res |= 1; /* table size mismatch */
+	if (group_count != 0 && group_count != ht->group_mask + 1)
+		res |= 2; /* group mask mismatch */
+	uint32_t count = 0;
+	uint32_t deleted = 0;
+	for (uint32_t g = 0; g < group_count; g++) {
+		struct SWISS(group) *group = (struct SWISS(group) *)
+			matras_get(&ht->mtable, g);
+		for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+			int8_t ctrl = group->ctrl[i];
+			if (ctrl == SWISS_CTRL_DELETED) {
+				deleted++;
+				continue;
+			}
+			if (ctrl == SWISS_CTRL_EMPTY)
+				continue;
+			if (ctrl < 0) {
+				res |= 4; /* wrong control byte */
+				continue;
+			}
+			count++;
+			uint32_t mixed = SWISS(mix)(group->hash[i]);
+			if (ctrl != SWISS(h2)(mixed))
+				res |= 8; /* wrong fingerprint */
+			/* No empty slots before the value. */
+			uint32_t probe = mixed & ht->group_mask;
+			for (uint32_t step = 1; probe != g; step++) {
+				struct SWISS(group) *pgroup =
+					(struct SWISS(group) *)
+					matras_get(&ht->mtable, probe);
+				if (SWISS(match)(pgroup->ctrl,
+						 SWISS_CTRL_EMPTY) != 0) {
+					res |= 16; /* value is unreachable */
+					break;
+				}
+				if (step > group_count) {
+					res |= 32; /* not on probe sequence */
+					break;
+				}
+				probe = (probe + step) & ht->group_mask;
+			}
+		}
+	}
+	if (count != ht->count)
+		res |= 64; /* count mismatch */
+	if (ht->growth_left != (int32_t)SWISS(max_load)(ht->table_size) -
+			       (int32_t)(count + deleted))
+		res |= 128; /* growth mismatch */
+	return res;
+}
@@ -176,8 +176,17 @@
 #cmakedefine HAVE_SCHED_YIELD 1
 #cmakedefine HAVE_POSIX_FADVISE 1
 #cmakedefine HAVE_MREMAP 1
+/*
+ * Defined if the compiler can build SSE 4.2 and PCLMUL code
+ * for the 3-way interleaved CRC32 (see cpu_feature.c).
+ */
+#cmakedefine HAVE_CRC32C_PCLMUL 1
 
 #cmakedefine HAVE_PRCTL_H 1
+/*
+ * Defined if this platform has Linux specific inotify_init1().
+ */
+#cmakedefine HAVE_INOTIFY_INIT1 1
 
 #cmakedefine HAVE_OPEN_MEMSTREAM 1
 #cmakedefine HAVE_FMEMOPEN 1
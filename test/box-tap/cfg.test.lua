@@ -4,7 +4,7 @@ local tap = require('tap')
 local test = tap.test('cfg')
 local socket = require('socket')
 local fio = require('fio')
-test:plan(43)
+test:plan(47)
 
 --------------------------------------------------------------------------------
 -- Invalid values
@@ -22,6 +22,8 @@ invalid('slab_alloc_minimal', 0)
 invalid('slab_alloc_minimal', -1)
 invalid('slab_alloc_minimal', 1048281)
 invalid('slab_alloc_minimal', 1000000000)
+invalid('slab_alloc_huge_page_size', 4096)
+invalid('slab_alloc_huge_page_size', 3 * 1024 * 1024)
 invalid('replication_source', '//guest@localhost:3301')
 invalid('wal_mode', 'invalid')
 invalid('rows_per_wal', -1)
@@ -87,6 +89,10 @@ test:is(box.cfg.too_long_threshold, 0.5, "too_long_threshold default value")
 box.cfg{too_long_threshold=0.1}
 test:is(box.cfg.too_long_threshold , 0.1, "too_long_threshold new value")
 
+test:is(box.cfg.wal_async_max_lag, 16 * 1024 * 1024, "wal_async_max_lag default value")
+box.cfg{wal_async_max_lag=1024}
+test:is(box.cfg.wal_async_max_lag, 1024, "wal_async_max_lag new value")
+
 --------------------------------------------------------------------------------
 -- gh-246: Read only mode
 --------------------------------------------------------------------------------
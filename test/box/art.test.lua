@@ -0,0 +1,115 @@
+env = require('test_run')
+test_run = env.new()
+
+--
+-- ART index: an adaptive radix tree keyed on an order-preserving
+-- binary encoding of the key parts.
+--
+s = box.schema.space.create('art')
+pk = s:create_index('pk', { type = 'art', parts = {1, 'string'} })
+sk = s:create_index('sk', { type = 'art', unique = false, parts = {2, 'integer', 3, 'unsigned'} })
+s.index.pk.type
+s.index.sk.unique
+s:insert{'b', 1, 10}
+s:insert{'a', -1, 20}
+s:insert{'ab', 1, 5}
+s:insert{'', 100, 1}
+s:insert{'ba', -100, 7}
+pk:len()
+pk:select{}
+pk:get{'ab'}
+pk:get{'c'}
+pk:select({'a'}, {iterator = 'GE'})
+pk:select({'a'}, {iterator = 'GT'})
+pk:select({'b'}, {iterator = 'LE'})
+pk:select({'b'}, {iterator = 'LT'})
+pk:select({'b'}, {iterator = 'REQ'})
+pk:select({}, {iterator = 'LT'})
+pk:min()
+pk:max()
+
+-- Composite keys, signed values and partial keys.
+sk:select{}
+sk:select{1}
+sk:select({1}, {iterator = 'REQ'})
+sk:select({1}, {iterator = 'GT'})
+sk:select({1}, {iterator = 'LT'})
+sk:select({-1, 20}, {iterator = 'GE'})
+sk:select({1, 6}, {iterator = 'LE'})
+sk:select{0}
+sk:max{1}
+s:insert{'c', 1, 5}
+#sk:select{1, 5}
+s:delete{'c'}
+#sk:select{1, 5}
+
+-- Duplicates and replaces.
+s:insert{'a', 0, 0}
+s:replace{'a', 2, 2}
+sk:select{-1}
+sk:select{2}
+s:update({'b'}, {{'=', 3, 11}})
+sk:select{1}
+
+-- Unsupported iterators and types.
+status, message = pcall(pk.select, pk, {'a'}, {iterator = 'BITS_ALL_SET'})
+status
+message:match('does not support .*')
+status, message = pcall(s.create_index, s, 'bad', { type = 'art', parts = {4, 'array'} })
+status
+message:match('ART index .*')
+status, message = pcall(s.create_index, s, 'bad', { type = 'art', parts = {4, 'number'} })
+message:match('ART index .*')
+s:drop()
+
+--
+-- Keys with a long common prefix, iteration while the index
+-- changes, and checkpoints.
+--
+s = box.schema.space.create('art_urls')
+pk = s:create_index('pk', { type = 'art', parts = {1, 'string'} })
+prefix = 'https://example.com/some/long/common/path/'
+for i = 1, 1000 do s:insert{prefix .. string.format('%04d', i), i} end
+pk:len()
+pk:get{prefix .. '0500'}[2]
+pk:get{prefix .. '1001'}
+pk:get{prefix}
+#pk:select({prefix}, {iterator = 'GE'})
+pk:select({prefix .. '0999'}, {iterator = 'GT'})[1][2]
+pk:select({prefix .. '0002'}, {iterator = 'LT'})[1][2]
+test_run:cmd("setopt delimiter ';'")
+function scan_and_delete_next()
+    local count = 0
+    for _, t in pk:pairs() do
+        count = count + 1
+        s:delete{prefix .. string.format('%04d', t[2] + 1)}
+    end
+    return count
+end;
+function check()
+    local count = 0
+    local last = 0
+    for _, t in pk:pairs() do
+        if t[2] <= last then return {'order', t} end
+        if pk:get{t[1]} == nil then return {'get', t} end
+        last = t[2]
+        count = count + 1
+    end
+    return count
+end;
+test_run:cmd("setopt delimiter ''");
+scan_and_delete_next()
+pk:len()
+check()
+box.snapshot()
+for i = 1, 1000, 4 do s:delete{prefix .. string.format('%04d', i)} end
+check()
+test_run:cmd('restart server default')
+s = box.space.art_urls
+pk = s.index.pk
+prefix = 'https://example.com/some/long/common/path/'
+pk.type
+pk:len()
+pk:get{prefix .. '0003'}[2]
+pk:get{prefix .. '0005'}
+s:drop()
@@ -0,0 +1,48 @@
+test_run = require('test_run').new()
+fiber = require('fiber')
+
+-- A transaction which writes to asynchronous spaces only
+-- is acknowledged before its rows are written to the WAL
+s = box.schema.space.create('test', {async = true})
+_ = s:create_index('pk')
+s:insert{1}
+s:replace{2, 'two'}
+box.begin() s:insert{3} s:delete{1} box.commit()
+s:select{}
+
+-- The rows are persisted nevertheless
+while box.stat.wal().async_pending > 0 do fiber.sleep(0.001) end
+test_run:cmd('restart server default')
+test_run = require('test_run').new()
+s = box.space.test
+s:select{}
+
+-- With the lag limit set to zero, every writer waits until
+-- the previous asynchronous transaction is written
+box.cfg{wal_async_max_lag = 0}
+box.cfg.wal_async_max_lag
+max_pending = 0
+test_run:cmd("setopt delimiter ';'")
+for i = 1, 100 do
+    s:replace{i}
+    max_pending = math.max(max_pending, box.stat.wal().async_pending)
+end;
+test_run:cmd("setopt delimiter ''");
+max_pending
+s:count()
+box.cfg{wal_async_max_lag = -1}
+box.cfg{wal_async_max_lag = 16 * 1024 * 1024}
+
+-- Without the limit, the queue grows as long as the tx
+-- thread doesn't yield
+max_pending = 0
+test_run:cmd("setopt delimiter ';'")
+for i = 101, 200 do
+    s:replace{i}
+    max_pending = math.max(max_pending, box.stat.wal().async_pending)
+end;
+test_run:cmd("setopt delimiter ''");
+max_pending > 1
+s:count()
+
+s:drop()
@@ -4,7 +4,13 @@ net_box = require('net.box')
 space = box.schema.space.create('tweedledum')
 index = space:create_index('primary', { type = 'hash' })
 
-errinj.info()
+-- the order of a Lua table is arbitrary, sort the injections
+info = errinj.info()
+names = {}
+for name in pairs(info) do table.insert(names, name) end
+table.sort(names)
+for i, name in ipairs(names) do names[i] = {name, info[name].state} end
+names
 errinj.set("some-injection", true)
 errinj.set("some-injection") -- check error
 space:select{222444}
@@ -151,6 +157,38 @@ tostring(t[1]) .. tostring(t[2]) ..tostring(t[3]) .. tostring(t[4]) .. tostring(
 errinj.set("ERRINJ_TUPLE_FIELD", false)
 tostring(t[1]) .. tostring(t[2]) ..tostring(t[3]) .. tostring(t[4]) .. tostring(t[5]) .. tostring(t[6])
 
+-- A failed asynchronous write can't be reported to the
+-- committer, so it makes further asynchronous commits fail
+-- until a checkpoint persists the rows missing from the WAL
+fiber = require('fiber')
+async = box.schema.space.create('async', {async = true})
+_ = async:create_index('pk')
+test_run:cmd("setopt delimiter ';'")
+function wait_async()
+    while box.stat.wal().async_pending > 0 do fiber.sleep(0.001) end
+end;
+test_run:cmd("setopt delimiter ''");
+errinj.set("ERRINJ_WAL_IO", true)
+async:insert{1}
+async:get{1}
+errinj.set("ERRINJ_WAL_IO", false)
+box.stat.wal().async_errors
+errinj.set("ERRINJ_WAL_WRITE", true)
+async:insert{2}
+wait_async()
+errinj.set("ERRINJ_WAL_WRITE", false)
+box.stat.wal().async_errors
+async:get{2}
+async:insert{3}
+async:get{3}
+s:replace{1, 2, 3, 4, 5, 6}
+box.snapshot()
+async:insert{3}
+wait_async()
+box.stat.wal().async_errors
+async:select{}
+async:drop()
+
 -- Cleanup
 s:drop()
 errinj = nil
@@ -0,0 +1,32 @@
+test_run = require('test_run').new()
+
+-- If no thread can be started to sort secondary keys after
+-- recovery, they are sorted in tx
+test_run:cmd('create server build with script = "box/lua/errinj_build.lua"')
+test_run:cmd('start server build')
+test_run:cmd('switch build')
+box.error.injection.info().ERRINJ_MEMTX_BUILD_THREAD.state
+s1 = box.schema.space.create('s1')
+_ = s1:create_index('pk')
+_ = s1:create_index('sk1', {parts = {2, 'unsigned'}})
+_ = s1:create_index('sk2', {parts = {3, 'string'}, unique = false})
+s2 = box.schema.space.create('s2')
+_ = s2:create_index('pk', {type = 'hash'})
+_ = s2:create_index('sk', {parts = {2, 'integer'}})
+for i = 1, 100 do s1:insert{i, (i * 37) % 101, tostring(i % 10)} end
+for i = 1, 100 do s2:insert{i, 50 - i} end
+test_run:cmd('switch default')
+test_run:cmd('stop server build')
+test_run:cmd('start server build')
+test_run:cmd('switch build')
+s1 = box.space.s1
+s2 = box.space.s2
+s1.index.sk1:count(), s1.index.sk2:count(), s2.index.sk:count()
+s1.index.sk1:select({}, {limit = 3})
+s1.index.sk1:max()
+s1.index.sk2:select({'3'}, {limit = 3})
+s2.index.sk:select({}, {limit = 3})
+s2.index.sk:get{0}
+test_run:cmd('switch default')
+test_run:cmd('stop server build')
+test_run:cmd('cleanup server build')
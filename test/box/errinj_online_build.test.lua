@@ -0,0 +1,60 @@
+test_run = require('test_run').new()
+fiber = require('fiber')
+errinj = box.error.injection
+
+--
+-- Transactions which change a space during an online build
+-- of its secondary key may fail to be written to WAL, as well
+-- as the alter itself.
+--
+s = box.schema.space.create('online_build')
+_ = s:create_index('pk')
+box.begin() for i = 1, 20000 do s:insert{i, i} end box.commit()
+
+test_run:cmd("setopt delimiter ';'")
+function writer()
+    local k = 1
+    while not done do
+        k = k * 7919 % 30000 + 1
+        pcall(s.replace, s, {k, k})
+        fiber.sleep(0)
+    end
+end;
+function check(index)
+    if index:count() ~= s:count() then
+        return {'count', index:count(), s:count()}
+    end
+    for _, t in s:pairs() do
+        local u = index:get{t[2]}
+        if u == nil or u[1] ~= t[1] then
+            return {'get', t}
+        end
+    end
+    return true
+end;
+test_run:cmd("setopt delimiter ''");
+
+-- WAL fails in the middle of the build.
+done = false
+_ = fiber.create(writer)
+_ = fiber.create(function() fiber.sleep(0) errinj.set("ERRINJ_WAL_IO", true) end) sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+done = true
+errinj.set("ERRINJ_WAL_IO", false)
+s.index.sk
+sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+check(sk)
+sk:drop()
+
+-- A transaction written to WAL before the alter is rolled back
+-- after it.
+ok = nil
+_ = fiber.create(function() fiber.sleep(0) errinj.set("ERRINJ_WAL_DELAY", true) errinj.set("ERRINJ_WAL_WRITE", true) ok, err = pcall(s.replace, s, {1, 30001}) end) sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+while ok == nil do fiber.sleep(0.001) end
+ok, err
+errinj.set("ERRINJ_WAL_WRITE", false)
+s:get{1}
+s.index.sk
+sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+check(sk)
+
+s:drop()
@@ -0,0 +1,68 @@
+env = require('test_run')
+test_run = env.new()
+net_box = require('net.box')
+
+s = box.schema.space.create('get_many')
+pk = s:create_index('pk', { type = 'hash' })
+tk = s:create_index('tk', { type = 'tree', parts = {2, 'unsigned'} })
+sk = s:create_index('sk', { type = 'tree', unique = false, parts = {3, 'unsigned'} })
+ck = s:create_index('ck', { type = 'tree', parts = {3, 'unsigned', 4, 'string'} })
+for i = 1, 5 do s:insert{i, i * 10, i % 2, 'x' .. i} end
+
+-- Show missing tuples explicitly.
+test_run:cmd("setopt delimiter ';'")
+function show(res, n)
+    local r = {}
+    for i = 1, n do
+        r[i] = res[i] or 'none'
+    end
+    return r
+end;
+test_run:cmd("setopt delimiter ''");
+
+-- Keys are tables of parts or single parts.
+show(pk:get_many({1, 3, 7, 5}), 4)
+show(tk:get_many({{10}, {60}, 20}), 3)
+show(s:get_many({{2}, 4, 2}), 3)
+show(ck:get_many({{1, 'x1'}, {1, 'x2'}, {0, 'x2'}}), 3)
+#pk:get_many({})
+#tk:get_many()
+
+-- Errors.
+sk:get_many({1})
+ck:get_many({{1}})
+pk:get_many({'a'})
+tk:get_many({{10, 20}})
+
+-- A batch agrees with single lookups.
+for i = 6, 1000 do s:insert{i, i * 10, i % 2, 'x' .. i} end
+keys = {}
+for i = 1, 500 do keys[i] = math.random(1500) end
+test_run:cmd("setopt delimiter ';'")
+function check(index, mul)
+    local k = {}
+    for i, v in ipairs(keys) do
+        k[i] = v * mul
+    end
+    local res = index:get_many(k)
+    for i, v in ipairs(k) do
+        if res[i] ~= index:get(v) then
+            return {i, v}
+        end
+    end
+    return true
+end;
+test_run:cmd("setopt delimiter ''");
+check(pk, 1)
+check(tk, 10)
+
+-- Remote multi-get.
+box.schema.user.grant('guest', 'read', 'universe')
+c = net_box.connect(box.cfg.listen)
+show(c.space.get_many:get_many({1, 3, 2000, 5}), 4)
+show(c.space.get_many.index.tk:get_many({{10}, {60}, 20}), 3)
+c.space.get_many.index.sk:get_many({1})
+c:close()
+box.schema.user.revoke('guest', 'read', 'universe')
+
+s:drop()
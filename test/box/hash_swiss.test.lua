@@ -0,0 +1,80 @@
+env = require('test_run')
+test_run = env.new()
+
+--
+-- HASH index over a swiss table: the same semantics as the
+-- default one, but another layout and iteration order.
+--
+s = box.schema.space.create('hash_swiss')
+pk = s:create_index('pk', { type = 'hash', swiss = true })
+sk = s:create_index('sk', { type = 'hash', swiss = true, parts = {2, 'string'} })
+s.index.pk.swiss
+s.index.sk.swiss
+for i = 1, 10000 do s:insert{i, 'k' .. i} end
+pk:len()
+pk:get{1}
+pk:get{10000}
+pk:get{10001}
+sk:get{'k500'}
+sk:get{'k0'}
+pk:select{42}
+sk:select{'k42'}
+sk:select{'k0'}
+
+-- Duplicates.
+s:insert{1, 'dup'}
+s:insert{10001, 'k1'}
+s:replace{1, 'one'}
+sk:get{'k1'}
+sk:get{'one'}
+
+-- Every tuple is seen once by a full scan and found by key.
+test_run:cmd("setopt delimiter ';'")
+function check(n)
+    local seen = {}
+    local count = 0
+    for _, t in pk:pairs() do
+        if seen[t[1]] then return {'twice', t} end
+        seen[t[1]] = true
+        count = count + 1
+    end
+    for i = 1, n do
+        local t = pk:get{i}
+        if (t ~= nil) ~= (seen[i] ~= nil) then
+            return {'get', i}
+        end
+        local u = t ~= nil and sk:get{t[2]} or nil
+        if t ~= nil and (u == nil or u[1] ~= i) then
+            return {'secondary', i}
+        end
+    end
+    return count
+end;
+test_run:cmd("setopt delimiter ''");
+check(10000)
+for i = 1, 10000, 2 do s:delete{i} end
+pk:len()
+check(10000)
+pk:get{1}
+pk:get{2}
+pk:get_many({2, 4})
+
+-- A snapshot iterates a read view of the table.
+box.snapshot()
+for i = 2, 10000, 4 do s:delete{i} end
+pk:len()
+check(10000)
+
+-- The option change rebuilds the index.
+sk:alter({swiss = false})
+s.index.sk.swiss
+check(10000)
+sk:alter({swiss = true})
+s.index.sk.swiss
+check(10000)
+
+-- Only memtx HASH indexes support the option.
+s:create_index('tk', { type = 'tree', swiss = true, parts = {2, 'string'} })
+s:create_index('tk', { type = 'hash', swiss = 1, parts = {2, 'string'} })
+
+s:drop()
@@ -0,0 +1,11 @@
+#!/usr/bin/env tarantool
+os = require('os')
+
+-- Make the secondary key build fall back to tx
+box.error.injection.set('ERRINJ_MEMTX_BUILD_THREAD', true)
+
+box.cfg{
+    listen              = os.getenv("LISTEN"),
+}
+
+require('console').listen(os.getenv('ADMIN'))
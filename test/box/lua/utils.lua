@@ -195,6 +195,45 @@ function check_space(space, N)
     return errors
 end
 
+-- Check that every secondary key of a space contains all its
+-- tuples, in order
+function check_indexes(space)
+    local function key(index, tuple)
+        local k = {}
+        for _, part in ipairs(index.parts) do
+            table.insert(k, tuple[part.fieldno])
+        end
+        return k
+    end
+    local function lt(index, x, y)
+        for _, part in ipairs(index.parts) do
+            local u, v = x[part.fieldno], y[part.fieldno]
+            if u ~= v then return u < v end
+        end
+        return false
+    end
+    local tuples = space.index[0]:select{}
+    for id = 1, #space.index do
+        local index = space.index[id]
+        local result = index:select{}
+        if #result ~= #tuples then
+            return false
+        end
+        for i = 2, #result do
+            if index.type == 'TREE' and
+               lt(index, result[i], result[i - 1]) then
+                return false
+            end
+        end
+        for _, tuple in ipairs(tuples) do
+            if index:count(key(index, tuple)) == 0 then
+                return false
+            end
+        end
+    end
+    return true
+end
+
 return {
     space_field_types = space_field_types;
     iterate = iterate;
@@ -204,4 +243,5 @@ return {
     sort = sort;
     tuple_to_string = tuple_to_string;
     check_space = check_space;
+    check_indexes = check_indexes;
 };
@@ -80,11 +80,13 @@ t;
 string.match(tostring(box.slab.info()), '^table:') ~= nil;
 box.slab.info().arena_used >= 0;
 box.slab.info().arena_size > 0;
+box.slab.info().delayed_free_size;
 string.match(tostring(box.slab.stats()), '^table:') ~= nil;
 t = {};
 for k, v in pairs(box.slab.info()) do
     table.insert(t, k)
 end;
+table.sort(t);
 t;
 box.runtime.info().used > 0;
 box.runtime.info().maxalloc > 0;
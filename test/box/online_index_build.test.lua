@@ -0,0 +1,70 @@
+env = require('test_run')
+test_run = env.new()
+fiber = require('fiber')
+
+--
+-- A secondary key of a memtx space is built online: the build
+-- yields between batches of tuples, and the changes made
+-- meanwhile get into the new index.
+--
+s = box.schema.space.create('online_build')
+_ = s:create_index('pk')
+box.begin() for i = 1, 20000 do s:insert{i, i} end box.commit()
+
+test_run:cmd("setopt delimiter ';'")
+function writer()
+    local k = 1
+    while not done do
+        k = k * 7919 % 30000 + 1
+        if k % 3 == 0 then
+            s:delete{k}
+        else
+            s:replace{k, k}
+        end
+        writes = writes + 1
+        fiber.sleep(0)
+    end
+end;
+function check(index)
+    if index:count() ~= s:count() then
+        return {'count', index:count(), s:count()}
+    end
+    for _, t in s:pairs() do
+        local u = index:get{t[2]}
+        if u == nil or u[1] ~= t[1] then
+            return {'get', t}
+        end
+    end
+    return true
+end;
+test_run:cmd("setopt delimiter ''");
+
+done = false
+writes = 0
+_ = fiber.create(writer)
+writes = 0 sk = s:create_index('sk', {parts = {2, 'unsigned'}}) during = writes
+during > 0
+done = true
+check(sk)
+sk:drop()
+
+-- A duplicate which the build hasn't reached yet fails the build.
+_ = fiber.create(function() fiber.sleep(0) s:replace{20000, 1} end) sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+s.index.sk
+s:replace{20000, 20000}
+
+-- A duplicate of a built tuple fails the statement.
+_ = fiber.create(function() fiber.sleep(0) ok, err = pcall(s.replace, s, {2, 1}) end) sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+ok, err
+s:get{2}
+check(sk)
+
+-- A statement changing the space is checked against the new
+-- format too.
+sk:drop()
+_ = fiber.create(function() fiber.sleep(0) ok, err = pcall(s.replace, s, {4, 'four'}) end) sk = s:create_index('sk', {parts = {2, 'unsigned'}})
+ok, err
+s:get{4}
+check(sk)
+
+s:drop()
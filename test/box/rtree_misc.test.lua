@@ -245,3 +245,18 @@ i:select({0, 0, 0}, {iterator = 'neighbor'})
 i:select({1, 2, 3, 4, 5, 6}, {iterator = 'BITS_ALL_SET' } )
 
 s:drop()
+
+-- an index created on a non-empty space is bulk loaded
+s = box.schema.space.create('spatial')
+_ = s:create_index('primary')
+for i = 1, 1000 do s:insert{i, {i % 37, i % 41}} end
+i = s:create_index('spatial', { type = 'rtree', unique = false, parts = {2, 'array'}})
+i:len()
+#i:select({0, 0, 10, 10}, {iterator = 'le'})
+#i:select({5, 0, 20, 3}, {iterator = 'overlaps'})
+s:insert{1001, {0, 0}}
+#i:select({0, 0, 10, 10}, {iterator = 'le'})
+s:delete{1001}
+s:delete{1}
+#i:select({0, 0, 10, 10}, {iterator = 'le'})
+s:drop()
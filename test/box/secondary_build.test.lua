@@ -0,0 +1,56 @@
+test_run = require('test_run').new()
+check = dofile('utils.lua').check_indexes
+
+-- Secondary keys are built in bulk after recovery, one space
+-- at a time, with trees sorted by a pool of threads
+a = box.schema.space.create('a')
+_ = a:create_index('pk')
+_ = a:create_index('num', {parts = {2, 'unsigned'}})
+_ = a:create_index('str', {parts = {3, 'string'}})
+_ = a:create_index('multi', {parts = {4, 'unsigned', 2, 'unsigned'}, unique = false})
+b = box.schema.space.create('b')
+_ = b:create_index('pk', {type = 'hash'})
+_ = b:create_index('num', {parts = {2, 'unsigned'}, unique = false})
+_ = b:create_index('hash', {type = 'hash', parts = {3, 'string'}})
+_ = b:create_index('str', {parts = {3, 'string'}})
+c = box.schema.space.create('c')
+_ = c:create_index('pk', {parts = {1, 'string'}})
+_ = c:create_index('num', {parts = {2, 'integer'}})
+d = box.schema.space.create('d')
+_ = d:create_index('pk')
+_ = d:create_index('num', {parts = {2, 'unsigned'}})
+
+test_run:cmd("setopt delimiter ';'")
+for i = 1, 1000 do
+    local k = i * 7919 % 1009
+    a:insert{i, k, tostring(k * 31), k % 10}
+    b:insert{i, k % 100, 'b' .. k}
+    c:insert{tostring(k), 500 - i}
+end;
+box.snapshot();
+for i = 1001, 2000 do
+    local k = i * 7919 % 1009
+    a:replace{i % 1000 + 1, k + 1009, tostring(k * 31 + 1), k % 7}
+    b:delete{i - 1000}
+    b:insert{i, k % 100, 'b' .. k}
+end;
+test_run:cmd("setopt delimiter ''");
+check(a), check(b), check(c), check(d)
+
+test_run:cmd('restart server default')
+check = dofile('utils.lua').check_indexes
+a = box.space.a
+b = box.space.b
+c = box.space.c
+d = box.space.d
+check(a), check(b), check(c), check(d)
+a.index.num:min()
+a.index.str:max()
+b.index.num:count(42)
+c.index.num:select({495}, {iterator = 'GT'})
+d.index.num:len()
+
+a:drop()
+b:drop()
+c:drop()
+d:drop()
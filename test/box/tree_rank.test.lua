@@ -0,0 +1,66 @@
+env = require('test_run')
+test_run = env.new()
+
+--
+-- count() and select() offset are answered from subtree sizes in
+-- TREE indexes. Check them against plain iteration.
+--
+s = box.schema.space.create('tree_rank')
+pk = s:create_index('pk', { type = 'tree' })
+sk = s:create_index('sk', { type = 'tree', unique = false, parts = {2, 'unsigned'} })
+for i = 1, 1000 do s:insert{i, i % 10} end
+
+test_run:cmd("setopt delimiter ';'")
+iterators = {'EQ', 'REQ', 'GE', 'GT', 'LE', 'LT', 'ALL'}
+offsets = {0, 1, 5, 99, 100, 101, 499, 500, 999, 1000, 1001}
+function check_count(index, key)
+    for _, it in ipairs(iterators) do
+        local n = index:count(key, {iterator = it})
+        local m = #index:select(key, {iterator = it})
+        -- count() ignores the key of ALL, select() doesn't
+        if it == 'ALL' then m = index:len() end
+        if n ~= m then
+            return {it, key, n, m}
+        end
+    end
+    return true
+end;
+function check_offset(index, key)
+    for _, it in ipairs(iterators) do
+        local all = index:select(key, {iterator = it})
+        for _, offset in ipairs(offsets) do
+            local res = index:select(key, {iterator = it, offset = offset,
+                                           limit = 3})
+            for i = 1, 3 do
+                local a = res[i]
+                local b = all[offset + i]
+                if (a == nil) ~= (b == nil) or (a ~= nil and a[1] ~= b[1]) then
+                    return {it, key, offset, i}
+                end
+            end
+        end
+    end
+    return true
+end;
+function check(index, keys)
+    for _, key in ipairs(keys) do
+        local r = check_count(index, key)
+        if r ~= true then return r end
+        r = check_offset(index, key)
+        if r ~= true then return r end
+    end
+    return true
+end;
+test_run:cmd("setopt delimiter ''");
+
+check(pk, {{}, {0}, {1}, {500}, {1000}, {1001}})
+check(sk, {{}, {0}, {3}, {9}, {10}})
+pk:count({500}, {iterator = 'ALL'})
+#pk:select({500}, {iterator = 'ALL'})
+
+-- Same after deletions.
+for i = 1, 1000, 3 do s:delete{i} end
+check(pk, {{}, {0}, {1}, {2}, {500}, {1000}, {1001}})
+check(sk, {{}, {0}, {3}, {9}, {10}})
+
+s:drop()
@@ -0,0 +1,52 @@
+env = require('test_run')
+test_run = env.new()
+fiber = require('fiber')
+errinj = box.error.injection
+
+box.schema.user.grant('guest', 'replication')
+s = box.schema.space.create('test')
+_ = s:create_index('pk')
+t = box.schema.space.create('temp')
+_ = t:create_index('pk')
+for i = 1, 100 do s:insert{i} t:insert{i} end
+
+-- The initial join is sent from a read view of the data and
+-- doesn't block checkpoints and DDL: slow the join down and
+-- change the data meanwhile
+errinj.set("ERRINJ_RELAY_JOIN_DELAY", true)
+cluster_len = box.space._cluster:len()
+connected = false
+trigger = box.session.on_connect(function() connected = true end)
+test_run:cmd("setopt delimiter ';'")
+f = fiber.create(function()
+    while not connected do fiber.sleep(0.01) end
+    fiber.sleep(0.1)
+    box.snapshot()
+    -- the replica is registered at the end of the join
+    is_joining = box.space._cluster:len() == cluster_len
+    t:drop()
+    for i = 101, 200 do s:insert{i} end
+    s:delete{1}
+end);
+test_run:cmd("setopt delimiter ''");
+test_run:cmd("create server replica with rpl_master=default, script='replication/replica.lua'")
+test_run:cmd("start server replica")
+f:status()
+is_joining
+box.session.on_connect(nil, trigger)
+errinj.set("ERRINJ_RELAY_JOIN_DELAY", false)
+
+test_run:cmd("switch replica")
+fiber = require('fiber')
+while box.space.test:count() < 199 do fiber.sleep(0.01) end
+box.space.test:count()
+box.space.test:get{1}
+box.space.test:get{2}
+box.space.test:get{200}
+box.space.temp
+
+test_run:cmd("switch default")
+test_run:cmd("stop server replica")
+test_run:cmd("cleanup server replica")
+s:drop()
+box.schema.user.revoke('guest', 'replication')
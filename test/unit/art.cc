@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <string>
+#include <map>
+#include <vector>
+
+#include "unit.h"
+#include "salad/art.h"
+
+static const size_t art_extent_size = 16 * 1024;
+static size_t extents_count = 0;
+static bool extents_exhausted = false;
+
+static void *
+extent_alloc(void *ctx)
+{
+	size_t *p_extents_count = (size_t *) ctx;
+	assert(p_extents_count == &extents_count);
+	if (extents_exhausted)
+		return NULL;
+	++*p_extents_count;
+	return malloc(art_extent_size);
+}
+
+static void
+extent_free(void *ctx, void *extent)
+{
+	size_t *p_extents_count = (size_t *) ctx;
+	assert(p_extents_count == &extents_count);
+	--*p_extents_count;
+	free(extent);
+}
+
+/** A value of the tree, the key is stored in it. */
+struct test_value {
+	std::string key;
+};
+
+static size_t keys_loaded = 0;
+
+static const unsigned char *
+load_key(void *value, uint32_t *len, void *arg)
+{
+	(void) arg;
+	struct test_value *v = (struct test_value *) value;
+	keys_loaded++;
+	*len = v->key.size();
+	return (const unsigned char *) v->key.data();
+}
+
+typedef std::map<std::string, test_value *> model_t;
+
+/**
+ * Make a key of random bytes, the way memtx encodes strings:
+ * zero bytes are escaped and the key ends with two zero bytes,
+ * so no key is a prefix of another one. A small alphabet and
+ * a common head make long shared paths and small nodes, the
+ * full one makes wide nodes.
+ */
+static std::string
+random_key(int alphabet, size_t max_len, const std::string &head)
+{
+	std::string key = head;
+	size_t len = rand() % (max_len + 1);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = rand() % alphabet;
+		if (alphabet < 256)
+			c = c == 0 ? 0 : 'a' + c;
+		key += (char) c;
+		if (c == 0)
+			key += (char) 0xff;
+	}
+	key += std::string(2, '\0');
+	return key;
+}
+
+static const unsigned char *
+key_data(const std::string &key)
+{
+	return (const unsigned char *) key.data();
+}
+
+/** Check the tree contents and order against the model. */
+static void
+check_iteration(struct art_node *root, const model_t &model)
+{
+	struct art_iterator it;
+	art_iterator_create(&it);
+	fail_if(art_iterator_first(&it, root) != 0);
+	for (model_t::const_iterator i = model.begin(); i != model.end();
+	     ++i) {
+		fail_unless(art_iterator_get(&it) == i->second);
+		fail_if(art_iterator_next(&it) != 0);
+	}
+	fail_unless(art_iterator_get(&it) == NULL);
+	fail_if(art_iterator_last(&it, root) != 0);
+	for (model_t::const_reverse_iterator i = model.rbegin();
+	     i != model.rend(); ++i) {
+		fail_unless(art_iterator_get(&it) == i->second);
+		fail_if(art_iterator_prev(&it) != 0);
+	}
+	fail_unless(art_iterator_get(&it) == NULL);
+	art_iterator_destroy(&it);
+}
+
+/**
+ * The first model key greater than the probe which doesn't
+ * start with it, @sa art_iterator_upper_bound().
+ */
+static model_t::const_iterator
+model_upper_bound(const model_t &model, const std::string &probe)
+{
+	model_t::const_iterator i = model.lower_bound(probe);
+	while (i != model.end() && i->first.compare(0, probe.size(), probe) == 0)
+		++i;
+	return i;
+}
+
+static void
+check_bounds(struct art *tree, const model_t &model, const std::string &probe)
+{
+	struct art_iterator it;
+	art_iterator_create(&it);
+	fail_if(art_iterator_lower_bound(tree, &it, key_data(probe),
+					 probe.size()) != 0);
+	model_t::const_iterator i = model.lower_bound(probe);
+	fail_unless(art_iterator_get(&it) ==
+		    (i != model.end() ? i->second : NULL));
+	/* The iterator continues from the bound. */
+	if (i != model.end()) {
+		fail_if(art_iterator_next(&it) != 0);
+		++i;
+		fail_unless(art_iterator_get(&it) ==
+			    (i != model.end() ? i->second : NULL));
+	}
+	fail_if(art_iterator_upper_bound(tree, &it, key_data(probe),
+					 probe.size()) != 0);
+	i = model_upper_bound(model, probe);
+	fail_unless(art_iterator_get(&it) ==
+		    (i != model.end() ? i->second : NULL));
+	if (i != model.begin() && i != model.end()) {
+		fail_if(art_iterator_prev(&it) != 0);
+		--i;
+		fail_unless(art_iterator_get(&it) == i->second);
+	}
+	art_iterator_destroy(&it);
+}
+
+static void
+model_clear(model_t &model)
+{
+	for (model_t::iterator i = model.begin(); i != model.end(); ++i)
+		delete i->second;
+	model.clear();
+}
+
+/** Insert or delete random keys and compare the tree with a model. */
+static void
+random_ops(size_t rounds, int alphabet, size_t max_len,
+	   const std::string &head)
+{
+	struct art tree;
+	art_create(&tree, load_key, NULL, art_extent_size,
+		   extent_alloc, extent_free, &extents_count);
+	model_t model;
+	for (size_t r = 0; r < rounds; r++) {
+		std::string key = random_key(alphabet, max_len, head);
+		model_t::iterator i = model.find(key);
+		void *found = art_find(&tree, key_data(key), key.size());
+		fail_unless(found == (i != model.end() ? i->second : NULL));
+		if (i == model.end() || rand() % 4 == 0) {
+			/* Insert or replace. */
+			test_value *value = new test_value;
+			value->key = key;
+			void *replaced;
+			fail_if(art_insert(&tree, key_data(key), key.size(),
+					   value, &replaced) != 0);
+			fail_unless(replaced == found);
+			delete (test_value *) replaced;
+			model[key] = value;
+		} else {
+			void *deleted;
+			fail_if(art_delete(&tree, key_data(key), key.size(),
+					   &deleted) != 0);
+			fail_unless(deleted == i->second);
+			delete i->second;
+			model.erase(i);
+		}
+		fail_unless(art_size(&tree) == model.size());
+		if (r % 64 == 0) {
+			check_iteration(tree.root, model);
+			for (int j = 0; j < 8; j++) {
+				std::string probe =
+					random_key(alphabet, max_len, head);
+				/* Probe prefixes of keys too. */
+				probe.resize(rand() % (probe.size() + 1));
+				check_bounds(&tree, model, probe);
+			}
+		}
+	}
+	check_iteration(tree.root, model);
+	/* Delete everything: all nodes go back to the free lists. */
+	while (!model.empty()) {
+		model_t::iterator i = model.begin();
+		void *deleted;
+		fail_if(art_delete(&tree, key_data(i->first), i->first.size(),
+				   &deleted) != 0);
+		fail_unless(deleted == i->second);
+		delete i->second;
+		model.erase(i);
+	}
+	fail_unless(tree.root == NULL && art_size(&tree) == 0);
+	art_destroy(&tree);
+	fail_unless(extents_count == 0);
+}
+
+static void
+simple_test()
+{
+	header();
+
+	struct art tree;
+	art_create(&tree, load_key, NULL, art_extent_size,
+		   extent_alloc, extent_free, &extents_count);
+	test_value a, b, c;
+	a.key = std::string("http://example.com/a", 21);
+	b.key = std::string("http://example.com/b", 21);
+	c.key = std::string("http://example.org/", 20);
+	void *old;
+	fail_if(art_insert(&tree, key_data(a.key), a.key.size(), &a, &old));
+	fail_unless(old == NULL && art_size(&tree) == 1);
+	fail_if(art_insert(&tree, key_data(b.key), b.key.size(), &b, &old));
+	fail_if(art_insert(&tree, key_data(c.key), c.key.size(), &c, &old));
+	fail_unless(art_size(&tree) == 3);
+	fail_unless(art_find(&tree, key_data(a.key), a.key.size()) == &a);
+	fail_unless(art_find(&tree, key_data(b.key), b.key.size()) == &b);
+	fail_unless(art_find(&tree, key_data(c.key), c.key.size()) == &c);
+	std::string miss("http://example.com/c", 21);
+	fail_unless(art_find(&tree, key_data(miss), miss.size()) == NULL);
+
+	/* The same key replaces the value. */
+	test_value a2;
+	a2.key = a.key;
+	fail_if(art_insert(&tree, key_data(a.key), a.key.size(), &a2, &old));
+	fail_unless(old == &a && art_size(&tree) == 3);
+	fail_unless(art_find(&tree, key_data(a.key), a.key.size()) == &a2);
+
+	/* Only one key is loaded on a lookup. */
+	keys_loaded = 0;
+	fail_unless(art_find(&tree, key_data(b.key), b.key.size()) == &b);
+	fail_unless(keys_loaded == 1);
+
+	for (uint32_t rnd = 0; rnd < 16; rnd++) {
+		void *value = art_random(&tree, rnd);
+		fail_unless(value == &a2 || value == &b || value == &c);
+	}
+
+	fail_if(art_delete(&tree, key_data(miss), miss.size(), &old));
+	fail_unless(old == NULL && art_size(&tree) == 3);
+	fail_if(art_delete(&tree, key_data(b.key), b.key.size(), &old));
+	fail_unless(old == &b && art_size(&tree) == 2);
+	fail_unless(art_find(&tree, key_data(b.key), b.key.size()) == NULL);
+	fail_unless(art_find(&tree, key_data(a.key), a.key.size()) == &a2);
+	fail_unless(art_find(&tree, key_data(c.key), c.key.size()) == &c);
+	art_destroy(&tree);
+	fail_unless(extents_count == 0);
+
+	footer();
+}
+
+static void
+random_test()
+{
+	header();
+
+	/* Long shared paths. */
+	random_ops(5000, 3, 40, "http://example.com/path/to/");
+	/* Dense short keys. */
+	random_ops(5000, 8, 4, "");
+	/* Wide nodes. */
+	random_ops(20000, 256, 3, "");
+
+	footer();
+}
+
+static void
+view_test()
+{
+	header();
+
+	struct art tree;
+	art_create(&tree, load_key, NULL, art_extent_size,
+		   extent_alloc, extent_free, &extents_count);
+	model_t model;
+	/* Values of deleted keys, freed after the views. */
+	std::vector<test_value *> deleted_values;
+	const int view_count = 4;
+	struct art_view views[view_count];
+	model_t view_models[view_count];
+	for (int v = 0; v < view_count; v++) {
+		for (int r = 0; r < 3000; r++) {
+			std::string key = random_key(4, 12, "k");
+			test_value *value = new test_value;
+			value->key = key;
+			void *replaced;
+			if (rand() % 3 == 0) {
+				delete value;
+				fail_if(art_delete(&tree, key_data(key),
+						   key.size(), &replaced));
+				model.erase(key);
+			} else {
+				fail_if(art_insert(&tree, key_data(key),
+						   key.size(), value,
+						   &replaced));
+				model[key] = value;
+			}
+			if (replaced != NULL)
+				deleted_values.push_back(
+					(test_value *) replaced);
+		}
+		art_view_create(&tree, &views[v]);
+		view_models[v] = model;
+	}
+	/* Change the tree more, the views don't see it. */
+	for (int r = 0; r < 3000; r++) {
+		std::string key = random_key(4, 12, "k");
+		void *deleted;
+		fail_if(art_delete(&tree, key_data(key), key.size(),
+				   &deleted));
+		model.erase(key);
+		if (deleted != NULL)
+			deleted_values.push_back((test_value *) deleted);
+	}
+	check_iteration(tree.root, model);
+	size_t extents_with_views = extents_count;
+	/* Destroy the views out of order. */
+	const int order[view_count] = {1, 3, 0, 2};
+	for (int j = 0; j < view_count; j++) {
+		for (int v = 0; v < view_count; v++) {
+			bool is_destroyed = false;
+			for (int k = 0; k < j; k++)
+				is_destroyed = is_destroyed || order[k] == v;
+			if (!is_destroyed)
+				check_iteration(views[v].root, view_models[v]);
+		}
+		art_view_destroy(&tree, &views[order[j]]);
+	}
+	fail_unless(tree.garbage == NULL);
+	check_iteration(tree.root, model);
+	/* Freed nodes are reused. */
+	for (int r = 0; r < 3000; r++) {
+		std::string key = random_key(4, 12, "k");
+		if (model.count(key) != 0)
+			continue;
+		test_value *value = new test_value;
+		value->key = key;
+		void *replaced;
+		fail_if(art_insert(&tree, key_data(key), key.size(), value,
+				   &replaced));
+		model[key] = value;
+	}
+	fail_unless(extents_count <= extents_with_views);
+	check_iteration(tree.root, model);
+	model_clear(model);
+	for (size_t i = 0; i < deleted_values.size(); i++)
+		delete deleted_values[i];
+	art_destroy(&tree);
+	fail_unless(extents_count == 0);
+
+	footer();
+}
+
+static void
+memory_error_test()
+{
+	header();
+
+	struct art tree;
+	art_create(&tree, load_key, NULL, art_extent_size,
+		   extent_alloc, extent_free, &extents_count);
+	model_t model;
+	struct art_view view;
+	art_view_create(&tree, &view);
+	extents_exhausted = true;
+	size_t failures = 0;
+	for (int r = 0; r < 20000; r++) {
+		std::string key = random_key(256, 3, "");
+		test_value *value = new test_value;
+		value->key = key;
+		void *replaced;
+		if (art_insert(&tree, key_data(key), key.size(), value,
+			       &replaced) != 0) {
+			/* A failed insertion doesn't change the tree. */
+			delete value;
+			failures++;
+			extents_exhausted = false;
+			art_view_destroy(&tree, &view);
+			art_view_create(&tree, &view);
+			extents_exhausted = true;
+			fail_unless(art_size(&tree) == model.size());
+			continue;
+		}
+		delete (test_value *) replaced;
+		model[key] = value;
+		/* Let the tree grow from time to time. */
+		extents_exhausted = rand() % 64 != 0;
+	}
+	fail_unless(failures > 0);
+	extents_exhausted = false;
+	check_iteration(tree.root, model);
+	art_view_destroy(&tree, &view);
+	model_clear(model);
+	art_destroy(&tree);
+	fail_unless(extents_count == 0);
+
+	footer();
+}
+
+int
+main(void)
+{
+	srand(time(NULL));
+	simple_test();
+	random_test();
+	view_test();
+	memory_error_test();
+	return 0;
+}
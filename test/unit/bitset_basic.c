@@ -198,12 +198,65 @@ void test_get_set()
 	footer();
 }
 
+static
+void test_page_types()
+{
+	header();
+
+	struct bitset bm;
+	bitset_create(&bm, realloc);
+	struct bitset_info info;
+
+	/* Sparse values are stored as arrays */
+	for (size_t i = 0; i < 1000; i++)
+		fail_if(bitset_set(&bm, i * 61) < 0);
+	bitset_info(&bm, &info);
+	fail_unless(info.pages == 1 && info.array_pages == 1);
+
+	/* Dense values are stored as a bitmap */
+	for (size_t i = 0; i < 8000; i++)
+		fail_if(bitset_set(&bm, i * 7) < 0);
+	bitset_info(&bm, &info);
+	fail_unless(info.pages == 1 && info.bitmap_pages == 1);
+
+	/* A full page is a single run */
+	for (size_t i = 0; i < 65536; i++)
+		fail_if(bitset_set(&bm, i) < 0);
+	bitset_info(&bm, &info);
+	fail_unless(info.pages == 1 && info.run_pages == 1);
+	fail_unless(info.mem_total < 100);
+
+	/* Holes split the run */
+	for (size_t i = 0; i < 65536; i += 1024)
+		fail_unless(bitset_clear(&bm, i) == 1);
+	bitset_info(&bm, &info);
+	fail_unless(info.pages == 1 && info.run_pages == 1);
+	for (size_t i = 0; i < 65536; i++)
+		fail_unless(bitset_test(&bm, i) == (i % 1024 != 0));
+
+	/* And make it an array again when it gets sparse */
+	for (size_t i = 0; i < 65536; i++) {
+		if (i % 64 != 1)
+			bitset_clear(&bm, i);
+	}
+	bitset_info(&bm, &info);
+	fail_unless(info.pages == 1 && info.array_pages == 1);
+	fail_unless(bitset_cardinality(&bm) == 1024);
+	for (size_t i = 0; i < 65536; i++)
+		fail_unless(bitset_test(&bm, i) == (i % 64 == 1));
+
+	bitset_destroy(&bm);
+
+	footer();
+}
+
 int main(int argc, char *argv[])
 {
 	setbuf(stdout, NULL);
 	srand(time(NULL));
 	test_cardinality();
 	test_get_set();
+	test_page_types();
 
 	return 0;
 }
@@ -39,6 +39,61 @@ void test_resize(void)
 	footer();
 }
 
+static bool alloc_fail = false;
+
+static void *
+test_realloc(void *ptr, size_t size)
+{
+	if (alloc_fail && size > 0)
+		return NULL;
+	return realloc(ptr, size);
+}
+
+static
+void test_remove_oom(void)
+{
+	header();
+
+	struct bitset_index index;
+	fail_unless(bitset_index_create(&index, test_realloc) == 0);
+
+	/* Dense values are stored as a single run */
+	uint8_t key = 1;
+	for (size_t i = 0; i < NUMS_SIZE; i++)
+		fail_unless(bitset_index_insert(&index, &key, 1, i) == 0);
+
+	/* Split the run until the run page is full */
+	size_t i = 1000;
+	while (bitset_index_remove_value(&index, i) == 0) {
+		alloc_fail = true;
+		i += 1000;
+		if (bitset_index_remove_value(&index, i) != 0)
+			break;
+		alloc_fail = false;
+		i += 1000;
+	}
+	fail_unless(alloc_fail);
+
+	/* A failed remove doesn't change the index */
+	fail_unless(bitset_index_contains_value(&index, i));
+	fail_unless(bitset_index_size(&index) == NUMS_SIZE - i / 1000 + 1);
+	fail_unless(bitset_index_count(&index, 0) == NUMS_SIZE - i / 1000 + 1);
+
+	/* A value at the edge of a run is removed without memory */
+	fail_unless(bitset_index_remove_value(&index, i - 999) == 0);
+	fail_unless(!bitset_index_contains_value(&index, i - 999));
+
+	alloc_fail = false;
+	fail_unless(bitset_index_remove_value(&index, i) == 0);
+	fail_unless(!bitset_index_contains_value(&index, i));
+	fail_unless(bitset_index_size(&index) == NUMS_SIZE - i / 1000 - 1);
+	fail_unless(bitset_index_count(&index, 0) == NUMS_SIZE - i / 1000 - 1);
+
+	bitset_index_destroy(&index);
+
+	footer();
+}
+
 static
 void test_size_and_count(void)
 {
@@ -290,6 +345,7 @@ int main(void)
 	test_size_and_count();
 	test_resize();
 	test_insert_remove();
+	test_remove_oom();
 	test_empty_simple();
 	test_all_simple();
 	test_all_set_simple();
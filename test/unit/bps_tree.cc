@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include <time.h>
+#include <string.h>
 
 #include "unit.h"
 #include "sptree.h"
@@ -12,6 +13,9 @@
 #ifndef MAX
 #define MAX(a,b) (((a)>(b))?(a):(b))
 #endif //#ifndef MAX
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif //#ifndef MIN
 
 SPTREE_DEF(test, realloc, qsort_arg);
 
@@ -71,6 +75,110 @@ compare(type_t a, type_t b);
 #define bps_tree_arg_t int
 #include "salad/bps_tree.h"
 
+#undef BPS_TREE_NAME
+#undef BPS_TREE_BLOCK_SIZE
+#undef BPS_TREE_EXTENT_SIZE
+#undef BPS_TREE_COMPARE
+#undef BPS_TREE_COMPARE_KEY
+#undef bps_tree_elem_t
+#undef bps_tree_key_t
+#undef bps_tree_arg_t
+
+/* tree with subtree cardinalities for rank_check test */
+#define BPS_TREE_NAME rank
+#define BPS_TREE_BLOCK_SIZE 128 /* value is to low specially for tests */
+#define BPS_TREE_EXTENT_SIZE 2048 /* value is to low specially for tests */
+#define BPS_TREE_COMPARE(a, b, arg) compare(a, b)
+#define BPS_TREE_COMPARE_KEY(a, b, arg) compare(a, b)
+#define bps_tree_elem_t type_t
+#define bps_tree_key_t type_t
+#define bps_tree_arg_t int
+#define BPS_TREE_RANK
+#include "salad/bps_tree.h"
+#undef BPS_TREE_NAME
+#undef BPS_TREE_BLOCK_SIZE
+#undef BPS_TREE_EXTENT_SIZE
+#undef BPS_TREE_COMPARE
+#undef BPS_TREE_COMPARE_KEY
+#undef bps_tree_elem_t
+#undef bps_tree_key_t
+#undef bps_tree_arg_t
+#undef BPS_TREE_RANK
+
+/*
+ * Trees of pointers to records with string keys, like memtx
+ * TREE indexes of tuples: a plain one, which dereferences
+ * a record on each comparison, and a hinted one, which keeps
+ * the first 8 bytes of the key next to the pointer.
+ */
+struct record {
+	uint32_t len;
+	char data[28];
+};
+
+struct hinted_elem {
+	struct record *rec;
+	uint64_t hint;
+};
+
+static int
+record_compare(const struct record *a, const struct record *b)
+{
+	int r = memcmp(a->data, b->data, MIN(a->len, b->len));
+	if (r != 0)
+		return r;
+	return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static uint64_t
+record_hint(const struct record *rec)
+{
+	uint64_t hint = 0;
+	for (uint32_t i = 0; i < sizeof(hint); i++) {
+		hint <<= 8;
+		if (i < rec->len)
+			hint |= (unsigned char) rec->data[i];
+	}
+	return hint;
+}
+
+static inline int
+hinted_compare(struct hinted_elem a, struct hinted_elem b)
+{
+	if (a.hint != b.hint)
+		return a.hint < b.hint ? -1 : 1;
+	return record_compare(a.rec, b.rec);
+}
+
+#define BPS_TREE_NAME plain_tree
+#define BPS_TREE_BLOCK_SIZE 512
+#define BPS_TREE_EXTENT_SIZE 16*1024
+#define BPS_TREE_COMPARE(a, b, arg) record_compare(a, b)
+#define BPS_TREE_COMPARE_KEY(a, b, arg) record_compare(a, b)
+#define bps_tree_elem_t struct record *
+#define bps_tree_key_t struct record *
+#define bps_tree_arg_t int
+#include "salad/bps_tree.h"
+#undef BPS_TREE_NAME
+#undef BPS_TREE_BLOCK_SIZE
+#undef BPS_TREE_EXTENT_SIZE
+#undef BPS_TREE_COMPARE
+#undef BPS_TREE_COMPARE_KEY
+#undef bps_tree_elem_t
+#undef bps_tree_key_t
+#undef bps_tree_arg_t
+
+#define BPS_TREE_NAME hinted_tree
+#define BPS_TREE_BLOCK_SIZE 512
+#define BPS_TREE_EXTENT_SIZE 16*1024
+#define BPS_TREE_COMPARE(a, b, arg) hinted_compare(a, b)
+#define BPS_TREE_COMPARE_KEY(a, b, arg) hinted_compare(a, *(b))
+#define bps_tree_elem_t struct hinted_elem
+#define bps_tree_key_t struct hinted_elem *
+#define bps_tree_arg_t int
+#define BPS_TREE_NO_DEBUG
+#include "salad/bps_tree.h"
+
 static int
 node_comp(const void *p1, const void *p2, void* unused)
 {
@@ -756,9 +864,355 @@ approximate_count()
 	footer();
 }
 
+/*
+ * Check ranks of all the keys and elements of all the ranks
+ * against a plain bitmap of present values.
+ */
+static bool
+rank_check_tree(const rank *tree, const bool *present, type_t limit)
+{
+	size_t expected_rank = 0;
+	for (type_t v = 0; v < limit; v++) {
+		if (rank_lower_bound_rank(tree, v) != expected_rank)
+			return false;
+		if (present[v]) {
+			struct rank_iterator itr =
+				rank_iterator_at(tree, expected_rank);
+			type_t *elem = rank_iterator_get_elem(tree, &itr);
+			if (elem == NULL || *elem != v)
+				return false;
+			expected_rank++;
+		}
+		if (rank_upper_bound_rank(tree, v) != expected_rank)
+			return false;
+	}
+	if (expected_rank != rank_size(tree))
+		return false;
+	struct rank_iterator itr = rank_iterator_at(tree, expected_rank);
+	return rank_iterator_is_invalid(&itr);
+}
+
+static void
+rank_check()
+{
+	header();
+	srand(0);
+
+	const type_t limit = 1024;
+	bool present[limit];
+	memset(present, 0, sizeof(present));
+
+	rank tree;
+	rank_create(&tree, 0, extent_alloc, extent_free, &extents_count);
+
+	/* Sequential inserts and deletions */
+	for (type_t i = 0; i < limit * 4; i++) {
+		type_t v = i % limit;
+		if (i / limit == 2 || i / limit == 3)
+			v = limit - 1 - v;
+		if (i / limit == 0 || i / limit == 2) {
+			rank_insert(&tree, v, NULL);
+			present[v] = true;
+		} else {
+			rank_delete(&tree, v);
+			present[v] = false;
+		}
+		if (rank_debug_check(&tree))
+			fail("debug check nonzero", "true");
+		if (i % 16 == 0 && !rank_check_tree(&tree, present, limit))
+			fail("ranks are correct", "false");
+	}
+	/* Random inserts and deletions */
+	for (int i = 0; i < 100000; i++) {
+		type_t v = rand() % limit;
+		if (rand() % 2) {
+			rank_insert(&tree, v, NULL);
+			present[v] = true;
+		} else {
+			rank_delete(&tree, v);
+			present[v] = false;
+		}
+		if (rank_debug_check(&tree))
+			fail("debug check nonzero", "true");
+		if (i % 64 == 0 && !rank_check_tree(&tree, present, limit))
+			fail("ranks are correct", "false");
+	}
+	if (!rank_check_tree(&tree, present, limit))
+		fail("ranks are correct", "false");
+	if (tree.debug_insert_leaf_branches_mask !=
+	    tree.debug_insert_leaf_branches_max_mask)
+		fail("not all insert leaf branches was tested", "true");
+	if (tree.debug_insert_inner_branches_mask !=
+	    tree.debug_insert_inner_branches_max_mask)
+		fail("not all insert inner branches was tested", "true");
+	if (tree.debug_delete_leaf_branches_mask !=
+	    tree.debug_delete_leaf_branches_max_mask)
+		fail("not all delete leaf branches was tested", "true");
+	if (tree.debug_delete_inner_branches_mask !=
+	    tree.debug_delete_inner_branches_max_mask)
+		fail("not all delete inner branches was tested", "true");
+	rank_destroy(&tree);
+
+	/* Building from a sorted array */
+	type_t arr[limit];
+	for (type_t count = 0; count <= limit; count += 73) {
+		memset(present, 0, sizeof(present));
+		for (type_t i = 0; i < count; i++) {
+			arr[i] = i;
+			present[i] = true;
+		}
+		rank_create(&tree, 0, extent_alloc, extent_free,
+			    &extents_count);
+		if (rank_build(&tree, arr, count))
+			fail("building failed", "true");
+		if (rank_debug_check(&tree))
+			fail("debug check nonzero", "true");
+		if (!rank_check_tree(&tree, present, limit))
+			fail("ranks are correct", "false");
+		rank_destroy(&tree);
+	}
+
+	footer();
+}
+
+static void *
+record_extent_alloc(void *ctx)
+{
+	(void)ctx;
+	return malloc(16 * 1024);
+}
+
+static void
+record_extent_free(void *ctx, void *extent)
+{
+	(void)ctx;
+	free(extent);
+}
+
+/**
+ * Allocate @a count records with random keys. Records are
+ * allocated one by one, like tuples, so that neighbours in
+ * a tree are far from each other in memory.
+ */
+static struct record **
+records_new(uint32_t count)
+{
+	struct record **recs = (struct record **)
+		malloc(count * sizeof(*recs));
+	for (uint32_t i = 0; i < count; i++) {
+		recs[i] = (struct record *) malloc(sizeof(struct record));
+		/* Some keys share the first 8 bytes. */
+		uint32_t prefix = rand() % (count / 2 + 1);
+		recs[i]->len = snprintf(recs[i]->data, sizeof(recs[i]->data),
+					"%08x%08x", prefix, (unsigned) rand());
+	}
+	return recs;
+}
+
+static void
+records_delete(struct record **recs, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+		free(recs[i]);
+	free(recs);
+}
+
+static void
+find_many_check()
+{
+	header();
+	srand(0);
+
+	const uint32_t count = 1000;
+	type_t keys[count];
+	type_t *found[count];
+	test tree;
+	test_create(&tree, 0, extent_alloc, extent_free, &extents_count);
+
+	/* Empty tree */
+	for (uint32_t i = 0; i < count; i++)
+		keys[i] = i;
+	test_find_many(&tree, keys, count, found);
+	for (uint32_t i = 0; i < count; i++)
+		fail_unless(found[i] == NULL);
+
+	/* Even numbers, so that every other key is missing */
+	const type_t limit = 10000;
+	for (type_t v = 0; v < limit; v += 2) {
+		test_insert(&tree, v, NULL);
+		for (uint32_t i = 0; i < count; i++)
+			keys[i] = rand() % (limit + 10) - 5;
+		/* Check groups of all sizes, including partial ones */
+		uint32_t n = v % 100 == 0 ? count : rand() % 40;
+		test_find_many(&tree, keys, n, found);
+		for (uint32_t i = 0; i < n; i++)
+			fail_unless(found[i] == test_find(&tree, keys[i]));
+	}
+
+	test_destroy(&tree);
+
+	footer();
+}
+
+static void
+hinted_tree_check()
+{
+	header();
+	srand(0);
+
+	const uint32_t count = 10000;
+	struct record **recs = records_new(count);
+
+	plain_tree plain;
+	plain_tree_create(&plain, 0, record_extent_alloc, record_extent_free,
+			  NULL);
+	hinted_tree hinted;
+	hinted_tree_create(&hinted, 0, record_extent_alloc,
+			   record_extent_free, NULL);
+	for (uint32_t i = 0; i < count; i++) {
+		struct hinted_elem elem = { recs[i], record_hint(recs[i]) };
+		struct record *plain_dup = NULL;
+		struct hinted_elem hinted_dup = { NULL, 0 };
+		plain_tree_insert(&plain, recs[i], &plain_dup);
+		hinted_tree_insert(&hinted, elem, &hinted_dup);
+		fail_unless(plain_dup == hinted_dup.rec);
+	}
+	fail_unless(plain_tree_size(&plain) == hinted_tree_size(&hinted));
+
+	/* Both trees have the same order. */
+	struct plain_tree_iterator pit = plain_tree_iterator_first(&plain);
+	struct hinted_tree_iterator hit = hinted_tree_iterator_first(&hinted);
+	while (!plain_tree_iterator_is_invalid(&pit)) {
+		struct record **p = plain_tree_iterator_get_elem(&plain, &pit);
+		struct hinted_elem *h =
+			hinted_tree_iterator_get_elem(&hinted, &hit);
+		fail_unless(h != NULL && *p == h->rec);
+		plain_tree_iterator_next(&plain, &pit);
+		hinted_tree_iterator_next(&hinted, &hit);
+	}
+	fail_unless(hinted_tree_iterator_is_invalid(&hit));
+
+	/* Lookups of present and missing keys agree. */
+	for (uint32_t i = 0; i < count; i++) {
+		struct record key;
+		if (i % 2 == 0)
+			key = *recs[i];
+		else
+			key.len = snprintf(key.data, sizeof(key.data),
+					   "%08x", (unsigned) rand() % count);
+		struct hinted_elem hkey = { &key, record_hint(&key) };
+		struct record **p = plain_tree_find(&plain, &key);
+		struct hinted_elem *h = hinted_tree_find(&hinted, &hkey);
+		fail_unless((p == NULL) == (h == NULL));
+		fail_unless(p == NULL || *p == h->rec);
+		bool pexact, hexact;
+		pit = plain_tree_lower_bound(&plain, &key, &pexact);
+		hit = hinted_tree_lower_bound(&hinted, &hkey, &hexact);
+		fail_unless(pexact == hexact);
+		p = plain_tree_iterator_get_elem(&plain, &pit);
+		h = hinted_tree_iterator_get_elem(&hinted, &hit);
+		fail_unless((p == NULL) == (h == NULL));
+		fail_unless(p == NULL || *p == h->rec);
+	}
+
+	plain_tree_destroy(&plain);
+	hinted_tree_destroy(&hinted);
+	records_delete(recs, count);
+
+	footer();
+}
+
+static double
+bench_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Lookups per second in the plain and hinted trees of
+ * @a count records. Not a part of the test, as the output
+ * depends on the machine: run as `bps_tree.test --bench [count]`.
+ */
+static void
+hinted_tree_bench(uint32_t count)
+{
+	srand(0);
+	struct record **recs = records_new(count);
+	const uint32_t n_lookups = 1000000;
+	uint32_t *order = (uint32_t *) malloc(n_lookups * sizeof(*order));
+	for (uint32_t i = 0; i < n_lookups; i++)
+		order[i] = rand() % count;
+
+	plain_tree plain;
+	plain_tree_create(&plain, 0, record_extent_alloc, record_extent_free,
+			  NULL);
+	hinted_tree hinted;
+	hinted_tree_create(&hinted, 0, record_extent_alloc,
+			   record_extent_free, NULL);
+	for (uint32_t i = 0; i < count; i++) {
+		struct hinted_elem elem = { recs[i], record_hint(recs[i]) };
+		plain_tree_insert(&plain, recs[i], NULL);
+		hinted_tree_insert(&hinted, elem, NULL);
+	}
+
+	uint32_t found = 0;
+	double start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++)
+		found += plain_tree_find(&plain, recs[order[i]]) != NULL;
+	double plain_time = bench_time() - start;
+
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++) {
+		struct record *rec = recs[order[i]];
+		struct hinted_elem key = { rec, record_hint(rec) };
+		found += hinted_tree_find(&hinted, &key) != NULL;
+	}
+	double hinted_time = bench_time() - start;
+
+	printf("records: %u, lookups: %u, found: %u\n",
+	       count, n_lookups, found);
+	printf("plain:  %.0f lookups/s\n", n_lookups / plain_time);
+	printf("hinted: %.0f lookups/s\n", n_lookups / hinted_time);
+
+	/* Hinted lookups in batches, as done by index:get_many(). */
+	const uint32_t batch = 256;
+	struct hinted_elem keys[batch];
+	struct hinted_elem *key_ptrs[batch];
+	struct hinted_elem *res[batch];
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i += batch) {
+		uint32_t n = MIN(batch, n_lookups - i);
+		for (uint32_t k = 0; k < n; k++) {
+			struct record *rec = recs[order[i + k]];
+			keys[k].rec = rec;
+			keys[k].hint = record_hint(rec);
+			key_ptrs[k] = &keys[k];
+		}
+		hinted_tree_find_many(&hinted, key_ptrs, n, res);
+		for (uint32_t k = 0; k < n; k++)
+			found += res[k] != NULL;
+	}
+	double batch_time = bench_time() - start;
+	printf("hinted, batches of %u: %.0f lookups/s\n",
+	       batch, n_lookups / batch_time);
+
+	plain_tree_destroy(&plain);
+	hinted_tree_destroy(&hinted);
+	free(order);
+	records_delete(recs, count);
+}
+
 int
-main(void)
+main(int argc, char **argv)
 {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		uint32_t count = argc > 2 ? atoi(argv[2]) : 1000000;
+		hinted_tree_bench(count);
+		return 0;
+	}
+
 	simple_check();
 	compare_with_sptree_check();
 	compare_with_sptree_check_branches();
@@ -767,6 +1221,9 @@ main(void)
 	printing_test();
 	white_box_test();
 	approximate_count();
+	rank_check();
+	find_many_check();
+	hinted_tree_check();
 	if (extents_count != 0)
 		fail("memory leak!", "true");
 }
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <third_party/crc32.h>
+#include "crc32.h"
+#include "cpu_feature.h"
+#include "unit.h"
+
+enum { BUF_SIZE = 3 * 8192 * 4 + 1000 };
+
+static char buf[BUF_SIZE + 8];
+
+static void
+fill_buf(void)
+{
+	srand(1);
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = rand();
+}
+
+/** All available implementations must agree with the software one. */
+static void
+test_implementations(void)
+{
+	header();
+
+	crc32_func funcs[3];
+	int count = 0;
+#if defined (__x86_64__) || defined (__i386__)
+	if (sse42_enabled_cpu())
+		funcs[count++] = crc32c_hw;
+#endif
+#if defined(HAVE_CRC32C_PCLMUL)
+	if (crc32c_hw_3way_enabled_cpu())
+		funcs[count++] = crc32c_hw_3way;
+#endif
+	funcs[count++] = crc32_calc;
+
+	unsigned int lens[] = { 0, 1, 7, 8, 9, 255, 256, 767, 768, 769,
+				3 * 8192 - 1, 3 * 8192, 3 * 8192 + 13,
+				BUF_SIZE };
+	for (size_t l = 0; l < lengthof(lens); l++) {
+		for (int align = 0; align < 8; align++) {
+			const char *data = buf + align;
+			uint32_t expected = crc32c(0x12345678, data, lens[l]);
+			for (int f = 0; f < count; f++) {
+				uint32_t crc = funcs[f](0x12345678, data,
+							lens[l]);
+				fail_unless(crc == expected);
+			}
+		}
+	}
+
+	footer();
+}
+
+/** A checksum of an iovec array equals one of the joint buffer. */
+static void
+test_iov(void)
+{
+	header();
+
+	struct iovec iov[4];
+	size_t sizes[] = { 100, 5000, 30000, 7 };
+	char *pos = buf;
+	size_t total = 0;
+	for (int i = 0; i < 4; i++) {
+		iov[i].iov_base = pos;
+		iov[i].iov_len = sizes[i];
+		pos += sizes[i];
+		total += sizes[i];
+	}
+	fail_unless(crc32_calc_iov(0, iov, 4, 10) ==
+		    crc32c(0, buf + 10, total - 10));
+	fail_unless(crc32_calc_iov(0, iov, 0, 0) == 0);
+
+	footer();
+}
+
+static void
+bench_one(const char *name, crc32_func f)
+{
+	enum { ITERATIONS = 20000 };
+	struct timespec start, end;
+	uint32_t crc = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < ITERATIONS; i++)
+		crc = f(crc, buf, BUF_SIZE);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double sec = (end.tv_sec - start.tv_sec) +
+		     (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-16s %8.2f GB/s (crc %08x)\n", name,
+	       (double) ITERATIONS * BUF_SIZE / sec / 1e9, crc);
+}
+
+/** Run with --bench to compare the implementations. */
+static void
+bench(void)
+{
+	bench_one("crc32c", crc32c);
+#if defined (__x86_64__) || defined (__i386__)
+	if (sse42_enabled_cpu())
+		bench_one("crc32c_hw", crc32c_hw);
+#endif
+#if defined(HAVE_CRC32C_PCLMUL)
+	if (crc32c_hw_3way_enabled_cpu())
+		bench_one("crc32c_hw_3way", crc32c_hw_3way);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+	crc32_init();
+	fill_buf();
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench();
+		return 0;
+	}
+	test_implementations();
+	test_iov();
+	return 0;
+}
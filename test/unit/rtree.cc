@@ -260,12 +260,129 @@ neighbor_test()
 	footer();
 }
 
+static bool
+rect_overlaps(const struct rtree_rect *a, const struct rtree_rect *b,
+	      unsigned dimension)
+{
+	for (unsigned d = 0; d < dimension; d++) {
+		if (a->coords[2 * d] > b->coords[2 * d + 1] ||
+		    a->coords[2 * d + 1] < b->coords[2 * d])
+			return false;
+	}
+	return true;
+}
+
+static void
+bulk_load_check(unsigned dimension, size_t count, bool preinsert)
+{
+	printf("Bulk load %zu records in %u dimensions%s\n", count, dimension,
+	       preinsert ? " into non-empty tree" : "");
+
+	struct rtree_rect *arr = (struct rtree_rect *)
+		malloc((count + 1) * sizeof(*arr));
+	for (size_t i = 0; i <= count; i++) {
+		for (unsigned d = 0; d < dimension; d++) {
+			coord_t c = rand() % 1000;
+			arr[i].coords[2 * d] = c;
+			arr[i].coords[2 * d + 1] = c + rand() % 10;
+		}
+	}
+
+	struct rtree tree;
+	rtree_init(&tree, dimension, extent_size,
+		   extent_alloc, extent_free, &page_count,
+		   RTREE_EUCLID);
+	if (preinsert)
+		rtree_insert(&tree, &arr[0], (record_t)1);
+	if (rtree_bulk_reserve(&tree, count / 2) != 0)
+		fail("reserve", "false");
+	for (size_t i = preinsert ? 2 : 1; i <= count; i++) {
+		if (rtree_bulk_add(&tree, &arr[i - 1], (record_t)i) != 0)
+			fail("bulk add", "false");
+	}
+	rtree_bulk_load(&tree);
+	if (rtree_number_of_records(&tree) != count)
+		fail("Tree count mismatch", "true");
+
+	struct rtree_iterator iterator;
+	rtree_iterator_init(&iterator);
+
+	/* Every record is found once */
+	char *seen = (char *)calloc(count + 1, 1);
+	struct rtree_rect rect;
+	rtree_search(&tree, &rect, SOP_ALL, &iterator);
+	record_t rec;
+	size_t found = 0;
+	while ((rec = rtree_iterator_next(&iterator)) != NULL) {
+		size_t i = (size_t)rec;
+		if (i == 0 || i > count || seen[i])
+			fail("record is found once", "false");
+		seen[i] = 1;
+		found++;
+	}
+	if (found != count)
+		fail("all records are found", "false");
+
+	/* Overlaps match a full scan */
+	for (int q = 0; q < 100; q++) {
+		for (unsigned d = 0; d < dimension; d++) {
+			coord_t c = rand() % 1000;
+			rect.coords[2 * d] = c;
+			rect.coords[2 * d + 1] = c + rand() % 100;
+		}
+		size_t expected = 0;
+		for (size_t i = 1; i <= count; i++)
+			expected += rect_overlaps(&arr[i - 1], &rect,
+						  dimension);
+		found = 0;
+		if (rtree_search(&tree, &rect, SOP_OVERLAPS, &iterator)) {
+			while ((rec = rtree_iterator_next(&iterator)) != NULL) {
+				if (!rect_overlaps(&arr[(size_t)rec - 1],
+						   &rect, dimension))
+					fail("overlapping record", "false");
+				found++;
+			}
+		}
+		if (found != expected)
+			fail("overlaps count mismatch", "true");
+	}
+
+	/* The tree stays valid for removals */
+	for (size_t i = 1; i <= count; i++) {
+		if (!rtree_remove(&tree, &arr[i - 1], (record_t)i))
+			fail("delete element in tree", "false");
+	}
+	if (rtree_number_of_records(&tree) != 0)
+		fail("Tree count mismatch", "true");
+
+	free(seen);
+	free(arr);
+	rtree_iterator_destroy(&iterator);
+	rtree_destroy(&tree);
+}
+
+static void
+bulk_load_test()
+{
+	header();
+
+	bulk_load_check(2, 0, false);
+	bulk_load_check(2, 1, false);
+	bulk_load_check(2, 100, false);
+	bulk_load_check(2, 20000, false);
+	bulk_load_check(3, 20000, false);
+	bulk_load_check(8, 5000, false);
+	bulk_load_check(2, 1000, true);
+
+	footer();
+}
 
 int
 main(void)
 {
 	simple_check();
 	neighbor_test();
+	bulk_load_test();
 	if (page_count != 0) {
 		fail("memory leak!", "true");
 	}
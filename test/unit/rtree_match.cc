@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+
+#include "unit.h"
+#include "salad/rtree.h"
+
+/*
+ * Check the page matchers and the neighbor distances against
+ * per-record predicates on NaN, infinite, signed zero and
+ * touching coordinates.
+ */
+
+static int extent_count = 0;
+
+const uint32_t extent_size = 1024 * 8;
+
+static void *
+extent_alloc(void *ctx)
+{
+	int *p_extent_count = (int *)ctx;
+	assert(p_extent_count == &extent_count);
+	++*p_extent_count;
+	return malloc(extent_size);
+}
+
+static void
+extent_free(void *ctx, void *page)
+{
+	int *p_extent_count = (int *)ctx;
+	assert(p_extent_count == &extent_count);
+	--*p_extent_count;
+	free(page);
+}
+
+enum { DIMENSION = 2, MAX_RECORDS = 20000 };
+
+static const coord_t values[] = {
+	-INFINITY, -DBL_MAX, -1, -0.0, 0, 1, 2, DBL_MAX, INFINITY, NAN
+};
+enum { VALUE_COUNT = sizeof(values) / sizeof(values[0]) };
+
+static const enum spatial_search_op ops[] = {
+	SOP_ALL, SOP_EQUALS, SOP_CONTAINS, SOP_STRICT_CONTAINS,
+	SOP_OVERLAPS, SOP_BELONGS, SOP_STRICT_BELONGS
+};
+static const char *op_names[] = {
+	"all", "equals", "contains", "strict_contains",
+	"overlaps", "belongs", "strict_belongs"
+};
+enum { OP_COUNT = sizeof(ops) / sizeof(ops[0]) };
+
+static struct rtree_rect records[MAX_RECORDS];
+
+/** Does record @a r match query @a q, checked per record. */
+static bool
+record_match(enum spatial_search_op op, const struct rtree_rect *q,
+	     const struct rtree_rect *r)
+{
+	for (unsigned k = 0; k < DIMENSION * 2; k += 2) {
+		const coord_t *qc = &q->coords[k];
+		const coord_t *rc = &r->coords[k];
+		switch (op) {
+		case SOP_ALL:
+			break;
+		case SOP_EQUALS:
+			if (rc[0] != qc[0] || rc[1] != qc[1])
+				return false;
+			break;
+		case SOP_CONTAINS:
+			if (qc[0] < rc[0] || qc[1] > rc[1])
+				return false;
+			break;
+		case SOP_STRICT_CONTAINS:
+			if (qc[0] <= rc[0] || qc[1] >= rc[1])
+				return false;
+			break;
+		case SOP_OVERLAPS:
+			if (qc[0] > rc[1] || qc[1] < rc[0])
+				return false;
+			break;
+		case SOP_BELONGS:
+			if (rc[0] < qc[0] || rc[1] > qc[1])
+				return false;
+			break;
+		case SOP_STRICT_BELONGS:
+			if (rc[0] <= qc[0] || rc[1] >= qc[1])
+				return false;
+			break;
+		default:
+			assert(false);
+		}
+	}
+	return true;
+}
+
+/** Distance from the low corner of @a q to @a r, checked per record. */
+static sq_coord_t
+record_distance(enum rtree_distance_type type, const struct rtree_rect *q,
+		const struct rtree_rect *r)
+{
+	sq_coord_t result = 0;
+	for (unsigned k = 0; k < DIMENSION * 2; k += 2) {
+		coord_t x = q->coords[k];
+		sq_coord_t diff = 0;
+		if (x < r->coords[k])
+			diff = r->coords[k] - x;
+		else if (x > r->coords[k + 1])
+			diff = x - r->coords[k + 1];
+		result += type == RTREE_EUCLID ? diff * diff : diff;
+	}
+	return result;
+}
+
+/** Search @a q in @a tree, check the result, return its size. */
+static size_t
+check_search(struct rtree *tree, size_t count, enum spatial_search_op op,
+	     const struct rtree_rect *q)
+{
+	static bool found[MAX_RECORDS];
+	for (size_t i = 0; i < count; i++)
+		found[i] = false;
+
+	struct rtree_iterator iterator;
+	rtree_iterator_init(&iterator);
+	size_t result = 0;
+	if (rtree_search(tree, q, op, &iterator)) {
+		record_t rec;
+		while ((rec = rtree_iterator_next(&iterator)) != NULL) {
+			size_t i = (uintptr_t)rec - 1;
+			if (i >= count || found[i])
+				fail("a record is found once", "false");
+			found[i] = true;
+			result++;
+		}
+	}
+	rtree_iterator_destroy(&iterator);
+
+	for (size_t i = 0; i < count; i++) {
+		if (found[i] != record_match(op, q, &records[i])) {
+			printf("%s [%g %g %g %g] record %zu [%g %g %g %g]\n",
+			       op_names[op], q->coords[0], q->coords[1],
+			       q->coords[2], q->coords[3], i,
+			       records[i].coords[0], records[i].coords[1],
+			       records[i].coords[2], records[i].coords[3]);
+			fail("search matches records", "false");
+		}
+	}
+	return result;
+}
+
+/** Search all queries made of @a values and print totals per op. */
+static void
+check_all_queries(struct rtree *tree, size_t count)
+{
+	size_t total[OP_COUNT] = {0};
+	struct rtree_rect q;
+	for (unsigned a = 0; a < VALUE_COUNT; a++)
+	for (unsigned b = 0; b < VALUE_COUNT; b++)
+	for (unsigned c = 0; c < VALUE_COUNT; c++)
+	for (unsigned d = 0; d < VALUE_COUNT; d++) {
+		q.coords[0] = values[a];
+		q.coords[1] = values[b];
+		q.coords[2] = values[c];
+		q.coords[3] = values[d];
+		for (unsigned op = 0; op < OP_COUNT; op++)
+			total[op] += check_search(tree, count, ops[op], &q);
+	}
+	for (unsigned op = 0; op < OP_COUNT; op++)
+		printf("%s: %zu\n", op_names[op], total[op]);
+}
+
+/** Check that neighbors come in order of distance. */
+static void
+check_neighbors(struct rtree *tree, size_t count,
+		enum rtree_distance_type type)
+{
+	struct rtree_rect q;
+	for (unsigned a = 0; a < VALUE_COUNT; a++)
+	for (unsigned b = 0; b < VALUE_COUNT; b++) {
+		/* Infinite points are infinitely far from each other. */
+		if (isinf(values[a]) || isinf(values[b]))
+			continue;
+		rtree_set2dp(&q, values[a], values[b]);
+		struct rtree_iterator iterator;
+		rtree_iterator_init(&iterator);
+		size_t result = 0;
+		sq_coord_t prev = 0;
+		if (rtree_search(tree, &q, SOP_NEIGHBOR, &iterator)) {
+			record_t rec;
+			while ((rec = rtree_iterator_next(&iterator)) != NULL) {
+				size_t i = (uintptr_t)rec - 1;
+				sq_coord_t distance =
+					record_distance(type, &q, &records[i]);
+				if (distance < prev)
+					fail("neighbors are ordered", "false");
+				prev = distance;
+				result++;
+			}
+		}
+		rtree_iterator_destroy(&iterator);
+		if (result != count)
+			fail("all neighbors are found", "false");
+	}
+}
+
+static unsigned
+next_value(unsigned *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) % VALUE_COUNT;
+}
+
+/**
+ * Records of one leaf page, with NaN coordinates too. Vector
+ * and scalar matchers must give the same as per-record checks.
+ */
+static void
+leaf_page_check(unsigned count)
+{
+	header();
+
+	struct rtree tree;
+	rtree_init(&tree, DIMENSION, extent_size,
+		   extent_alloc, extent_free, &extent_count,
+		   RTREE_EUCLID);
+	if (count > tree.page_max_fill)
+		count = tree.page_max_fill;
+
+	unsigned seed = count;
+	for (unsigned i = 0; i < count; i++) {
+		for (unsigned k = 0; k < DIMENSION * 2; k += 2) {
+			coord_t lo = values[next_value(&seed)];
+			coord_t hi = values[next_value(&seed)];
+			/* Keep NaN as is, order the others. */
+			records[i].coords[k] = lo < hi ? lo : hi;
+			records[i].coords[k + 1] = lo < hi ? hi : lo;
+		}
+		rtree_insert(&tree, &records[i],
+			     (record_t)(uintptr_t)(i + 1));
+	}
+	if (tree.height != 1)
+		fail("records fit one page", "false");
+
+	check_all_queries(&tree, count);
+
+	rtree_destroy(&tree);
+
+	footer();
+}
+
+/*
+ * Coordinates of records in a tree of many pages. Choosing
+ * a subtree for a new record computes areas, which must stay
+ * finite.
+ */
+static const coord_t tree_values[] = {
+	-1e150, -1, -0.0, 0, 1, 2, 1e150
+};
+enum {
+	TREE_VALUE_COUNT = sizeof(tree_values) / sizeof(tree_values[0])
+};
+
+/**
+ * Records of many pages, touching each other and the queries,
+ * with signed zero coordinates. Interior pages must not skip
+ * any matching records.
+ */
+static void
+tree_check(enum rtree_distance_type type)
+{
+	header();
+
+	struct rtree tree;
+	rtree_init(&tree, DIMENSION, extent_size,
+		   extent_alloc, extent_free, &extent_count, type);
+
+	unsigned count = 0;
+	for (unsigned a = 0; a < TREE_VALUE_COUNT; a++)
+	for (unsigned b = a; b < TREE_VALUE_COUNT; b++)
+	for (unsigned c = 0; c < TREE_VALUE_COUNT; c++)
+	for (unsigned d = c; d < TREE_VALUE_COUNT; d++) {
+		for (unsigned copy = 0; copy < 4; copy++) {
+			rtree_set2d(&records[count], tree_values[a],
+				    tree_values[c], tree_values[b],
+				    tree_values[d]);
+			rtree_insert(&tree, &records[count],
+				     (record_t)(uintptr_t)(count + 1));
+			count++;
+		}
+	}
+	printf("Test tree size: %u, height: %u\n",
+	       (unsigned)rtree_number_of_records(&tree), tree.height);
+
+	check_all_queries(&tree, count);
+	check_neighbors(&tree, count, type);
+
+	rtree_destroy(&tree);
+
+	footer();
+}
+
+int
+main(void)
+{
+	leaf_page_check(7);
+	leaf_page_check(MAX_RECORDS);
+	tree_check(RTREE_EUCLID);
+	tree_check(RTREE_MANHATTAN);
+	if (extent_count != 0) {
+		fail("memory leak!", "false");
+	}
+}
@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vector>
+#include <time.h>
+
+#include "unit.h"
+
+typedef uint64_t hash_value_t;
+typedef uint32_t hash_t;
+
+static const size_t swiss_extent_size = 16 * 1024;
+static size_t extents_count = 0;
+static bool extents_exhausted = false;
+
+hash_t
+hash(hash_value_t value)
+{
+	return (hash_t) value;
+}
+
+bool
+equal(hash_value_t v1, hash_value_t v2)
+{
+	return v1 == v2;
+}
+
+bool
+equal_key(hash_value_t v1, hash_value_t v2)
+{
+	return v1 == v2;
+}
+
+#define SWISS_NAME
+#define SWISS_DATA_TYPE uint64_t
+#define SWISS_KEY_TYPE uint64_t
+#define SWISS_CMP_ARG_TYPE int
+#define SWISS_EQUAL(a, b, arg) equal(a, b)
+#define SWISS_EQUAL_KEY(a, b, arg) equal_key(a, b)
+#include "salad/swiss.h"
+
+/* The light hash table, to compare with in the benchmark. */
+#define LIGHT_NAME
+#define LIGHT_DATA_TYPE uint64_t
+#define LIGHT_KEY_TYPE uint64_t
+#define LIGHT_CMP_ARG_TYPE int
+#define LIGHT_EQUAL(a, b, arg) equal(a, b)
+#define LIGHT_EQUAL_KEY(a, b, arg) equal_key(a, b)
+#include "salad/light.h"
+
+inline void *
+my_swiss_alloc(void *ctx)
+{
+	size_t *p_extents_count = (size_t *)ctx;
+	assert(p_extents_count == &extents_count);
+	if (extents_exhausted)
+		return NULL;
+	++*p_extents_count;
+	return malloc(swiss_extent_size);
+}
+
+inline void
+my_swiss_free(void *ctx, void *p)
+{
+	size_t *p_extents_count = (size_t *)ctx;
+	assert(p_extents_count == &extents_count);
+	--*p_extents_count;
+	free(p);
+}
+
+/**
+ * Insert or delete random values and compare the table with
+ * a bitmap. @a hash_mod makes many values share a hash.
+ */
+static void
+random_ops(size_t rounds, hash_t hash_mul, hash_t hash_mod)
+{
+	struct swiss_core ht;
+	swiss_create(&ht, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+	std::vector<bool> vect;
+	size_t count = 0;
+	const size_t start_limits = 20;
+	for(size_t limits = start_limits; limits <= 2 * rounds; limits *= 10) {
+		while (vect.size() < limits)
+			vect.push_back(false);
+		for (size_t i = 0; i < rounds; i++) {
+
+			hash_value_t val = rand() % limits;
+			hash_t h = hash(val) % hash_mod * hash_mul;
+			hash_t fnd = swiss_find(&ht, h, val);
+			bool has1 = fnd != swiss_end;
+			bool has2 = vect[val];
+			assert(has1 == has2);
+			if (has1 != has2) {
+				fail("find key failed!", "true");
+				return;
+			}
+
+			if (!has1) {
+				count++;
+				vect[val] = true;
+				swiss_insert(&ht, h, val);
+			} else {
+				count--;
+				vect[val] = false;
+				swiss_delete(&ht, fnd);
+			}
+
+			if (count != ht.count)
+				fail("count check failed!", "true");
+
+			bool identical = true;
+			for (hash_value_t test = 0; test < limits; test++) {
+				hash_t th = hash(test) % hash_mod * hash_mul;
+				if (vect[test]) {
+					if (swiss_find(&ht, th, test) == swiss_end)
+						identical = false;
+				} else {
+					if (swiss_find(&ht, th, test) != swiss_end)
+						identical = false;
+				}
+			}
+			if (!identical)
+				fail("internal test failed!", "true");
+
+			int check = swiss_selfcheck(&ht);
+			if (check)
+				fail("internal test failed!", "true");
+		}
+	}
+	swiss_destroy(&ht);
+}
+
+static void
+simple_test()
+{
+	header();
+
+	random_ops(1000, 1, UINT32_MAX);
+
+	footer();
+}
+
+static void
+collision_test()
+{
+	header();
+
+	/* Same home group. */
+	random_ops(100, 1024, UINT32_MAX);
+	/* Same fingerprint and same hash. */
+	random_ops(100, 1, 7);
+
+	footer();
+}
+
+static void
+iterator_test()
+{
+	header();
+
+	struct swiss_core ht;
+	swiss_create(&ht, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+	const size_t rounds = 1000;
+	const size_t start_limits = 20;
+
+	const size_t iterator_count = 16;
+	struct swiss_iterator iterators[iterator_count];
+	for (size_t i = 0; i < iterator_count; i++)
+		swiss_iterator_begin(&ht, iterators + i);
+	size_t cur_iterator = 0;
+	hash_value_t strage_thing = 0;
+
+	for(size_t limits = start_limits; limits <= 2 * rounds; limits *= 10) {
+		for (size_t i = 0; i < rounds; i++) {
+			hash_value_t val = rand() % limits;
+			hash_t h = hash(val);
+			hash_t fnd = swiss_find(&ht, h, val);
+
+			if (fnd == swiss_end) {
+				swiss_insert(&ht, h, val);
+			} else {
+				swiss_delete(&ht, fnd);
+			}
+
+			hash_value_t *pval = swiss_iterator_get_and_next(&ht, iterators + cur_iterator);
+			if (pval)
+				strage_thing ^= *pval;
+			if (!pval || (rand() % iterator_count) == 0) {
+				if (rand() % iterator_count) {
+					hash_value_t val = rand() % limits;
+					hash_t h = hash(val);
+					swiss_iterator_key(&ht, iterators + cur_iterator, h, val);
+				} else {
+					swiss_iterator_begin(&ht, iterators + cur_iterator);
+				}
+			}
+
+			cur_iterator++;
+			if (cur_iterator >= iterator_count)
+				cur_iterator = 0;
+		}
+	}
+	swiss_destroy(&ht);
+
+	if (strage_thing >> 20) {
+		printf("impossible!\n"); // prevent strage_thing to be optimized out
+	}
+
+	footer();
+}
+
+static void
+iterator_freeze_check()
+{
+	header();
+
+	const int test_data_size = 1000;
+	hash_value_t comp_buf[test_data_size];
+	const int test_data_mod = 2000;
+	srand(0);
+	struct swiss_core ht;
+
+	for (int i = 0; i < 10; i++) {
+		swiss_create(&ht, swiss_extent_size,
+			     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+		int comp_buf_size = 0;
+		for (int j = 0; j < test_data_size; j++) {
+			hash_value_t val = rand() % test_data_mod;
+			hash_t h = hash(val);
+			swiss_insert(&ht, h, val);
+		}
+		struct swiss_iterator iterator;
+		swiss_iterator_begin(&ht, &iterator);
+		hash_value_t *e;
+		while ((e = swiss_iterator_get_and_next(&ht, &iterator))) {
+			comp_buf[comp_buf_size++] = *e;
+		}
+		struct swiss_iterator iterator1;
+		swiss_iterator_begin(&ht, &iterator1);
+		swiss_iterator_freeze(&ht, &iterator1);
+		struct swiss_iterator iterator2;
+		swiss_iterator_begin(&ht, &iterator2);
+		swiss_iterator_freeze(&ht, &iterator2);
+		/* Enough to make the table grow and rehash. */
+		for (int j = 0; j < test_data_size * 2; j++) {
+			hash_value_t val = rand() % (test_data_mod * 2);
+			hash_t h = hash(val);
+			swiss_insert(&ht, h, val);
+		}
+		int tested_count = 0;
+		while ((e = swiss_iterator_get_and_next(&ht, &iterator1))) {
+			if (*e != comp_buf[tested_count]) {
+				fail("version restore failed (1)", "true");
+			}
+			tested_count++;
+			if (tested_count > comp_buf_size) {
+				fail("version restore failed (2)", "true");
+			}
+		}
+		if (tested_count != comp_buf_size)
+			fail("version restore failed (3)", "true");
+		swiss_iterator_destroy(&ht, &iterator1);
+		for (int j = 0; j < test_data_size; j++) {
+			hash_value_t val = rand() % test_data_mod;
+			hash_t h = hash(val);
+			hash_t pos = swiss_find(&ht, h, val);
+			if (pos != swiss_end)
+				swiss_delete(&ht, pos);
+		}
+
+		tested_count = 0;
+		while ((e = swiss_iterator_get_and_next(&ht, &iterator2))) {
+			if (*e != comp_buf[tested_count]) {
+				fail("version restore failed (4)", "true");
+			}
+			tested_count++;
+			if (tested_count > comp_buf_size) {
+				fail("version restore failed (5)", "true");
+			}
+		}
+		if (tested_count != comp_buf_size)
+			fail("version restore failed (6)", "true");
+		if (swiss_selfcheck(&ht))
+			fail("internal test failed!", "true");
+
+		swiss_destroy(&ht);
+	}
+
+	footer();
+}
+
+static void
+reserve_test()
+{
+	header();
+
+	struct swiss_core ht;
+	swiss_create(&ht, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+	const uint32_t count = 10000;
+	if (swiss_reserve(&ht, count) != 0)
+		fail("reserve failed", "true");
+	uint32_t table_size = ht.table_size;
+	for (uint32_t i = 0; i < count; i++)
+		swiss_insert(&ht, hash(i), i);
+	if (ht.table_size != table_size)
+		fail("table grew after reserve", "true");
+	/* Reserving less than is stored must not shrink the table. */
+	if (swiss_reserve(&ht, 10) != 0 || ht.table_size != table_size)
+		fail("reserve shrank the table", "true");
+	for (uint32_t i = 0; i < count; i++)
+		if (swiss_find(&ht, hash(i), i) == swiss_end)
+			fail("value lost", "true");
+	if (swiss_selfcheck(&ht))
+		fail("internal test failed!", "true");
+	swiss_destroy(&ht);
+
+	footer();
+}
+
+static void
+overload_test()
+{
+	header();
+
+	struct swiss_core ht;
+	swiss_create(&ht, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+	hash_value_t val = 0;
+	for (; val < 1000; val++)
+		swiss_insert(&ht, hash(val), val);
+	uint32_t table_size = ht.table_size;
+	/* The table can't grow, but the free slots are still used. */
+	extents_exhausted = true;
+	while (swiss_insert(&ht, hash(val), val) != swiss_end)
+		val++;
+	extents_exhausted = false;
+	if (ht.table_size != table_size || ht.count != table_size)
+		fail("free slots are not used", "true");
+	for (hash_value_t test = 0; test < val; test++)
+		if (swiss_find(&ht, hash(test), test) == swiss_end)
+			fail("value lost", "true");
+	if (swiss_find(&ht, hash(val), val) != swiss_end)
+		fail("value found in a full table", "true");
+	if (swiss_selfcheck(&ht))
+		fail("internal test failed!", "true");
+	/* Deleted and inserted back without any allocations. */
+	extents_exhausted = true;
+	for (hash_value_t test = 0; test < val; test += 3) {
+		swiss_delete_value(&ht, hash(test), test);
+		if (swiss_insert(&ht, hash(test), test) == swiss_end)
+			fail("reinsert failed", "true");
+	}
+	extents_exhausted = false;
+	/* Grows on the next insert. */
+	if (swiss_insert(&ht, hash(val), val) == swiss_end ||
+	    ht.table_size != table_size * 2)
+		fail("table did not grow", "true");
+	if (swiss_selfcheck(&ht))
+		fail("internal test failed!", "true");
+	swiss_destroy(&ht);
+
+	footer();
+}
+
+static double
+bench_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** A hash with well mixed bits, like the tuple hashes are. */
+static hash_t
+bench_hash(hash_value_t value)
+{
+	return (hash_t)((value * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**
+ * Inserts and hit and miss lookups per second in light and
+ * swiss tables of @a count values. Not a part of the test, as
+ * the output depends on the machine: run as
+ * `swiss.test --bench [count]`.
+ */
+static void
+swiss_bench(uint32_t count)
+{
+	srand(0);
+	const uint32_t n_lookups = 1000000;
+	uint64_t *order = (uint64_t *) malloc(n_lookups * sizeof(*order));
+	for (uint32_t i = 0; i < n_lookups; i++)
+		order[i] = rand() % count;
+
+	struct light_core lt;
+	light_create(&lt, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+	struct swiss_core st;
+	swiss_create(&st, swiss_extent_size,
+		     my_swiss_alloc, my_swiss_free, &extents_count, 0);
+
+	double start = bench_time();
+	for (uint32_t i = 0; i < count; i++)
+		light_insert(&lt, bench_hash(i), i);
+	double light_insert_time = bench_time() - start;
+	start = bench_time();
+	for (uint32_t i = 0; i < count; i++)
+		swiss_insert(&st, bench_hash(i), i);
+	double swiss_insert_time = bench_time() - start;
+
+	uint32_t found = 0;
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++)
+		found += light_find_key(&lt, bench_hash(order[i]),
+					order[i]) != light_end;
+	double light_hit_time = bench_time() - start;
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++)
+		found += swiss_find_key(&st, bench_hash(order[i]),
+					order[i]) != swiss_end;
+	double swiss_hit_time = bench_time() - start;
+
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++)
+		found += light_find_key(&lt, bench_hash(order[i] + count),
+					order[i] + count) != light_end;
+	double light_miss_time = bench_time() - start;
+	start = bench_time();
+	for (uint32_t i = 0; i < n_lookups; i++)
+		found += swiss_find_key(&st, bench_hash(order[i] + count),
+					order[i] + count) != swiss_end;
+	double swiss_miss_time = bench_time() - start;
+
+	printf("values: %u, lookups: %u, found: %u\n",
+	       count, n_lookups, found);
+	printf("light: %.0f inserts/s, %.0f hits/s, %.0f misses/s, "
+	       "%u extents\n", count / light_insert_time,
+	       n_lookups / light_hit_time, n_lookups / light_miss_time,
+	       (unsigned) matras_extent_count(&lt.mtable));
+	printf("swiss: %.0f inserts/s, %.0f hits/s, %.0f misses/s, "
+	       "%u extents\n", count / swiss_insert_time,
+	       n_lookups / swiss_hit_time, n_lookups / swiss_miss_time,
+	       (unsigned) matras_extent_count(&st.mtable));
+
+	light_destroy(&lt);
+	swiss_destroy(&st);
+	free(order);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		uint32_t count = argc > 2 ? atoi(argv[2]) : 1000000;
+		swiss_bench(count);
+		return 0;
+	}
+
+	srand(time(0));
+	simple_test();
+	collision_test();
+	iterator_test();
+	iterator_freeze_check();
+	reserve_test();
+	overload_test();
+	if (extents_count != 0)
+		fail("memory leak!", "true");
+}
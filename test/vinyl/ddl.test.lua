@@ -9,6 +9,11 @@ space = box.schema.space.create('test', { engine = 'vinyl' })
 index = space:create_index('primary', {type = 'hash'})
 space:drop()
 
+-- swiss option is memtx only
+space = box.schema.space.create('test', { engine = 'vinyl' })
+index = space:create_index('primary', {swiss = true})
+space:drop()
+
 -- ensure alter is not supported
 space = box.schema.space.create('test', { engine = 'vinyl' })
 index = space:create_index('primary')
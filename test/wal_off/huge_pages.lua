@@ -0,0 +1,11 @@
+#!/usr/bin/env tarantool
+
+box.cfg{
+    listen              = os.getenv("LISTEN"),
+    slab_alloc_arena    = 0.1,
+    slab_alloc_huge_page_size = 2 * 1024 * 1024,
+    pid_file            = "tarantool.pid",
+    wal_mode            = "none"
+}
+
+require('console').listen(os.getenv('ADMIN'))
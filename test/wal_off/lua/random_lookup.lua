@@ -0,0 +1,32 @@
+local log = require('log')
+
+-- Fill a space with n_records tuples and look up random keys
+-- n_lookups times in its HASH and TREE indexes. The time taken
+-- is logged along with the way the arena is mapped, the number
+-- of tuples found is returned.
+local function random_lookup(n_records, n_lookups, mode)
+    local s = box.schema.space.create('random_lookup')
+    s:create_index('pk', { type = 'hash' })
+    s:create_index('sk', { type = 'tree', parts = {2, 'unsigned'} })
+    for i = 1, n_records do
+        s:insert{i, i * 7919 % n_records}
+    end
+    local found = 0
+    local start = os.clock()
+    for i = 1, n_lookups do
+        local key = math.random(n_records)
+        if s.index.pk:get{key} ~= nil then
+            found = found + 1
+        end
+        if s.index.sk:get{key - 1} ~= nil then
+            found = found + 1
+        end
+    end
+    local elapsed = os.clock() - start
+    s:drop()
+    log.info("random lookup (%s): %d lookups in %.3f s", mode,
+             2 * n_lookups, elapsed)
+    return found
+end
+
+return random_lookup
@@ -0,0 +1,28 @@
+env = require('test_run')
+test_run = env.new()
+
+--
+-- Random lookups with the memtx arena on regular pages (this
+-- server) and on 2MB huge pages. The times are logged by each
+-- server along with the way its arena is mapped: if the system
+-- has no huge pages reserved, the arena falls back to
+-- transparent huge pages.
+--
+random_lookup = dofile('random_lookup.lua')
+box.cfg.slab_alloc_huge_page_size
+random_lookup(100000, 1000000, 'regular pages')
+
+test_run:cmd('create server huge_pages with script="wal_off/huge_pages.lua"')
+test_run:cmd("start server huge_pages")
+test_run:cmd("switch huge_pages")
+test_run = require('test_run').new()
+random_lookup = dofile('random_lookup.lua')
+box.cfg.slab_alloc_huge_page_size
+mode = test_run:grep_log('huge_pages', 'tuple arena is backed by %d+ byte huge pages') or test_run:grep_log('huge_pages', 'falling back to transparent huge pages')
+mode ~= nil
+random_lookup(100000, 1000000, mode)
+box.info.status
+
+test_run:cmd("switch default")
+test_run:cmd("stop server huge_pages")
+test_run:cmd("cleanup server huge_pages")
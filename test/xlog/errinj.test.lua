@@ -41,3 +41,37 @@ errinj.set('ERRINJ_WAL_WRITE', false)
 test:drop()
 errinj = nil
 box.schema.user.revoke('guest', 'read,write,execute', 'universe')
+
+--
+-- Incremental snapshots: if the keys of deleted tuples take too
+-- much memory, they are dropped and the next snapshot is full.
+--
+fio = require('fio')
+errinj = box.error.injection
+test_run_snap_is_delta = function() local snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap')) local fh = fio.open(snaps[#snaps], {'O_RDONLY'}) local header = fh:read(1024) fh:close() return header:match('\nBase: ') ~= nil end
+box.cfg{snap_delta_count = 2}
+s = box.schema.space.create('delta')
+_ = s:create_index('pk')
+for i = 1, 10 do s:insert{i} end
+box.snapshot()
+test_run_snap_is_delta()
+s:delete{1}
+box.snapshot()
+test_run_snap_is_delta()
+errinj.set('ERRINJ_SNAP_DELTA_KEYS', true)
+s:delete{2}
+errinj.set('ERRINJ_SNAP_DELTA_KEYS', false)
+s:delete{3}
+box.snapshot()
+test_run_snap_is_delta()
+s:delete{4}
+box.snapshot()
+test_run_snap_is_delta()
+test_run:cmd('restart server default')
+s = box.space.delta
+s:count()
+s:get{2}
+s:get{3}
+s:get{5}
+s:drop()
+box.cfg{snap_delta_count = 0}
@@ -0,0 +1,58 @@
+env = require('test_run').new()
+fio = require('fio')
+fiber = require('fiber')
+
+--
+-- Old snapshots and xlogs are removed by the garbage collector
+-- after each snapshot while the snapshot daemon is enabled.
+-- box.info.gc() tells why each file is kept.
+--
+test_run_snaps = function() return #fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap')) end
+test_run_reasons = function() local r = {} for _, f in ipairs(box.info.gc().files) do r[f.reason] = (r[f.reason] or 0) + 1 end return r end
+test_run_wait_gc = function() while test_run_reasons().none ~= nil do fiber.sleep(0.01) end end
+
+-- disabled by default: nothing is removed
+box.info.gc().checkpoint_count
+s = box.schema.space.create('gc')
+_ = s:create_index('pk')
+for i = 1, 25 do s:insert{i} end
+box.snapshot()
+for i = 26, 50 do s:insert{i} end
+box.snapshot()
+test_run_snaps() >= 2
+r = test_run_reasons()
+r.none
+
+-- keep the last snapshot and the xlogs written after it
+box.cfg{snapshot_period = 3600, snapshot_count = 1}
+box.info.gc().checkpoint_count
+for i = 51, 75 do s:insert{i} end
+box.snapshot()
+test_run_wait_gc()
+test_run_snaps()
+r = test_run_reasons()
+r.checkpoint
+r.recovery ~= nil
+r.disabled
+files = box.info.gc().files
+-- the oldest xlog has the last rows of the snapshot
+fio.basename(files[2].path, '.xlog') <= fio.basename(files[1].path, '.snap')
+
+-- the base of a kept incremental snapshot is kept
+box.cfg{snap_delta_count = 2}
+for i = 76, 100 do s:insert{i} end
+box.snapshot()
+for i = 101, 125 do s:insert{i} end
+box.snapshot()
+test_run_wait_gc()
+test_run_snaps()
+r = test_run_reasons()
+r.checkpoint
+r.base
+
+-- no consumers without replicas
+#box.info.gc().consumers
+
+box.cfg{snapshot_period = 0, snapshot_count = 6, snap_delta_count = 0}
+box.info.gc().checkpoint_count
+s:drop()
@@ -0,0 +1,52 @@
+env = require('test_run').new()
+fio = require('fio')
+
+box.cfg{snap_delta_count = -1}
+box.cfg{snap_delta_count = 101}
+box.cfg.snap_delta_count
+
+--
+-- With snap_delta_count > 0 a snapshot contains only the
+-- tuples changed since the previous one and the keys of the
+-- deleted tuples. On restart the chain of snapshots is loaded
+-- starting from the last full one.
+--
+test_run_snap_header = function(snap) local fh = fio.open(snap, {'O_RDONLY'}) local header = fh:read(1024) fh:close() return header end
+test_run_snap_base = function(snap) return tonumber(test_run_snap_header(snap):match('\nBase: (%d+)\n')) end
+test_run_snap_lsn = function(snap) return tonumber(fio.basename(snap, '.snap')) end
+
+box.cfg{snap_delta_count = 2}
+s = box.schema.space.create('delta')
+_ = s:create_index('pk')
+_ = s:create_index('sk', {parts = {2, 'unsigned'}, unique = false})
+for i = 1, 100 do s:insert{i, i % 10} end
+-- the first snapshot is full
+box.snapshot()
+snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap'))
+test_run_snap_base(snaps[#snaps])
+
+for i = 1, 50 do s:delete{i} end
+for i = 51, 60 do s:replace{i, 100} end
+s:insert{1, 200}
+box.snapshot()
+snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap'))
+test_run_snap_base(snaps[#snaps]) == test_run_snap_lsn(snaps[#snaps - 1])
+
+for i = 61, 70 do s:delete{i} end
+box.snapshot()
+snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap'))
+test_run_snap_base(snaps[#snaps]) == test_run_snap_lsn(snaps[#snaps - 1])
+
+env:cmd('restart server default')
+
+s = box.space.delta
+box.cfg.snap_delta_count
+s:count()
+s:get{1}
+s:get{2}
+s:get{55}
+s:get{65}
+s:get{80}
+s.index.sk:count(100)
+s.index.sk:count(0)
+s:drop()
@@ -0,0 +1,71 @@
+env = require('test_run').new()
+fio = require('fio')
+xlog = require('xlog')
+
+box.cfg.snap_sections
+
+--
+-- With snap_sections = true tuples of each space are written
+-- to a snapshot in blocks, one section per space, and the
+-- last row of the file has the offsets of the sections.
+--
+box.cfg{snap_sections = true}
+a = box.schema.space.create('a')
+_ = a:create_index('pk')
+b = box.schema.space.create('b')
+_ = b:create_index('pk')
+for i = 1, 1000 do a:insert{i, string.rep('x', 200)} end
+for i = 1, 10 do b:insert{i} end
+box.snapshot()
+snaps = fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap'))
+snap = snaps[#snaps]
+
+rows = {}
+for _, row in xlog.pairs(snap) do table.insert(rows, row) end
+types = {}
+for _, row in ipairs(rows) do types[row.HEADER.type] = (types[row.HEADER.type] or 0) + 1 end
+types[80] > 0
+types[81]
+types.INSERT
+-- space 'a' does not fit in one block
+n_blocks = 0
+n_tuples = 0
+env:cmd("setopt delimiter ';'")
+for _, row in ipairs(rows) do
+    if row.BODY.space_id == a.id then
+        n_blocks = n_blocks + 1
+        n_tuples = n_tuples + #row.BODY.data
+    end
+end;
+env:cmd("setopt delimiter ''");
+n_blocks
+n_tuples
+
+-- the index is the last row
+index = rows[#rows].BODY.data
+rows[#rows].HEADER.type
+index[a.id][2]
+index[b.id][2]
+-- each section starts with an xlog tx
+fh = fio.open(snap, {'O_RDONLY'})
+fh:pread(3, index[a.id][1]) == '\xd5\xba\x0b'
+fh:pread(3, index[b.id][1]) == '\xd5\xba\x0b'
+fh:close()
+index[a.id][1] < index[b.id][1]
+
+env:cmd('restart server default')
+
+box.cfg.snap_sections
+a = box.space.a
+b = box.space.b
+a:count()
+a:get{500}[1]
+#a:get{500}[2]
+b:select{}
+-- snapshots without sections are loaded as before
+box.snapshot()
+env:cmd('restart server default')
+box.space.a:count()
+box.space.b:count()
+box.space.a:drop()
+box.space.b:drop()
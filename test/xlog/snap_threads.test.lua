@@ -0,0 +1,31 @@
+env = require('test_run').new()
+fio = require('fio')
+
+box.cfg{snap_threads = 0}
+box.cfg{snap_threads = 65}
+box.cfg.snap_threads
+
+--
+-- A snapshot written by several threads is split into parts,
+-- all of them are loaded on restart.
+--
+box.cfg{snap_threads = 4}
+s1 = box.schema.space.create('s1')
+_ = s1:create_index('pk')
+s2 = box.schema.space.create('s2')
+_ = s2:create_index('pk', {type = 'hash'})
+for i = 1, 100 do s1:insert{i} end
+for i = 1, 200 do s2:insert{i, i * 2} end
+box.snapshot()
+#fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.snap.[0-9]*'))
+#fio.glob(fio.pathjoin(box.cfg.snap_dir, '*.inprogress'))
+
+env:cmd('restart server default')
+
+fio = require('fio')
+box.cfg.snap_threads
+box.space.s1:count()
+box.space.s2:count()
+box.space.s2:get{7}
+box.space.s1:drop()
+box.space.s2:drop()